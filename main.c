@@ -1,8 +1,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "modbus.h"
+#include "modbus_crc.h"
+#include "modbus_rtu.h"
+
+// Обработка кадров, выделенных сборщиком RTU из потока байт
+static void on_rtu_request(void* user, const uint8_t* adu, uint16_t length, uint64_t timestamp_us) {
+    (void)timestamp_us;
+    uint8_t response[MODBUS_MAX_ADU_SIZE];
+    uint16_t resp_length;
+    if (modbus_process_response_from_master((ModbusDevice*)user, (uint8_t*)adu, length,
+                                            response, &resp_length) == MODBUS_OK) {
+        printf("RTU Stream Response: ");
+        print_hex(response, resp_length);
+    }
+}
 
 int main() {
+    // Сверка всех реализаций CRC16 с побитовой
+    printf("CRC16 self-test (%s): %s\n\n", modbus_crc16_impl_name(modbus_crc16_active_impl()),
+           modbus_crc16_selftest() == MODBUS_OK ? "OK" : "FAILED");
+
     // Инициализация устройства
     ModbusDevice* device = modbus_init_device(100, 100, 100, 100);
 
@@ -183,22 +201,34 @@ int main() {
     printf("\n");
 
 
-    uint16_t value_count;
-    uint16_t* values = modbus_process_response_from_slave(response_buffer, resp_length, &value_count);
+    // Разбор ответа в буфер на стеке с проверкой CRC и соответствия запросу
+    uint16_t values[MODBUS_MAX_ADU_SIZE];
+    ModbusResponse response = {
+        .values = values,
+        .values_capacity = MODBUS_MAX_ADU_SIZE
+    };
+    modbus_dump_response(response_buffer, resp_length);
+    int status = modbus_decode_response(&fc03_check, response_buffer, resp_length, &response);
 
-    if (values != NULL) {
+    if (status == MODBUS_OK && response.value_count > 0) {
         printf("Returned values: ");
-        for (uint16_t i = 0; i < value_count; i++) {
+        for (uint16_t i = 0; i < response.value_count; i++) {
             printf("%d ", values[i]);
         }
         printf("\n");
-        free(values); // Не забудьте освободить память!
     } else {
-        printf("No values returned (write operation or error)\n");
+        printf("No values returned (write operation or error %d)\n", status);
     }
 
-
-
+    // Поток байт с шумом: сборщик пропускает мусор и находит кадр по CRC
+    ModbusRtuFramer framer;
+    modbus_rtu_framer_init(&framer, 19200, MODBUS_RTU_REQUESTS, on_rtu_request, device);
+    modbus_create_request(&fc03_check, request_buffer, &req_length);
+    uint8_t noise[] = {0x00, 0x03, 0xFF};
+    modbus_rtu_framer_feed(&framer, noise, sizeof(noise), 0);
+    modbus_rtu_framer_feed(&framer, request_buffer, 3, 1000);
+    modbus_rtu_framer_feed(&framer, request_buffer + 3, req_length - 3, 2000);
+    printf("RTU Stream: frames %u, dropped bytes %u\n\n", framer.frames, framer.dropped_bytes);
 
     // Освобождение памяти
     modbus_free_device(device);
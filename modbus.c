@@ -2,22 +2,133 @@
 #include <stdlib.h>
 #include <string.h>
 #include "modbus.h"
+#include "modbus_crc.h"
+#include "modbus_shm.h"
+#include "modbus_stats.h"
+#include "modbus_sync.h"
+#include "modbus_watch.h"
+#include "modbus_capture.h"
+
+// Число 64-битных слов под n бит
+#define MODBUS_BITS_WORDS(n) (((uint32_t)(n) + 63) / 64)
+
+static inline uint64_t bits_load_le(const uint8_t* src, unsigned nbytes) {
+    uint64_t w = 0;
+    for (unsigned i = 0; i < nbytes; i++) {
+        w |= (uint64_t)src[i] << (8 * i);
+    }
+    return w;
+}
 
-// Вычисление CRC16
-static uint16_t modbus_crc16(uint8_t* buffer, uint16_t length) {
-    uint16_t crc = 0xFFFF;
-    for (uint16_t pos = 0; pos < length; pos++) {
-        crc ^= (uint16_t)buffer[pos];
-        for (int i = 8; i != 0; i--) {
-            if ((crc & 0x0001) != 0) {
-                crc >>= 1;
-                crc ^= 0xA001;
-            } else {
-                crc >>= 1;
-            }
+static inline void bits_store_le(uint8_t* dst, uint64_t w, unsigned nbytes) {
+    for (unsigned i = 0; i < nbytes; i++) {
+        dst[i] = (uint8_t)(w >> (8 * i));
+    }
+}
+
+// Чтение по 64 бита за шаг: окно собирается из двух соседних слов сдвигами
+void modbus_bits_read(const uint64_t* bits, uint16_t address, uint16_t count, uint8_t* dst) {
+    uint32_t word = address / 64;
+    unsigned shift = address % 64;
+    uint32_t remaining = count;
+
+    while (remaining > 0) {
+        unsigned n = remaining < 64 ? remaining : 64;
+        uint64_t w = bits[word] >> shift;
+        if (shift != 0 && shift + n > 64) {
+            w |= bits[word + 1] << (64 - shift);
         }
+        if (n < 64) w &= (UINT64_C(1) << n) - 1;
+        unsigned nbytes = (n + 7) / 8;
+        bits_store_le(dst, w, nbytes);
+        dst += nbytes;
+        remaining -= n;
+        word++;
+    }
+}
+
+// Запись по 64 бита за шаг: значение вставляется по маске в одно или два слова
+void modbus_bits_write(uint64_t* bits, uint16_t address, uint16_t count, const uint8_t* src) {
+    uint32_t word = address / 64;
+    unsigned shift = address % 64;
+    uint32_t remaining = count;
+
+    while (remaining > 0) {
+        unsigned n = remaining < 64 ? remaining : 64;
+        unsigned nbytes = (n + 7) / 8;
+        uint64_t mask = (n == 64) ? ~UINT64_C(0) : ((UINT64_C(1) << n) - 1);
+        uint64_t v = bits_load_le(src, nbytes) & mask;
+        bits[word] = (bits[word] & ~(mask << shift)) | (v << shift);
+        if (shift != 0 && shift + n > 64) {
+            bits[word + 1] = (bits[word + 1] & ~(mask >> (64 - shift))) | (v >> (64 - shift));
+        }
+        src += nbytes;
+        remaining -= n;
+        word++;
+    }
+}
+
+static inline bool bits_get(const uint64_t* bits, uint16_t address) {
+    return (bits[address / 64] >> (address % 64)) & 1;
+}
+
+static inline void bits_set(uint64_t* bits, uint16_t address, bool value) {
+    uint64_t mask = UINT64_C(1) << (address % 64);
+    if (value) {
+        bits[address / 64] |= mask;
+    } else {
+        bits[address / 64] &= ~mask;
     }
-    return crc;
+}
+
+bool modbus_get_coil(const ModbusDevice* device, uint16_t address) {
+    if (address >= device->num_coils) return false;
+    return bits_get(device->coils, address);
+}
+
+int modbus_set_coil(ModbusDevice* device, uint16_t address, bool value) {
+    if (address >= device->num_coils) return MODBUS_ERR_ADDRESS;
+    modbus_device_write_begin(device, MODBUS_TABLE_COILS, address, 1);
+    bits_set(device->coils, address, value);
+    modbus_device_write_end(device, MODBUS_TABLE_COILS, address, 1);
+    return MODBUS_OK;
+}
+
+int modbus_read_coils(const ModbusDevice* device, uint16_t address, uint16_t count, uint8_t* dst) {
+    return modbus_device_read(device, MODBUS_TABLE_COILS, address, count, dst);
+}
+
+int modbus_write_coils(ModbusDevice* device, uint16_t address, uint16_t count, const uint8_t* src) {
+    if (address + count > device->num_coils) return MODBUS_ERR_ADDRESS;
+    modbus_device_write_begin(device, MODBUS_TABLE_COILS, address, count);
+    modbus_bits_write(device->coils, address, count, src);
+    modbus_device_write_end(device, MODBUS_TABLE_COILS, address, count);
+    return MODBUS_OK;
+}
+
+bool modbus_get_discrete_input(const ModbusDevice* device, uint16_t address) {
+    if (address >= device->num_discrete_inputs) return false;
+    return bits_get(device->discrete_inputs, address);
+}
+
+int modbus_set_discrete_input(ModbusDevice* device, uint16_t address, bool value) {
+    if (address >= device->num_discrete_inputs) return MODBUS_ERR_ADDRESS;
+    modbus_device_write_begin(device, MODBUS_TABLE_DISCRETE_INPUTS, address, 1);
+    bits_set(device->discrete_inputs, address, value);
+    modbus_device_write_end(device, MODBUS_TABLE_DISCRETE_INPUTS, address, 1);
+    return MODBUS_OK;
+}
+
+int modbus_read_discrete_inputs(const ModbusDevice* device, uint16_t address, uint16_t count, uint8_t* dst) {
+    return modbus_device_read(device, MODBUS_TABLE_DISCRETE_INPUTS, address, count, dst);
+}
+
+int modbus_write_discrete_inputs(ModbusDevice* device, uint16_t address, uint16_t count, const uint8_t* src) {
+    if (address + count > device->num_discrete_inputs) return MODBUS_ERR_ADDRESS;
+    modbus_device_write_begin(device, MODBUS_TABLE_DISCRETE_INPUTS, address, count);
+    modbus_bits_write(device->discrete_inputs, address, count, src);
+    modbus_device_write_end(device, MODBUS_TABLE_DISCRETE_INPUTS, address, count);
+    return MODBUS_OK;
 }
 
 // Инициализация устройства
@@ -32,23 +143,36 @@ ModbusDevice* modbus_init_device(uint16_t num_holding, uint16_t num_input,
 
     device->holding_registers = (uint16_t*)calloc(num_holding, sizeof(uint16_t));
     device->input_registers = (uint16_t*)calloc(num_input, sizeof(uint16_t));
-    device->coils = (bool*)calloc(num_coils, sizeof(bool));
-    device->discrete_inputs = (bool*)calloc(num_discrete, sizeof(bool));
+    device->coils = (uint64_t*)calloc(MODBUS_BITS_WORDS(num_coils), sizeof(uint64_t));
+    device->discrete_inputs = (uint64_t*)calloc(MODBUS_BITS_WORDS(num_discrete), sizeof(uint64_t));
+    device->sync = NULL;
+    device->image = NULL;
+    device->image_size = 0;
+    device->stats = NULL;
+    device->watch = NULL;
+    device->capture = NULL;
 
     return device;
 }
 
 // Освобождение памяти устройства
 void modbus_free_device(ModbusDevice* device) {
-    free(device->holding_registers);
-    free(device->input_registers);
-    free(device->coils);
-    free(device->discrete_inputs);
+    modbus_device_disable_sync(device);
+    modbus_device_disable_stats(device);
+    modbus_device_disable_watch(device);
+    if (device->image != NULL) {
+        modbus_shm_unmap(device);
+    } else {
+        free(device->holding_registers);
+        free(device->input_registers);
+        free(device->coils);
+        free(device->discrete_inputs);
+    }
     free(device);
 }
 
-// Создание Modbus запроса
-int modbus_create_request(ModbusFrame* frame, uint8_t* buffer, uint16_t* length) {
+// Создание запроса без CRC: адрес slave + PDU (общая часть RTU и TCP)
+int modbus_create_pdu(const ModbusFrame* frame, uint8_t* buffer, uint16_t* length) {
     uint16_t pos = 0;
 
     buffer[pos++] = frame->slave_id;
@@ -100,8 +224,44 @@ int modbus_create_request(ModbusFrame* frame, uint8_t* buffer, uint16_t* length)
         pos += byte_count;
         break;
     }
+
+    case FC_MASK_WRITE_REG:
+        if (frame->data_length != 4 || frame->data == NULL) return MODBUS_ERR_VALUE;
+        memcpy(&buffer[pos], frame->data, 4);
+        pos += 4;
+        break;
+
+    case FC_READ_WRITE_MULT_REG: {
+        buffer[pos++] = (frame->quantity >> 8) & 0xFF;
+        buffer[pos++] = frame->quantity & 0xFF;
+        buffer[pos++] = (frame->write_address >> 8) & 0xFF;
+        buffer[pos++] = frame->write_address & 0xFF;
+        buffer[pos++] = (frame->write_quantity >> 8) & 0xFF;
+        buffer[pos++] = frame->write_quantity & 0xFF;
+        uint8_t byte_count = frame->write_quantity * 2;
+        buffer[pos++] = byte_count;
+        if (frame->data_length != byte_count || frame->data == NULL) {
+            return MODBUS_ERR_VALUE;
+        }
+        memcpy(&buffer[pos], frame->data, byte_count);
+        pos += byte_count;
+        break;
+    }
+
+    case FC_READ_FIFO_QUEUE:
+        break;  // только адрес указателя FIFO
     }
 
+    *length = pos;
+    return MODBUS_OK;
+}
+
+// Создание Modbus запроса
+int modbus_create_request(ModbusFrame* frame, uint8_t* buffer, uint16_t* length) {
+    uint16_t pos;
+    int status = modbus_create_pdu(frame, buffer, &pos);
+    if (status != MODBUS_OK) return status;
+
     uint16_t crc = modbus_crc16(buffer, pos);
     buffer[pos++] = crc & 0xFF;
     buffer[pos++] = (crc >> 8) & 0xFF;
@@ -110,15 +270,20 @@ int modbus_create_request(ModbusFrame* frame, uint8_t* buffer, uint16_t* length)
     return MODBUS_OK;
 }
 
-// Обработка запроса от master
-int modbus_process_response_from_master(ModbusDevice* device, uint8_t* rx_buffer, uint16_t rx_length,
-                            uint8_t* tx_buffer, uint16_t* tx_length) {
-    if (rx_length < MODBUS_MIN_ADU_SIZE) return MODBUS_ERR_VALUE;
+// Коды исключений Modbus по кодам ошибок библиотеки
+uint8_t modbus_exception_code(int error) {
+    switch(error) {
+    case MODBUS_ERR_FUNCTION: return MODBUS_EXC_ILLEGAL_FUNCTION;
+    case MODBUS_ERR_ADDRESS:  return MODBUS_EXC_ILLEGAL_ADDRESS;
+    case MODBUS_ERR_VALUE:    return MODBUS_EXC_ILLEGAL_VALUE;
+    default:                  return MODBUS_EXC_DEVICE_FAILURE;
+    }
+}
 
-    // Проверка CRC
-    uint16_t received_crc = (rx_buffer[rx_length-1] << 8) | rx_buffer[rx_length-2];
-    uint16_t calculated_crc = modbus_crc16(rx_buffer, rx_length-2);
-    if (received_crc != calculated_crc) return MODBUS_ERR_CRC;
+static int device_process_request(ModbusDevice* device, const uint8_t* rx_buffer, uint16_t rx_length,
+                                  uint8_t* tx_buffer, uint16_t* tx_length) {
+    // FC24 - единственный запрос короче 6 байт (только адрес указателя FIFO)
+    if (rx_length < 4 || (rx_length < 6 && rx_buffer[1] != FC_READ_FIFO_QUEUE)) return MODBUS_ERR_VALUE;
 
     uint8_t slave_id = rx_buffer[0];
     uint8_t function = rx_buffer[1];
@@ -131,60 +296,73 @@ int modbus_process_response_from_master(ModbusDevice* device, uint8_t* rx_buffer
     switch(function) {
     case FC_READ_COILS: {
         uint16_t quantity = (rx_buffer[4] << 8) | rx_buffer[5];
+        if (quantity == 0 || quantity > MODBUS_MAX_READ_BITS) return MODBUS_ERR_VALUE;
         if (address + quantity > device->num_coils) return MODBUS_ERR_ADDRESS;
         uint8_t byte_count = (quantity + 7) / 8;
         tx_buffer[pos++] = byte_count;
-        for (uint16_t i = 0; i < quantity; i++) {
-            if (i % 8 == 0) tx_buffer[pos + (i/8)] = 0;
-            if (device->coils[address + i]) {
-                tx_buffer[pos + (i/8)] |= (1 << (i % 8));
-            }
-        }
+        uint32_t start;
+        do {
+            start = modbus_sync_read_begin(device, MODBUS_TABLE_COILS, address, quantity);
+            modbus_bits_read(device->coils, address, quantity, &tx_buffer[pos]);
+        } while (device->sync != NULL &&
+                 modbus_sync_read_retry(device, MODBUS_TABLE_COILS, address, quantity, start));
         pos += byte_count;
         break;
     }
 
     case FC_READ_DISCRETE_INPUTS: {
         uint16_t quantity = (rx_buffer[4] << 8) | rx_buffer[5];
+        if (quantity == 0 || quantity > MODBUS_MAX_READ_BITS) return MODBUS_ERR_VALUE;
         if (address + quantity > device->num_discrete_inputs) return MODBUS_ERR_ADDRESS;
         uint8_t byte_count = (quantity + 7) / 8;
         tx_buffer[pos++] = byte_count;
-        for (uint16_t i = 0; i < quantity; i++) {
-            if (i % 8 == 0) tx_buffer[pos + (i/8)] = 0;
-            if (device->discrete_inputs[address + i]) {
-                tx_buffer[pos + (i/8)] |= (1 << (i % 8));
-            }
-        }
+        uint32_t start;
+        do {
+            start = modbus_sync_read_begin(device, MODBUS_TABLE_DISCRETE_INPUTS, address, quantity);
+            modbus_bits_read(device->discrete_inputs, address, quantity, &tx_buffer[pos]);
+        } while (device->sync != NULL &&
+                 modbus_sync_read_retry(device, MODBUS_TABLE_DISCRETE_INPUTS, address, quantity, start));
         pos += byte_count;
         break;
     }
 
     case FC_READ_HOLDING_REG: {
         uint16_t quantity = (rx_buffer[4] << 8) | rx_buffer[5];
+        if (quantity == 0 || quantity > MODBUS_MAX_READ_REGS) return MODBUS_ERR_VALUE;
         if (address + quantity > device->num_holding_regs) return MODBUS_ERR_ADDRESS;
         tx_buffer[pos++] = quantity * 2;
-        for (uint16_t i = 0; i < quantity; i++) {
-            tx_buffer[pos++] = (device->holding_registers[address + i] >> 8) & 0xFF;
-            tx_buffer[pos++] = device->holding_registers[address + i] & 0xFF;
-        }
+        uint32_t start;
+        do {
+            start = modbus_sync_read_begin(device, MODBUS_TABLE_HOLDING_REGS, address, quantity);
+            modbus_regs_to_be(&device->holding_registers[address], quantity, &tx_buffer[pos]);
+        } while (device->sync != NULL &&
+                 modbus_sync_read_retry(device, MODBUS_TABLE_HOLDING_REGS, address, quantity, start));
+        pos += quantity * 2;
         break;
     }
 
     case FC_READ_INPUT_REG: {
         uint16_t quantity = (rx_buffer[4] << 8) | rx_buffer[5];
+        if (quantity == 0 || quantity > MODBUS_MAX_READ_REGS) return MODBUS_ERR_VALUE;
         if (address + quantity > device->num_input_regs) return MODBUS_ERR_ADDRESS;
         tx_buffer[pos++] = quantity * 2;
-        for (uint16_t i = 0; i < quantity; i++) {
-            tx_buffer[pos++] = (device->input_registers[address + i] >> 8) & 0xFF;
-            tx_buffer[pos++] = device->input_registers[address + i] & 0xFF;
-        }
+        uint32_t start;
+        do {
+            start = modbus_sync_read_begin(device, MODBUS_TABLE_INPUT_REGS, address, quantity);
+            modbus_regs_to_be(&device->input_registers[address], quantity, &tx_buffer[pos]);
+        } while (device->sync != NULL &&
+                 modbus_sync_read_retry(device, MODBUS_TABLE_INPUT_REGS, address, quantity, start));
+        pos += quantity * 2;
         break;
     }
 
     case FC_WRITE_SINGLE_COIL: {
         if (address >= device->num_coils) return MODBUS_ERR_ADDRESS;
         uint16_t value = (rx_buffer[4] << 8) | rx_buffer[5];
-        device->coils[address] = (value == 0xFF00); // FF00 = ON, 0000 = OFF
+        modbus_device_write_begin(device, MODBUS_TABLE_COILS, address, 1);
+        bits_set(device->coils, address, value == 0xFF00); // FF00 = ON, 0000 = OFF
+        modbus_device_write_end(device, MODBUS_TABLE_COILS, address, 1);
+        if (device->watch != NULL) modbus_watch_notify(device, MODBUS_TABLE_COILS, address, 1);
         memcpy(&tx_buffer[pos], &rx_buffer[2], 4);  // Эхо запроса
         pos += 4;
         break;
@@ -193,44 +371,175 @@ int modbus_process_response_from_master(ModbusDevice* device, uint8_t* rx_buffer
     case FC_WRITE_SINGLE_REG: {
         if (address >= device->num_holding_regs) return MODBUS_ERR_ADDRESS;
         uint16_t value = (rx_buffer[4] << 8) | rx_buffer[5];
+        modbus_device_write_begin(device, MODBUS_TABLE_HOLDING_REGS, address, 1);
         device->holding_registers[address] = value;
+        modbus_device_write_end(device, MODBUS_TABLE_HOLDING_REGS, address, 1);
+        if (device->watch != NULL) modbus_watch_notify(device, MODBUS_TABLE_HOLDING_REGS, address, 1);
         memcpy(&tx_buffer[pos], &rx_buffer[2], 4);  // Эхо запроса
         pos += 4;
         break;
     }
 
     case FC_WRITE_MULT_COILS: {
+        if (rx_length < 7 || rx_length < 7 + rx_buffer[6]) return MODBUS_ERR_VALUE;
         uint16_t quantity = (rx_buffer[4] << 8) | rx_buffer[5];
         uint8_t byte_count = rx_buffer[6];
+        if (quantity == 0 || quantity > MODBUS_MAX_WRITE_BITS) return MODBUS_ERR_VALUE;
         if (address + quantity > device->num_coils) return MODBUS_ERR_ADDRESS;
         if (byte_count != ((quantity + 7) / 8)) return MODBUS_ERR_VALUE;
-        for (uint16_t i = 0; i < quantity; i++) {
-            uint8_t byte = rx_buffer[7 + (i / 8)];
-            device->coils[address + i] = (byte & (1 << (i % 8))) != 0;
-        }
+        modbus_device_write_begin(device, MODBUS_TABLE_COILS, address, quantity);
+        modbus_bits_write(device->coils, address, quantity, &rx_buffer[7]);
+        modbus_device_write_end(device, MODBUS_TABLE_COILS, address, quantity);
+        if (device->watch != NULL) modbus_watch_notify(device, MODBUS_TABLE_COILS, address, quantity);
         memcpy(&tx_buffer[pos], &rx_buffer[2], 4);  // Адрес и количество
         pos += 4;
         break;
     }
 
     case FC_WRITE_MULT_REG: {
+        if (rx_length < 7 || rx_length < 7 + rx_buffer[6]) return MODBUS_ERR_VALUE;
         uint16_t quantity = (rx_buffer[4] << 8) | rx_buffer[5];
         uint8_t byte_count = rx_buffer[6];
+        if (quantity == 0 || quantity > MODBUS_MAX_WRITE_REGS) return MODBUS_ERR_VALUE;
         if (address + quantity > device->num_holding_regs) return MODBUS_ERR_ADDRESS;
         if (byte_count != (quantity * 2)) return MODBUS_ERR_VALUE;
-        for (uint16_t i = 0; i < quantity; i++) {
-            device->holding_registers[address + i] =
-                (rx_buffer[7 + i*2] << 8) | rx_buffer[8 + i*2];
-        }
+        modbus_device_write_begin(device, MODBUS_TABLE_HOLDING_REGS, address, quantity);
+        modbus_regs_from_be(&rx_buffer[7], quantity, &device->holding_registers[address]);
+        modbus_device_write_end(device, MODBUS_TABLE_HOLDING_REGS, address, quantity);
+        if (device->watch != NULL) modbus_watch_notify(device, MODBUS_TABLE_HOLDING_REGS, address, quantity);
         memcpy(&tx_buffer[pos], &rx_buffer[2], 4);  // Адрес и количество
         pos += 4;
         break;
     }
 
+    case FC_MASK_WRITE_REG: {
+        if (rx_length < 8) return MODBUS_ERR_VALUE;
+        if (address >= device->num_holding_regs) return MODBUS_ERR_ADDRESS;
+        uint16_t and_mask = (rx_buffer[4] << 8) | rx_buffer[5];
+        uint16_t or_mask = (rx_buffer[6] << 8) | rx_buffer[7];
+        modbus_device_write_begin(device, MODBUS_TABLE_HOLDING_REGS, address, 1);
+        uint16_t current = device->holding_registers[address];
+        device->holding_registers[address] = (current & and_mask) | (or_mask & ~and_mask);
+        modbus_device_write_end(device, MODBUS_TABLE_HOLDING_REGS, address, 1);
+        if (device->watch != NULL) modbus_watch_notify(device, MODBUS_TABLE_HOLDING_REGS, address, 1);
+        memcpy(&tx_buffer[pos], &rx_buffer[2], 6);  // Эхо запроса
+        pos += 6;
+        break;
+    }
+
+    case FC_READ_WRITE_MULT_REG: {
+        if (rx_length < 11 || rx_length < 11 + rx_buffer[10]) return MODBUS_ERR_VALUE;
+        uint16_t read_quantity = (rx_buffer[4] << 8) | rx_buffer[5];
+        uint16_t write_address = (rx_buffer[6] << 8) | rx_buffer[7];
+        uint16_t write_quantity = (rx_buffer[8] << 8) | rx_buffer[9];
+        uint8_t byte_count = rx_buffer[10];
+        if (read_quantity == 0 || read_quantity > MODBUS_MAX_READ_REGS) return MODBUS_ERR_VALUE;
+        if (write_quantity == 0 || write_quantity > MODBUS_MAX_RW_WRITE_REGS) return MODBUS_ERR_VALUE;
+        if (byte_count != write_quantity * 2) return MODBUS_ERR_VALUE;
+        if (address + read_quantity > device->num_holding_regs ||
+            write_address + write_quantity > device->num_holding_regs) {
+            return MODBUS_ERR_ADDRESS;
+        }
+        // Запись выполняется до чтения; обе под одной блокировкой общего диапазона,
+        // поэтому чтение видит ровно результат этой записи
+        uint16_t first = address < write_address ? address : write_address;
+        uint32_t read_end = (uint32_t)address + read_quantity;
+        uint32_t write_end = (uint32_t)write_address + write_quantity;
+        uint16_t span = (uint16_t)((read_end > write_end ? read_end : write_end) - first);
+        modbus_device_write_begin(device, MODBUS_TABLE_HOLDING_REGS, first, span);
+        modbus_regs_from_be(&rx_buffer[11], write_quantity, &device->holding_registers[write_address]);
+        tx_buffer[pos++] = read_quantity * 2;
+        modbus_regs_to_be(&device->holding_registers[address], read_quantity, &tx_buffer[pos]);
+        modbus_device_write_end(device, MODBUS_TABLE_HOLDING_REGS, first, span);
+        if (device->watch != NULL) modbus_watch_notify(device, MODBUS_TABLE_HOLDING_REGS, write_address, write_quantity);
+        pos += read_quantity * 2;
+        break;
+    }
+
+    case FC_READ_FIFO_QUEUE: {
+        // Очередь в holding-регистрах: по адресу указателя - число значений, следом значения
+        if (address >= device->num_holding_regs) return MODBUS_ERR_ADDRESS;
+        uint16_t available = device->num_holding_regs - address;
+        uint16_t span = available < 1 + MODBUS_MAX_FIFO_COUNT ? available : 1 + MODBUS_MAX_FIFO_COUNT;
+        int status;
+        uint16_t fifo_count;
+        uint32_t start;
+        do {
+            start = modbus_sync_read_begin(device, MODBUS_TABLE_HOLDING_REGS, address, span);
+            fifo_count = device->holding_registers[address];
+            if (fifo_count > MODBUS_MAX_FIFO_COUNT) {
+                status = MODBUS_ERR_VALUE;
+            } else if (1 + fifo_count > span) {
+                status = MODBUS_ERR_ADDRESS;
+            } else {
+                status = MODBUS_OK;
+                modbus_regs_to_be(&device->holding_registers[address + 1], fifo_count, &tx_buffer[pos + 4]);
+            }
+        } while (device->sync != NULL &&
+                 modbus_sync_read_retry(device, MODBUS_TABLE_HOLDING_REGS, address, span, start));
+        if (status != MODBUS_OK) return status;
+        uint16_t byte_count = 2 + fifo_count * 2;
+        tx_buffer[pos++] = (byte_count >> 8) & 0xFF;
+        tx_buffer[pos++] = byte_count & 0xFF;
+        tx_buffer[pos++] = (fifo_count >> 8) & 0xFF;
+        tx_buffer[pos++] = fifo_count & 0xFF;
+        pos += fifo_count * 2;
+        break;
+    }
+
     default:
         return MODBUS_ERR_FUNCTION;
     }
 
+    *tx_length = pos;
+    return MODBUS_OK;
+}
+
+// Обработка запроса без CRC: rx_buffer = адрес slave + PDU (общая часть RTU и TCP)
+int modbus_process_request(ModbusDevice* device, const uint8_t* rx_buffer, uint16_t rx_length,
+                           uint8_t* tx_buffer, uint16_t* tx_length) {
+    if (device->stats == NULL && device->capture == NULL) {
+        return device_process_request(device, rx_buffer, rx_length, tx_buffer, tx_length);
+    }
+
+    if (device->capture != NULL) {
+        modbus_capture_record(device->capture, MODBUS_CAPTURE_REQUEST | MODBUS_CAPTURE_PDU, rx_buffer, rx_length);
+    }
+    uint64_t start = device->stats != NULL ? modbus_stats_begin(device) : 0;
+    int status = device_process_request(device, rx_buffer, rx_length, tx_buffer, tx_length);
+    if (device->stats != NULL) {
+        modbus_stats_record(device, rx_length > 1 ? rx_buffer[1] : 0, status, rx_length,
+                            status == MODBUS_OK ? *tx_length : 0, start);
+    }
+    if (device->capture != NULL) {
+        if (status == MODBUS_OK) {
+            modbus_capture_record(device->capture, MODBUS_CAPTURE_RESPONSE | MODBUS_CAPTURE_PDU, tx_buffer, *tx_length);
+        } else if (rx_length > 1) {
+            // Исключение, которое отправит транспорт
+            uint8_t exception[3] = { rx_buffer[0], rx_buffer[1] | 0x80, modbus_exception_code(status) };
+            modbus_capture_record(device->capture, MODBUS_CAPTURE_RESPONSE | MODBUS_CAPTURE_PDU, exception, 3);
+        }
+    }
+    return status;
+}
+
+// Обработка запроса от master
+int modbus_process_response_from_master(ModbusDevice* device, uint8_t* rx_buffer, uint16_t rx_length,
+                            uint8_t* tx_buffer, uint16_t* tx_length) {
+    if (rx_length < MODBUS_MIN_ADU_SIZE) return MODBUS_ERR_VALUE;
+
+    // Проверка CRC
+    uint16_t received_crc = (rx_buffer[rx_length-1] << 8) | rx_buffer[rx_length-2];
+    uint16_t calculated_crc = modbus_crc16(rx_buffer, rx_length-2);
+    if (received_crc != calculated_crc) {
+        if (device->stats != NULL) modbus_stats_record_crc_error(device, rx_buffer[1], rx_length);
+        return MODBUS_ERR_CRC;
+    }
+
+    uint16_t pos;
+    int status = modbus_process_request(device, rx_buffer, rx_length - MODBUS_CRC_SIZE, tx_buffer, &pos);
+    if (status != MODBUS_OK) return status;
+
     uint16_t crc = modbus_crc16(tx_buffer, pos);
     tx_buffer[pos++] = crc & 0xFF;
     tx_buffer[pos++] = (crc >> 8) & 0xFF;
@@ -246,12 +555,158 @@ void print_hex(uint8_t* buffer, uint16_t length) {
     printf("\n");
 }
 
-// Обработка ответа от slave устройства
-uint16_t *modbus_process_response_from_slave(uint8_t *buffer, uint16_t length, uint16_t *value_count) {
+// Разбор ответа без CRC (адрес slave + PDU) без выделения памяти и без вывода
+int modbus_decode_pdu(const ModbusFrame* request, const uint8_t* buffer, uint16_t length,
+                      ModbusResponse* response) {
+    response->slave_id = 0;
+    response->function_code = 0;
+    response->exception_code = 0;
+    response->address = 0;
+    response->quantity = 0;
+    response->data = NULL;
+    response->byte_count = 0;
+    response->value_count = 0;
+
+    if (length < 3) return MODBUS_ERR_VALUE;
+
+    response->slave_id = buffer[0];
+    response->function_code = buffer[1] & 0x7F;
+    if (request != NULL && (response->slave_id != request->slave_id ||
+                            response->function_code != request->function_code)) {
+        return MODBUS_ERR_MISMATCH;
+    }
+
+    if (buffer[1] & 0x80) {
+        if (length != 3) return MODBUS_ERR_VALUE;
+        response->exception_code = buffer[2];
+        return MODBUS_ERR_EXCEPTION;
+    }
+
+    switch(response->function_code) {
+    case FC_READ_COILS:
+    case FC_READ_DISCRETE_INPUTS: {
+        uint8_t byte_count = buffer[2];
+        if (length != 3 + byte_count) return MODBUS_ERR_VALUE;
+        uint16_t bit_count = byte_count * 8;
+        if (request != NULL) {
+            if (byte_count != (request->quantity + 7) / 8) return MODBUS_ERR_MISMATCH;
+            bit_count = request->quantity;
+            response->address = request->address;
+        }
+        response->quantity = bit_count;
+        response->data = &buffer[3];
+        response->byte_count = byte_count;
+        if (response->values != NULL) {
+            if (bit_count > response->values_capacity) return MODBUS_ERR_VALUE;
+            for (uint16_t i = 0; i < bit_count; i++) {
+                response->values[i] = (buffer[3 + i / 8] >> (i % 8)) & 1;
+            }
+            response->value_count = bit_count;
+        }
+        break;
+    }
+
+    case FC_READ_HOLDING_REG:
+    case FC_READ_INPUT_REG:
+    case FC_READ_WRITE_MULT_REG: {
+        uint8_t byte_count = buffer[2];
+        if (length != 3 + byte_count || (byte_count & 1)) return MODBUS_ERR_VALUE;
+        uint16_t reg_count = byte_count / 2;
+        if (request != NULL) {
+            if (reg_count != request->quantity) return MODBUS_ERR_MISMATCH;
+            response->address = request->address;
+        }
+        response->quantity = reg_count;
+        response->data = &buffer[3];
+        response->byte_count = byte_count;
+        if (response->values != NULL) {
+            if (reg_count > response->values_capacity) return MODBUS_ERR_VALUE;
+            modbus_regs_from_be(&buffer[3], reg_count, response->values);
+            response->value_count = reg_count;
+        }
+        break;
+    }
+
+    case FC_WRITE_SINGLE_COIL:
+    case FC_WRITE_SINGLE_REG:
+    case FC_WRITE_MULT_COILS:
+    case FC_WRITE_MULT_REG: {
+        if (length != 6) return MODBUS_ERR_VALUE;
+        response->address = (buffer[2] << 8) | buffer[3];
+        response->quantity = (buffer[4] << 8) | buffer[5];
+        if (request != NULL) {
+            uint16_t expected = request->quantity;
+            if (request->function_code == FC_WRITE_SINGLE_COIL) {
+                expected = request->quantity ? 0xFF00 : 0x0000;
+            }
+            if (response->address != request->address || response->quantity != expected) {
+                return MODBUS_ERR_MISMATCH;
+            }
+        }
+        break;
+    }
+
+    case FC_MASK_WRITE_REG: {
+        if (length != 8) return MODBUS_ERR_VALUE;
+        response->address = (buffer[2] << 8) | buffer[3];
+        response->quantity = 1;
+        response->data = &buffer[4];    // AND- и OR-маски
+        response->byte_count = 4;
+        if (request != NULL && response->address != request->address) return MODBUS_ERR_MISMATCH;
+        // Маски сверяются, если запрос их сохранил (master хранит запросы без data)
+        if (request != NULL && request->data != NULL &&
+            (request->data_length != 4 || memcmp(request->data, &buffer[4], 4) != 0)) {
+            return MODBUS_ERR_MISMATCH;
+        }
+        break;
+    }
+
+    case FC_READ_FIFO_QUEUE: {
+        if (length < 6) return MODBUS_ERR_VALUE;
+        uint16_t byte_count = (buffer[2] << 8) | buffer[3];
+        uint16_t fifo_count = (buffer[4] << 8) | buffer[5];
+        if (length != 4 + byte_count || byte_count != 2 + fifo_count * 2) return MODBUS_ERR_VALUE;
+        if (fifo_count > MODBUS_MAX_FIFO_COUNT) return MODBUS_ERR_VALUE;
+        if (request != NULL) response->address = request->address;
+        response->quantity = fifo_count;
+        response->data = &buffer[6];
+        response->byte_count = fifo_count * 2;
+        if (response->values != NULL) {
+            if (fifo_count > response->values_capacity) return MODBUS_ERR_VALUE;
+            modbus_regs_from_be(&buffer[6], fifo_count, response->values);
+            response->value_count = fifo_count;
+        }
+        break;
+    }
+
+    default:
+        return MODBUS_ERR_FUNCTION;
+    }
+
+    return MODBUS_OK;
+}
+
+// Разбор ответа от slave с проверкой CRC
+int modbus_decode_response(const ModbusFrame* request, const uint8_t* buffer, uint16_t length,
+                           ModbusResponse* response) {
+    if (length < MODBUS_MIN_ADU_SIZE) {
+        response->value_count = 0;
+        return MODBUS_ERR_VALUE;
+    }
+
+    uint16_t received_crc = (buffer[length-1] << 8) | buffer[length-2];
+    if (received_crc != modbus_crc16(buffer, length - 2)) {
+        response->value_count = 0;
+        return MODBUS_ERR_CRC;
+    }
+    return modbus_decode_pdu(request, buffer, length - MODBUS_CRC_SIZE, response);
+}
+
+// Отладочный вывод ответа от slave
+void modbus_dump_response(const uint8_t* buffer, uint16_t length) {
     if (length < MODBUS_MIN_ADU_SIZE) {
         printf("Error: Response too short\n");
-        *value_count = 0;
-        return NULL;
+        return;
     }
 
     uint8_t slave_id = buffer[0];
@@ -265,13 +720,9 @@ uint16_t *modbus_process_response_from_slave(uint8_t *buffer, uint16_t length, u
     if (function >= 0x80) {
         printf("  Error Code: 0x%02X\n", buffer[2]);
         printf("  CRC: 0x%04X\n", crc);
-        *value_count = 0;
-        return NULL;
+        return;
     }
 
-    uint16_t* result = NULL;
-    *value_count = 0;
-
     switch(function) {
     case FC_READ_COILS:
     case FC_READ_DISCRETE_INPUTS: {
@@ -279,39 +730,22 @@ uint16_t *modbus_process_response_from_slave(uint8_t *buffer, uint16_t length, u
         uint16_t bit_count = byte_count * 8; // Максимальное число бит
         printf("  Byte Count: %d\n", byte_count);
         printf("  Values: ");
-
-        // Выделяем память под значения (по одному биту на значение)
-        result = (uint16_t*)malloc(bit_count * sizeof(uint16_t));
-        *value_count = 0;
-
-        for (uint8_t i = 0; i < byte_count; i++) {
-            uint8_t byte = buffer[3 + i];
-            for (int bit = 0; bit < 8 && (i * 8 + bit) < bit_count; bit++) {
-                uint16_t value = (byte >> bit) & 1;
-                result[*value_count] = value;
-                printf("%d", value);
-                if (i * 8 + bit + 1 < bit_count) printf(" ");
-                (*value_count)++;
-            }
+        for (uint16_t i = 0; i < bit_count; i++) {
+            printf("%d", (buffer[3 + i / 8] >> (i % 8)) & 1);
+            if (i + 1 < bit_count) printf(" ");
         }
         printf("\n");
         break;
     }
     case FC_READ_HOLDING_REG:
-    case FC_READ_INPUT_REG: {
+    case FC_READ_INPUT_REG:
+    case FC_READ_WRITE_MULT_REG: {
         uint8_t byte_count = buffer[2];
         uint16_t reg_count = byte_count / 2;
         printf("  Byte Count: %d\n", byte_count);
         printf("  Register Values: ");
-
-        // Выделяем память под значения регистров
-        result = (uint16_t*)malloc(reg_count * sizeof(uint16_t));
-        *value_count = reg_count;
-
         for (uint16_t i = 0; i < reg_count; i++) {
-            uint16_t value = (buffer[3 + i*2] << 8) | buffer[4 + i*2];
-            result[i] = value;
-            printf("%d", value);
+            printf("%d", (buffer[3 + i*2] << 8) | buffer[4 + i*2]);
             if (i + 1 < reg_count) printf(", ");
         }
         printf("\n");
@@ -328,9 +762,6 @@ uint16_t *modbus_process_response_from_slave(uint8_t *buffer, uint16_t length, u
         } else {
             printf("%d\n", value);
         }
-        // Ничего не возвращаем
-        *value_count = 0;
-        result = NULL;
         break;
     }
     case FC_WRITE_MULT_COILS:
@@ -339,18 +770,66 @@ uint16_t *modbus_process_response_from_slave(uint8_t *buffer, uint16_t length, u
         uint16_t quantity = (buffer[4] << 8) | buffer[5];
         printf("  Address: %d\n", address);
         printf("  Quantity: %d\n", quantity);
-        // Ничего не возвращаем
-        *value_count = 0;
-        result = NULL;
+        break;
+    }
+    case FC_MASK_WRITE_REG: {
+        uint16_t address = (buffer[2] << 8) | buffer[3];
+        printf("  Address: %d\n", address);
+        printf("  AND Mask: 0x%04X\n", (buffer[4] << 8) | buffer[5]);
+        printf("  OR Mask: 0x%04X\n", (buffer[6] << 8) | buffer[7]);
+        break;
+    }
+    case FC_READ_FIFO_QUEUE: {
+        uint16_t fifo_count = (buffer[4] << 8) | buffer[5];
+        printf("  FIFO Count: %d\n", fifo_count);
+        printf("  FIFO Values: ");
+        for (uint16_t i = 0; i < fifo_count; i++) {
+            printf("%d", (buffer[6 + i*2] << 8) | buffer[7 + i*2]);
+            if (i + 1 < fifo_count) printf(", ");
+        }
+        printf("\n");
         break;
     }
     default:
         printf("  Unknown function code\n");
-        *value_count = 0;
-        result = NULL;
         break;
     }
     printf("  CRC: 0x%04X\n", crc);
+}
+
+// Обработка ответа от slave устройства (устаревший интерфейс: печать и выделение памяти)
+uint16_t *modbus_process_response_from_slave(uint8_t *buffer, uint16_t length, uint16_t *value_count) {
+    *value_count = 0;
+    modbus_dump_response(buffer, length);
+    if (length < MODBUS_MIN_ADU_SIZE) return NULL;
 
-    return result;
+    uint16_t capacity = 0;
+    switch(buffer[1]) {
+    case FC_READ_COILS:
+    case FC_READ_DISCRETE_INPUTS:
+        capacity = buffer[2] * 8;
+        break;
+    case FC_READ_HOLDING_REG:
+    case FC_READ_INPUT_REG:
+    case FC_READ_WRITE_MULT_REG:
+        capacity = buffer[2] / 2;
+        break;
+    case FC_READ_FIFO_QUEUE:
+        capacity = MODBUS_MAX_FIFO_COUNT;
+        break;
+    default:
+        return NULL;
+    }
+
+    ModbusResponse response = {
+        .values = (uint16_t*)malloc(capacity * sizeof(uint16_t)),
+        .values_capacity = capacity
+    };
+    if (response.values == NULL) return NULL;
+    if (modbus_decode_response(NULL, buffer, length, &response) != MODBUS_OK) {
+        free(response.values);
+        return NULL;
+    }
+    *value_count = response.value_count;
+    return response.values;
 }
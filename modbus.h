@@ -3,12 +3,21 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // Определение констант Modbus
 #define MODBUS_MAX_ADU_SIZE     256
 #define MODBUS_MIN_ADU_SIZE     4
 #define MODBUS_CRC_SIZE         2
 
+// Ограничения протокола на число элементов в одном запросе
+#define MODBUS_MAX_READ_BITS    2000
+#define MODBUS_MAX_READ_REGS    125
+#define MODBUS_MAX_WRITE_BITS   1968
+#define MODBUS_MAX_WRITE_REGS   123
+#define MODBUS_MAX_RW_WRITE_REGS 121    // запись в FC23
+#define MODBUS_MAX_FIFO_COUNT   31
+
 // Коды функций Modbus
 #define FC_READ_COILS           0x01
 #define FC_READ_DISCRETE_INPUTS 0x02
@@ -18,6 +27,9 @@
 #define FC_WRITE_SINGLE_REG     0x06
 #define FC_WRITE_MULT_COILS     0x0F
 #define FC_WRITE_MULT_REG       0x10
+#define FC_MASK_WRITE_REG       0x16
+#define FC_READ_WRITE_MULT_REG  0x17
+#define FC_READ_FIFO_QUEUE      0x18
 
 // Коды ошибок
 #define MODBUS_OK               0
@@ -25,8 +37,25 @@
 #define MODBUS_ERR_FUNCTION     2
 #define MODBUS_ERR_ADDRESS      3
 #define MODBUS_ERR_VALUE        4
+#define MODBUS_ERR_EXCEPTION    5   // slave вернул код исключения
+#define MODBUS_ERR_MISMATCH     6   // ответ не соответствует запросу
+#define MODBUS_ERR_IO           7   // ошибка ввода-вывода (порт, сокет)
+#define MODBUS_ERR_TIMEOUT      8   // ответ не получен вовремя
+#define MODBUS_ERR_BUSY         9   // нет свободного места в окне запросов
+#define MODBUS_ERR_UNIT         10  // запрос адресован неизвестному устройству
+
+// Коды исключений в ответе slave
+#define MODBUS_EXC_ILLEGAL_FUNCTION 0x01
+#define MODBUS_EXC_ILLEGAL_ADDRESS  0x02
+#define MODBUS_EXC_ILLEGAL_VALUE    0x03
+#define MODBUS_EXC_DEVICE_FAILURE   0x04
+#define MODBUS_EXC_DEVICE_BUSY      0x06
+#define MODBUS_EXC_GATEWAY_PATH     0x0A    // шлюз: нет пути к устройству
+#define MODBUS_EXC_GATEWAY_TARGET   0x0B    // шлюз: устройство не ответило
 
 // Структура Modbus фрейма
+// Запрос master. FC22: data - AND- и OR-маски (4 байта, big-endian);
+// FC24: address - адрес указателя FIFO
 typedef struct {
     uint8_t slave_id;
     uint8_t function_code;
@@ -34,18 +63,54 @@ typedef struct {
     uint16_t quantity;
     uint8_t* data;
     uint16_t data_length;
+    uint16_t write_address;     // FC23: адрес и число записываемых регистров
+    uint16_t write_quantity;    // (address/quantity - читаемые, data - записываемые, big-endian)
 } ModbusFrame;
 
+// Разобранный ответ slave; values и values_capacity задаёт вызывающая сторона
+typedef struct {
+    uint8_t slave_id;
+    uint8_t function_code;      // без бита исключения 0x80
+    uint8_t exception_code;     // 0, если ответ не исключение
+    uint16_t address;           // эхо адреса (FC05/06/0F/10) или адрес из запроса
+    uint16_t quantity;          // число значений; для FC05/06 - записанное значение
+    const uint8_t* data;        // сырые данные чтения внутри буфера ответа
+    uint8_t byte_count;
+    uint16_t* values;           // буфер для значений (по одному на бит или регистр), может быть NULL
+    uint16_t values_capacity;
+    uint16_t value_count;
+} ModbusResponse;
+
+// Таблицы данных Modbus
+typedef enum {
+    MODBUS_TABLE_COILS = 0,         // FC01
+    MODBUS_TABLE_DISCRETE_INPUTS,   // FC02
+    MODBUS_TABLE_HOLDING_REGS,      // FC03
+    MODBUS_TABLE_INPUT_REGS,        // FC04
+    MODBUS_TABLE_COUNT
+} ModbusTable;
+
+typedef struct ModbusDeviceSync ModbusDeviceSync;
+typedef struct ModbusDeviceStats ModbusDeviceStats;
+typedef struct ModbusDeviceWatch ModbusDeviceWatch;
+typedef struct ModbusCapture ModbusCapture;
+
 // Структура для хранения регистров устройства
 typedef struct {
     uint16_t* holding_registers; //read/write
     uint16_t* input_registers; //read
-    bool* coils; //read/write
-    bool* discrete_inputs; //read
+    uint64_t* coils; //read/write, упакованы по 64 бита в слове (бит i -> слово i/64, бит i%64)
+    uint64_t* discrete_inputs; //read, упакованы так же
     uint16_t num_holding_regs;
     uint16_t num_input_regs;
     uint16_t num_coils;
     uint16_t num_discrete_inputs;
+    ModbusDeviceSync* sync; // NULL - без синхронизации потоков (см. modbus_sync.h)
+    void* image;            // отображённый образ (см. modbus_shm.h), NULL - таблицы в куче
+    size_t image_size;      // длина отображения, известная только этому процессу
+    ModbusDeviceStats* stats; // NULL - статистика не ведётся (см. modbus_stats.h)
+    ModbusDeviceWatch* watch; // NULL - записи master не отслеживаются (см. modbus_watch.h)
+    ModbusCapture* capture;   // NULL - обмен не записывается (см. modbus_capture.h)
 } ModbusDevice;
 
 // Прототипы функций
@@ -53,9 +118,55 @@ ModbusDevice* modbus_init_device(uint16_t num_holding, uint16_t num_input,
                                  uint16_t num_coils, uint16_t num_discrete);
 void modbus_free_device(ModbusDevice* device);
 int modbus_create_request(ModbusFrame* frame, uint8_t* buffer, uint16_t* length);
+// Запрос без CRC (адрес slave + PDU), общий для RTU и TCP
+int modbus_create_pdu(const ModbusFrame* frame, uint8_t* buffer, uint16_t* length);
 int modbus_process_response_from_master(ModbusDevice* device, uint8_t* rx_buffer, uint16_t rx_length,
                             uint8_t* tx_buffer, uint16_t* tx_length);
+// Обработка запроса без CRC (адрес slave + PDU), общая для RTU и TCP
+int modbus_process_request(ModbusDevice* device, const uint8_t* rx_buffer, uint16_t rx_length,
+                           uint8_t* tx_buffer, uint16_t* tx_length);
+uint8_t modbus_exception_code(int error);
 uint16_t* modbus_process_response_from_slave(uint8_t* buffer, uint16_t length, uint16_t* value_count);
+// Проверка CRC и соответствия запросу (request может быть NULL), без malloc и stdio
+int modbus_decode_response(const ModbusFrame* request, const uint8_t* buffer, uint16_t length,
+                           ModbusResponse* response);
+int modbus_decode_pdu(const ModbusFrame* request, const uint8_t* buffer, uint16_t length,
+                      ModbusResponse* response);
+void modbus_dump_response(const uint8_t* buffer, uint16_t length);
+
+// Упакованные битовые таблицы: чтение/запись count бит с позиции address
+// в формате Modbus (младший бит первого байта - первый бит)
+void modbus_bits_read(const uint64_t* bits, uint16_t address, uint16_t count, uint8_t* dst);
+void modbus_bits_write(uint64_t* bits, uint16_t address, uint16_t count, const uint8_t* src);
+
+// Реализации пересылки блоков регистров
+typedef enum {
+    MODBUS_REGS_IMPL_AUTO = 0,
+    MODBUS_REGS_IMPL_SCALAR,
+    MODBUS_REGS_IMPL_SSSE3,
+    MODBUS_REGS_IMPL_AVX2,
+    MODBUS_REGS_IMPL_COUNT
+} ModbusRegsImpl;
+
+// Пересылка блока регистров в/из big-endian представления кадра за один проход (буферы не перекрываются).
+// Реализация выбирается при загрузке; modbus_regs_select - до запуска потоков
+void modbus_regs_to_be(const uint16_t* regs, uint16_t count, uint8_t* dst);
+void modbus_regs_from_be(const uint8_t* src, uint16_t count, uint16_t* regs);
+int modbus_regs_select(ModbusRegsImpl impl);
+ModbusRegsImpl modbus_regs_active_impl(void);
+int modbus_regs_impl_supported(ModbusRegsImpl impl);
+const char* modbus_regs_impl_name(ModbusRegsImpl impl);
+
+// Доступ к coils и discrete inputs устройства
+bool modbus_get_coil(const ModbusDevice* device, uint16_t address);
+int modbus_set_coil(ModbusDevice* device, uint16_t address, bool value);
+int modbus_read_coils(const ModbusDevice* device, uint16_t address, uint16_t count, uint8_t* dst);
+int modbus_write_coils(ModbusDevice* device, uint16_t address, uint16_t count, const uint8_t* src);
+bool modbus_get_discrete_input(const ModbusDevice* device, uint16_t address);
+int modbus_set_discrete_input(ModbusDevice* device, uint16_t address, bool value);
+int modbus_read_discrete_inputs(const ModbusDevice* device, uint16_t address, uint16_t count, uint8_t* dst);
+int modbus_write_discrete_inputs(ModbusDevice* device, uint16_t address, uint16_t count, const uint8_t* src);
+
 void print_hex(uint8_t* buffer, uint16_t length);
 
 #endif // MODBUS_H
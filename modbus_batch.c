@@ -0,0 +1,184 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "modbus_batch.h"
+
+#define MODBUS_POOL_MAX_THREADS 64
+
+struct ModbusWorkerPool {
+    unsigned threads;
+    pthread_t workers[MODBUS_POOL_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t generation;
+    unsigned pending;           // потоков, ещё обрабатывающих текущий участок
+    bool stop;
+
+    // Текущий участок: номера кадров, разложенные по потокам (устойчиво)
+    ModbusUnitRegistry* registry;
+    ModbusBatchFrame* frames;
+    uint32_t* items;
+    uint32_t items_capacity;
+    uint32_t shard_start[MODBUS_POOL_MAX_THREADS + 1];
+};
+
+typedef struct {
+    ModbusWorkerPool* pool;
+    unsigned index;
+} PoolWorker;
+
+int modbus_process_batch(ModbusDevice* device, ModbusBatchFrame* frames, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        ModbusBatchFrame* frame = &frames[i];
+        frame->tx_length = 0;
+        frame->status = modbus_process_response_from_master(device, (uint8_t*)frame->rx, frame->rx_length,
+                                                            frame->tx, &frame->tx_length);
+    }
+    return MODBUS_OK;
+}
+
+int modbus_registry_process_batch(ModbusUnitRegistry* registry, ModbusBatchFrame* frames, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        ModbusBatchFrame* frame = &frames[i];
+        frame->status = modbus_registry_process_rtu(registry, frame->rx, frame->rx_length,
+                                                    frame->tx, &frame->tx_length);
+    }
+    return MODBUS_OK;
+}
+
+static void pool_process_shard(ModbusWorkerPool* pool, unsigned shard) {
+    for (uint32_t i = pool->shard_start[shard]; i < pool->shard_start[shard + 1]; i++) {
+        ModbusBatchFrame* frame = &pool->frames[pool->items[i]];
+        frame->status = modbus_registry_process_rtu(pool->registry, frame->rx, frame->rx_length,
+                                                    frame->tx, &frame->tx_length);
+    }
+}
+
+static void* pool_worker_thread(void* arg) {
+    PoolWorker* worker = (PoolWorker*)arg;
+    ModbusWorkerPool* pool = worker->pool;
+    unsigned index = worker->index;
+    free(worker);
+
+    uint64_t seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->generation == seen) pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->stop) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_process_shard(pool, index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ModbusWorkerPool* modbus_worker_pool_create(unsigned threads) {
+    if (threads == 0 || threads > MODBUS_POOL_MAX_THREADS) return NULL;
+    ModbusWorkerPool* pool = (ModbusWorkerPool*)calloc(1, sizeof(ModbusWorkerPool));
+    if (pool == NULL) return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // Поток 0 - вызывающий, остальные создаются здесь
+    pool->threads = 1;
+    for (unsigned i = 1; i < threads; i++) {
+        PoolWorker* worker = (PoolWorker*)malloc(sizeof(PoolWorker));
+        if (worker == NULL) break;
+        worker->pool = pool;
+        worker->index = i;
+        if (pthread_create(&pool->workers[i], NULL, pool_worker_thread, worker) != 0) {
+            free(worker);
+            break;
+        }
+        pool->threads++;
+    }
+    if (pool->threads != threads) {
+        modbus_worker_pool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void modbus_worker_pool_free(ModbusWorkerPool* pool) {
+    if (pool == NULL) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned i = 1; i < pool->threads; i++) pthread_join(pool->workers[i], NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->items);
+    free(pool);
+}
+
+unsigned modbus_worker_pool_threads(const ModbusWorkerPool* pool) {
+    return pool->threads;
+}
+
+// Параллельная обработка кадров [begin, end) без широковещательных
+static void pool_run_segment(ModbusWorkerPool* pool, uint32_t begin, uint32_t end) {
+    unsigned threads = pool->threads;
+    uint32_t counts[MODBUS_POOL_MAX_THREADS] = {0};
+    for (uint32_t i = begin; i < end; i++) {
+        const ModbusBatchFrame* frame = &pool->frames[i];
+        unsigned shard = frame->rx_length > 0 ? frame->rx[0] % threads : 0;
+        counts[shard]++;
+    }
+    pool->shard_start[0] = 0;
+    for (unsigned s = 0; s < threads; s++) pool->shard_start[s + 1] = pool->shard_start[s] + counts[s];
+    for (unsigned s = 0; s < threads; s++) counts[s] = pool->shard_start[s];
+    for (uint32_t i = begin; i < end; i++) {
+        const ModbusBatchFrame* frame = &pool->frames[i];
+        unsigned shard = frame->rx_length > 0 ? frame->rx[0] % threads : 0;
+        pool->items[counts[shard]++] = i;
+    }
+
+    if (threads > 1) {
+        pthread_mutex_lock(&pool->lock);
+        pool->pending = threads - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    pool_process_shard(pool, 0);
+
+    if (threads > 1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending > 0) pthread_cond_wait(&pool->done, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+int modbus_worker_pool_process(ModbusWorkerPool* pool, ModbusUnitRegistry* registry,
+                               ModbusBatchFrame* frames, uint32_t count) {
+    if (count > pool->items_capacity) {
+        uint32_t* items = (uint32_t*)realloc(pool->items, count * sizeof(uint32_t));
+        if (items == NULL) return MODBUS_ERR_VALUE;
+        pool->items = items;
+        pool->items_capacity = count;
+    }
+    pool->registry = registry;
+    pool->frames = frames;
+
+    // Широковещательная запись затрагивает все устройства: участки до и после неё
+    // не пересекаются во времени
+    uint32_t begin = 0;
+    for (uint32_t i = 0; i <= count; i++) {
+        bool broadcast = i < count && frames[i].rx_length > 0 && frames[i].rx[0] == MODBUS_BROADCAST_UNIT;
+        if (i < count && !broadcast) continue;
+        if (i > begin) pool_run_segment(pool, begin, i);
+        if (broadcast) modbus_registry_process_batch(registry, &frames[i], 1);
+        begin = i + 1;
+    }
+    return MODBUS_OK;
+}
@@ -0,0 +1,32 @@
+#ifndef MODBUS_BATCH_H
+#define MODBUS_BATCH_H
+
+#include <stdint.h>
+#include "modbus.h"
+#include "modbus_units.h"
+
+// Кадр пакета: запрос RTU (с CRC) и место под ответ; tx_length = 0 - ответа нет
+typedef struct {
+    const uint8_t* rx;
+    uint16_t rx_length;
+    uint8_t* tx;                // не меньше MODBUS_MAX_ADU_SIZE
+    uint16_t tx_length;
+    int status;
+} ModbusBatchFrame;
+
+// Обработка пакета кадров одним вызовом; статус каждого кадра - в frames[i].status
+int modbus_process_batch(ModbusDevice* device, ModbusBatchFrame* frames, uint32_t count);
+int modbus_registry_process_batch(ModbusUnitRegistry* registry, ModbusBatchFrame* frames, uint32_t count);
+
+// Пул потоков: кадры распределяются по потокам по адресу slave (unit % threads),
+// порядок кадров одного адреса сохраняется. Широковещательные кадры выполняются
+// отдельно между параллельными участками. threads учитывает вызывающий поток.
+typedef struct ModbusWorkerPool ModbusWorkerPool;
+
+ModbusWorkerPool* modbus_worker_pool_create(unsigned threads);
+void modbus_worker_pool_free(ModbusWorkerPool* pool);
+unsigned modbus_worker_pool_threads(const ModbusWorkerPool* pool);
+int modbus_worker_pool_process(ModbusWorkerPool* pool, ModbusUnitRegistry* registry,
+                               ModbusBatchFrame* frames, uint32_t count);
+
+#endif // MODBUS_BATCH_H
@@ -0,0 +1,2355 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <libgen.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "modbus.h"
+#include "modbus_batch.h"
+#include "modbus_bridge.h"
+#include "modbus_cache.h"
+#include "modbus_capture.h"
+#include "modbus_crc.h"
+#include "modbus_history.h"
+#include "modbus_plan.h"
+#include "modbus_poller.h"
+#include "modbus_rtu.h"
+#include "modbus_shm.h"
+#include "modbus_stats.h"
+#include "modbus_tcp.h"
+#include "modbus_sync.h"
+#include "modbus_template.h"
+#include "modbus_units.h"
+#include "modbus_values.h"
+#include "modbus_watch.h"
+
+#define BENCH_ITERATIONS 1000000
+
+static volatile uint32_t bench_sink;
+static int bench_failures;      // проверки корректности: ненулевой код выхода, если что-то не сошлось
+
+static void bench_check_result(const char* name, int failures) {
+    printf("check %-10s %s\n", name, failures == 0 ? "ok" : "FAILED");
+    if (failures != 0) bench_failures++;
+}
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Прежний побайтовый цикл сериализации FC03/FC04 - точка отсчёта
+__attribute__((noinline))
+static void bench_regs_to_be_bytewise(const uint16_t* regs, uint16_t count, uint8_t* dst) {
+    uint16_t pos = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        dst[pos++] = (regs[i] >> 8) & 0xFF;
+        dst[pos++] = regs[i] & 0xFF;
+    }
+}
+
+// Пересылка 125 регистров (максимум для FC03/FC04) каждой реализацией
+static void bench_regs_block(void) {
+    uint16_t regs[125];
+    uint8_t frame[250];
+    for (uint16_t i = 0; i < 125; i++) regs[i] = (uint16_t)(i * 257);
+
+    // Полный блок FC03 и короткий, как у одиночных значений
+    static const uint16_t counts[] = { 125, 4 };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        uint16_t count = counts[c];
+        uint64_t start = bench_now_ns();
+        for (int i = 0; i < BENCH_ITERATIONS; i++) {
+            bench_regs_to_be_bytewise(regs, count, frame);
+            bench_sink += frame[i % (count * 2)];
+        }
+        printf("regs %3u %-7s to_be %7.1f ns/op\n", count, "bytewise",
+               (double)(bench_now_ns() - start) / BENCH_ITERATIONS);
+
+        for (int impl = MODBUS_REGS_IMPL_SCALAR; impl < MODBUS_REGS_IMPL_COUNT; impl++) {
+            if (modbus_regs_select((ModbusRegsImpl)impl) != MODBUS_OK) continue;
+
+            uint64_t start = bench_now_ns();
+            for (int i = 0; i < BENCH_ITERATIONS; i++) {
+                modbus_regs_to_be(regs, count, frame);
+                bench_sink += frame[i % (count * 2)];
+            }
+            double to_be_ns = (double)(bench_now_ns() - start) / BENCH_ITERATIONS;
+
+            start = bench_now_ns();
+            for (int i = 0; i < BENCH_ITERATIONS; i++) {
+                modbus_regs_from_be(frame, count, regs);
+                bench_sink += regs[i % count];
+            }
+            double from_be_ns = (double)(bench_now_ns() - start) / BENCH_ITERATIONS;
+
+            printf("regs %3u %-7s to_be %7.1f ns/op  from_be %7.1f ns/op\n", count,
+                   modbus_regs_impl_name((ModbusRegsImpl)impl), to_be_ns, from_be_ns);
+        }
+    }
+    modbus_regs_select(MODBUS_REGS_IMPL_AUTO);
+}
+
+// Полный цикл обработки FC03 на 125 регистров
+static void bench_fc03_full_read(void) {
+    ModbusDevice* device = modbus_init_device(125, 0, 0, 0);
+    uint8_t request[MODBUS_MAX_ADU_SIZE];
+    uint8_t response[MODBUS_MAX_ADU_SIZE];
+    uint16_t req_length, resp_length;
+    ModbusFrame frame = {
+        .slave_id = 1,
+        .function_code = FC_READ_HOLDING_REG,
+        .address = 0,
+        .quantity = 125,
+        .data = NULL,
+        .data_length = 0
+    };
+    modbus_create_request(&frame, request, &req_length);
+
+    for (int impl = MODBUS_REGS_IMPL_SCALAR; impl < MODBUS_REGS_IMPL_COUNT; impl++) {
+        if (modbus_regs_select((ModbusRegsImpl)impl) != MODBUS_OK) continue;
+
+        uint64_t start = bench_now_ns();
+        for (int i = 0; i < BENCH_ITERATIONS; i++) {
+            modbus_process_response_from_master(device, request, req_length, response, &resp_length);
+            bench_sink += resp_length;
+        }
+        double ns = (double)(bench_now_ns() - start) / BENCH_ITERATIONS;
+        printf("fc03 125 %-7s %7.1f ns/op  %10.0f frames/s\n",
+               modbus_regs_impl_name((ModbusRegsImpl)impl), ns, 1e9 / ns);
+    }
+    modbus_regs_select(MODBUS_REGS_IMPL_AUTO);
+    modbus_free_device(device);
+}
+
+// 1000 устройств в одном потоке: адрес slave 8-битный, поэтому устройства разнесены
+// по нескольким линиям (таблицам) по BENCH_UNITS_PER_LINE
+#define BENCH_UNITS_PER_LINE    200
+#define BENCH_REQUEST_MIX       4096
+
+static void bench_unit_gateway(int unit_total) {
+    int lines = (unit_total + BENCH_UNITS_PER_LINE - 1) / BENCH_UNITS_PER_LINE;
+    ModbusUnitRegistry* registries = (ModbusUnitRegistry*)malloc(lines * sizeof(ModbusUnitRegistry));
+    ModbusDevice** devices = (ModbusDevice**)malloc(unit_total * sizeof(ModbusDevice*));
+    for (int l = 0; l < lines; l++) modbus_registry_init(&registries[l]);
+    for (int u = 0; u < unit_total; u++) {
+        devices[u] = modbus_init_device(64, 64, 64, 64);
+        modbus_registry_add(&registries[u / BENCH_UNITS_PER_LINE], (uint8_t)(u % BENCH_UNITS_PER_LINE + 1),
+                            devices[u]);
+    }
+
+    // Смесь запросов к случайным устройствам: чтение FC03 и запись FC06
+    static uint8_t requests[BENCH_REQUEST_MIX][16];
+    static uint16_t lengths[BENCH_REQUEST_MIX];
+    static int request_line[BENCH_REQUEST_MIX];
+    uint32_t seed = 12345;
+    for (int i = 0; i < BENCH_REQUEST_MIX; i++) {
+        seed = seed * 1103515245u + 12345u;
+        int u = (int)((seed >> 8) % (uint32_t)unit_total);
+        ModbusFrame frame = {
+            .slave_id = (uint8_t)(u % BENCH_UNITS_PER_LINE + 1),
+            .function_code = (i & 3) ? FC_READ_HOLDING_REG : FC_WRITE_SINGLE_REG,
+            .address = (uint16_t)(i % 54),
+            .quantity = (i & 3) ? 10 : (uint16_t)i,     // для FC06 - записываемое значение
+            .data = NULL,
+            .data_length = 0
+        };
+        modbus_create_request(&frame, requests[i], &lengths[i]);
+        request_line[i] = u / BENCH_UNITS_PER_LINE;
+    }
+
+    uint8_t response[MODBUS_MAX_ADU_SIZE];
+    uint16_t resp_length;
+    int errors = 0;
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        int r = i & (BENCH_REQUEST_MIX - 1);
+        if (modbus_registry_process_rtu(&registries[request_line[r]], requests[r], lengths[r],
+                                        response, &resp_length) != MODBUS_OK) {
+            errors++;
+        }
+        bench_sink += resp_length;
+    }
+    double ns = (double)(bench_now_ns() - start) / BENCH_ITERATIONS;
+    printf("gateway %d units / %d lines  %7.1f ns/op  %10.0f frames/s  errors %d\n",
+           unit_total, lines, ns, 1e9 / ns, errors);
+
+    for (int u = 0; u < unit_total; u++) modbus_free_device(devices[u]);
+    free(devices);
+    free(registries);
+}
+
+// Пакетная обработка: 240 устройств, пакет кадров FC03 по случайным адресам, 1..N потоков
+#define BENCH_BATCH_UNITS       240
+#define BENCH_BATCH_FRAMES      4096
+#define BENCH_BATCH_ROUNDS      200
+
+static void bench_batch_scaling(unsigned max_threads) {
+    ModbusUnitRegistry registry;
+    modbus_registry_init(&registry);
+    ModbusDevice* devices[BENCH_BATCH_UNITS];
+    for (int u = 0; u < BENCH_BATCH_UNITS; u++) {
+        devices[u] = modbus_init_device(125, 0, 0, 0);
+        modbus_registry_add(&registry, (uint8_t)(u + 1), devices[u]);
+    }
+
+    static uint8_t requests[BENCH_BATCH_FRAMES][8];
+    static uint8_t responses[BENCH_BATCH_FRAMES][MODBUS_MAX_ADU_SIZE];
+    static ModbusBatchFrame frames[BENCH_BATCH_FRAMES];
+    uint32_t seed = 777;
+    for (int i = 0; i < BENCH_BATCH_FRAMES; i++) {
+        seed = seed * 1103515245u + 12345u;
+        ModbusFrame frame = {
+            .slave_id = (uint8_t)((seed >> 8) % BENCH_BATCH_UNITS + 1),
+            .function_code = FC_READ_HOLDING_REG,
+            .address = 0,
+            .quantity = 64,
+            .data = NULL,
+            .data_length = 0
+        };
+        uint16_t length;
+        modbus_create_request(&frame, requests[i], &length);
+        frames[i] = (ModbusBatchFrame){ .rx = requests[i], .rx_length = length, .tx = responses[i] };
+    }
+
+    uint64_t start = bench_now_ns();
+    for (int r = 0; r < BENCH_BATCH_ROUNDS; r++) {
+        modbus_registry_process_batch(&registry, frames, BENCH_BATCH_FRAMES);
+    }
+    double ns = (double)(bench_now_ns() - start) / ((double)BENCH_BATCH_ROUNDS * BENCH_BATCH_FRAMES);
+    printf("batch fc03 64 inline     %7.1f ns/frame  %10.0f frames/s\n", ns, 1e9 / ns);
+
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        ModbusWorkerPool* pool = modbus_worker_pool_create(threads);
+        if (pool == NULL) break;
+        int errors = 0;
+        start = bench_now_ns();
+        for (int r = 0; r < BENCH_BATCH_ROUNDS; r++) {
+            modbus_worker_pool_process(pool, &registry, frames, BENCH_BATCH_FRAMES);
+        }
+        ns = (double)(bench_now_ns() - start) / ((double)BENCH_BATCH_ROUNDS * BENCH_BATCH_FRAMES);
+        for (int i = 0; i < BENCH_BATCH_FRAMES; i++) {
+            if (frames[i].status != MODBUS_OK || frames[i].tx_length != 5 + 64 * 2) errors++;
+        }
+        printf("batch fc03 64 %2u threads %7.1f ns/frame  %10.0f frames/s  errors %d\n",
+               threads, ns, 1e9 / ns, errors);
+        modbus_worker_pool_free(pool);
+    }
+
+    for (int u = 0; u < BENCH_BATCH_UNITS; u++) modbus_free_device(devices[u]);
+}
+
+// Стресс-тест seqlock: читатели FC03 и modbus_device_read против писателей приложения
+// и FC10. Пара регистров (2k, 2k+1) всегда пишется как (v, ~v) - разорванное значение видно сразу.
+#define BENCH_SYNC_REGS         200
+#define BENCH_SYNC_READERS      4
+
+typedef struct {
+    ModbusDevice* device;
+    atomic_bool stop;
+    atomic_ulong reads;
+    atomic_ulong torn;
+    atomic_ulong writes;
+} BenchSync;
+
+static void* bench_sync_app_writer(void* arg) {
+    BenchSync* bench = (BenchSync*)arg;
+    uint16_t v = 0;
+    while (!atomic_load(&bench->stop)) {
+        v++;
+        modbus_device_write_begin(bench->device, MODBUS_TABLE_HOLDING_REGS, 0, BENCH_SYNC_REGS);
+        for (int i = 0; i < BENCH_SYNC_REGS; i += 2) {
+            bench->device->holding_registers[i] = v;
+            bench->device->holding_registers[i + 1] = (uint16_t)~v;
+        }
+        modbus_device_write_end(bench->device, MODBUS_TABLE_HOLDING_REGS, 0, BENCH_SYNC_REGS);
+        atomic_fetch_add(&bench->writes, 1);
+    }
+    return NULL;
+}
+
+static void* bench_sync_protocol_writer(void* arg) {
+    BenchSync* bench = (BenchSync*)arg;
+    uint16_t regs[MODBUS_MAX_WRITE_REGS - 1];
+    uint8_t data[sizeof(regs)];
+    uint8_t request[MODBUS_MAX_ADU_SIZE];
+    uint8_t response[MODBUS_MAX_ADU_SIZE];
+    uint16_t req_length, resp_length;
+    uint16_t v = 0x8000;
+    while (!atomic_load(&bench->stop)) {
+        v++;
+        for (unsigned i = 0; i < MODBUS_MAX_WRITE_REGS - 1; i += 2) {
+            regs[i] = v;
+            regs[i + 1] = (uint16_t)~v;
+        }
+        modbus_regs_to_be(regs, MODBUS_MAX_WRITE_REGS - 1, data);
+        ModbusFrame frame = {
+            .slave_id = 1,
+            .function_code = FC_WRITE_MULT_REG,
+            .address = 60,
+            .quantity = MODBUS_MAX_WRITE_REGS - 1,
+            .data = data,
+            .data_length = sizeof(data)
+        };
+        modbus_create_request(&frame, request, &req_length);
+        modbus_process_response_from_master(bench->device, request, req_length, response, &resp_length);
+        atomic_fetch_add(&bench->writes, 1);
+    }
+    return NULL;
+}
+
+static void* bench_sync_reader(void* arg) {
+    BenchSync* bench = (BenchSync*)arg;
+    uint8_t request[MODBUS_MAX_ADU_SIZE];
+    uint8_t response[MODBUS_MAX_ADU_SIZE];
+    uint16_t regs[MODBUS_MAX_READ_REGS + 1];
+    uint16_t req_length, resp_length;
+    ModbusFrame frame = {
+        .slave_id = 1,
+        .function_code = FC_READ_HOLDING_REG,
+        .address = 38,              // диапазон захватывает три блока seqlock
+        .quantity = MODBUS_MAX_READ_REGS - 1,
+        .data = NULL,
+        .data_length = 0
+    };
+    modbus_create_request(&frame, request, &req_length);
+    unsigned long reads = 0, torn = 0;
+    while (!atomic_load(&bench->stop)) {
+        if ((reads & 1) == 0) {
+            modbus_process_response_from_master(bench->device, request, req_length, response, &resp_length);
+            modbus_regs_from_be(&response[3], frame.quantity, regs);
+        } else {
+            modbus_device_read(bench->device, MODBUS_TABLE_HOLDING_REGS, frame.address, frame.quantity, regs);
+        }
+        for (unsigned i = 0; i < frame.quantity; i += 2) {
+            uint16_t expect = (uint16_t)~regs[i];
+            if (regs[i + 1] != expect) {
+                torn++;
+                break;
+            }
+        }
+        reads++;
+    }
+    atomic_fetch_add(&bench->reads, reads);
+    atomic_fetch_add(&bench->torn, torn);
+    return NULL;
+}
+
+static void bench_sync_stress(int seconds) {
+    BenchSync bench;
+    bench.device = modbus_init_device(BENCH_SYNC_REGS, 0, 0, 0);
+    for (int i = 0; i < BENCH_SYNC_REGS; i += 2) bench.device->holding_registers[i + 1] = 0xFFFF;
+    modbus_device_enable_sync(bench.device);
+    atomic_init(&bench.stop, false);
+    atomic_init(&bench.reads, 0);
+    atomic_init(&bench.torn, 0);
+    atomic_init(&bench.writes, 0);
+
+    pthread_t writers[2], readers[BENCH_SYNC_READERS];
+    pthread_create(&writers[0], NULL, bench_sync_app_writer, &bench);
+    pthread_create(&writers[1], NULL, bench_sync_protocol_writer, &bench);
+    for (int i = 0; i < BENCH_SYNC_READERS; i++) pthread_create(&readers[i], NULL, bench_sync_reader, &bench);
+    sleep((unsigned)seconds);
+    atomic_store(&bench.stop, true);
+    for (int i = 0; i < 2; i++) pthread_join(writers[i], NULL);
+    for (int i = 0; i < BENCH_SYNC_READERS; i++) pthread_join(readers[i], NULL);
+
+    printf("seqlock stress %d readers / 2 writers: reads %lu writes %lu torn %lu\n", BENCH_SYNC_READERS,
+           atomic_load(&bench.reads), atomic_load(&bench.writes), atomic_load(&bench.torn));
+    // Разорванное чтение - нарушение seqlock; без чтений проверка ничего не доказала
+    bench_check_result("sync", atomic_load(&bench.torn) != 0 || atomic_load(&bench.reads) == 0);
+    modbus_free_device(bench.device);
+}
+
+static void* bench_tcp_server_thread(void* arg) {
+    modbus_tcp_server_run((ModbusTcpServer*)arg);
+    return NULL;
+}
+
+static int bench_tcp_connect(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Пропускная способность TCP сервера на loopback: connections соединений,
+// в каждом по pipeline запросов FC03 за раз; проверяется эхо transaction id
+static void bench_tcp_throughput(int connections, int pipeline, int rounds) {
+    enum { REGS = 10, RESPONSE_SIZE = MODBUS_TCP_MBAP_SIZE + 2 + REGS * 2 };
+    ModbusDevice* device = modbus_init_device(1000, 0, 0, 0);
+    ModbusTcpServer* server = modbus_tcp_server_create(device, "127.0.0.1", 0);
+    if (server == NULL) {
+        printf("tcp: server create failed\n");
+        modbus_free_device(device);
+        return;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, bench_tcp_server_thread, server);
+
+    int* fds = (int*)malloc(connections * sizeof(int));
+    uint8_t* batch = (uint8_t*)malloc(pipeline * 12);
+    uint8_t* responses = (uint8_t*)malloc(pipeline * RESPONSE_SIZE);
+    int opened = 0;
+    for (; opened < connections; opened++) {
+        fds[opened] = bench_tcp_connect(modbus_tcp_server_port(server));
+        if (fds[opened] < 0) break;
+    }
+
+    uint64_t errors = 0, requests = 0;
+    uint64_t start = bench_now_ns();
+    for (int round = 0; round < rounds; round++) {
+        for (int c = 0; c < opened; c++) {
+            for (int k = 0; k < pipeline; k++) {
+                uint16_t tid = (uint16_t)(round * pipeline + k);
+                uint8_t request[12] = { tid >> 8, tid & 0xFF, 0, 0, 0, 6, 1, FC_READ_HOLDING_REG,
+                                        0, (uint8_t)k, 0, REGS };
+                memcpy(batch + k * 12, request, 12);
+            }
+            if (send(fds[c], batch, pipeline * 12, MSG_NOSIGNAL) != pipeline * 12) errors++;
+        }
+        for (int c = 0; c < opened; c++) {
+            size_t received = 0, expected = (size_t)pipeline * RESPONSE_SIZE;
+            while (received < expected) {
+                ssize_t n = recv(fds[c], responses + received, expected - received, 0);
+                if (n <= 0) break;
+                received += (size_t)n;
+            }
+            if (received != expected) {
+                errors++;
+                continue;
+            }
+            for (int k = 0; k < pipeline; k++) {
+                const uint8_t* resp = responses + k * RESPONSE_SIZE;
+                uint16_t tid = (uint16_t)(round * pipeline + k);
+                if (((resp[0] << 8) | resp[1]) != tid || resp[7] != FC_READ_HOLDING_REG) errors++;
+            }
+            requests += pipeline;
+        }
+    }
+    double seconds = (double)(bench_now_ns() - start) / 1e9;
+    printf("tcp loopback conns %4d pipeline %3d  %10.0f req/s  %8.1f ns/req  errors %llu\n",
+           opened, pipeline, requests / seconds, seconds * 1e9 / (requests ? requests : 1),
+           (unsigned long long)errors);
+
+    for (int c = 0; c < opened; c++) close(fds[c]);
+    free(fds);
+    free(batch);
+    free(responses);
+    modbus_tcp_server_stop(server);
+    pthread_join(thread, NULL);
+    modbus_tcp_server_free(server);
+    modbus_free_device(device);
+}
+
+typedef struct {
+    ModbusTcpMaster* master;
+    ModbusFrame request;
+    uint64_t remaining;
+    uint64_t completed;
+    uint64_t errors;
+} BenchMasterState;
+
+static void bench_master_completion(void* user, int connection, const ModbusFrame* request,
+                                    int status, const ModbusResponse* response) {
+    BenchMasterState* state = (BenchMasterState*)user;
+    (void)request;
+    state->completed++;
+    if (status != MODBUS_OK || response->value_count != state->request.quantity) state->errors++;
+    if (state->remaining > 0) {
+        state->remaining--;
+        if (modbus_tcp_master_submit(state->master, connection, &state->request,
+                                     bench_master_completion, state) != MODBUS_OK) {
+            state->errors++;
+        }
+    }
+}
+
+// Конвейерный master против локального сервера: окно window запросов на соединение
+static void bench_tcp_master(int connections, uint16_t window, uint64_t total) {
+    ModbusDevice* device = modbus_init_device(1000, 0, 0, 0);
+    ModbusTcpServer* server = modbus_tcp_server_create(device, "127.0.0.1", 0);
+    ModbusTcpMaster* master = modbus_tcp_master_create(window, 1000);
+    if (server == NULL || master == NULL) {
+        printf("tcp master: setup failed\n");
+        modbus_tcp_server_free(server);
+        modbus_tcp_master_free(master);
+        modbus_free_device(device);
+        return;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, bench_tcp_server_thread, server);
+
+    BenchMasterState state = {
+        .master = master,
+        .request = { .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 0, .quantity = 10 },
+        .remaining = total
+    };
+    uint64_t start = bench_now_ns();
+    for (int c = 0; c < connections; c++) {
+        int connection;
+        if (modbus_tcp_master_connect(master, "127.0.0.1", modbus_tcp_server_port(server), &connection) != MODBUS_OK) {
+            state.errors++;
+            continue;
+        }
+        for (uint16_t k = 0; k < window && state.remaining > 0; k++) {
+            state.remaining--;
+            modbus_tcp_master_submit(master, connection, &state.request, bench_master_completion, &state);
+        }
+    }
+    while (state.completed < total && state.errors == 0) {
+        modbus_tcp_master_poll(master, 100);
+    }
+    double seconds = (double)(bench_now_ns() - start) / 1e9;
+    printf("tcp master conns %4d window %3u  %10.0f req/s  errors %llu\n",
+           connections, window, state.completed / seconds, (unsigned long long)state.errors);
+
+    modbus_tcp_master_free(master);
+    modbus_tcp_server_stop(server);
+    pthread_join(thread, NULL);
+    modbus_tcp_server_free(server);
+    modbus_free_device(device);
+}
+
+// Ферма loopback slave для опросчика: все серверы в одном потоке через общий epoll.
+// Посреди прогона первые restart_count серверов останавливаются и через паузу
+// поднимаются на тех же портах - опросчик должен переподключиться сам.
+typedef struct {
+    ModbusDevice* device;
+    ModbusTcpServer** servers;
+    uint16_t* ports;
+    int count;
+    int restart_count;
+    uint64_t down_at_ns;
+    uint64_t up_at_ns;
+    atomic_bool stop;
+} BenchSlaveFarm;
+
+static void* bench_slave_farm_thread(void* arg) {
+    BenchSlaveFarm* farm = (BenchSlaveFarm*)arg;
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    for (int i = 0; i < farm->count; i++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, modbus_tcp_server_fd(farm->servers[i]), &ev);
+    }
+    bool down = false, up = false;
+    while (!atomic_load(&farm->stop)) {
+        struct epoll_event events[256];
+        int count = epoll_wait(epoll_fd, events, 256, 10);
+        for (int i = 0; i < count; i++) {
+            ModbusTcpServer* server = farm->servers[events[i].data.u32];
+            if (server != NULL) modbus_tcp_server_run_once(server, 0);
+        }
+        uint64_t now = bench_now_ns();
+        if (!down && now >= farm->down_at_ns) {
+            down = true;
+            for (int i = 0; i < farm->restart_count; i++) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, modbus_tcp_server_fd(farm->servers[i]), NULL);
+                modbus_tcp_server_free(farm->servers[i]);
+                farm->servers[i] = NULL;
+            }
+        }
+        if (down && !up && now >= farm->up_at_ns) {
+            up = true;
+            for (int i = 0; i < farm->restart_count; i++) {
+                farm->servers[i] = modbus_tcp_server_create(farm->device, "127.0.0.1", farm->ports[i]);
+                if (farm->servers[i] == NULL) continue;
+                struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, modbus_tcp_server_fd(farm->servers[i]), &ev);
+            }
+        }
+    }
+    close(epoll_fd);
+    return NULL;
+}
+
+static void bench_poller_completion(void* user, int connection, const ModbusFrame* request,
+                                    int status, const ModbusResponse* response) {
+    (void)connection;
+    (void)request;
+    uint64_t* bad_values = (uint64_t*)user;
+    if (status == MODBUS_OK && response->value_count != request->quantity) (*bad_values)++;
+}
+
+// slaves устройств, у каждого FC03 (10 регистров) каждые 20 мс и FC01 (16 coils) каждые 100 мс
+static void bench_poller_farm(ModbusPollerBackend backend, int slaves, uint32_t duration_ms) {
+    BenchSlaveFarm farm = {
+        .device = modbus_init_device(100, 0, 100, 0),
+        .servers = (ModbusTcpServer**)calloc(slaves, sizeof(ModbusTcpServer*)),
+        .ports = (uint16_t*)calloc(slaves, sizeof(uint16_t)),
+        .count = slaves,
+        .restart_count = slaves / 10
+    };
+    ModbusPollerConfig config = {
+        .backend = backend,
+        .max_devices = (uint32_t)slaves,
+        .timeout_ms = 500,
+        .reconnect_ms = 50
+    };
+    ModbusPoller* poller = modbus_poller_create(&config);
+    const char* name = backend == MODBUS_POLLER_IO_URING ? "io_uring" : "epoll";
+    if (poller == NULL || modbus_poller_backend(poller) != backend) {
+        printf("poller %s: unavailable\n", name);
+        modbus_poller_free(poller);
+        free(farm.servers);
+        free(farm.ports);
+        modbus_free_device(farm.device);
+        return;
+    }
+
+    int started = 0;
+    for (; started < slaves; started++) {
+        farm.servers[started] = modbus_tcp_server_create(farm.device, "127.0.0.1", 0);
+        if (farm.servers[started] == NULL) break;
+        farm.ports[started] = modbus_tcp_server_port(farm.servers[started]);
+    }
+    farm.count = started;
+    uint64_t start = bench_now_ns();
+    farm.down_at_ns = start + (uint64_t)duration_ms * 1000000u / 2;
+    farm.up_at_ns = farm.down_at_ns + 200000000u;
+    atomic_init(&farm.stop, false);
+    pthread_t thread;
+    pthread_create(&thread, NULL, bench_slave_farm_thread, &farm);
+
+    uint64_t bad_values = 0;
+    ModbusFrame read_regs = { .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 0, .quantity = 10 };
+    ModbusFrame read_coils = { .slave_id = 1, .function_code = FC_READ_COILS, .address = 0, .quantity = 16 };
+    for (int i = 0; i < started; i++) {
+        int device;
+        modbus_poller_add_device(poller, "127.0.0.1", farm.ports[i], &device);
+        modbus_poller_add_schedule(poller, device, &read_regs, 20, bench_poller_completion, &bad_values);
+        modbus_poller_add_schedule(poller, device, &read_coils, 100, bench_poller_completion, &bad_values);
+    }
+    uint64_t end = start + (uint64_t)duration_ms * 1000000u;
+    while (bench_now_ns() < end) modbus_poller_run_once(poller, 10);
+
+    int connected = 0;
+    for (int i = 0; i < started; i++) connected += modbus_poller_connected(poller, i);
+    ModbusPollerStats stats;
+    modbus_poller_stats(poller, &stats);
+    double seconds = (double)(bench_now_ns() - start) / 1e9;
+    printf("poller %-8s slaves %4d  %8.0f req/s  ok %llu failed %llu timeouts %llu io %llu overruns %llu  "
+           "connects %llu disconnects %llu  connected %d/%d  bad %llu\n",
+           name, started, stats.requests / seconds, (unsigned long long)stats.responses,
+           (unsigned long long)stats.failures, (unsigned long long)stats.timeouts,
+           (unsigned long long)stats.io_errors, (unsigned long long)stats.overruns,
+           (unsigned long long)stats.connects, (unsigned long long)stats.disconnects,
+           connected, started, (unsigned long long)bad_values);
+    // Перезапущенные slave к концу прогона снова на связи
+    bench_check_result("poller", bad_values != 0 || stats.responses == 0 || connected != started);
+
+    modbus_poller_free(poller);
+    atomic_store(&farm.stop, true);
+    pthread_join(thread, NULL);
+    for (int i = 0; i < started; i++) modbus_tcp_server_free(farm.servers[i]);
+    free(farm.servers);
+    free(farm.ports);
+    modbus_free_device(farm.device);
+}
+
+// Slave RTU на стороне master pty: на линии шлюза он выглядит как настоящее устройство
+typedef struct {
+    ModbusDevice* device;
+    int fd;
+    atomic_bool stop;
+    uint32_t requests;          // кадры, принятые с линии
+    uint32_t crc_errors;        // из них с неверным CRC, посчитанным шлюзом
+} BenchPtySlave;
+
+// Unit с маршрутом в линию, на запросы к которому slave не отвечает: тайм-аут шлюза
+#define BENCH_BRIDGE_SILENT_UNIT    3
+
+static void bench_pty_slave_frame(void* user, const uint8_t* adu, uint16_t length, uint64_t timestamp_us) {
+    (void)timestamp_us;
+    BenchPtySlave* slave = (BenchPtySlave*)user;
+    uint8_t rx[MODBUS_MAX_ADU_SIZE];
+    uint8_t tx[MODBUS_MAX_ADU_SIZE];
+    uint16_t tx_length = 0;
+    memcpy(rx, adu, length);
+    slave->requests++;
+    if (modbus_process_response_from_master(slave->device, rx, length, tx, &tx_length) == MODBUS_ERR_CRC) {
+        slave->crc_errors++;
+    }
+    if (rx[0] == 0 || rx[0] == BENCH_BRIDGE_SILENT_UNIT) return;
+    for (uint16_t sent = 0; sent < tx_length;) {
+        ssize_t n = write(slave->fd, tx + sent, tx_length - sent);
+        if (n > 0) sent += (uint16_t)n;
+        else if (n < 0 && errno != EAGAIN && errno != EINTR) return;
+    }
+}
+
+static void* bench_pty_slave_thread(void* arg) {
+    BenchPtySlave* slave = (BenchPtySlave*)arg;
+    ModbusRtuFramer framer;
+    modbus_rtu_framer_init(&framer, 115200, MODBUS_RTU_REQUESTS, bench_pty_slave_frame, slave);
+    while (!atomic_load(&slave->stop)) {
+        struct pollfd pfd = { .fd = slave->fd, .events = POLLIN };
+        if (poll(&pfd, 1, 1) > 0) modbus_rtu_read(&framer, slave->fd);
+        modbus_rtu_framer_poll(&framer, modbus_rtu_now_us());
+    }
+    return NULL;
+}
+
+static void* bench_bridge_thread(void* arg) {
+    modbus_bridge_run((ModbusBridge*)arg);
+    return NULL;
+}
+
+// Запрос клиента шлюзу и ответ длиной expected байт; возвращает, сколько принято
+static uint16_t bench_bridge_exchange(int fd, const ModbusFrame* frame, uint16_t transaction_id,
+                                      uint8_t* response, uint16_t expected) {
+    uint8_t request[MODBUS_TCP_MAX_ADU_SIZE];
+    uint16_t request_length;
+    modbus_tcp_create_request(frame, transaction_id, request, &request_length);
+    send(fd, request, request_length, MSG_NOSIGNAL);
+    uint16_t received = 0;
+    while (received < expected) {
+        ssize_t n = recv(fd, response + received, expected - received, 0);
+        if (n <= 0) break;
+        received += (uint16_t)n;
+    }
+    return received;
+}
+
+// Исключение шлюза: MBAP с эхом transaction id, код функции | 0x80, код исключения
+static bool bench_bridge_exception(const uint8_t* response, uint16_t received, uint16_t transaction_id,
+                                   uint8_t unit, uint8_t code) {
+    return received == MODBUS_TCP_MBAP_SIZE + 2 && ((response[0] << 8) | response[1]) == transaction_id &&
+           response[6] == unit && response[7] == (FC_READ_HOLDING_REG | 0x80) && response[8] == code;
+}
+
+// Преобразование кадров на месте: RTU ADU совпадает с modbus_create_request (в том числе CRC),
+// ответ slave получает MBAP с transaction id запроса, испорченный CRC ответа отвергается
+static int bench_bridge_convert_check(ModbusDevice* device) {
+    int failures = 0;
+    for (uint16_t quantity = 1; quantity <= MODBUS_MAX_READ_REGS; quantity += 31) {
+        ModbusFrame frame = { .slave_id = 1, .function_code = FC_READ_HOLDING_REG,
+                              .address = (uint16_t)(quantity % 50), .quantity = quantity };
+        uint8_t buffer[MODBUS_BRIDGE_BUFFER];
+        uint8_t expected[MODBUS_MAX_ADU_SIZE];
+        uint16_t tcp_length, rtu_length, expected_length;
+        modbus_tcp_create_request(&frame, (uint16_t)(0xA500 + quantity), buffer, &tcp_length);
+        modbus_create_request(&frame, expected, &expected_length);
+        if (modbus_bridge_tcp_to_rtu(buffer, tcp_length, &rtu_length) != MODBUS_OK || rtu_length != expected_length ||
+            memcmp(buffer + MODBUS_BRIDGE_RTU_OFFSET, expected, rtu_length) != 0) {
+            failures++;
+            continue;
+        }
+
+        uint8_t reply[MODBUS_MAX_ADU_SIZE];
+        uint16_t reply_length;
+        if (modbus_process_response_from_master(device, expected, expected_length, reply, &reply_length) != MODBUS_OK) {
+            failures++;
+            continue;
+        }
+        memcpy(buffer + MODBUS_BRIDGE_RTU_OFFSET, reply, reply_length);
+        if (modbus_bridge_rtu_to_tcp(buffer, reply_length, (uint16_t)(0xA500 + quantity), &tcp_length) != MODBUS_OK ||
+            tcp_length != reply_length - MODBUS_CRC_SIZE + MODBUS_BRIDGE_RTU_OFFSET ||
+            ((buffer[0] << 8) | buffer[1]) != 0xA500 + quantity || buffer[2] != 0 || buffer[3] != 0 ||
+            ((buffer[4] << 8) | buffer[5]) != reply_length - MODBUS_CRC_SIZE ||
+            memcmp(buffer + MODBUS_BRIDGE_RTU_OFFSET, reply, reply_length - MODBUS_CRC_SIZE) != 0) {
+            failures++;
+        }
+        reply[reply_length / 2] ^= 0x01;
+        memcpy(buffer + MODBUS_BRIDGE_RTU_OFFSET, reply, reply_length);
+        if (modbus_bridge_rtu_to_tcp(buffer, reply_length, 1, &tcp_length) != MODBUS_ERR_CRC) failures++;
+    }
+    return failures;
+}
+
+// Шлюз TCP -> RTU с pty вместо последовательной линии: время запроса FC03 через шлюз
+// и собственная задержка шлюза (преобразование кадров и запись в линию и клиенту)
+static void bench_bridge(int rounds) {
+    BenchPtySlave slave = { .device = modbus_init_device(200, 0, 0, 0) };
+    atomic_init(&slave.stop, false);
+    slave.fd = posix_openpt(O_RDWR | O_NOCTTY);
+    int line_fd = -1;
+    ModbusBridge* bridge = modbus_bridge_create("127.0.0.1", 0, 64);
+    int line;
+    if (slave.fd < 0 || grantpt(slave.fd) != 0 || unlockpt(slave.fd) != 0 || bridge == NULL ||
+        modbus_rtu_open(ptsname(slave.fd), 115200, &line_fd) != MODBUS_OK ||
+        modbus_bridge_add_line(bridge, line_fd, 115200, 200, 1000, &line) != MODBUS_OK) {
+        printf("bridge: pty setup failed\n");
+        modbus_bridge_free(bridge);
+        if (line_fd >= 0) close(line_fd);
+        if (slave.fd >= 0) close(slave.fd);
+        modbus_free_device(slave.device);
+        return;
+    }
+    fcntl(slave.fd, F_SETFL, fcntl(slave.fd, F_GETFL) | O_NONBLOCK);
+    for (uint16_t i = 0; i < 200; i++) slave.device->holding_registers[i] = i;
+    modbus_bridge_route(bridge, 1, 1, line);
+    modbus_bridge_route(bridge, BENCH_BRIDGE_SILENT_UNIT, BENCH_BRIDGE_SILENT_UNIT, line);
+
+    pthread_t slave_thread, bridge_thread;
+    pthread_create(&slave_thread, NULL, bench_pty_slave_thread, &slave);
+    pthread_create(&bridge_thread, NULL, bench_bridge_thread, bridge);
+    int fd = bench_tcp_connect(modbus_bridge_port(bridge));
+
+    uint8_t response[MODBUS_TCP_MAX_ADU_SIZE];
+    int errors = 0;
+    uint32_t routed_count = 0;
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < rounds && fd >= 0; i++) {
+        // Каждый десятый запрос - к unit без маршрута: исключение шлюза без обращения к линии
+        bool routed = i % 10 != 0;
+        ModbusFrame frame = { .slave_id = routed ? 1 : 2, .function_code = FC_READ_HOLDING_REG,
+                              .address = 0, .quantity = 100 };
+        uint16_t expected = routed ? MODBUS_TCP_MBAP_SIZE + 2 + 200 : MODBUS_TCP_MBAP_SIZE + 2;
+        uint16_t received = bench_bridge_exchange(fd, &frame, (uint16_t)i, response, expected);
+        if (routed) {
+            routed_count++;
+            uint16_t transaction_id = (response[0] << 8) | response[1];
+            if (received != expected || transaction_id != (uint16_t)i || response[6] != 1 ||
+                response[7] != FC_READ_HOLDING_REG || response[8] != 200 ||
+                response[MODBUS_TCP_MBAP_SIZE + 2 + 2 * 99 + 1] != 99) {
+                errors++;
+            }
+        } else if (!bench_bridge_exception(response, received, (uint16_t)i, 2, MODBUS_EXC_GATEWAY_PATH)) {
+            errors++;
+        }
+    }
+    double us = (double)(bench_now_ns() - start) / rounds / 1e3;
+
+    // Slave молчит: исключение шлюза по тайм-ауту ответа (200 мс), затем линия снова работает
+    enum { SILENT = 3 };
+    for (int i = 0; i < SILENT && fd >= 0; i++) {
+        uint16_t transaction_id = (uint16_t)(0xF000 + i);
+        ModbusFrame silent = { .slave_id = BENCH_BRIDGE_SILENT_UNIT, .function_code = FC_READ_HOLDING_REG,
+                               .address = 0, .quantity = 1 };
+        uint16_t received = bench_bridge_exchange(fd, &silent, transaction_id, response, MODBUS_TCP_MBAP_SIZE + 2);
+        if (!bench_bridge_exception(response, received, transaction_id, BENCH_BRIDGE_SILENT_UNIT,
+                                    MODBUS_EXC_GATEWAY_TARGET)) {
+            errors++;
+        }
+        ModbusFrame frame = { .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 10, .quantity = 1 };
+        received = bench_bridge_exchange(fd, &frame, transaction_id, response, MODBUS_TCP_MBAP_SIZE + 4);
+        if (received != MODBUS_TCP_MBAP_SIZE + 4 || ((response[0] << 8) | response[1]) != transaction_id ||
+            response[7] != FC_READ_HOLDING_REG || response[10] != 10) {
+            errors++;
+        }
+        routed_count += 2;
+    }
+
+    modbus_bridge_stop(bridge);
+    pthread_join(bridge_thread, NULL);
+    atomic_store(&slave.stop, true);
+    pthread_join(slave_thread, NULL);
+    ModbusBridgeStats stats;
+    modbus_bridge_stats(bridge, &stats);
+    printf("bridge pty 115200 fc03 100  %8.1f us/req  gateway %5.2f us/req  ok %llu timeouts %llu "
+           "rejected %llu bad %llu  errors %d\n",
+           us, stats.requests ? (double)stats.overhead_ns / stats.requests / 1e3 : 0.0,
+           (unsigned long long)stats.responses, (unsigned long long)stats.timeouts,
+           (unsigned long long)stats.rejected, (unsigned long long)stats.bad_responses, errors);
+    // Каждый запрос с маршрутом дошёл до slave с верным CRC; ответы дошли до клиента с верным CRC
+    errors += bench_bridge_convert_check(slave.device);
+    if (fd < 0 || slave.requests != routed_count || slave.crc_errors != 0 || stats.bad_responses != 0 ||
+        stats.timeouts != SILENT) {
+        errors++;
+    }
+    bench_check_result("bridge", errors);
+
+    if (fd >= 0) close(fd);
+    modbus_bridge_free(bridge);
+    close(line_fd);
+    close(slave.fd);
+    modbus_free_device(slave.device);
+}
+
+static void bench_history_count(void* user, uint64_t timestamp_us, const uint16_t* values, uint16_t count) {
+    (void)timestamp_us;
+    *(uint64_t*)user += values[count - 1];
+}
+
+// Блок 125 регистров, опрос раз в 100 мс: каждый скан меняет на единицы ~10% аналоговых
+// значений и счётчик в последнем регистре. Интервал опорных снимков - компромисс между
+// степенью сжатия и временем "значения на момент T"
+static void bench_history(uint32_t keyframe_interval, uint32_t scans) {
+    enum { COUNT = 125 };
+    ModbusHistorian* history = modbus_history_create();
+    ModbusHistoryBlockConfig config = { .address = 0, .count = COUNT, .memory_bytes = 1 << 20,
+                                        .keyframe_interval = keyframe_interval };
+    int block;
+    if (history == NULL || modbus_history_add_block(history, &config, &block) != MODBUS_OK) {
+        printf("history: setup failed\n");
+        modbus_history_free(history);
+        return;
+    }
+    uint16_t regs[COUNT];
+    for (int i = 0; i < COUNT; i++) regs[i] = (uint16_t)(1000 + i * 10);
+    uint32_t seed = 1;
+    uint64_t start = bench_now_ns();
+    for (uint32_t scan = 0; scan < scans; scan++) {
+        for (int k = 0; k < COUNT / 10; k++) {
+            seed = seed * 1103515245u + 12345u;
+            regs[(seed >> 8) % (COUNT - 1)] += (uint16_t)((seed >> 20) % 9) - 4;
+        }
+        regs[COUNT - 1]++;
+        modbus_history_record(history, block, 1000000ull + scan * 100000ull, regs);
+    }
+    double record_ns = (double)(bench_now_ns() - start) / scans;
+
+    ModbusHistoryStats stats;
+    modbus_history_stats(history, block, &stats);
+    uint64_t oldest = stats.oldest_us, span = stats.newest_us - stats.oldest_us;
+    uint16_t values[COUNT];
+    enum { QUERIES = 20000 };
+    for (int i = 0; i < QUERIES; i++) {
+        seed = seed * 1103515245u + 12345u;
+        modbus_history_value_at(history, block, oldest + seed % (span + 1), 0, COUNT, values, NULL);
+    }
+    modbus_history_stats(history, block, &stats);
+    double value_at_ns = (double)stats.query_ns_total / stats.queries;
+
+    // Минута истории
+    uint64_t sum = 0, matched = 0;
+    start = bench_now_ns();
+    modbus_history_query(history, block, oldest + span / 2, oldest + span / 2 + 60000000ull, 0, COUNT,
+                         bench_history_count, &sum, &matched);
+    double range_us = (double)(bench_now_ns() - start) / 1e3;
+    bench_sink += (uint32_t)sum + values[0];
+
+    printf("history 125 regs keyframe %-4u  record %6.0f ns  ratio %5.2f  stored %llu of %llu scans (%.1f h)  "
+           "value_at %6.0f ns (max %llu)  range 1 min %llu scans %7.1f us\n",
+           keyframe_interval, record_ns, (double)stats.raw_bytes / stats.encoded_bytes,
+           (unsigned long long)stats.stored_records, (unsigned long long)stats.records, span / 3.6e9,
+           value_at_ns, (unsigned long long)stats.query_ns_max, (unsigned long long)matched, range_us);
+    modbus_history_free(history);
+}
+
+// Запрос master (адрес slave + PDU) через обработку slave и разбор ответа
+static int bench_exchange(ModbusDevice* device, const ModbusFrame* request, ModbusResponse* response) {
+    uint8_t pdu[MODBUS_MAX_ADU_SIZE];
+    uint8_t reply[MODBUS_MAX_ADU_SIZE];
+    uint16_t pdu_length, reply_length;
+    int status = modbus_create_pdu(request, pdu, &pdu_length);
+    if (status == MODBUS_OK) status = modbus_process_request(device, pdu, pdu_length, reply, &reply_length);
+    if (status == MODBUS_OK) status = modbus_decode_pdu(request, reply, reply_length, response);
+    return status;
+}
+
+// Планировщик опроса: объединение через допустимые разрывы, предел длины запроса по коду
+// функции, раскладка ответов по тегам
+static void bench_plan_check(void) {
+    ModbusDevice* devices[3] = { NULL, modbus_init_device(1000, 0, 3000, 0), modbus_init_device(0, 100, 0, 0) };
+    for (uint16_t i = 0; i < 1000; i++) devices[1]->holding_registers[i] = (uint16_t)(i * 7 + 1);
+    for (uint16_t i = 0; i < 3000; i++) modbus_set_coil(devices[1], i, i % 3 == 0);
+    for (uint16_t i = 0; i < 100; i++) devices[2]->input_registers[i] = (uint16_t)(0x8000 | i);
+
+    ModbusPlanner* planner = modbus_planner_create(4, 8);
+    ModbusTag tags[64];
+    uint32_t tag_count = 0;
+    // Регистры: 0-1 и 3 - разрыв 1, один запрос; 10-13 и 12-13 - разрыв 6 > 4, новый запрос;
+    // 20 тегов по 10 регистров подряд с 200 - 200 регистров, больше 125: два запроса
+    tags[tag_count++] = (ModbusTag){ 1, MODBUS_TABLE_HOLDING_REGS, 0, 2 };
+    tags[tag_count++] = (ModbusTag){ 1, MODBUS_TABLE_HOLDING_REGS, 3, 1 };
+    tags[tag_count++] = (ModbusTag){ 1, MODBUS_TABLE_HOLDING_REGS, 10, 4 };
+    tags[tag_count++] = (ModbusTag){ 1, MODBUS_TABLE_HOLDING_REGS, 12, 2 };
+    for (uint16_t a = 200; a < 400; a += 10) tags[tag_count++] = (ModbusTag){ 1, MODBUS_TABLE_HOLDING_REGS, a, 10 };
+    // Биты: 0-15 и 20-27 - разрыв 4 <= 8; 1000-2989 и 2995-2999 - ровно 2000 бит одним запросом
+    tags[tag_count++] = (ModbusTag){ 1, MODBUS_TABLE_COILS, 0, 16 };
+    tags[tag_count++] = (ModbusTag){ 1, MODBUS_TABLE_COILS, 20, 8 };
+    tags[tag_count++] = (ModbusTag){ 1, MODBUS_TABLE_COILS, 1000, 1990 };
+    tags[tag_count++] = (ModbusTag){ 1, MODBUS_TABLE_COILS, 2995, 5 };
+    tags[tag_count++] = (ModbusTag){ 2, MODBUS_TABLE_INPUT_REGS, 50, 3 };
+    const uint32_t expected_requests = 4 + 2 + 1;
+
+    int failures = 0;
+    uint32_t ids[64];
+    for (uint32_t i = 0; i < tag_count; i++) {
+        if (modbus_planner_add_tag(planner, &tags[i], &ids[i]) != MODBUS_OK) failures++;
+    }
+    if (modbus_planner_update(planner) != MODBUS_OK) failures++;
+    uint32_t count;
+    const ModbusPlanRequest* plan = modbus_planner_requests(planner, &count);
+    if (count != expected_requests) failures++;
+
+    uint16_t* values = (uint16_t*)malloc(MODBUS_MAX_READ_BITS * sizeof(uint16_t));
+    for (uint32_t r = 0; r < count; r++) {
+        const ModbusFrame* request = &plan[r].request;
+        bool bits = request->function_code == FC_READ_COILS || request->function_code == FC_READ_DISCRETE_INPUTS;
+        if (request->quantity > (bits ? MODBUS_MAX_READ_BITS : MODBUS_MAX_READ_REGS)) failures++;
+        ModbusResponse response = { .values = values, .values_capacity = MODBUS_MAX_READ_BITS };
+        if (bench_exchange(devices[request->slave_id], request, &response) != MODBUS_OK ||
+            modbus_planner_scatter(planner, r, &response) != MODBUS_OK) {
+            failures++;
+        }
+    }
+    for (uint32_t i = 0; i < tag_count; i++) {
+        const uint16_t* tag_values = modbus_planner_tag_values(planner, ids[i]);
+        const ModbusDevice* device = devices[tags[i].unit];
+        for (uint16_t k = 0; tag_values != NULL && k < tags[i].width; k++) {
+            uint16_t address = (uint16_t)(tags[i].address + k);
+            uint16_t expect = tags[i].table == MODBUS_TABLE_COILS ? modbus_get_coil(device, address)
+                              : tags[i].table == MODBUS_TABLE_HOLDING_REGS ? device->holding_registers[address]
+                                                                           : device->input_registers[address];
+            if (tag_values[k] != expect) failures++;
+        }
+        if (tag_values == NULL) failures++;
+    }
+
+    // Слот удалённого тега достаётся новому тегу уже: до перестройки раскладка по старому
+    // плану отклоняется, после - новый тег получает свои значения
+    uint32_t request_index = 0;
+    for (uint32_t r = 0; r < count; r++) {
+        if (plan[r].request.slave_id == 1 && plan[r].request.function_code == FC_READ_HOLDING_REG &&
+            plan[r].request.address == 0) {
+            request_index = r;
+        }
+    }
+    ModbusFrame request = plan[request_index].request;
+    ModbusResponse response = { .values = values, .values_capacity = MODBUS_MAX_READ_BITS };
+    ModbusTag narrow = { 1, MODBUS_TABLE_HOLDING_REGS, 1, 1 };
+    uint32_t narrow_id;
+    if (bench_exchange(devices[1], &request, &response) != MODBUS_OK ||
+        modbus_planner_remove_tag(planner, ids[0]) != MODBUS_OK ||
+        modbus_planner_scatter(planner, request_index, &response) != MODBUS_ERR_MISMATCH ||
+        modbus_planner_add_tag(planner, &narrow, &narrow_id) != MODBUS_OK || narrow_id != ids[0] ||
+        modbus_planner_scatter(planner, request_index, &response) != MODBUS_ERR_MISMATCH ||
+        modbus_planner_update(planner) != MODBUS_OK) {
+        failures++;
+    }
+    plan = modbus_planner_requests(planner, &count);
+    for (uint32_t r = 0; r < count; r++) {
+        if (plan[r].request.slave_id != 1 || plan[r].request.function_code != FC_READ_HOLDING_REG ||
+            plan[r].request.address != 1) {
+            continue;
+        }
+        request = plan[r].request;
+        if (bench_exchange(devices[1], &request, &response) != MODBUS_OK ||
+            modbus_planner_scatter(planner, r, &response) != MODBUS_OK) {
+            failures++;
+        }
+    }
+    const uint16_t* narrow_values = modbus_planner_tag_values(planner, narrow_id);
+    if (narrow_values == NULL || narrow_values[0] != devices[1]->holding_registers[1]) failures++;
+
+    printf("plan %u tags -> %u requests (expected %u)\n", tag_count, count, expected_requests);
+    bench_check_result("plan", failures);
+
+    free(values);
+    modbus_planner_free(planner);
+    modbus_free_device(devices[1]);
+    modbus_free_device(devices[2]);
+}
+
+typedef struct {
+    ModbusRange ranges[8];
+    ModbusTable tables[8];
+    int calls;
+    uint32_t extra_id;
+    bool subscribed;
+} BenchWatchLog;
+
+static void bench_watch_callback(void* user, ModbusDevice* device, ModbusTable table, uint16_t address,
+                                 uint16_t count) {
+    BenchWatchLog* log = (BenchWatchLog*)user;
+    if (log->calls < 8) {
+        log->tables[log->calls] = table;
+        log->ranges[log->calls] = (ModbusRange){ address, count };
+    }
+    log->calls++;
+    // Подписка из обработчика не должна зависать на списке подписок
+    if (!log->subscribed) {
+        log->subscribed = true;
+        modbus_watch_subscribe(device, MODBUS_TABLE_HOLDING_REGS, 500, 10, bench_watch_callback, log, &log->extra_id);
+    }
+}
+
+// Записи master отмечаются в картах изменений и доходят до подписчиков пересечением диапазонов
+static void bench_watch_check(void) {
+    ModbusDevice* device = modbus_init_device(1000, 0, 100, 0);
+    BenchWatchLog log;
+    memset(&log, 0, sizeof(log));
+    uint32_t regs_id, coils_id;
+    int failures = 0;
+    if (modbus_device_enable_watch(device) != MODBUS_OK ||
+        modbus_watch_subscribe(device, MODBUS_TABLE_HOLDING_REGS, 10, 10, bench_watch_callback, &log,
+                               &regs_id) != MODBUS_OK ||
+        modbus_watch_subscribe(device, MODBUS_TABLE_COILS, 0, 8, bench_watch_callback, &log, &coils_id) != MODBUS_OK) {
+        failures++;
+    }
+
+    uint8_t data[20] = { 0 };
+    uint16_t values[16];
+    ModbusResponse response = { .values = values, .values_capacity = 16 };
+    ModbusFrame writes[] = {
+        { .slave_id = 1, .function_code = FC_WRITE_MULT_REG, .address = 15, .quantity = 10,
+          .data = data, .data_length = 20 },                                            // -> 15..19
+        { .slave_id = 1, .function_code = FC_WRITE_SINGLE_COIL, .address = 3, .quantity = 1 },  // -> coil 3
+        { .slave_id = 1, .function_code = FC_WRITE_SINGLE_REG, .address = 100, .quantity = 7 }, // вне подписок
+        { .slave_id = 1, .function_code = FC_WRITE_SINGLE_REG, .address = 505, .quantity = 7 }, // подписка из обработчика
+    };
+    for (size_t i = 0; i < sizeof(writes) / sizeof(writes[0]); i++) {
+        if (bench_exchange(device, &writes[i], &response) != MODBUS_OK) failures++;
+    }
+    if (log.calls != 3 ||
+        log.tables[0] != MODBUS_TABLE_HOLDING_REGS || log.ranges[0].address != 15 || log.ranges[0].count != 5 ||
+        log.tables[1] != MODBUS_TABLE_COILS || log.ranges[1].address != 3 || log.ranges[1].count != 1 ||
+        log.ranges[2].address != 505 || log.ranges[2].count != 1) {
+        failures++;
+    }
+
+    ModbusRange ranges[8];
+    uint32_t count;
+    modbus_dirty_collect(device, MODBUS_TABLE_HOLDING_REGS, ranges, 8, &count);
+    if (count != 3 || ranges[0].address != 15 || ranges[0].count != 10 || ranges[1].address != 100 ||
+        ranges[1].count != 1 || ranges[2].address != 505) {
+        failures++;
+    }
+    modbus_dirty_collect(device, MODBUS_TABLE_COILS, ranges, 8, &count);
+    if (count != 1 || ranges[0].address != 3 || ranges[0].count != 1) failures++;
+    if (modbus_dirty_any(device, MODBUS_TABLE_HOLDING_REGS)) failures++;
+
+    // После отписки обработчик не вызывается
+    modbus_watch_unsubscribe(device, regs_id);
+    modbus_watch_unsubscribe(device, log.extra_id);
+    if (bench_exchange(device, &writes[0], &response) != MODBUS_OK || log.calls != 3) failures++;
+    bench_check_result("watch", failures);
+
+    modbus_device_disable_watch(device);
+    modbus_free_device(device);
+}
+
+typedef struct {
+    ModbusReadCache* cache;
+    const ModbusDevice* device;
+    int calls;
+    int errors;
+    bool resubmit;              // повторить тот же запрос из обработчика
+    bool invalidate;            // сбросить прочитанный диапазон из обработчика
+    bool invalidate_first;      // то же, но до проверки значений ответа
+} BenchCacheClient;
+
+static void bench_cache_completion(void* user, int connection, const ModbusFrame* request,
+                                   int status, const ModbusResponse* response) {
+    BenchCacheClient* client = (BenchCacheClient*)user;
+    (void)connection;
+    client->calls++;
+    if (client->invalidate_first) {
+        client->invalidate_first = false;
+        modbus_cache_invalidate(client->cache, request->slave_id, MODBUS_TABLE_HOLDING_REGS,
+                                request->address, request->quantity);
+    }
+    if (status != MODBUS_OK || response->value_count != request->quantity) {
+        client->errors++;
+    } else {
+        for (uint16_t k = 0; k < request->quantity; k++) {
+            if (response->values[k] != client->device->holding_registers[request->address + k]) client->errors++;
+        }
+    }
+    if (client->resubmit) {
+        client->resubmit = false;
+        if (modbus_cache_submit(client->cache, request, bench_cache_completion, client) != MODBUS_OK) {
+            client->errors++;
+        }
+    }
+    if (client->invalidate) {
+        client->invalidate = false;
+        modbus_cache_invalidate(client->cache, request->slave_id, MODBUS_TABLE_HOLDING_REGS,
+                                request->address, request->quantity);
+    }
+}
+
+static void bench_cache_wait(ModbusTcpMaster* master, int connection) {
+    for (int i = 0; i < 100 && modbus_tcp_master_pending(master, connection) > 0; i++) {
+        modbus_tcp_master_poll(master, 10);
+    }
+}
+
+// Кэш чтения шлюза: попадание, ожидание общего чтения, истечение TTL и обращения
+// к кэшу из обработчиков завершения
+static void bench_cache_check(void) {
+    ModbusDevice* device = modbus_init_device(1000, 0, 0, 0);
+    for (uint16_t i = 0; i < 1000; i++) device->holding_registers[i] = (uint16_t)(i * 13 + 5);
+    ModbusTcpServer* server = modbus_tcp_server_create(device, "127.0.0.1", 0);
+    ModbusTcpMaster* master = modbus_tcp_master_create(16, 1000);
+    int connection = -1;
+    if (server == NULL || master == NULL ||
+        modbus_tcp_master_connect(master, "127.0.0.1", modbus_tcp_server_port(server), &connection) != MODBUS_OK) {
+        bench_check_result("cache", 1);
+        modbus_tcp_master_free(master);
+        modbus_tcp_server_free(server);
+        modbus_free_device(device);
+        return;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, bench_tcp_server_thread, server);
+
+    ModbusReadCache* cache = modbus_cache_create(master, connection, 60000);
+    modbus_cache_set_ttl(cache, 1, MODBUS_TABLE_HOLDING_REGS, 100, 10, 20);
+    BenchCacheClient first = { .cache = cache, .device = device };
+    BenchCacheClient second = { .cache = cache, .device = device };
+    int failures = 0;
+    ModbusFrame wide = { .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 0, .quantity = 10 };
+    ModbusFrame inner = { .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 2, .quantity = 5 };
+    ModbusFrame short_ttl = { .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 100, .quantity = 10 };
+    ModbusCacheStats stats;
+
+    // Промах и вложенный запрос к нему же: одна транзакция, оба получают ответ
+    modbus_cache_submit(cache, &wide, bench_cache_completion, &first);
+    modbus_cache_submit(cache, &inner, bench_cache_completion, &second);
+    bench_cache_wait(master, connection);
+    // Попадание отвечает до возврата
+    modbus_cache_submit(cache, &inner, bench_cache_completion, &second);
+    modbus_cache_stats(cache, &stats);
+    if (first.calls != 1 || second.calls != 2 || stats.hits != 1 || stats.collapsed != 1 || stats.downstream != 1) {
+        failures++;
+    }
+
+    // После TTL запись не отдаётся
+    modbus_cache_submit(cache, &short_ttl, bench_cache_completion, &first);
+    bench_cache_wait(master, connection);
+    usleep(40000);
+    modbus_cache_submit(cache, &short_ttl, bench_cache_completion, &first);
+    bench_cache_wait(master, connection);
+    modbus_cache_stats(cache, &stats);
+    if (first.calls != 3 || stats.hits != 1 || stats.downstream != 3) failures++;
+
+    // Из обработчика первого ожидающего: повторный запрос (попадание в только что сохранённую
+    // запись), затем сброс этой записи - второй ожидающий всё равно получает ответ
+    modbus_cache_invalidate(cache, 1, MODBUS_TABLE_HOLDING_REGS, 0, 1000);
+    first.resubmit = true;
+    first.invalidate = true;
+    modbus_cache_submit(cache, &wide, bench_cache_completion, &first);
+    modbus_cache_submit(cache, &inner, bench_cache_completion, &second);
+    bench_cache_wait(master, connection);
+    modbus_cache_stats(cache, &stats);
+    if (first.calls != 5 || second.calls != 3 || stats.hits != 2 || stats.downstream != 4) failures++;
+    // Запись сброшена: следующий запрос снова уходит slave
+    modbus_cache_submit(cache, &inner, bench_cache_completion, &second);
+    bench_cache_wait(master, connection);
+    modbus_cache_stats(cache, &stats);
+    if (second.calls != 4 || stats.downstream != 5) failures++;
+
+    // Попадание, обработчик которого сначала сбрасывает запись: значения ответа не должны
+    // ссылаться на освобождённую запись
+    second.invalidate_first = true;
+    modbus_cache_submit(cache, &inner, bench_cache_completion, &second);
+    modbus_cache_stats(cache, &stats);
+    if (second.calls != 5 || stats.hits != 3 || stats.downstream != 5) failures++;
+    modbus_cache_submit(cache, &inner, bench_cache_completion, &second);
+    bench_cache_wait(master, connection);
+    modbus_cache_stats(cache, &stats);
+    if (second.calls != 6 || stats.downstream != 6) failures++;
+
+    failures += first.errors + second.errors;
+    bench_check_result("cache", failures);
+
+    modbus_cache_free(cache);
+    modbus_tcp_master_free(master);
+    modbus_tcp_server_stop(server);
+    pthread_join(thread, NULL);
+    modbus_tcp_server_free(server);
+    modbus_free_device(device);
+}
+
+// Образ устройства в файле: запись через одно отображение видна через второе и после
+// повторного открытия; заголовок с чужими размерами или испорченный файл не подключаются
+static void bench_shm_check(void) {
+    char path[] = "/tmp/modbus_bench_shm_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        bench_check_result("shm", 1);
+        return;
+    }
+    close(fd);
+
+    int failures = 0;
+    int status;
+    ModbusDevice* writer = modbus_shm_open(path, 200, 10, 64, 8, &status);
+    ModbusDevice* reader = modbus_shm_attach(path, &status);
+    if (writer == NULL || reader == NULL) {
+        bench_check_result("shm", 1);
+        if (writer != NULL) modbus_free_device(writer);
+        if (reader != NULL) modbus_free_device(reader);
+        unlink(path);
+        return;
+    }
+    if (reader->num_holding_regs != 200 || reader->num_input_regs != 10 || reader->num_coils != 64 ||
+        reader->num_discrete_inputs != 8) {
+        failures++;
+    }
+
+    uint8_t data[2 * MODBUS_MAX_WRITE_REGS];
+    for (int i = 0; i < 2 * MODBUS_MAX_WRITE_REGS; i++) data[i] = (uint8_t)(i * 31 + 7);
+    uint16_t values[MODBUS_MAX_READ_REGS];
+    ModbusResponse response = { .values = values, .values_capacity = MODBUS_MAX_READ_REGS };
+    ModbusFrame write = { .slave_id = 1, .function_code = FC_WRITE_MULT_REG, .address = 50, .quantity = 100,
+                          .data = data, .data_length = 200 };
+    ModbusFrame read = { .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 50, .quantity = 100 };
+    ModbusFrame coil = { .slave_id = 1, .function_code = FC_WRITE_SINGLE_COIL, .address = 63, .quantity = 1 };
+    ModbusFrame read_coils = { .slave_id = 1, .function_code = FC_READ_COILS, .address = 60, .quantity = 4 };
+    if (bench_exchange(writer, &write, &response) != MODBUS_OK ||
+        bench_exchange(writer, &coil, &response) != MODBUS_OK ||
+        bench_exchange(reader, &read, &response) != MODBUS_OK || response.value_count != 100) {
+        failures++;
+    }
+    for (uint16_t i = 0; i < 100; i++) {
+        if (values[i] != (uint16_t)((data[2 * i] << 8) | data[2 * i + 1])) failures++;
+    }
+    if (bench_exchange(reader, &read_coils, &response) != MODBUS_OK || values[3] != 1 || values[0] != 0) failures++;
+    // Обратно: запись через второе отображение
+    reader->input_registers[9] = 0xBEEF;
+    if (writer->input_registers[9] != 0xBEEF) failures++;
+    if (modbus_shm_flush(writer) != MODBUS_OK) failures++;
+    // Заголовок в общей памяти испорчен другим процессом: сброс и снятие отображения
+    // берут длину из своего отображения, а не из заголовка
+    ModbusShmHeader* shared = (ModbusShmHeader*)reader->image;
+    uint64_t total_size = shared->total_size;
+    shared->total_size = UINT64_C(1) << 40;
+    if (modbus_shm_flush(writer) != MODBUS_OK) failures++;
+    void* writer_image = writer->image;
+    size_t writer_size = writer->image_size;
+    modbus_free_device(writer);
+    if (writer_size != total_size || msync(writer_image, writer_size, MS_ASYNC) == 0 || errno != ENOMEM) failures++;
+    shared->total_size = total_size;
+    modbus_free_device(reader);
+
+    // Повторное открытие: те же размеры - прежние значения, другие - отказ
+    ModbusDevice* reopened = modbus_shm_open(path, 200, 10, 64, 8, &status);
+    if (reopened == NULL || reopened->holding_registers[50] != (uint16_t)((data[0] << 8) | data[1]) ||
+        reopened->input_registers[9] != 0xBEEF || !modbus_get_coil(reopened, 63)) {
+        failures++;
+    }
+    if (reopened != NULL) modbus_free_device(reopened);
+    if (modbus_shm_open(path, 201, 10, 64, 8, &status) != NULL || status != MODBUS_ERR_MISMATCH) failures++;
+
+    // Размер файла не совпадает с заголовком
+    struct stat st;
+    stat(path, &st);
+    if (truncate(path, st.st_size + MODBUS_SHM_ALIGN) != 0 ||
+        modbus_shm_attach(path, &status) != NULL || status != MODBUS_ERR_MISMATCH) {
+        failures++;
+    }
+    // Испорченный заголовок
+    uint32_t magic = 0;
+    fd = open(path, O_RDWR);
+    if (truncate(path, st.st_size) != 0 || fd < 0 || pwrite(fd, &magic, sizeof(magic), 0) != sizeof(magic) ||
+        modbus_shm_attach(path, &status) != NULL || status != MODBUS_ERR_MISMATCH) {
+        failures++;
+    }
+    if (fd >= 0) close(fd);
+    unlink(path);
+    bench_check_result("shm", failures);
+}
+
+// modbus_replay из каталога бенчмарка; код завершения 0 - расхождений нет
+static int bench_run_replay(const char* engine, const char* size, const char* path) {
+    char exe[4096];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 32);
+    if (n <= 0) return -1;
+    exe[n] = '\0';
+    char replay[4096];
+    snprintf(replay, sizeof(replay), "%s/modbus_replay", dirname(exe));
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) dup2(null_fd, STDOUT_FILENO);
+        execl(replay, replay, "--engine", engine, "--size", size, path, (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) return -1;
+    return WEXITSTATUS(status);
+}
+
+// Запись обмена FC03/FC16 в файл, чтение обратно и воспроизведение обоими движками modbus_replay
+static void bench_capture_check(void) {
+    enum { TABLE_SIZE = 200, EXCHANGES = 40 };
+    char path[] = "/tmp/modbus_bench_capture_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) close(fd);
+    ModbusCapture* capture = fd >= 0 ? modbus_capture_open(path, 0) : NULL;
+    if (capture == NULL) {
+        if (fd >= 0) unlink(path);
+        bench_check_result("capture", 1);
+        return;
+    }
+    ModbusDevice* device = modbus_init_device(TABLE_SIZE, TABLE_SIZE, TABLE_SIZE, TABLE_SIZE);
+    modbus_device_set_capture(device, capture);
+
+    int failures = 0;
+    uint8_t data[2 * 20];
+    uint16_t values[MODBUS_MAX_READ_REGS];
+    uint8_t functions[EXCHANGES];
+    for (int i = 0; i < EXCHANGES; i++) {
+        for (int k = 0; k < (int)sizeof(data); k++) data[k] = (uint8_t)(i + k);
+        ModbusResponse response = { .values = values, .values_capacity = MODBUS_MAX_READ_REGS };
+        // Каждое пятое чтение - за границей таблицы: исключение тоже записывается
+        ModbusFrame frame = (i % 2 == 0)
+            ? (ModbusFrame){ .slave_id = 1, .function_code = FC_WRITE_MULT_REG, .address = (uint16_t)(i * 4),
+                             .quantity = 20, .data = data, .data_length = sizeof(data) }
+            : (ModbusFrame){ .slave_id = 1, .function_code = FC_READ_HOLDING_REG,
+                             .address = (uint16_t)(i % 5 == 0 ? TABLE_SIZE - 5 : i * 4 - 4), .quantity = 20 };
+        int status = bench_exchange(device, &frame, &response);
+        if (status != (i % 2 == 1 && i % 5 == 0 ? MODBUS_ERR_ADDRESS : MODBUS_OK)) failures++;
+        functions[i] = frame.function_code;
+    }
+    modbus_device_set_capture(device, NULL);
+    ModbusCaptureStats stats;
+    modbus_capture_stats(capture, &stats);
+    modbus_capture_close(capture);
+    if (stats.dropped != 0) failures++;
+
+    // Запросы и ответы по очереди, в порядке обмена
+    ModbusCaptureFile file;
+    uint64_t records = 0;
+    if (modbus_capture_map(path, &file) == MODBUS_OK) {
+        size_t offset = 0;
+        ModbusCaptureRecord record;
+        uint64_t previous_us = 0;
+        while (modbus_capture_next(&file, &offset, &record)) {
+            uint64_t exchange = records / 2;
+            uint8_t direction = records % 2 == 0 ? MODBUS_CAPTURE_REQUEST : MODBUS_CAPTURE_RESPONSE;
+            if (exchange >= EXCHANGES || record.kind != (direction | MODBUS_CAPTURE_PDU) || record.unit != 1 ||
+                record.length < 3 || (record.frame[1] & 0x7F) != functions[exchange] ||
+                record.timestamp_us < previous_us) {
+                failures++;
+            }
+            previous_us = record.timestamp_us;
+            records++;
+        }
+        if (offset != file.size) failures++;
+        modbus_capture_unmap(&file);
+    }
+    if (records != 2 * EXCHANGES) failures++;
+
+    char size[8];
+    snprintf(size, sizeof(size), "%d", TABLE_SIZE);
+    if (bench_run_replay("slave", size, path) != 0) failures++;
+    if (bench_run_replay("master", size, path) != 0) failures++;
+    printf("capture %llu records replayed by slave and master engines\n", (unsigned long long)records);
+    bench_check_result("capture", failures);
+
+    unlink(path);
+    modbus_free_device(device);
+}
+
+// Многорегистровые значения: векторные перестановки против скалярных для всех типов и порядков
+// (с хвостами, не кратными вектору), известные раскладки ABCD/CDAB/BADC/DCBA, упаковка после
+// распаковки, округление и ограничение диапазоном при записи тегов
+static void bench_values_check(void) {
+    enum { VALUES = 37, REGS = VALUES * 4 };
+    uint16_t regs[REGS], packed[REGS];
+    uint8_t reference[VALUES * 8], unpacked[VALUES * 8];
+    for (int i = 0; i < REGS; i++) regs[i] = (uint16_t)(i * 0x0F0F + 0x1234);
+    int failures = 0;
+
+    for (int type = 0; type < MODBUS_VALUE_TYPE_COUNT; type++) {
+        size_t value_size = modbus_value_width((ModbusValueType)type) * 2u;
+        for (int order = MODBUS_ORDER_ABCD; order <= MODBUS_ORDER_DCBA; order++) {
+            for (uint32_t count = 0; count <= VALUES; count++) {
+                modbus_regs_select(MODBUS_REGS_IMPL_SCALAR);
+                modbus_values_unpack(regs, count, (ModbusValueType)type, (ModbusWordOrder)order, reference);
+                for (int impl = MODBUS_REGS_IMPL_SCALAR; impl < MODBUS_REGS_IMPL_COUNT; impl++) {
+                    if (modbus_regs_select((ModbusRegsImpl)impl) != MODBUS_OK) continue;
+                    memset(unpacked, 0xA5, sizeof(unpacked));
+                    memset(packed, 0xA5, sizeof(packed));
+                    modbus_values_unpack(regs, count, (ModbusValueType)type, (ModbusWordOrder)order, unpacked);
+                    modbus_values_pack(unpacked, count, (ModbusValueType)type, (ModbusWordOrder)order, packed);
+                    size_t reg_count = count * value_size / 2;
+                    if (memcmp(unpacked, reference, count * value_size) != 0 ||
+                        memcmp(packed, regs, reg_count * sizeof(uint16_t)) != 0 ||
+                        (reg_count < REGS && packed[reg_count] != 0xA5A5)) {
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+
+    // A B C D = 01 02 03 04 (05 06 07 08 для 64 бит)
+    static const uint16_t words[4][4] = {
+        { 0x0102, 0x0304, 0x0506, 0x0708 },     // ABCD
+        { 0x0304, 0x0102, 0x0708, 0x0506 },     // CDAB: 32 бит
+        { 0x0201, 0x0403, 0x0605, 0x0807 },     // BADC
+        { 0x0403, 0x0201, 0x0807, 0x0605 },     // DCBA: 32 бит
+    };
+    static const uint16_t words64[4][4] = {
+        { 0x0102, 0x0304, 0x0506, 0x0708 },
+        { 0x0708, 0x0506, 0x0304, 0x0102 },
+        { 0x0201, 0x0403, 0x0605, 0x0807 },
+        { 0x0807, 0x0605, 0x0403, 0x0201 },
+    };
+    for (int impl = MODBUS_REGS_IMPL_SCALAR; impl < MODBUS_REGS_IMPL_COUNT; impl++) {
+        if (modbus_regs_select((ModbusRegsImpl)impl) != MODBUS_OK) continue;
+        for (int order = MODBUS_ORDER_ABCD; order <= MODBUS_ORDER_DCBA; order++) {
+            uint32_t v32[2];
+            uint64_t v64;
+            modbus_values_unpack(words[order], 2, MODBUS_VALUE_UINT32, (ModbusWordOrder)order, v32);
+            modbus_values_unpack(words64[order], 1, MODBUS_VALUE_UINT64, (ModbusWordOrder)order, &v64);
+            if (v32[0] != 0x01020304u || v32[1] != 0x05060708u || v64 != 0x0102030405060708ull) failures++;
+        }
+    }
+    modbus_regs_select(MODBUS_REGS_IMPL_AUTO);
+
+    // Запись тегов: NaN - нижняя граница типа, вне диапазона - ближайшая граница,
+    // половины - от нуля
+    static const ModbusValueLayout layouts[] = {
+        { MODBUS_VALUE_UINT16, MODBUS_ORDER_ABCD, 0, 0, 0 },
+        { MODBUS_VALUE_INT16, MODBUS_ORDER_ABCD, 1, 0, 0 },
+        { MODBUS_VALUE_UINT32, MODBUS_ORDER_CDAB, 2, 0, 0 },
+        { MODBUS_VALUE_INT32, MODBUS_ORDER_BADC, 4, 0, 0 },
+        { MODBUS_VALUE_UINT64, MODBUS_ORDER_DCBA, 6, 0, 0 },
+        { MODBUS_VALUE_INT64, MODBUS_ORDER_ABCD, 10, 0, 0 },
+        { MODBUS_VALUE_INT16, MODBUS_ORDER_ABCD, 14, 0.1, -100.0 },
+    };
+    enum { TAGS = sizeof(layouts) / sizeof(layouts[0]) };
+    static const struct {
+        double in[TAGS];
+        int64_t expect[TAGS - 2];       // UINT16, INT16, UINT32, INT32, INT64
+        uint64_t expect_u64;
+        int16_t expect_scaled;
+    } cases[] = {
+        { { NAN, NAN, NAN, NAN, NAN, NAN, NAN },
+          { 0, -32768, 0, INT32_MIN, INT64_MIN }, 0, -32768 },
+        { { 1e30, 1e30, 1e30, 1e30, 1e30, 1e30, 1e30 },
+          { 65535, 32767, 4294967295ll, INT32_MAX, INT64_MAX }, UINT64_MAX, 32767 },
+        { { -1e30, -1e30, -1e30, -1e30, -1e30, -1e30, -1e30 },
+          { 0, -32768, 0, INT32_MIN, INT64_MIN }, 0, -32768 },
+        { { 2.5, -2.5, 2.5, -2.5, 2.5, -2.5, -100.25 },
+          { 3, -3, 3, -3, -3 }, 3, -3 },
+        { { 65535.4, -32768.4, 4294967294.6, 2147483646.6, 1e20, 9.3e18, 3376.7 },
+          { 65535, -32768, 4294967295ll, 2147483647, INT64_MAX }, UINT64_MAX, 32767 },
+    };
+    ModbusValueMap* map = modbus_value_map_create(layouts, TAGS);
+    for (size_t c = 0; map != NULL && c < sizeof(cases) / sizeof(cases[0]); c++) {
+        uint16_t block[18];
+        memset(block, 0, sizeof(block));
+        if (modbus_value_map_encode(map, cases[c].in, block, 18) != MODBUS_OK) failures++;
+        uint16_t u16;
+        int16_t i16, scaled;
+        uint32_t u32;
+        int32_t i32;
+        uint64_t u64;
+        int64_t i64;
+        modbus_values_unpack(block + 0, 1, MODBUS_VALUE_UINT16, MODBUS_ORDER_ABCD, &u16);
+        modbus_values_unpack(block + 1, 1, MODBUS_VALUE_INT16, MODBUS_ORDER_ABCD, &i16);
+        modbus_values_unpack(block + 2, 1, MODBUS_VALUE_UINT32, MODBUS_ORDER_CDAB, &u32);
+        modbus_values_unpack(block + 4, 1, MODBUS_VALUE_INT32, MODBUS_ORDER_BADC, &i32);
+        modbus_values_unpack(block + 6, 1, MODBUS_VALUE_UINT64, MODBUS_ORDER_DCBA, &u64);
+        modbus_values_unpack(block + 10, 1, MODBUS_VALUE_INT64, MODBUS_ORDER_ABCD, &i64);
+        modbus_values_unpack(block + 14, 1, MODBUS_VALUE_INT16, MODBUS_ORDER_ABCD, &scaled);
+        if (u16 != cases[c].expect[0] || i16 != cases[c].expect[1] || u32 != (uint64_t)cases[c].expect[2] ||
+            i32 != cases[c].expect[3] || i64 != cases[c].expect[4] || u64 != cases[c].expect_u64 ||
+            scaled != cases[c].expect_scaled || block[15] != 0) {
+            failures++;
+        }
+    }
+    if (map == NULL) failures++;
+    modbus_value_map_free(map);
+    bench_check_result("values", failures);
+}
+
+enum { BENCH_HISTORY_ADDRESS = 100, BENCH_HISTORY_REGS = 40, BENCH_HISTORY_SCANS = 4000, BENCH_HISTORY_STEP_US = 1000 };
+
+typedef struct {
+    const uint16_t* shadow;     // все записанные снимки подряд
+    uint16_t address;           // от начала блока
+    uint64_t expected_us;       // метка следующего ожидаемого снимка
+    uint64_t calls;
+    int errors;
+} BenchHistoryShadow;
+
+static void bench_history_compare(void* user, uint64_t timestamp_us, const uint16_t* values, uint16_t count) {
+    BenchHistoryShadow* shadow = (BenchHistoryShadow*)user;
+    uint64_t scan = (timestamp_us - BENCH_HISTORY_STEP_US) / BENCH_HISTORY_STEP_US;
+    const uint16_t* expect = shadow->shadow + scan * BENCH_HISTORY_REGS + shadow->address;
+    if (timestamp_us != shadow->expected_us || memcmp(values, expect, count * sizeof(uint16_t)) != 0) {
+        shadow->errors++;
+    }
+    shadow->expected_us = timestamp_us + BENCH_HISTORY_STEP_US;
+    shadow->calls++;
+}
+
+// Все снимки, оставшиеся в буфере, и промежутки между ними против теневой копии
+static int bench_history_verify(ModbusHistorian* history, int block, const uint16_t* shadow, uint32_t scans) {
+    ModbusHistoryStats stats;
+    modbus_history_stats(history, block, &stats);
+    int failures = 0;
+    uint16_t values[BENCH_HISTORY_REGS];
+    uint64_t snapshot_us;
+    // До самого старого снимка значений нет
+    if (modbus_history_value_at(history, block, stats.oldest_us - 1, BENCH_HISTORY_ADDRESS, BENCH_HISTORY_REGS, values,
+                                &snapshot_us) != MODBUS_ERR_VALUE) {
+        failures++;
+    }
+    uint32_t first = (uint32_t)(stats.oldest_us / BENCH_HISTORY_STEP_US) - 1;
+    if (first + stats.stored_records != scans) failures++;
+    for (uint32_t scan = first; scan < scans; scan++) {
+        uint64_t t = (uint64_t)(scan + 1) * BENCH_HISTORY_STEP_US;
+        uint16_t address = (uint16_t)(scan % 7);
+        uint16_t count = (uint16_t)(BENCH_HISTORY_REGS - address - scan % 5);
+        const uint16_t* expect = shadow + (size_t)scan * BENCH_HISTORY_REGS + address;
+        // Точно на метке и между метками - тот же снимок
+        for (uint64_t at = t; at < t + BENCH_HISTORY_STEP_US; at += BENCH_HISTORY_STEP_US / 2) {
+            if (modbus_history_value_at(history, block, at, BENCH_HISTORY_ADDRESS + address, count, values,
+                                        &snapshot_us) != MODBUS_OK ||
+                snapshot_us != t || memcmp(values, expect, count * sizeof(uint16_t)) != 0) {
+                failures++;
+            }
+        }
+    }
+    // Диапазон, начинающийся до самого старого снимка: разбор идёт по всем группам подряд
+    BenchHistoryShadow compare = { .shadow = shadow, .address = 3, .expected_us = stats.oldest_us };
+    uint64_t matched = 0;
+    if (modbus_history_query(history, block, 0, (uint64_t)scans * BENCH_HISTORY_STEP_US,
+                             BENCH_HISTORY_ADDRESS + compare.address, 30,
+                             bench_history_compare, &compare, &matched) != MODBUS_OK ||
+        matched != stats.stored_records || compare.calls != matched) {
+        failures++;
+    }
+    return failures + compare.errors;
+}
+
+// Историк с маленьким буфером: запись постоянно вытесняет старые группы, и записи
+// разной длины регулярно разрезаются концом кольцевого буфера. Каждые 500 сканов всё,
+// что осталось в буфере, сверяется с теневой копией записанных снимков
+static void bench_history_check(void) {
+    ModbusHistorian* history = modbus_history_create();
+    ModbusHistoryBlockConfig config = { .address = BENCH_HISTORY_ADDRESS, .count = BENCH_HISTORY_REGS,
+                                        .memory_bytes = 6000,
+                                        .keyframe_interval = 8 };
+    int block;
+    uint16_t* shadow = (uint16_t*)malloc((size_t)BENCH_HISTORY_SCANS * BENCH_HISTORY_REGS * sizeof(uint16_t));
+    if (history == NULL || shadow == NULL || modbus_history_add_block(history, &config, &block) != MODBUS_OK) {
+        bench_check_result("history", 1);
+        free(shadow);
+        modbus_history_free(history);
+        return;
+    }
+    int failures = 0;
+    uint16_t regs[BENCH_HISTORY_REGS];
+    for (int i = 0; i < BENCH_HISTORY_REGS; i++) regs[i] = (uint16_t)(i * 1000);
+    uint32_t seed = 7;
+    for (uint32_t scan = 0; scan < BENCH_HISTORY_SCANS; scan++) {
+        // Без изменений, несколько мелких, скачки через весь диапазон uint16_t
+        seed = seed * 1103515245u + 12345u;
+        int changes = (seed >> 16) % 4 == 0 ? 0 : (int)((seed >> 8) % (BENCH_HISTORY_REGS + 1));
+        for (int k = 0; k < changes; k++) {
+            seed = seed * 1103515245u + 12345u;
+            regs[(seed >> 8) % BENCH_HISTORY_REGS] += (seed >> 24) % 3 == 0 ? (uint16_t)(seed >> 4)
+                                                                           : (uint16_t)((seed >> 20) % 9) - 4;
+        }
+        memcpy(shadow + (size_t)scan * BENCH_HISTORY_REGS, regs, sizeof(regs));
+        if (modbus_history_record(history, block, (uint64_t)(scan + 1) * BENCH_HISTORY_STEP_US, regs) != MODBUS_OK) {
+            failures++;
+        }
+        if ((scan + 1) % 500 == 0) failures += bench_history_verify(history, block, shadow, scan + 1);
+    }
+
+    ModbusHistoryStats stats;
+    modbus_history_stats(history, block, &stats);
+    // Буфер прокручен многократно
+    if (stats.evicted_records == 0 || stats.records != BENCH_HISTORY_SCANS ||
+        stats.encoded_bytes < 10 * stats.capacity_bytes) {
+        failures++;
+    }
+    // Запросы вне блока
+    uint16_t values[BENCH_HISTORY_REGS];
+    if (modbus_history_value_at(history, block, stats.newest_us, BENCH_HISTORY_ADDRESS - 1, 2, values, NULL) != MODBUS_ERR_ADDRESS ||
+        modbus_history_value_at(history, block, stats.newest_us, BENCH_HISTORY_ADDRESS + BENCH_HISTORY_REGS - 1, 2,
+                                values, NULL) != MODBUS_ERR_ADDRESS) {
+        failures++;
+    }
+    printf("history check %u scans, %llu kept, %llu evicted, ring %llu bytes\n", BENCH_HISTORY_SCANS,
+           (unsigned long long)stats.stored_records, (unsigned long long)stats.evicted_records,
+           (unsigned long long)stats.capacity_bytes);
+    bench_check_result("history", failures);
+    free(shadow);
+    modbus_history_free(history);
+}
+
+typedef struct {
+    uint8_t frames[8][MODBUS_MAX_ADU_SIZE];
+    uint16_t lengths[8];
+    uint32_t count;
+} BenchRtuLog;
+
+static void bench_rtu_frame(void* user, const uint8_t* adu, uint16_t length, uint64_t timestamp_us) {
+    BenchRtuLog* log = (BenchRtuLog*)user;
+    (void)timestamp_us;
+    if (log->count < 8) {
+        memcpy(log->frames[log->count], adu, length);
+        log->lengths[log->count] = length;
+    }
+    log->count++;
+}
+
+// Сборщик RTU после помех: мусор с правдоподобным заголовком (в том числе с длиной, которая
+// так и не придёт), обрывки и кадры с неверным CRC перед верным кадром - сразу за ним или
+// через паузу. Каждый верный кадр должен быть найден.
+static void bench_rtu_resync_check(void) {
+    static const uint8_t noise[][24] = {
+        { 0x01, 0x10, 0x00, 0x00, 0x00, 0x01, 0xF0 },                     // FC10 на 240 байт данных
+        { 0x01, 0x03 },
+        { 0xFF, 0xFF, 0xFF },
+        { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00 },               // FC03 с неверным CRC
+        { 0x01, 0x0F, 0x00, 0x10, 0x07, 0xD0, 0xFA, 0x55, 0x55 },         // FC0F: 250 байт
+        { 0x11, 0x17, 0x00, 0x00, 0x00, 0x02, 0x00, 0x05, 0x00, 0x01, 0x02, 0x12 },
+        { 0x00, 0x42, 0x9A, 0x01, 0x2B, 0x0E, 0x01, 0x00, 0x77, 0x13, 0xC4, 0xE9, 0x5D, 0x01, 0x06 },
+    };
+    static const uint8_t noise_lengths[] = { 7, 2, 3, 8, 9, 12, 15 };
+    enum { NOISE = sizeof(noise_lengths) };
+    uint8_t coils[2] = { 0xA5, 0x01 };
+    uint8_t regs[6] = { 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC };
+    ModbusFrame frames[] = {
+        { .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 0, .quantity = 10 },
+        { .slave_id = 1, .function_code = FC_WRITE_SINGLE_REG, .address = 7, .quantity = 0x1234 },
+        { .slave_id = 17, .function_code = FC_WRITE_MULT_REG, .address = 100, .quantity = 3,
+          .data = regs, .data_length = 6 },
+        { .slave_id = 2, .function_code = FC_WRITE_MULT_COILS, .address = 3, .quantity = 9,
+          .data = coils, .data_length = 2 },
+        { .slave_id = 1, .function_code = FC_READ_COILS, .address = 60, .quantity = 10 },
+    };
+    enum { FRAMES = sizeof(frames) / sizeof(frames[0]) };
+
+    ModbusRtuFramer framer;
+    BenchRtuLog log;
+    int failures = 0, recovered = 0, cases = 0;
+    uint64_t now = 1000000;
+    // gap = 0: помеха и кадр одним куском; иначе - пауза gap мкс между ними
+    static const uint32_t gaps[] = { 0, 300, 5000 };
+    for (size_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+        for (int n = 0; n < NOISE; n++) {
+            for (int f = 0; f < FRAMES; f++) {
+                uint8_t adu[MODBUS_MAX_ADU_SIZE];
+                uint16_t length;
+                modbus_create_request(&frames[f], adu, &length);
+                memset(&log, 0, sizeof(log));
+                modbus_rtu_framer_init(&framer, 19200, MODBUS_RTU_REQUESTS, bench_rtu_frame, &log);
+                if (gaps[g] == 0) {
+                    uint8_t stream[2 * MODBUS_MAX_ADU_SIZE];
+                    memcpy(stream, noise[n], noise_lengths[n]);
+                    memcpy(stream + noise_lengths[n], adu, length);
+                    now += (noise_lengths[n] + length) * framer.char_time_us;
+                    modbus_rtu_framer_feed(&framer, stream, noise_lengths[n] + length, now);
+                } else {
+                    now += noise_lengths[n] * framer.char_time_us;
+                    modbus_rtu_framer_feed(&framer, noise[n], noise_lengths[n], now);
+                    now += gaps[g] + length * framer.char_time_us;
+                    modbus_rtu_framer_feed(&framer, adu, length, now);
+                }
+                now += 10000;
+                modbus_rtu_framer_poll(&framer, now);
+                cases++;
+                // Кадр должен быть последним найденным: помеха перед ним может случайно
+                // оказаться кадром, но не может его поглотить
+                if (log.count >= 1 && log.count <= 8 && log.lengths[log.count - 1] == length &&
+                    memcmp(log.frames[log.count - 1], adu, length) == 0 && framer.length == 0) {
+                    recovered++;
+                } else {
+                    failures++;
+                }
+            }
+        }
+    }
+    printf("rtu resync %d of %d frames recovered after noise\n", recovered, cases);
+    bench_check_result("rtu resync", failures);
+}
+
+// Известная смесь запросов одного потока: чтения, записи, чтения за границей таблицы
+// (исключение) и кадры RTU с испорченным CRC
+#define BENCH_STATS_READS       300
+#define BENCH_STATS_WRITES      200
+#define BENCH_STATS_FAULTS      50
+#define BENCH_STATS_CRC         10
+#define BENCH_STATS_THREADS     4
+
+static void* bench_stats_thread(void* arg) {
+    ModbusDevice* device = (ModbusDevice*)arg;
+    uint16_t values[MODBUS_MAX_READ_REGS];
+    intptr_t failures = 0;
+    for (int i = 0; i < BENCH_STATS_READS + BENCH_STATS_WRITES + BENCH_STATS_FAULTS; i++) {
+        ModbusResponse response = { .values = values, .values_capacity = MODBUS_MAX_READ_REGS };
+        ModbusFrame frame;
+        int expected = MODBUS_OK;
+        if (i < BENCH_STATS_READS) {
+            frame = (ModbusFrame){ .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 0, .quantity = 10 };
+        } else if (i < BENCH_STATS_READS + BENCH_STATS_WRITES) {
+            frame = (ModbusFrame){ .slave_id = 1, .function_code = FC_WRITE_SINGLE_REG, .address = 5,
+                                   .quantity = (uint16_t)i };
+        } else {
+            frame = (ModbusFrame){ .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 95, .quantity = 10 };
+            expected = MODBUS_ERR_ADDRESS;
+        }
+        if (bench_exchange(device, &frame, &response) != expected) failures++;
+    }
+    ModbusFrame read = { .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 0, .quantity = 10 };
+    for (int i = 0; i < BENCH_STATS_CRC; i++) {
+        uint8_t adu[MODBUS_MAX_ADU_SIZE], reply[MODBUS_MAX_ADU_SIZE];
+        uint16_t length, reply_length;
+        modbus_create_request(&read, adu, &length);
+        adu[length - 1] ^= 0x5A;
+        if (modbus_process_response_from_master(device, adu, length, reply, &reply_length) != MODBUS_ERR_CRC) failures++;
+    }
+    return (void*)failures;
+}
+
+// Статистика: точные счётчики при записи из нескольких потоков в свои и общую копии
+// (потоков больше, чем копий), порядок процентилей задержки, сброс
+static void bench_stats_check(void) {
+    ModbusDevice* device = modbus_init_device(100, 0, 0, 0);
+    int failures = 0;
+    if (modbus_device_enable_stats(device, 2, 0) != MODBUS_OK) failures++;
+
+    pthread_t threads[BENCH_STATS_THREADS];
+    for (int t = 0; t < BENCH_STATS_THREADS; t++) {
+        pthread_create(&threads[t], NULL, bench_stats_thread, device);
+    }
+    for (int t = 0; t < BENCH_STATS_THREADS; t++) {
+        void* result;
+        pthread_join(threads[t], &result);
+        if ((intptr_t)result != 0) failures++;
+    }
+
+    static ModbusStatsSnapshot snapshot;
+    modbus_stats_snapshot(device, &snapshot);
+    const ModbusFcStats* reads = &snapshot.fc[modbus_stats_slot(FC_READ_HOLDING_REG)];
+    const ModbusFcStats* writes = &snapshot.fc[modbus_stats_slot(FC_WRITE_SINGLE_REG)];
+    if (reads->requests != (uint64_t)BENCH_STATS_THREADS * (BENCH_STATS_READS + BENCH_STATS_FAULTS) ||
+        reads->exceptions != (uint64_t)BENCH_STATS_THREADS * BENCH_STATS_FAULTS ||
+        reads->crc_errors != (uint64_t)BENCH_STATS_THREADS * BENCH_STATS_CRC ||
+        writes->requests != (uint64_t)BENCH_STATS_THREADS * BENCH_STATS_WRITES ||
+        writes->exceptions != 0 || writes->crc_errors != 0) {
+        failures++;
+    }
+    uint64_t others = 0;
+    for (int f = 0; f < MODBUS_STATS_FC_SLOTS; f++) {
+        const ModbusFcStats* fc = &snapshot.fc[f];
+        if (fc != reads && fc != writes) others += fc->requests + fc->exceptions + fc->crc_errors;
+        // Замеряется каждый запрос: в гистограмме столько же записей
+        uint64_t samples = 0, max_ns = 0;
+        for (unsigned b = 0; b < MODBUS_STATS_BUCKETS; b++) {
+            samples += fc->latency[b];
+            if (fc->latency[b] != 0) max_ns = modbus_stats_bucket_upper_ns(b);
+        }
+        if (samples != fc->requests) failures++;
+        uint64_t p50 = modbus_stats_percentile_ns(fc, 0.5);
+        uint64_t p99 = modbus_stats_percentile_ns(fc, 0.99);
+        if (p50 > p99 || p99 > max_ns) failures++;
+    }
+    if (others != 0) failures++;
+    printf("stats %llu requests, p50 %llu ns p99 %llu ns\n", (unsigned long long)(reads->requests + writes->requests),
+           (unsigned long long)modbus_stats_percentile_ns(reads, 0.5),
+           (unsigned long long)modbus_stats_percentile_ns(reads, 0.99));
+
+    // После сброса учитываются только новые запросы
+    modbus_stats_reset(device);
+    modbus_stats_snapshot(device, &snapshot);
+    for (int f = 0; f < MODBUS_STATS_FC_SLOTS; f++) {
+        if (snapshot.fc[f].requests != 0 || modbus_stats_percentile_ns(&snapshot.fc[f], 0.5) != 0) failures++;
+    }
+    if (bench_stats_thread(device) != NULL) failures++;
+    modbus_stats_snapshot(device, &snapshot);
+    if (reads->requests != BENCH_STATS_READS + BENCH_STATS_FAULTS || reads->crc_errors != BENCH_STATS_CRC ||
+        writes->requests != BENCH_STATS_WRITES) {
+        failures++;
+    }
+    bench_check_result("stats", failures);
+    modbus_free_device(device);
+}
+
+// FC22/23/24 против модели: маскированная запись (reg & AND) | (OR & ~AND), запись FC23
+// до чтения при пересечении диапазонов, границы очереди FC24 (0..31 значений, > 31 - ILLEGAL_VALUE)
+static void bench_functions_check(void) {
+    enum { REGS = 200, FIFO = 150 };
+    ModbusDevice* device = modbus_init_device(REGS, 0, 0, 0);
+    uint16_t values[MODBUS_MAX_READ_REGS];
+    int failures = 0;
+    uint32_t seed = 0x2545F491u;
+
+    for (int i = 0; i < 500; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        uint16_t address = (uint16_t)(seed % REGS);
+        uint16_t current = (uint16_t)(seed >> 8);
+        seed = seed * 1664525u + 1013904223u;
+        uint16_t and_mask = (uint16_t)seed, or_mask = (uint16_t)(seed >> 16);
+        // Крайние маски: только AND, только OR
+        if (i % 50 == 1) and_mask = 0;
+        if (i % 50 == 2) and_mask = 0xFFFF;
+        device->holding_registers[address] = current;
+        uint8_t masks[4] = { and_mask >> 8, and_mask & 0xFF, or_mask >> 8, or_mask & 0xFF };
+        ModbusFrame frame = { .slave_id = 1, .function_code = FC_MASK_WRITE_REG, .address = address,
+                              .data = masks, .data_length = 4 };
+        ModbusResponse response = { 0 };
+        if (bench_exchange(device, &frame, &response) != MODBUS_OK || response.address != address ||
+            device->holding_registers[address] != (uint16_t)((current & and_mask) | (or_mask & ~and_mask))) {
+            failures++;
+        }
+    }
+    uint8_t masks[4] = { 0 };
+    ModbusFrame mask_out = { .slave_id = 1, .function_code = FC_MASK_WRITE_REG, .address = REGS,
+                             .data = masks, .data_length = 4 };
+    ModbusResponse response = { .values = values, .values_capacity = MODBUS_MAX_READ_REGS };
+    if (bench_exchange(device, &mask_out, &response) != MODBUS_ERR_ADDRESS) failures++;
+
+    // FC23: чтение [read, read + 20) и запись [write, write + 10) со всеми сдвигами пересечения
+    for (int shift = -12; shift <= 22; shift++) {
+        uint16_t read_address = 40, write_address = (uint16_t)(40 + shift);
+        for (uint16_t r = 0; r < REGS; r++) device->holding_registers[r] = (uint16_t)(0x1000 + r);
+        uint8_t data[20];
+        for (int k = 0; k < 10; k++) {
+            data[2 * k] = 0xB0;
+            data[2 * k + 1] = (uint8_t)(shift + 12 + k);
+        }
+        ModbusFrame frame = { .slave_id = 1, .function_code = FC_READ_WRITE_MULT_REG, .address = read_address,
+                              .quantity = 20, .write_address = write_address, .write_quantity = 10,
+                              .data = data, .data_length = sizeof(data) };
+        response = (ModbusResponse){ .values = values, .values_capacity = MODBUS_MAX_READ_REGS };
+        if (bench_exchange(device, &frame, &response) != MODBUS_OK || response.value_count != 20) {
+            failures++;
+            continue;
+        }
+        for (uint16_t r = 0; r < REGS; r++) {
+            bool written = r >= write_address && r < write_address + 10;
+            uint16_t expected = written ? (uint16_t)(0xB000 | (uint8_t)(shift + 12 + r - write_address))
+                                        : (uint16_t)(0x1000 + r);
+            if (device->holding_registers[r] != expected) failures++;
+            if (r >= read_address && r < read_address + 20 && values[r - read_address] != expected) failures++;
+        }
+    }
+    uint8_t data[20] = { 0 };
+    ModbusFrame rw_out = { .slave_id = 1, .function_code = FC_READ_WRITE_MULT_REG, .address = 0, .quantity = 1,
+                           .write_address = REGS - 5, .write_quantity = 10, .data = data, .data_length = sizeof(data) };
+    if (bench_exchange(device, &rw_out, &response) != MODBUS_ERR_ADDRESS) failures++;
+
+    // FC24: указатель - число значений, следом значения
+    for (uint16_t count = 0; count <= MODBUS_MAX_FIFO_COUNT + 2; count++) {
+        device->holding_registers[FIFO] = count;
+        for (uint16_t k = 0; k < MODBUS_MAX_FIFO_COUNT + 2 && FIFO + 1 + k < REGS; k++) {
+            device->holding_registers[FIFO + 1 + k] = (uint16_t)(count * 100 + k);
+        }
+        ModbusFrame frame = { .slave_id = 1, .function_code = FC_READ_FIFO_QUEUE, .address = FIFO };
+        response = (ModbusResponse){ .values = values, .values_capacity = MODBUS_MAX_READ_REGS };
+        int status = bench_exchange(device, &frame, &response);
+        if (count > MODBUS_MAX_FIFO_COUNT) {
+            if (status != MODBUS_ERR_VALUE || modbus_exception_code(status) != MODBUS_EXC_ILLEGAL_VALUE) failures++;
+            continue;
+        }
+        if (status != MODBUS_OK || response.quantity != count || response.value_count != count) {
+            failures++;
+            continue;
+        }
+        for (uint16_t k = 0; k < count; k++) {
+            if (values[k] != count * 100 + k) failures++;
+        }
+    }
+    // Очередь выходит за конец таблицы; указатель за таблицей
+    device->holding_registers[REGS - 3] = 5;
+    ModbusFrame fifo_tail = { .slave_id = 1, .function_code = FC_READ_FIFO_QUEUE, .address = REGS - 3 };
+    if (bench_exchange(device, &fifo_tail, &response) != MODBUS_ERR_ADDRESS) failures++;
+    device->holding_registers[REGS - 3] = 2;
+    if (bench_exchange(device, &fifo_tail, &response) != MODBUS_OK || response.quantity != 2) failures++;
+    ModbusFrame fifo_out = { .slave_id = 1, .function_code = FC_READ_FIFO_QUEUE, .address = REGS };
+    if (bench_exchange(device, &fifo_out, &response) != MODBUS_ERR_ADDRESS) failures++;
+
+    bench_check_result("fc22-24", failures);
+    modbus_free_device(device);
+}
+
+// Шаблоны запросов: после случайных правок unit id, transaction id и данных записи ADU
+// (вместе с инкрементальным CRC) совпадает с запросом, заново собранным modbus_create_request
+static void bench_template_check(void) {
+    static const struct {
+        uint8_t function_code;
+        uint16_t quantity;
+        uint16_t payload;           // байт данных записи
+    } cases[] = {
+        { FC_WRITE_SINGLE_COIL, 1, 2 }, { FC_WRITE_SINGLE_REG, 0x1234, 2 },
+        { FC_WRITE_MULT_COILS, 1, 1 }, { FC_WRITE_MULT_COILS, 1968, 246 },
+        { FC_WRITE_MULT_REG, 1, 2 }, { FC_WRITE_MULT_REG, 37, 74 }, { FC_WRITE_MULT_REG, 123, 246 },
+        { FC_MASK_WRITE_REG, 1, 4 }, { FC_READ_WRITE_MULT_REG, 10, 2 }, { FC_READ_WRITE_MULT_REG, 10, 242 },
+        { FC_READ_HOLDING_REG, 125, 0 },
+    };
+    int failures = 0, patches = 0;
+    uint32_t seed = 0x9E3779B9u;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        for (int transport = MODBUS_TEMPLATE_RTU; transport <= MODBUS_TEMPLATE_TCP; transport++) {
+            uint8_t shadow[MODBUS_TEMPLATE_MAX_ADU] = { 0 };
+            // FC05/06 кодируют значение из quantity
+            if (cases[c].function_code == FC_WRITE_SINGLE_COIL) shadow[0] = 0xFF;
+            if (cases[c].function_code == FC_WRITE_SINGLE_REG) {
+                shadow[0] = 0x12;
+                shadow[1] = 0x34;
+            }
+            ModbusFrame frame = { .slave_id = 1, .function_code = cases[c].function_code, .address = 100,
+                                  .quantity = cases[c].quantity, .data = shadow, .data_length = cases[c].payload };
+            if (frame.function_code == FC_READ_WRITE_MULT_REG) {
+                frame.write_address = 300;
+                frame.write_quantity = cases[c].payload / 2;
+            }
+            ModbusRequestTemplate tpl;
+            if (modbus_template_compile(&tpl, (ModbusTemplateTransport)transport, &frame) != MODBUS_OK) {
+                failures++;
+                continue;
+            }
+            uint16_t transaction_id = 0;
+            for (int round = 0; round < 300; round++) {
+                seed = seed * 1664525u + 1013904223u;
+                uint32_t r = seed >> 8;
+                if (r % 4 == 0) {
+                    frame.slave_id = (uint8_t)(r >> 4);
+                    modbus_template_set_unit(&tpl, frame.slave_id);
+                } else if (r % 4 == 1 && transport == MODBUS_TEMPLATE_TCP) {
+                    transaction_id = (uint16_t)(r >> 4);
+                    modbus_template_set_transaction(&tpl, transaction_id);
+                } else if (cases[c].function_code == FC_WRITE_SINGLE_COIL) {
+                    uint8_t value[2] = { (r & 0x10) ? 0xFF : 0x00, 0x00 };
+                    if (modbus_template_patch_payload(&tpl, 0, value, 2) != MODBUS_OK) failures++;
+                    memcpy(shadow, value, 2);
+                } else if (cases[c].payload != 0) {
+                    // Правка [offset, offset + length) случайными байтами, в том числе у концов данных
+                    uint16_t offset = (uint16_t)((r >> 4) % cases[c].payload);
+                    uint16_t length = (uint16_t)(1 + (r >> 12) % (cases[c].payload - offset));
+                    if (r & 0x8) offset = 0;
+                    uint8_t bytes[MODBUS_TEMPLATE_MAX_ADU];
+                    for (uint16_t i = 0; i < length; i++) {
+                        seed = seed * 1664525u + 1013904223u;
+                        bytes[i] = (uint8_t)(seed >> 24);
+                    }
+                    if (modbus_template_patch_payload(&tpl, offset, bytes, length) != MODBUS_OK) failures++;
+                    memcpy(shadow + offset, bytes, length);
+                }
+                if (cases[c].function_code == FC_WRITE_SINGLE_COIL) frame.quantity = shadow[0] ? 1 : 0;
+                if (cases[c].function_code == FC_WRITE_SINGLE_REG) frame.quantity = (uint16_t)((shadow[0] << 8) | shadow[1]);
+
+                uint8_t expected[MODBUS_TCP_MAX_ADU_SIZE];
+                uint16_t expected_length, length;
+                int status = transport == MODBUS_TEMPLATE_RTU
+                    ? modbus_create_request(&frame, expected, &expected_length)
+                    : modbus_tcp_create_request(&frame, transaction_id, expected, &expected_length);
+                const uint8_t* adu = modbus_template_adu(&tpl, &length);
+                if (status != MODBUS_OK || length != expected_length || memcmp(adu, expected, length) != 0 ||
+                    modbus_template_frame(&tpl)->slave_id != frame.slave_id ||
+                    modbus_template_frame(&tpl)->quantity != frame.quantity) {
+                    failures++;
+                }
+                patches++;
+            }
+        }
+    }
+    // Недопустимые правки не меняют шаблон
+    uint8_t on[2] = { 0xFF, 0x00 };
+    ModbusFrame coil = { .slave_id = 1, .function_code = FC_WRITE_SINGLE_COIL, .address = 5, .quantity = 1,
+                         .data = on, .data_length = 2 };
+    ModbusRequestTemplate tpl;
+    modbus_template_compile(&tpl, MODBUS_TEMPLATE_RTU, &coil);
+    uint8_t bad[2] = { 0x12, 0x34 };
+    uint8_t expected[MODBUS_MAX_ADU_SIZE];
+    uint16_t expected_length, length;
+    modbus_create_request(&coil, expected, &expected_length);
+    const uint8_t* adu = modbus_template_adu(&tpl, &length);
+    if (modbus_template_patch_payload(&tpl, 0, bad, 2) != MODBUS_ERR_VALUE ||
+        modbus_template_patch_payload(&tpl, 1, bad, 2) != MODBUS_ERR_VALUE ||
+        length != expected_length || memcmp(adu, expected, length) != 0) {
+        failures++;
+    }
+    printf("template %d patched requests rebuilt\n", patches);
+    bench_check_result("template", failures);
+}
+
+// Упакованные биты: запись и чтение с любым сдвигом внутри слова и через границы 64-битных
+// слов против модели "байт на бит"; соседние биты не меняются, хвост последнего байта - нули
+static void bench_bits_check(void) {
+    enum { BITS = 4096, WORDS = BITS / 64, ROUNDS = 4000 };
+    static uint64_t bits[WORDS];
+    static uint8_t model[BITS];
+    int failures = 0;
+    uint32_t seed = 0xB5297A4Du;
+    memset(bits, 0, sizeof(bits));
+    memset(model, 0, sizeof(model));
+
+    for (int round = 0; round < ROUNDS; round++) {
+        seed = seed * 1664525u + 1013904223u;
+        uint16_t address, count;
+        if (round == 0) {
+            address = 60;
+            count = 10;
+        } else if (round < 128) {
+            // Сдвиги 56..63 перед границей слова
+            address = (uint16_t)(64 * (1 + round % 8) - 8 + round / 16);
+            count = (uint16_t)(1 + round % 70);
+        } else {
+            address = (uint16_t)((seed >> 8) % (BITS - 1));
+            count = (uint16_t)(1 + (seed >> 20) % MODBUS_MAX_WRITE_BITS);
+        }
+        if (address + count > BITS) count = (uint16_t)(BITS - address);
+
+        uint8_t src[MODBUS_MAX_WRITE_BITS / 8 + 2];
+        for (unsigned i = 0; i < sizeof(src); i++) {
+            seed = seed * 1664525u + 1013904223u;
+            src[i] = (uint8_t)(seed >> 24);
+        }
+        modbus_bits_write(bits, address, count, src);
+        for (uint16_t i = 0; i < count; i++) model[address + i] = (src[i / 8] >> (i % 8)) & 1;
+
+        // Чтение другого диапазона, пересекающего записанный
+        seed = seed * 1664525u + 1013904223u;
+        uint16_t read_address = (uint16_t)(address > 70 ? address - (seed >> 8) % 70 : address);
+        uint16_t read_count = (uint16_t)(1 + (seed >> 16) % (MODBUS_MAX_READ_BITS));
+        if (read_address + read_count > BITS) read_count = (uint16_t)(BITS - read_address);
+        uint8_t dst[MODBUS_MAX_READ_BITS / 8 + 2];
+        memset(dst, 0xA5, sizeof(dst));
+        uint16_t bytes = (uint16_t)((read_count + 7) / 8);
+        modbus_bits_read(bits, read_address, read_count, dst);
+        for (uint16_t i = 0; i < bytes * 8; i++) {
+            uint8_t expected = i < read_count ? model[read_address + i] : 0;
+            if (((dst[i / 8] >> (i % 8)) & 1) != expected) failures++;
+        }
+        if (dst[bytes] != 0xA5) failures++;
+    }
+    for (uint32_t i = 0; i < BITS; i++) {
+        if (((bits[i / 64] >> (i % 64)) & 1) != model[i]) failures++;
+    }
+    bench_check_result("bits", failures);
+}
+
+// Разбор ответов: по одному искажённому кадру на каждый код ошибки modbus_decode_response
+// и modbus_decode_pdu. crc: 1 - дописать верный CRC, 0 - испорченный
+typedef struct {
+    const char* name;
+    uint8_t request;            // индекс запроса в bench_decode_requests
+    uint8_t length;             // адрес slave + PDU без CRC
+    uint8_t pdu[12];
+    uint8_t crc;
+    uint8_t capacity;           // values_capacity
+    int status;
+    uint8_t exception_code;
+} BenchDecodeCase;
+
+static void bench_decode_check(void) {
+    static const ModbusFrame requests[] = {
+        { .slave_id = 1, .function_code = FC_READ_HOLDING_REG, .address = 10, .quantity = 2 },
+        { .slave_id = 1, .function_code = FC_READ_COILS, .address = 0, .quantity = 10 },
+        { .slave_id = 1, .function_code = FC_WRITE_SINGLE_REG, .address = 7, .quantity = 0x1234 },
+    };
+    static const BenchDecodeCase cases[] = {
+        { "ok",               0, 7, { 1, 0x03, 4, 0x00, 0x01, 0x00, 0x02 }, 1, 8, MODBUS_OK, 0 },
+        { "crc",              0, 7, { 1, 0x03, 4, 0x00, 0x01, 0x00, 0x02 }, 0, 8, MODBUS_ERR_CRC, 0 },
+        { "exception",        0, 3, { 1, 0x83, MODBUS_EXC_ILLEGAL_ADDRESS }, 1, 8, MODBUS_ERR_EXCEPTION,
+          MODBUS_EXC_ILLEGAL_ADDRESS },
+        { "exception long",   0, 4, { 1, 0x83, MODBUS_EXC_ILLEGAL_ADDRESS, 0 }, 1, 8, MODBUS_ERR_VALUE, 0 },
+        { "slave",            0, 7, { 2, 0x03, 4, 0x00, 0x01, 0x00, 0x02 }, 1, 8, MODBUS_ERR_MISMATCH, 0 },
+        { "function",         0, 7, { 1, 0x04, 4, 0x00, 0x01, 0x00, 0x02 }, 1, 8, MODBUS_ERR_MISMATCH, 0 },
+        { "exception slave",  0, 3, { 2, 0x83, MODBUS_EXC_ILLEGAL_ADDRESS }, 1, 8, MODBUS_ERR_MISMATCH, 0 },
+        { "short",            0, 2, { 1, 0x03 }, 1, 8, MODBUS_ERR_VALUE, 0 },
+        { "truncated",        0, 6, { 1, 0x03, 4, 0x00, 0x01, 0x00 }, 1, 8, MODBUS_ERR_VALUE, 0 },
+        { "byte count",       0, 7, { 1, 0x03, 6, 0x00, 0x01, 0x00, 0x02 }, 1, 8, MODBUS_ERR_VALUE, 0 },
+        { "odd byte count",   0, 6, { 1, 0x03, 3, 0x00, 0x01, 0x00 }, 1, 8, MODBUS_ERR_VALUE, 0 },
+        { "quantity",         0, 5, { 1, 0x03, 2, 0x00, 0x01 }, 1, 8, MODBUS_ERR_MISMATCH, 0 },
+        { "capacity",         0, 7, { 1, 0x03, 4, 0x00, 0x01, 0x00, 0x02 }, 1, 1, MODBUS_ERR_VALUE, 0 },
+        { "coil bytes",       1, 6, { 1, 0x01, 3, 0xFF, 0x03, 0x00 }, 1, 16, MODBUS_ERR_MISMATCH, 0 },
+        { "coil ok",          1, 5, { 1, 0x01, 2, 0xFF, 0x03 }, 1, 16, MODBUS_OK, 0 },
+        { "echo",             2, 6, { 1, 0x06, 0x00, 0x07, 0x12, 0x35 }, 1, 8, MODBUS_ERR_MISMATCH, 0 },
+        { "echo length",      2, 5, { 1, 0x06, 0x00, 0x07, 0x12 }, 1, 8, MODBUS_ERR_VALUE, 0 },
+    };
+    int failures = 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const BenchDecodeCase* test = &cases[c];
+        const ModbusFrame* request = &requests[test->request];
+        uint8_t adu[sizeof(test->pdu) + MODBUS_CRC_SIZE];
+        memcpy(adu, test->pdu, test->length);
+        uint16_t crc = modbus_crc16(adu, test->length) ^ (test->crc ? 0 : 0x0100);
+        adu[test->length] = crc & 0xFF;
+        adu[test->length + 1] = (crc >> 8) & 0xFF;
+
+        uint16_t values[16];
+        ModbusResponse response = { .values = values, .values_capacity = test->capacity };
+        int status = modbus_decode_response(request, adu, test->length + MODBUS_CRC_SIZE, &response);
+        bool ok = status == test->status && response.exception_code == test->exception_code;
+        if (status == MODBUS_OK) {
+            ok = ok && response.slave_id == 1 && response.function_code == request->function_code &&
+                 response.value_count == request->quantity;
+        }
+        if (status == MODBUS_ERR_EXCEPTION) ok = ok && response.function_code == request->function_code;
+        // Без CRC: тот же результат, кроме самой ошибки CRC
+        if (test->crc) {
+            ModbusResponse pdu_response = { .values = values, .values_capacity = test->capacity };
+            ok = ok && modbus_decode_pdu(request, adu, test->length, &pdu_response) == test->status &&
+                 pdu_response.exception_code == test->exception_code;
+        }
+        if (!ok) {
+            printf("decode case \"%s\": status %d, expected %d\n", test->name, status, test->status);
+            failures++;
+        }
+    }
+    // Значения первого случая и биты ответа FC01
+    uint8_t regs[] = { 1, 0x03, 4, 0xAB, 0xCD, 0x00, 0x02, 0, 0 };
+    uint16_t crc = modbus_crc16(regs, 7);
+    regs[7] = crc & 0xFF;
+    regs[8] = crc >> 8;
+    uint16_t values[16];
+    ModbusResponse response = { .values = values, .values_capacity = 16 };
+    if (modbus_decode_response(&requests[0], regs, sizeof(regs), &response) != MODBUS_OK ||
+        values[0] != 0xABCD || values[1] != 0x0002 || response.address != 10) {
+        failures++;
+    }
+    uint8_t coils[] = { 1, 0x01, 2, 0x35, 0x02 };
+    if (modbus_decode_pdu(&requests[1], coils, sizeof(coils), &response) != MODBUS_OK ||
+        response.value_count != 10 || values[0] != 1 || values[1] != 0 || values[2] != 1 || values[9] != 1) {
+        failures++;
+    }
+    // Кадр короче минимального ADU
+    uint8_t tiny[] = { 1, 0x03, 0x00 };
+    if (modbus_decode_response(&requests[0], tiny, sizeof(tiny), &response) != MODBUS_ERR_VALUE) failures++;
+    bench_check_result("decode", failures);
+}
+
+// Порядок пакета: кадры одного unit выполняются в порядке подачи, широковещательные - между
+// соседними кадрами. Запись FC06 в регистр 0 unit, широковещательная запись в регистр 1,
+// чтение FC03 регистров 0..1 должно вернуть последние записи перед ним по порядку подачи
+#define BENCH_ORDER_UNITS       7
+#define BENCH_ORDER_FRAMES      3000
+
+static void bench_batch_order_check(void) {
+    ModbusUnitRegistry registry;
+    modbus_registry_init(&registry);
+    ModbusDevice* devices[BENCH_ORDER_UNITS];
+    for (int u = 0; u < BENCH_ORDER_UNITS; u++) {
+        devices[u] = modbus_init_device(4, 0, 0, 0);
+        modbus_registry_add(&registry, (uint8_t)(u + 1), devices[u]);
+    }
+
+    static ModbusFrame requests[BENCH_ORDER_FRAMES];
+    static uint8_t adus[BENCH_ORDER_FRAMES][8];
+    static uint8_t responses[BENCH_ORDER_FRAMES][MODBUS_MAX_ADU_SIZE];
+    static uint16_t expected[BENCH_ORDER_FRAMES][2];
+    static ModbusBatchFrame frames[BENCH_ORDER_FRAMES];
+    uint16_t unit_value[BENCH_ORDER_UNITS] = { 0 };
+    uint16_t broadcast_value = 0;
+    uint32_t seed = 4242;
+    for (int i = 0; i < BENCH_ORDER_FRAMES; i++) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t r = seed >> 8;
+        ModbusFrame* frame = &requests[i];
+        if (r % 50 == 0) {
+            *frame = (ModbusFrame){ .slave_id = MODBUS_BROADCAST_UNIT, .function_code = FC_WRITE_SINGLE_REG,
+                                    .address = 1, .quantity = ++broadcast_value };
+        } else {
+            int u = (int)((r >> 8) % BENCH_ORDER_UNITS);
+            if (r % 2 == 0) {
+                *frame = (ModbusFrame){ .slave_id = (uint8_t)(u + 1), .function_code = FC_WRITE_SINGLE_REG,
+                                        .address = 0, .quantity = (uint16_t)(i + 1) };
+                unit_value[u] = (uint16_t)(i + 1);
+            } else {
+                *frame = (ModbusFrame){ .slave_id = (uint8_t)(u + 1), .function_code = FC_READ_HOLDING_REG,
+                                        .address = 0, .quantity = 2 };
+                expected[i][0] = unit_value[u];
+                expected[i][1] = broadcast_value;
+            }
+        }
+        uint16_t length;
+        modbus_create_request(frame, adus[i], &length);
+        frames[i] = (ModbusBatchFrame){ .rx = adus[i], .rx_length = length, .tx = responses[i] };
+    }
+
+    int failures = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned max_threads = cpus > 4 ? (unsigned)cpus : 4;
+    // threads = 0 - modbus_registry_process_batch без пула
+    for (unsigned threads = 0; threads <= max_threads; threads = threads ? threads * 2 : 1) {
+        for (int u = 0; u < BENCH_ORDER_UNITS; u++) memset(devices[u]->holding_registers, 0, 4 * sizeof(uint16_t));
+        for (int i = 0; i < BENCH_ORDER_FRAMES; i++) frames[i].tx_length = 0;
+        ModbusWorkerPool* pool = threads ? modbus_worker_pool_create(threads) : NULL;
+        if (threads != 0 && pool == NULL) {
+            failures++;
+            break;
+        }
+        if (pool != NULL) {
+            modbus_worker_pool_process(pool, &registry, frames, BENCH_ORDER_FRAMES);
+        } else {
+            modbus_registry_process_batch(&registry, frames, BENCH_ORDER_FRAMES);
+        }
+        for (int i = 0; i < BENCH_ORDER_FRAMES; i++) {
+            if (requests[i].slave_id == MODBUS_BROADCAST_UNIT) {
+                if (frames[i].tx_length != 0) failures++;
+                continue;
+            }
+            uint16_t values[2];
+            ModbusResponse response = { .values = values, .values_capacity = 2 };
+            if (frames[i].status != MODBUS_OK ||
+                modbus_decode_response(&requests[i], frames[i].tx, frames[i].tx_length, &response) != MODBUS_OK) {
+                failures++;
+                continue;
+            }
+            if (requests[i].function_code == FC_READ_HOLDING_REG &&
+                (values[0] != expected[i][0] || values[1] != expected[i][1])) {
+                failures++;
+            }
+        }
+        for (int u = 0; u < BENCH_ORDER_UNITS; u++) {
+            if (devices[u]->holding_registers[0] != unit_value[u] ||
+                devices[u]->holding_registers[1] != broadcast_value) {
+                failures++;
+            }
+        }
+        modbus_worker_pool_free(pool);
+    }
+    bench_check_result("batch", failures);
+    for (int u = 0; u < BENCH_ORDER_UNITS; u++) modbus_free_device(devices[u]);
+}
+
+int main(void) {
+    bench_plan_check();
+    bench_watch_check();
+    bench_cache_check();
+    bench_shm_check();
+    bench_capture_check();
+    bench_values_check();
+    bench_history_check();
+    bench_rtu_resync_check();
+    bench_stats_check();
+    bench_functions_check();
+    bench_template_check();
+    bench_bits_check();
+    bench_decode_check();
+    bench_batch_order_check();
+    bench_regs_block();
+    bench_fc03_full_read();
+    bench_unit_gateway(1000);
+    bench_sync_stress(2);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    bench_batch_scaling(cpus > 4 ? (unsigned)cpus : 4);
+    bench_tcp_throughput(1, 1, 20000);
+    bench_tcp_throughput(64, 16, 200);
+    bench_tcp_throughput(1000, 4, 20);
+    bench_tcp_master(1, 1, 20000);
+    bench_tcp_master(1, 64, 200000);
+    bench_tcp_master(100, 16, 200000);
+    bench_poller_farm(MODBUS_POLLER_IO_URING, 200, 2000);
+    bench_poller_farm(MODBUS_POLLER_EPOLL, 200, 2000);
+    bench_bridge(2000);
+    bench_history(16, 200000);
+    bench_history(64, 200000);
+    bench_history(256, 200000);
+    return bench_failures == 0 ? 0 : 1;
+}
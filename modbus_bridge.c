@@ -0,0 +1,645 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "modbus_bridge.h"
+#include "modbus_crc.h"
+#include "modbus_rtu.h"
+
+#define BRIDGE_MAX_EVENTS   256
+#define BRIDGE_CHAR_BITS    11      // символ RTU: старт + 8 бит + чётность/стоп + стоп
+
+typedef struct BridgeClient {
+    int fd;
+    uint32_t generation;        // меняется при закрытии: ответы прежнему клиенту отбрасываются
+    bool want_write;
+    uint16_t rx_length;
+    uint16_t tx_length;
+    uint16_t tx_sent;
+    struct BridgeClient* prev;
+    struct BridgeClient* next;
+    uint8_t rx[MODBUS_TCP_CONN_BUFFER];
+    uint8_t tx[MODBUS_TCP_CONN_BUFFER];   // только то, что не ушло сразу из буфера запроса
+} BridgeClient;
+
+// Запрос в пути: MBAP ADU -> RTU ADU -> ответ RTU -> MBAP ADU в одном buffer
+typedef struct {
+    uint8_t buffer[MODBUS_BRIDGE_BUFFER];
+    uint16_t length;            // длина MBAP ADU запроса, затем - принятые байты ответа RTU
+    uint16_t rtu_length;
+    uint16_t tx_sent;           // отправлено в линию
+    uint16_t transaction_id;
+    uint8_t unit;               // запроса: ответ в buffer затирает заголовок
+    uint8_t function;
+    BridgeClient* client;
+    uint32_t client_generation;
+    uint64_t received_us;
+    int next;
+} BridgeSlot;
+
+typedef struct {
+    int fd;
+    bool want_write;
+    uint32_t char_time_us;
+    uint32_t t35_us;
+    uint64_t timeout_us;
+    uint64_t queue_timeout_us;
+    int head;                   // очередь слотов
+    int tail;
+    int active;                 // запрос, ждущий ответа; -1 - линия свободна
+    bool sending;               // active ещё передаётся
+    uint64_t deadline_us;       // ответа active
+    uint64_t last_byte_us;
+    uint64_t idle_at_us;        // раньше нельзя начинать передачу (пауза t3.5)
+} BridgeLine;
+
+struct ModbusBridge {
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;
+    uint16_t port;
+    atomic_bool stop;
+    BridgeClient* active;
+    BridgeClient* free_list;
+    BridgeLine lines[MODBUS_BRIDGE_MAX_LINES];
+    int line_count;
+    int8_t routes[256];         // unit id -> линия, -1 - нет маршрута
+    BridgeSlot* slots;
+    int free_slot;
+    ModbusBridgeStats stats;
+};
+
+static uint64_t bridge_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int modbus_bridge_tcp_to_rtu(uint8_t* buffer, uint16_t tcp_length, uint16_t* rtu_length) {
+    uint16_t transaction_id, adu_length;
+    if (modbus_tcp_parse_mbap(buffer, tcp_length, &transaction_id, &adu_length) != MODBUS_OK ||
+        adu_length != tcp_length) {
+        return MODBUS_ERR_VALUE;
+    }
+    uint8_t* adu = buffer + MODBUS_BRIDGE_RTU_OFFSET;
+    uint16_t length = tcp_length - MODBUS_BRIDGE_RTU_OFFSET;
+    uint16_t crc = modbus_crc16(adu, length);
+    adu[length] = crc & 0xFF;
+    adu[length + 1] = (crc >> 8) & 0xFF;
+    *rtu_length = length + MODBUS_CRC_SIZE;
+    return MODBUS_OK;
+}
+
+int modbus_bridge_rtu_to_tcp(uint8_t* buffer, uint16_t rtu_length, uint16_t transaction_id,
+                             uint16_t* tcp_length) {
+    if (rtu_length < MODBUS_MIN_ADU_SIZE) return MODBUS_ERR_VALUE;
+    uint8_t* adu = buffer + MODBUS_BRIDGE_RTU_OFFSET;
+    uint16_t length = rtu_length - MODBUS_CRC_SIZE;
+    uint16_t received_crc = (adu[length + 1] << 8) | adu[length];
+    if (modbus_crc16(adu, length) != received_crc) return MODBUS_ERR_CRC;
+    buffer[0] = (transaction_id >> 8) & 0xFF;
+    buffer[1] = transaction_id & 0xFF;
+    buffer[2] = 0;
+    buffer[3] = 0;
+    buffer[4] = (length >> 8) & 0xFF;
+    buffer[5] = length & 0xFF;
+    *tcp_length = MODBUS_BRIDGE_RTU_OFFSET + length;
+    return MODBUS_OK;
+}
+
+// ----- Клиенты TCP -----
+
+static void bridge_close(ModbusBridge* bridge, BridgeClient* client) {
+    close(client->fd);
+    client->fd = -1;
+    client->generation++;
+    if (client->prev) client->prev->next = client->next;
+    else bridge->active = client->next;
+    if (client->next) client->next->prev = client->prev;
+    client->next = bridge->free_list;
+    bridge->free_list = client;
+}
+
+static void bridge_want_write(ModbusBridge* bridge, BridgeClient* client, bool want_write) {
+    if (client->want_write == want_write) return;
+    struct epoll_event ev = { .events = want_write ? EPOLLIN | EPOLLOUT : EPOLLIN, .data.ptr = client };
+    if (epoll_ctl(bridge->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev) != 0) {
+        bridge_close(bridge, client);
+        return;
+    }
+    client->want_write = want_write;
+}
+
+static void bridge_flush(ModbusBridge* bridge, BridgeClient* client) {
+    while (client->tx_sent < client->tx_length) {
+        ssize_t n = send(client->fd, client->tx + client->tx_sent, client->tx_length - client->tx_sent,
+                         MSG_NOSIGNAL);
+        if (n > 0) {
+            client->tx_sent += (uint16_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            bridge_want_write(bridge, client, true);
+            return;
+        }
+        bridge_close(bridge, client);
+        return;
+    }
+    client->tx_length = 0;
+    client->tx_sent = 0;
+    bridge_want_write(bridge, client, false);
+}
+
+// Ответ клиенту прямо из буфера запроса; копия - только если сокет не принял всё сразу
+static void bridge_send(ModbusBridge* bridge, BridgeClient* client, const uint8_t* data, uint16_t length) {
+    uint16_t sent = 0;
+    if (client->tx_length == 0) {
+        ssize_t n = send(client->fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            bridge_close(bridge, client);
+            return;
+        }
+        if (n > 0) sent = (uint16_t)n;
+        if (sent == length) return;
+    }
+    // Клиент не забирает ответы
+    if (client->tx_length + (length - sent) > MODBUS_TCP_CONN_BUFFER) {
+        bridge_close(bridge, client);
+        return;
+    }
+    memcpy(client->tx + client->tx_length, data + sent, length - sent);
+    client->tx_length += length - sent;
+    bridge_want_write(bridge, client, true);
+}
+
+// Исключение шлюза (MBAP ADU, 9 байт)
+static uint16_t bridge_exception(uint16_t transaction_id, uint8_t unit, uint8_t function, uint8_t code,
+                                 uint8_t* exception) {
+    exception[0] = (transaction_id >> 8) & 0xFF;
+    exception[1] = transaction_id & 0xFF;
+    exception[2] = 0;
+    exception[3] = 0;
+    exception[4] = 0;
+    exception[5] = 3;
+    exception[6] = unit;
+    exception[7] = function | 0x80;
+    exception[8] = code;
+    return 9;
+}
+
+// ----- Линии -----
+
+static void bridge_slot_free(ModbusBridge* bridge, int index) {
+    bridge->slots[index].next = bridge->free_slot;
+    bridge->free_slot = index;
+}
+
+// Ответ клиенту, от которого пришёл запрос слота; слот освобождается
+static void bridge_finish(ModbusBridge* bridge, int index, const uint8_t* data, uint16_t length) {
+    BridgeSlot* slot = &bridge->slots[index];
+    if (slot->client->fd >= 0 && slot->client->generation == slot->client_generation) {
+        bridge_send(bridge, slot->client, data, length);
+    } else {
+        bridge->stats.dropped++;
+    }
+    bridge_slot_free(bridge, index);
+}
+
+static void bridge_fail(ModbusBridge* bridge, int index) {
+    BridgeSlot* slot = &bridge->slots[index];
+    uint8_t exception[9];
+    uint16_t length = bridge_exception(slot->transaction_id, slot->unit, slot->function,
+                                       MODBUS_EXC_GATEWAY_TARGET, exception);
+    bridge_finish(bridge, index, exception, length);
+}
+
+static void bridge_line_want_write(ModbusBridge* bridge, BridgeLine* line, bool want_write) {
+    if (line->want_write == want_write) return;
+    struct epoll_event ev = { .events = want_write ? EPOLLIN | EPOLLOUT : EPOLLIN, .data.ptr = line };
+    epoll_ctl(bridge->epoll_fd, EPOLL_CTL_MOD, line->fd, &ev);
+    line->want_write = want_write;
+}
+
+// Дописывание запроса active в линию; по окончании - ожидание ответа
+static void bridge_line_write(ModbusBridge* bridge, BridgeLine* line, uint64_t now_us) {
+    BridgeSlot* slot = &bridge->slots[line->active];
+    uint8_t* adu = slot->buffer + MODBUS_BRIDGE_RTU_OFFSET;
+    while (slot->tx_sent < slot->rtu_length) {
+        ssize_t n = write(line->fd, adu + slot->tx_sent, slot->rtu_length - slot->tx_sent);
+        if (n > 0) {
+            slot->tx_sent += (uint16_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            bridge_line_want_write(bridge, line, true);
+            return;
+        }
+        // Линия не принимает данные: запрос завершается как без ответа
+        int index = line->active;
+        line->active = -1;
+        line->sending = false;
+        bridge->stats.timeouts++;
+        bridge_fail(bridge, index);
+        return;
+    }
+    bridge_line_want_write(bridge, line, false);
+    line->sending = false;
+    uint64_t transmit_us = (uint64_t)slot->rtu_length * line->char_time_us;
+
+    if (adu[0] == 0) {
+        // Широковещательный запрос: ответа нет, следующий - после передачи и паузы
+        int index = line->active;
+        line->active = -1;
+        line->idle_at_us = now_us + transmit_us + line->t35_us;
+        bridge_slot_free(bridge, index);
+        return;
+    }
+    slot->length = 0;
+    line->deadline_us = now_us + transmit_us + line->timeout_us;
+}
+
+// Передача следующего запроса из очереди, если линия свободна и пауза t3.5 выдержана
+static void bridge_line_kick(ModbusBridge* bridge, BridgeLine* line, uint64_t now_us) {
+    while (line->active < 0 && line->head >= 0 && now_us >= line->idle_at_us) {
+        int index = line->head;
+        BridgeSlot* slot = &bridge->slots[index];
+        line->head = slot->next;
+        if (line->head < 0) line->tail = -1;
+
+        if (now_us - slot->received_us > line->queue_timeout_us) {
+            bridge->stats.timeouts++;
+            bridge_fail(bridge, index);
+            continue;
+        }
+        uint64_t start = bridge_now_ns();
+        if (modbus_bridge_tcp_to_rtu(slot->buffer, slot->length, &slot->rtu_length) != MODBUS_OK) {
+            bridge_fail(bridge, index);
+            continue;
+        }
+        // Приёмник линии мог накопить шум, пока она простаивала
+        uint8_t noise[64];
+        while (read(line->fd, noise, sizeof(noise)) > 0) {}
+
+        line->active = index;
+        line->sending = true;
+        slot->tx_sent = 0;
+        bridge_line_write(bridge, line, now_us);
+        bridge->stats.overhead_ns += bridge_now_ns() - start;
+    }
+}
+
+// Проверка принятого ответа: unit id и код функции (или исключение) запроса, CRC
+static void bridge_line_complete(ModbusBridge* bridge, BridgeLine* line, uint16_t length, uint64_t now_us) {
+    uint64_t start = bridge_now_ns();
+    int index = line->active;
+    BridgeSlot* slot = &bridge->slots[index];
+    const uint8_t* adu = slot->buffer + MODBUS_BRIDGE_RTU_OFFSET;
+    line->active = -1;
+    line->idle_at_us = now_us + line->t35_us;
+
+    // Ответ не от того slave или не на эту функцию (например, запоздавший на прошлый запрос)
+    uint16_t tcp_length;
+    if (adu[0] != slot->unit || (adu[1] & 0x7F) != slot->function ||
+        modbus_bridge_rtu_to_tcp(slot->buffer, length, slot->transaction_id, &tcp_length) != MODBUS_OK) {
+        bridge->stats.bad_responses++;
+        bridge_fail(bridge, index);
+    } else {
+        bridge->stats.responses++;
+        bridge_finish(bridge, index, slot->buffer, tcp_length);
+    }
+    bridge->stats.overhead_ns += bridge_now_ns() - start;
+}
+
+static void bridge_line_readable(ModbusBridge* bridge, BridgeLine* line, uint64_t now_us) {
+    if (line->active < 0 || line->sending) {
+        uint8_t noise[64];
+        while (read(line->fd, noise, sizeof(noise)) > 0) {}
+        return;
+    }
+    BridgeSlot* slot = &bridge->slots[line->active];
+    uint8_t* adu = slot->buffer + MODBUS_BRIDGE_RTU_OFFSET;
+    uint16_t capacity = MODBUS_BRIDGE_BUFFER - MODBUS_BRIDGE_RTU_OFFSET;
+    for (;;) {
+        if (slot->length == capacity) break;
+        ssize_t n = read(line->fd, adu + slot->length, capacity - slot->length);
+        if (n > 0) {
+            slot->length += (uint16_t)n;
+            line->last_byte_us = now_us;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        break;
+    }
+    if (slot->length == 0) return;
+
+    int expected = modbus_rtu_expected_length(adu, slot->length, MODBUS_RTU_RESPONSES);
+    if (expected > 0 && slot->length >= expected) {
+        bridge_line_complete(bridge, line, (uint16_t)expected, now_us);
+    } else if (slot->length == capacity) {
+        bridge_line_complete(bridge, line, slot->length, now_us);
+    }
+    // expected < 0: конец кадра определит пауза t3.5 (bridge_line_timers)
+}
+
+static void bridge_line_timers(ModbusBridge* bridge, BridgeLine* line, uint64_t now_us) {
+    if (line->active >= 0 && !line->sending) {
+        BridgeSlot* slot = &bridge->slots[line->active];
+        if (slot->length > 0 && now_us - line->last_byte_us >= line->t35_us) {
+            bridge_line_complete(bridge, line, slot->length, now_us);
+        } else if (now_us >= line->deadline_us) {
+            int index = line->active;
+            line->active = -1;
+            line->idle_at_us = now_us + line->t35_us;
+            bridge->stats.timeouts++;
+            bridge_fail(bridge, index);
+        }
+    }
+    bridge_line_kick(bridge, line, now_us);
+}
+
+// ----- Приём запросов -----
+
+static void bridge_submit(ModbusBridge* bridge, BridgeClient* client, const uint8_t* adu, uint16_t length,
+                          uint16_t transaction_id, uint64_t now_us) {
+    uint64_t start = bridge_now_ns();
+    bridge->stats.requests++;
+    int line_index = bridge->routes[adu[6]];
+    if (line_index < 0 || bridge->free_slot < 0) {
+        uint8_t exception[9];
+        bridge->stats.rejected++;
+        uint8_t code = line_index < 0 ? MODBUS_EXC_GATEWAY_PATH : MODBUS_EXC_DEVICE_BUSY;
+        bridge_send(bridge, client, exception, bridge_exception(transaction_id, adu[6], adu[7], code, exception));
+        return;
+    }
+
+    int index = bridge->free_slot;
+    BridgeSlot* slot = &bridge->slots[index];
+    bridge->free_slot = slot->next;
+    memcpy(slot->buffer, adu, length);
+    slot->length = length;
+    slot->transaction_id = transaction_id;
+    slot->unit = adu[6];
+    slot->function = adu[7];
+    slot->client = client;
+    slot->client_generation = client->generation;
+    slot->received_us = now_us;
+    slot->next = -1;
+
+    BridgeLine* line = &bridge->lines[line_index];
+    if (line->tail >= 0) {
+        bridge->slots[line->tail].next = index;
+    } else {
+        line->head = index;
+    }
+    line->tail = index;
+    bridge->stats.overhead_ns += bridge_now_ns() - start;
+    bridge_line_kick(bridge, line, now_us);
+}
+
+static void bridge_client_readable(ModbusBridge* bridge, BridgeClient* client, uint64_t now_us) {
+    ssize_t n = recv(client->fd, client->rx + client->rx_length, MODBUS_TCP_CONN_BUFFER - client->rx_length, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        bridge_close(bridge, client);
+        return;
+    }
+    if (n < 0) return;
+    client->rx_length += (uint16_t)n;
+
+    uint16_t offset = 0;
+    uint32_t generation = client->generation;
+    for (;;) {
+        uint16_t transaction_id, adu_length;
+        if (modbus_tcp_parse_mbap(client->rx + offset, client->rx_length - offset,
+                                  &transaction_id, &adu_length) != MODBUS_OK) {
+            bridge_close(bridge, client);
+            return;
+        }
+        if (adu_length == 0) break;
+        bridge_submit(bridge, client, client->rx + offset, adu_length, transaction_id, now_us);
+        if (client->generation != generation) return;    // закрыт при отправке исключения
+        offset += adu_length;
+    }
+    if (offset > 0) {
+        memmove(client->rx, client->rx + offset, client->rx_length - offset);
+        client->rx_length -= offset;
+    }
+}
+
+static void bridge_accept(ModbusBridge* bridge) {
+    for (;;) {
+        int fd = accept4(bridge->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        // Клиенты не освобождаются до modbus_bridge_free: на них ссылаются слоты
+        BridgeClient* client = bridge->free_list;
+        if (client != NULL) {
+            bridge->free_list = client->next;
+        } else {
+            client = (BridgeClient*)calloc(1, sizeof(BridgeClient));
+            if (client == NULL) {
+                close(fd);
+                continue;
+            }
+        }
+        client->fd = fd;
+        client->want_write = false;
+        client->rx_length = 0;
+        client->tx_length = 0;
+        client->tx_sent = 0;
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = client };
+        if (epoll_ctl(bridge->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            client->fd = -1;
+            client->next = bridge->free_list;
+            bridge->free_list = client;
+            continue;
+        }
+        client->prev = NULL;
+        client->next = bridge->active;
+        if (bridge->active) bridge->active->prev = client;
+        bridge->active = client;
+    }
+}
+
+// ----- Создание и цикл -----
+
+ModbusBridge* modbus_bridge_create(const char* address, uint16_t port, uint16_t max_pending) {
+    if (max_pending == 0) return NULL;
+    ModbusBridge* bridge = (ModbusBridge*)calloc(1, sizeof(ModbusBridge));
+    if (bridge == NULL) return NULL;
+    bridge->listen_fd = -1;
+    bridge->wake_fd = -1;
+    atomic_init(&bridge->stop, false);
+    memset(bridge->routes, -1, sizeof(bridge->routes));
+
+    bridge->slots = (BridgeSlot*)malloc(max_pending * sizeof(BridgeSlot));
+    bridge->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    bridge->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    bridge->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (bridge->slots == NULL || bridge->epoll_fd < 0 || bridge->wake_fd < 0 || bridge->listen_fd < 0) goto fail;
+    for (int i = 0; i < max_pending; i++) bridge->slots[i].next = i + 1 < max_pending ? i + 1 : -1;
+    bridge->free_slot = 0;
+
+    int one = 1;
+    setsockopt(bridge->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (address != NULL && inet_pton(AF_INET, address, &addr.sin_addr) != 1) goto fail;
+    if (bind(bridge->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) goto fail;
+    if (listen(bridge->listen_fd, SOMAXCONN) != 0) goto fail;
+    socklen_t addr_length = sizeof(addr);
+    getsockname(bridge->listen_fd, (struct sockaddr*)&addr, &addr_length);
+    bridge->port = ntohs(addr.sin_port);
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &bridge->listen_fd };
+    if (epoll_ctl(bridge->epoll_fd, EPOLL_CTL_ADD, bridge->listen_fd, &ev) != 0) goto fail;
+    ev.data.ptr = &bridge->wake_fd;
+    if (epoll_ctl(bridge->epoll_fd, EPOLL_CTL_ADD, bridge->wake_fd, &ev) != 0) goto fail;
+    return bridge;
+
+fail:
+    modbus_bridge_free(bridge);
+    return NULL;
+}
+
+void modbus_bridge_free(ModbusBridge* bridge) {
+    if (bridge == NULL) return;
+    while (bridge->active) bridge_close(bridge, bridge->active);
+    while (bridge->free_list) {
+        BridgeClient* next = bridge->free_list->next;
+        free(bridge->free_list);
+        bridge->free_list = next;
+    }
+    if (bridge->listen_fd >= 0) close(bridge->listen_fd);
+    if (bridge->wake_fd >= 0) close(bridge->wake_fd);
+    if (bridge->epoll_fd >= 0) close(bridge->epoll_fd);
+    free(bridge->slots);
+    free(bridge);
+}
+
+uint16_t modbus_bridge_port(const ModbusBridge* bridge) {
+    return bridge->port;
+}
+
+int modbus_bridge_add_line(ModbusBridge* bridge, int fd, uint32_t baud_rate, uint32_t timeout_ms,
+                           uint32_t queue_timeout_ms, int* line) {
+    if (bridge->line_count == MODBUS_BRIDGE_MAX_LINES) return MODBUS_ERR_VALUE;
+    BridgeLine* l = &bridge->lines[bridge->line_count];
+    memset(l, 0, sizeof(*l));
+    l->fd = fd;
+    if (baud_rate == 0) baud_rate = 19200;
+    l->char_time_us = (BRIDGE_CHAR_BITS * 1000000u + baud_rate - 1) / baud_rate;
+    // Как в modbus_rtu_framer_init: выше 19200 бод t3.5 фиксирован
+    l->t35_us = baud_rate > 19200 ? 1750 : l->char_time_us * 7 / 2;
+    l->timeout_us = (uint64_t)timeout_ms * 1000u;
+    l->queue_timeout_us = (uint64_t)queue_timeout_ms * 1000u;
+    l->head = -1;
+    l->tail = -1;
+    l->active = -1;
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = l };
+    if (epoll_ctl(bridge->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) return MODBUS_ERR_IO;
+    *line = bridge->line_count++;
+    return MODBUS_OK;
+}
+
+int modbus_bridge_route(ModbusBridge* bridge, uint8_t first, uint8_t last, int line) {
+    if (line < 0 || line >= bridge->line_count || first > last) return MODBUS_ERR_VALUE;
+    for (int unit = first; unit <= last; unit++) bridge->routes[unit] = (int8_t)line;
+    return MODBUS_OK;
+}
+
+static BridgeLine* bridge_line_of(ModbusBridge* bridge, void* ptr) {
+    if ((uint8_t*)ptr < (uint8_t*)bridge->lines ||
+        (uint8_t*)ptr >= (uint8_t*)(bridge->lines + MODBUS_BRIDGE_MAX_LINES)) {
+        return NULL;
+    }
+    return (BridgeLine*)ptr;
+}
+
+int modbus_bridge_run_once(ModbusBridge* bridge, int timeout_ms) {
+    // Ожидание не дольше ближайшего срока линий
+    uint64_t now = modbus_rtu_now_us();
+    for (int i = 0; i < bridge->line_count; i++) {
+        BridgeLine* line = &bridge->lines[i];
+        uint64_t next = UINT64_MAX;
+        if (line->active >= 0 && !line->sending) {
+            next = line->deadline_us;
+            if (bridge->slots[line->active].length > 0) next = line->last_byte_us + line->t35_us;
+        } else if (line->active < 0 && line->head >= 0) {
+            next = line->idle_at_us;
+        }
+        if (next == UINT64_MAX) continue;
+        int left_ms = next > now ? (int)((next - now + 999) / 1000) : 0;
+        if (timeout_ms < 0 || left_ms < timeout_ms) timeout_ms = left_ms;
+    }
+
+    struct epoll_event events[BRIDGE_MAX_EVENTS];
+    int count = epoll_wait(bridge->epoll_fd, events, BRIDGE_MAX_EVENTS, timeout_ms);
+    if (count < 0 && errno != EINTR) return MODBUS_ERR_IO;
+
+    now = modbus_rtu_now_us();
+    for (int i = 0; i < count; i++) {
+        void* ptr = events[i].data.ptr;
+        BridgeLine* line = bridge_line_of(bridge, ptr);
+        if (ptr == &bridge->listen_fd) {
+            bridge_accept(bridge);
+        } else if (ptr == &bridge->wake_fd) {
+            uint64_t value;
+            while (read(bridge->wake_fd, &value, sizeof(value)) > 0) {}
+        } else if (line != NULL) {
+            if ((events[i].events & EPOLLOUT) && line->active >= 0 && line->sending) {
+                bridge_line_write(bridge, line, now);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) bridge_line_readable(bridge, line, now);
+        } else {
+            BridgeClient* client = (BridgeClient*)ptr;
+            if (client->fd < 0) continue;
+            if (events[i].events & EPOLLOUT) bridge_flush(bridge, client);
+            if (client->fd >= 0 && (events[i].events & EPOLLIN)) bridge_client_readable(bridge, client, now);
+            if (client->fd >= 0 && (events[i].events & (EPOLLERR | EPOLLHUP))) bridge_close(bridge, client);
+        }
+    }
+    for (int i = 0; i < bridge->line_count; i++) bridge_line_timers(bridge, &bridge->lines[i], now);
+    return MODBUS_OK;
+}
+
+int modbus_bridge_run(ModbusBridge* bridge) {
+    while (!atomic_load(&bridge->stop)) {
+        int status = modbus_bridge_run_once(bridge, -1);
+        if (status != MODBUS_OK) return status;
+    }
+    atomic_store(&bridge->stop, false);
+    return MODBUS_OK;
+}
+
+void modbus_bridge_stop(ModbusBridge* bridge) {
+    atomic_store(&bridge->stop, true);
+    uint64_t one = 1;
+    ssize_t written = write(bridge->wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+void modbus_bridge_stats(const ModbusBridge* bridge, ModbusBridgeStats* stats) {
+    *stats = bridge->stats;
+}
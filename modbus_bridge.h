@@ -0,0 +1,59 @@
+#ifndef MODBUS_BRIDGE_H
+#define MODBUS_BRIDGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "modbus.h"
+#include "modbus_tcp.h"
+
+// Шлюз Modbus TCP -> RTU. Запрос не разбирается в ModbusFrame: MBAP ADU превращается
+// в RTU ADU на месте (заголовок отбрасывается смещением, CRC дописывается в конец),
+// ответ slave принимается сразу за 6 байт места под заголовок и так же на месте
+// превращается обратно в MBAP ADU.
+
+// RTU ADU в буфере шлюза начинается с unit id, т.е. на месте последнего байта MBAP
+#define MODBUS_BRIDGE_RTU_OFFSET    (MODBUS_TCP_MBAP_SIZE - 1)
+#define MODBUS_BRIDGE_BUFFER        (MODBUS_TCP_MAX_ADU_SIZE + MODBUS_CRC_SIZE)
+#define MODBUS_BRIDGE_MAX_LINES     32
+
+// MBAP ADU в buffer[0, tcp_length) -> RTU ADU в buffer[MODBUS_BRIDGE_RTU_OFFSET, +*rtu_length).
+// buffer - не меньше MODBUS_BRIDGE_BUFFER байт.
+int modbus_bridge_tcp_to_rtu(uint8_t* buffer, uint16_t tcp_length, uint16_t* rtu_length);
+// RTU ADU в buffer[MODBUS_BRIDGE_RTU_OFFSET, +rtu_length) -> MBAP ADU в buffer[0, *tcp_length);
+// MODBUS_ERR_CRC, если CRC не сошёлся
+int modbus_bridge_rtu_to_tcp(uint8_t* buffer, uint16_t rtu_length, uint16_t transaction_id,
+                             uint16_t* tcp_length);
+
+typedef struct {
+    uint64_t requests;
+    uint64_t responses;         // ответы slave, переданные клиентам
+    uint64_t timeouts;          // slave не ответил или запрос слишком долго ждал в очереди
+    uint64_t bad_responses;     // ошибка CRC или ответ не на тот запрос
+    uint64_t rejected;          // нет маршрута или свободного места под запрос
+    uint64_t dropped;           // ответ пришёл, а клиент уже отключился
+    uint64_t overhead_ns;       // время самого шлюза: преобразование и запись в линию и клиенту
+} ModbusBridgeStats;
+
+typedef struct ModbusBridge ModbusBridge;
+
+// max_pending - сколько запросов всех клиентов могут одновременно ждать в очередях линий
+ModbusBridge* modbus_bridge_create(const char* address, uint16_t port, uint16_t max_pending);
+// Дескрипторы линий не закрываются
+void modbus_bridge_free(ModbusBridge* bridge);
+uint16_t modbus_bridge_port(const ModbusBridge* bridge);
+
+// Последовательная линия (fd из modbus_rtu_open). На линии один запрос в полёте, остальные
+// ждут в очереди не дольше queue_timeout_ms; ответ slave ждётся не дольше timeout_ms.
+// По истечении сроков клиент получает исключение MODBUS_EXC_GATEWAY_TARGET.
+int modbus_bridge_add_line(ModbusBridge* bridge, int fd, uint32_t baud_rate, uint32_t timeout_ms,
+                           uint32_t queue_timeout_ms, int* line);
+// Запросы к unit id first..last уходят в линию line; без маршрута - MODBUS_EXC_GATEWAY_PATH
+int modbus_bridge_route(ModbusBridge* bridge, uint8_t first, uint8_t last, int line);
+
+int modbus_bridge_run_once(ModbusBridge* bridge, int timeout_ms);
+int modbus_bridge_run(ModbusBridge* bridge);
+void modbus_bridge_stop(ModbusBridge* bridge);
+
+void modbus_bridge_stats(const ModbusBridge* bridge, ModbusBridgeStats* stats);
+
+#endif // MODBUS_BRIDGE_H
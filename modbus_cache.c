@@ -0,0 +1,422 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "modbus_cache.h"
+
+#define CACHE_KEYS  (256 * MODBUS_TABLE_COUNT)
+
+typedef struct {
+    ModbusFrame request;
+    ModbusTcpCompletion callback;
+    void* user;
+} CacheWaiter;
+
+typedef struct CacheEntry {
+    struct CacheEntry* next;
+    ModbusReadCache* cache;
+    uint8_t unit;
+    uint8_t table;
+    uint16_t address;
+    uint16_t count;
+    bool in_flight;
+    bool stale;                 // после записи: ответ не сохранять и новых ожидающих не принимать
+    bool linked;                // в списке ключа
+    uint64_t expires_ms;
+    uint32_t ttl_ms;
+    uint16_t* values;
+    CacheWaiter* waiters;
+    uint32_t waiter_count;
+    uint32_t waiter_capacity;
+} CacheEntry;
+
+typedef struct {
+    uint8_t unit;
+    uint8_t table;
+    uint16_t address;
+    uint32_t end;
+    uint32_t ttl_ms;
+} CacheRule;
+
+// Запись, идущая через кэш
+typedef struct {
+    ModbusReadCache* cache;
+    ModbusTcpCompletion callback;
+    void* user;
+} CacheWrite;
+
+struct ModbusReadCache {
+    ModbusTcpMaster* master;
+    int connection;
+    uint32_t default_ttl_ms;
+    CacheEntry* entries[CACHE_KEYS];
+    CacheRule* rules;
+    uint32_t rule_count;
+    uint32_t rule_capacity;
+    ModbusCacheStats stats;
+};
+
+static const uint8_t cache_function[MODBUS_TABLE_COUNT] = {
+    FC_READ_COILS, FC_READ_DISCRETE_INPUTS, FC_READ_HOLDING_REG, FC_READ_INPUT_REG
+};
+
+static uint64_t cache_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static int cache_read_table(uint8_t function) {
+    switch(function) {
+    case FC_READ_COILS:           return MODBUS_TABLE_COILS;
+    case FC_READ_DISCRETE_INPUTS: return MODBUS_TABLE_DISCRETE_INPUTS;
+    case FC_READ_HOLDING_REG:     return MODBUS_TABLE_HOLDING_REGS;
+    case FC_READ_INPUT_REG:       return MODBUS_TABLE_INPUT_REGS;
+    default:                      return -1;
+    }
+}
+
+static uint16_t cache_limit(uint8_t table) {
+    return (table == MODBUS_TABLE_COILS || table == MODBUS_TABLE_DISCRETE_INPUTS)
+           ? MODBUS_MAX_READ_BITS : MODBUS_MAX_READ_REGS;
+}
+
+ModbusReadCache* modbus_cache_create(ModbusTcpMaster* master, int connection, uint32_t default_ttl_ms) {
+    ModbusReadCache* cache = (ModbusReadCache*)calloc(1, sizeof(ModbusReadCache));
+    if (cache == NULL) return NULL;
+    cache->master = master;
+    cache->connection = connection;
+    cache->default_ttl_ms = default_ttl_ms;
+    return cache;
+}
+
+static void cache_entry_free(CacheEntry* entry) {
+    free(entry->values);
+    free(entry->waiters);
+    free(entry);
+}
+
+void modbus_cache_free(ModbusReadCache* cache) {
+    if (cache == NULL) return;
+    for (int k = 0; k < CACHE_KEYS; k++) {
+        CacheEntry* entry = cache->entries[k];
+        while (entry != NULL) {
+            CacheEntry* next = entry->next;
+            cache_entry_free(entry);
+            entry = next;
+        }
+    }
+    free(cache->rules);
+    free(cache);
+}
+
+int modbus_cache_set_ttl(ModbusReadCache* cache, uint8_t unit, ModbusTable table,
+                         uint16_t address, uint16_t count, uint32_t ttl_ms) {
+    if (table >= MODBUS_TABLE_COUNT || count == 0) return MODBUS_ERR_VALUE;
+    if (cache->rule_count == cache->rule_capacity) {
+        uint32_t capacity = cache->rule_capacity ? cache->rule_capacity * 2 : 8;
+        CacheRule* rules = (CacheRule*)realloc(cache->rules, capacity * sizeof(CacheRule));
+        if (rules == NULL) return MODBUS_ERR_VALUE;
+        cache->rules = rules;
+        cache->rule_capacity = capacity;
+    }
+    cache->rules[cache->rule_count++] = (CacheRule){
+        .unit = unit, .table = (uint8_t)table, .address = address,
+        .end = (uint32_t)address + count, .ttl_ms = ttl_ms
+    };
+    return MODBUS_OK;
+}
+
+// Наименьший TTL среди правил, пересекающих диапазон
+static uint32_t cache_ttl(const ModbusReadCache* cache, uint8_t unit, uint8_t table,
+                          uint16_t address, uint16_t count) {
+    uint32_t ttl = cache->default_ttl_ms;
+    bool matched = false;
+    uint32_t end = (uint32_t)address + count;
+    for (uint32_t i = 0; i < cache->rule_count; i++) {
+        const CacheRule* rule = &cache->rules[i];
+        if (rule->unit != unit || rule->table != table) continue;
+        if (rule->address >= end || rule->end <= address) continue;
+        if (!matched || rule->ttl_ms < ttl) ttl = rule->ttl_ms;
+        matched = true;
+    }
+    return ttl;
+}
+
+static void cache_unlink(ModbusReadCache* cache, CacheEntry* entry) {
+    if (!entry->linked) return;
+    CacheEntry** link = &cache->entries[entry->unit * MODBUS_TABLE_COUNT + entry->table];
+    while (*link != entry) link = &(*link)->next;
+    *link = entry->next;
+    entry->next = NULL;
+    entry->linked = false;
+}
+
+// Ответ на запрос из части значений, прочитанных с base
+static void cache_deliver(const ModbusReadCache* cache, uint8_t unit, uint16_t base, const uint16_t* values,
+                          const CacheWaiter* waiter) {
+    uint16_t offset = waiter->request.address - base;
+    ModbusResponse response = {
+        .slave_id = unit,
+        .function_code = waiter->request.function_code,
+        .exception_code = 0,
+        .address = waiter->request.address,
+        .quantity = waiter->request.quantity,
+        .data = NULL,
+        .byte_count = 0,
+        .values = (uint16_t*)values + offset,
+        .values_capacity = waiter->request.quantity,
+        .value_count = waiter->request.quantity
+    };
+    waiter->callback(waiter->user, cache->connection, &waiter->request, MODBUS_OK, &response);
+}
+
+static int cache_add_waiter(CacheEntry* entry, const ModbusFrame* request, ModbusTcpCompletion callback,
+                            void* user) {
+    if (entry->waiter_count == entry->waiter_capacity) {
+        uint32_t capacity = entry->waiter_capacity ? entry->waiter_capacity * 2 : 4;
+        CacheWaiter* waiters = (CacheWaiter*)realloc(entry->waiters, capacity * sizeof(CacheWaiter));
+        if (waiters == NULL) return MODBUS_ERR_VALUE;
+        entry->waiters = waiters;
+        entry->waiter_capacity = capacity;
+    }
+    CacheWaiter* waiter = &entry->waiters[entry->waiter_count++];
+    waiter->request = *request;
+    waiter->request.data = NULL;
+    waiter->callback = callback;
+    waiter->user = user;
+    return MODBUS_OK;
+}
+
+static void cache_read_completion(void* user, int connection, const ModbusFrame* request,
+                                  int status, const ModbusResponse* response) {
+    (void)connection;
+    (void)request;
+    CacheEntry* entry = (CacheEntry*)user;
+    ModbusReadCache* cache = entry->cache;
+    bool complete = status == MODBUS_OK && response->value_count >= entry->count;
+    uint8_t unit = entry->unit;
+    uint16_t base = entry->address;
+
+    // Ожидающие забираются, а судьба записи решается до обработчиков: из них можно снова
+    // обращаться к кэшу, и повторный запрос или сброс может удалить запись
+    CacheWaiter* waiters = entry->waiters;
+    uint32_t waiter_count = entry->waiter_count;
+    entry->waiters = NULL;
+    entry->waiter_count = 0;
+    entry->waiter_capacity = 0;
+    entry->in_flight = false;
+    if (complete && !entry->stale && entry->ttl_ms != 0) {
+        memcpy(entry->values, response->values, entry->count * sizeof(uint16_t));
+        entry->expires_ms = cache_now_ms() + entry->ttl_ms;
+    } else {
+        cache_unlink(cache, entry);
+        cache_entry_free(entry);
+    }
+
+    // Ответ берётся из response: он действителен до конца вызова, запись - нет
+    for (uint32_t i = 0; i < waiter_count; i++) {
+        const CacheWaiter* waiter = &waiters[i];
+        if (complete) {
+            cache_deliver(cache, unit, base, response->values, waiter);
+        } else {
+            waiter->callback(waiter->user, cache->connection, &waiter->request,
+                             status == MODBUS_OK ? MODBUS_ERR_MISMATCH : status, response);
+        }
+    }
+    free(waiters);
+}
+
+static int cache_submit_read(ModbusReadCache* cache, const ModbusFrame* request, uint8_t table,
+                             ModbusTcpCompletion callback, void* user) {
+    uint64_t now = cache_now_ms();
+    uint32_t start = request->address;
+    uint32_t end = start + request->quantity;
+    CacheEntry** link = &cache->entries[request->slave_id * MODBUS_TABLE_COUNT + table];
+
+    // Покрывающая запись: свежая - ответ сразу, в полёте - ждать её ответа.
+    // Попутно удаляются устаревшие записи.
+    for (CacheEntry* entry = *link; entry != NULL; ) {
+        CacheEntry* next = entry->next;
+        bool covers = !entry->stale && entry->address <= start && (uint32_t)entry->address + entry->count >= end;
+        if (covers && entry->in_flight) {
+            int status = cache_add_waiter(entry, request, callback, user);
+            if (status == MODBUS_OK) cache->stats.collapsed++;
+            return status;
+        }
+        if (!entry->in_flight && entry->expires_ms <= now) {
+            cache_unlink(cache, entry);
+            cache_entry_free(entry);
+        } else if (covers) {
+            CacheWaiter waiter = { .request = *request, .callback = callback, .user = user };
+            cache->stats.hits++;
+            // Запись или сброс из обработчика может освободить запись кэша: ответ - из копии
+            uint16_t values[MODBUS_MAX_READ_BITS];
+            memcpy(values, entry->values + (start - entry->address), request->quantity * sizeof(uint16_t));
+            cache_deliver(cache, entry->unit, request->address, values, &waiter);
+            return MODBUS_OK;
+        }
+        entry = next;
+    }
+
+    // Промах: диапазон расширяется до объединения с пересекающимися или соседними
+    // записями кэша, пока укладывается в ограничение протокола
+    uint16_t limit = cache_limit(table);
+    for (CacheEntry* entry = *link; entry != NULL; entry = entry->next) {
+        if (entry->in_flight || entry->stale) continue;
+        uint32_t entry_end = (uint32_t)entry->address + entry->count;
+        if (entry->address > end || entry_end < start) continue;
+        uint32_t new_start = entry->address < start ? entry->address : start;
+        uint32_t new_end = entry_end > end ? entry_end : end;
+        if (new_end - new_start <= limit) {
+            start = new_start;
+            end = new_end;
+        }
+    }
+
+    CacheEntry* entry = (CacheEntry*)calloc(1, sizeof(CacheEntry));
+    if (entry == NULL) return MODBUS_ERR_VALUE;
+    entry->values = (uint16_t*)malloc((end - start) * sizeof(uint16_t));
+    if (entry->values == NULL || cache_add_waiter(entry, request, callback, user) != MODBUS_OK) {
+        cache_entry_free(entry);
+        return MODBUS_ERR_VALUE;
+    }
+    entry->cache = cache;
+    entry->unit = request->slave_id;
+    entry->table = table;
+    entry->address = (uint16_t)start;
+    entry->count = (uint16_t)(end - start);
+    entry->in_flight = true;
+    entry->ttl_ms = cache_ttl(cache, entry->unit, table, entry->address, entry->count);
+
+    ModbusFrame downstream = {
+        .slave_id = request->slave_id,
+        .function_code = cache_function[table],
+        .address = entry->address,
+        .quantity = entry->count,
+        .data = NULL,
+        .data_length = 0
+    };
+    int status = modbus_tcp_master_submit(cache->master, cache->connection, &downstream,
+                                          cache_read_completion, entry);
+    if (status != MODBUS_OK) {
+        cache_entry_free(entry);
+        return status;
+    }
+    cache->stats.misses++;
+    cache->stats.downstream++;
+
+    // Поглощённые записи больше не нужны: их диапазон покрывает новое чтение
+    for (CacheEntry* old = *link; old != NULL; ) {
+        CacheEntry* next = old->next;
+        if (!old->in_flight && old->address >= start && (uint32_t)old->address + old->count <= end) {
+            cache_unlink(cache, old);
+            cache_entry_free(old);
+        }
+        old = next;
+    }
+    entry->next = *link;
+    *link = entry;
+    entry->linked = true;
+    return MODBUS_OK;
+}
+
+void modbus_cache_invalidate(ModbusReadCache* cache, uint8_t unit, ModbusTable table,
+                             uint16_t address, uint16_t count) {
+    if (table >= MODBUS_TABLE_COUNT) return;
+    uint32_t end = (uint32_t)address + count;
+    CacheEntry* entry = cache->entries[unit * MODBUS_TABLE_COUNT + table];
+    while (entry != NULL) {
+        CacheEntry* next = entry->next;
+        if (entry->address < end && (uint32_t)entry->address + entry->count > address) {
+            cache->stats.invalidations++;
+            if (entry->in_flight) {
+                // Чтение могло уйти до записи: ответ отдаётся ожидающим, но не сохраняется
+                entry->stale = true;
+            } else {
+                cache_unlink(cache, entry);
+                cache_entry_free(entry);
+            }
+        }
+        entry = next;
+    }
+}
+
+// Таблица и диапазон, которые меняет запрос записи
+static bool cache_write_range(const ModbusFrame* request, uint8_t* table, uint16_t* address, uint16_t* count) {
+    switch(request->function_code) {
+    case FC_WRITE_SINGLE_COIL:
+        *table = MODBUS_TABLE_COILS;
+        *address = request->address;
+        *count = 1;
+        return true;
+    case FC_WRITE_MULT_COILS:
+        *table = MODBUS_TABLE_COILS;
+        *address = request->address;
+        *count = request->quantity;
+        return true;
+    case FC_WRITE_SINGLE_REG:
+    case FC_MASK_WRITE_REG:
+        *table = MODBUS_TABLE_HOLDING_REGS;
+        *address = request->address;
+        *count = 1;
+        return true;
+    case FC_WRITE_MULT_REG:
+        *table = MODBUS_TABLE_HOLDING_REGS;
+        *address = request->address;
+        *count = request->quantity;
+        return true;
+    case FC_READ_WRITE_MULT_REG:
+        *table = MODBUS_TABLE_HOLDING_REGS;
+        *address = request->write_address;
+        *count = request->write_quantity;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void cache_write_completion(void* user, int connection, const ModbusFrame* request,
+                                   int status, const ModbusResponse* response) {
+    CacheWrite* write = (CacheWrite*)user;
+    uint8_t table;
+    uint16_t address, count;
+    // Чтения, ушедшие пока запись была в полёте, тоже не должны попасть в кэш
+    if (cache_write_range(request, &table, &address, &count)) {
+        modbus_cache_invalidate(write->cache, request->slave_id, (ModbusTable)table, address, count);
+    }
+    write->callback(write->user, connection, request, status, response);
+    free(write);
+}
+
+int modbus_cache_submit(ModbusReadCache* cache, const ModbusFrame* request,
+                        ModbusTcpCompletion callback, void* user) {
+    int table = cache_read_table(request->function_code);
+    if (table >= 0) {
+        if (request->quantity == 0 || request->quantity > cache_limit((uint8_t)table)) return MODBUS_ERR_VALUE;
+        if ((uint32_t)request->address + request->quantity > 0x10000) return MODBUS_ERR_ADDRESS;
+        return cache_submit_read(cache, request, (uint8_t)table, callback, user);
+    }
+
+    uint8_t write_table;
+    uint16_t address, count;
+    if (!cache_write_range(request, &write_table, &address, &count)) {
+        return modbus_tcp_master_submit(cache->master, cache->connection, request, callback, user);
+    }
+
+    CacheWrite* write = (CacheWrite*)malloc(sizeof(CacheWrite));
+    if (write == NULL) return MODBUS_ERR_VALUE;
+    write->cache = cache;
+    write->callback = callback;
+    write->user = user;
+    int status = modbus_tcp_master_submit(cache->master, cache->connection, request, cache_write_completion, write);
+    if (status != MODBUS_OK) {
+        free(write);
+        return status;
+    }
+    modbus_cache_invalidate(cache, request->slave_id, (ModbusTable)write_table, address, count);
+    return MODBUS_OK;
+}
+
+void modbus_cache_stats(const ModbusReadCache* cache, ModbusCacheStats* stats) {
+    *stats = cache->stats;
+}
@@ -0,0 +1,40 @@
+#ifndef MODBUS_CACHE_H
+#define MODBUS_CACHE_H
+
+#include <stdint.h>
+#include "modbus.h"
+#include "modbus_tcp.h"
+
+// Кэш чтения шлюза перед соединением TCP master:
+// - FC01-FC04 отдаются из свежей записи, если её диапазон покрывает запрос;
+// - одинаковые (и вложенные) запросы, пока чтение в полёте, ждут один ответ;
+// - промах, пересекающийся с записью кэша, читает объединённый диапазон;
+// - записи через кэш (FC05/06/0F/10/16/17) сбрасывают пересекающиеся записи кэша.
+typedef struct ModbusReadCache ModbusReadCache;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t collapsed;         // запросы, присоединённые к чтению в полёте
+    uint64_t downstream;        // транзакции, отправленные slave
+    uint64_t invalidations;
+} ModbusCacheStats;
+
+ModbusReadCache* modbus_cache_create(ModbusTcpMaster* master, int connection, uint32_t default_ttl_ms);
+// Только когда у соединения нет запросов в полёте
+void modbus_cache_free(ModbusReadCache* cache);
+
+// TTL для диапазона таблицы устройства; 0 - не хранить (объединение запросов в полёте остаётся)
+int modbus_cache_set_ttl(ModbusReadCache* cache, uint8_t unit, ModbusTable table,
+                         uint16_t address, uint16_t count, uint32_t ttl_ms);
+
+// Как modbus_tcp_master_submit. Попадание в кэш завершается до возврата из функции;
+// в ответах из кэша заполнены только values (data = NULL).
+int modbus_cache_submit(ModbusReadCache* cache, const ModbusFrame* request,
+                        ModbusTcpCompletion callback, void* user);
+
+void modbus_cache_invalidate(ModbusReadCache* cache, uint8_t unit, ModbusTable table,
+                             uint16_t address, uint16_t count);
+void modbus_cache_stats(const ModbusReadCache* cache, ModbusCacheStats* stats);
+
+#endif // MODBUS_CACHE_H
@@ -0,0 +1,251 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "modbus_capture.h"
+
+// Кольцевой буфер: записи выровнены на 8 байт и начинаются со слова commit
+// (размер записи вместе с заголовком; 0 - место занято, но кадр ещё копируется;
+// поток записи обнуляет прочитанное).
+// Писатель резервирует место CAS по head, копирует кадр и публикует commit;
+// запись, не поместившаяся до конца буфера, начинается с нуля, а хвост
+// закрывается записью-заполнителем с флагом CAPTURE_PAD.
+#define CAPTURE_PAD             0x80000000u
+#define CAPTURE_ENTRY_HEADER    8
+#define CAPTURE_DEFAULT_RING    (1u << 20)
+#define CAPTURE_IDLE_NS         1000000     // пауза потока записи, когда буфер пуст
+
+struct ModbusCapture {
+    uint8_t* ring;
+    uint64_t capacity;
+    _Alignas(64) atomic_uint_fast64_t head;     // резерв писателей
+    _Alignas(64) atomic_uint_fast64_t tail;     // освобождено потоком записи
+    _Alignas(64) atomic_uint_fast64_t dropped;
+    atomic_uint_fast64_t records;
+    atomic_uint_fast64_t bytes;
+    atomic_uint_fast64_t io_errors;
+    atomic_bool stop;
+    FILE* file;
+    pthread_t thread;
+};
+
+static uint64_t capture_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void capture_put_u16(uint8_t* dst, uint16_t value) {
+    dst[0] = value & 0xFF;
+    dst[1] = (value >> 8) & 0xFF;
+}
+
+static void capture_put_u64(uint8_t* dst, uint64_t value) {
+    for (int i = 0; i < 8; i++) dst[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint16_t capture_get_u16(const uint8_t* src) {
+    return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+static uint64_t capture_get_u64(const uint8_t* src) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | src[i];
+    return value;
+}
+
+static atomic_uint_least32_t* capture_commit(ModbusCapture* capture, uint64_t pos) {
+    return (atomic_uint_least32_t*)(capture->ring + pos);
+}
+
+// Поток записи: переносит опубликованные записи из буфера в файл
+static bool capture_drain(ModbusCapture* capture) {
+    uint64_t tail = atomic_load_explicit(&capture->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&capture->head, memory_order_acquire);
+    bool wrote = false;
+    while (tail != head) {
+        uint64_t pos = tail & (capture->capacity - 1);
+        atomic_uint_least32_t* commit = capture_commit(capture, pos);
+        uint32_t size = atomic_load_explicit(commit, memory_order_acquire);
+        if (size == 0) break;   // писатель ещё копирует кадр
+        if (!(size & CAPTURE_PAD)) {
+            const uint8_t* record = capture->ring + pos + CAPTURE_ENTRY_HEADER;
+            size_t length = MODBUS_CAPTURE_RECORD_SIZE + capture_get_u16(record + 8);
+            if (fwrite(record, 1, length, capture->file) == length) {
+                atomic_fetch_add_explicit(&capture->records, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&capture->bytes, length, memory_order_relaxed);
+            } else {
+                atomic_fetch_add_explicit(&capture->io_errors, 1, memory_order_relaxed);
+            }
+            wrote = true;
+        }
+        // Обнуляется вся запись: следующие записи могут начаться в середине её тела,
+        // и их слово commit должно читаться как 0 до публикации
+        size &= ~CAPTURE_PAD;
+        memset(capture->ring + pos, 0, size);
+        tail += size;
+        atomic_store_explicit(&capture->tail, tail, memory_order_release);
+    }
+    return wrote;
+}
+
+static void* capture_thread(void* arg) {
+    ModbusCapture* capture = (ModbusCapture*)arg;
+    struct timespec idle = { .tv_sec = 0, .tv_nsec = CAPTURE_IDLE_NS };
+    for (;;) {
+        bool stop = atomic_load(&capture->stop);
+        if (capture_drain(capture)) continue;
+        fflush(capture->file);
+        if (stop) break;
+        nanosleep(&idle, NULL);
+    }
+    return NULL;
+}
+
+ModbusCapture* modbus_capture_open(const char* path, size_t ring_size) {
+    if (ring_size == 0) ring_size = CAPTURE_DEFAULT_RING;
+    if (ring_size > (1u << 30)) return NULL;   // размер записи-заполнителя - 31 бит
+    uint64_t capacity = 4096;
+    while (capacity < ring_size) capacity <<= 1;
+
+    ModbusCapture* capture = (ModbusCapture*)calloc(1, sizeof(ModbusCapture));
+    if (capture == NULL) return NULL;
+    capture->capacity = capacity;
+    capture->ring = (uint8_t*)aligned_alloc(64, capacity);
+    capture->file = fopen(path, "wb");
+    if (capture->ring == NULL || capture->file == NULL) goto fail;
+    memset(capture->ring, 0, capacity);
+    setvbuf(capture->file, NULL, _IOFBF, 1 << 16);
+    atomic_init(&capture->head, 0);
+    atomic_init(&capture->tail, 0);
+    atomic_init(&capture->dropped, 0);
+    atomic_init(&capture->records, 0);
+    atomic_init(&capture->bytes, 0);
+    atomic_init(&capture->io_errors, 0);
+    atomic_init(&capture->stop, false);
+
+    uint8_t header[MODBUS_CAPTURE_HEADER_SIZE];
+    memcpy(header, MODBUS_CAPTURE_MAGIC, 4);
+    capture_put_u16(header + 4, MODBUS_CAPTURE_VERSION);
+    capture_put_u16(header + 6, MODBUS_CAPTURE_RECORD_SIZE);
+    capture_put_u64(header + 8, capture_now_us());
+    if (fwrite(header, 1, sizeof(header), capture->file) != sizeof(header)) goto fail;
+    if (pthread_create(&capture->thread, NULL, capture_thread, capture) != 0) goto fail;
+    return capture;
+
+fail:
+    if (capture->file != NULL) fclose(capture->file);
+    free(capture->ring);
+    free(capture);
+    return NULL;
+}
+
+void modbus_capture_close(ModbusCapture* capture) {
+    if (capture == NULL) return;
+    atomic_store(&capture->stop, true);
+    pthread_join(capture->thread, NULL);
+    fclose(capture->file);
+    free(capture->ring);
+    free(capture);
+}
+
+int modbus_capture_record(ModbusCapture* capture, uint8_t kind, const uint8_t* frame, uint16_t length) {
+    uint64_t size = (CAPTURE_ENTRY_HEADER + MODBUS_CAPTURE_RECORD_SIZE + length + 7) & ~7ull;
+    uint64_t head = atomic_load_explicit(&capture->head, memory_order_relaxed);
+    uint64_t pos, need;
+    do {
+        uint64_t tail = atomic_load_explicit(&capture->tail, memory_order_acquire);
+        pos = head & (capture->capacity - 1);
+        need = capture->capacity - pos < size ? capture->capacity - pos + size : size;
+        if (head + need - tail > capture->capacity) {
+            atomic_fetch_add_explicit(&capture->dropped, 1, memory_order_relaxed);
+            return MODBUS_ERR_BUSY;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&capture->head, &head, head + need,
+                                                    memory_order_acq_rel, memory_order_relaxed));
+    if (need != size) {
+        atomic_store_explicit(capture_commit(capture, pos), (uint32_t)(need - size) | CAPTURE_PAD,
+                              memory_order_release);
+        pos = 0;
+    }
+
+    uint8_t unit = 0;
+    if ((kind & MODBUS_CAPTURE_FRAMING) == MODBUS_CAPTURE_TCP) {
+        if (length > 6) unit = frame[6];
+    } else if (length > 0) {
+        unit = frame[0];
+    }
+    uint8_t* record = capture->ring + pos + CAPTURE_ENTRY_HEADER;
+    capture_put_u64(record, capture_now_us());
+    capture_put_u16(record + 8, length);
+    record[10] = kind;
+    record[11] = unit;
+    memcpy(record + MODBUS_CAPTURE_RECORD_SIZE, frame, length);
+    atomic_store_explicit(capture_commit(capture, pos), (uint32_t)size, memory_order_release);
+    return MODBUS_OK;
+}
+
+void modbus_capture_stats(const ModbusCapture* capture, ModbusCaptureStats* stats) {
+    ModbusCapture* c = (ModbusCapture*)capture;
+    stats->records = atomic_load_explicit(&c->records, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&c->bytes, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&c->dropped, memory_order_relaxed);
+    stats->io_errors = atomic_load_explicit(&c->io_errors, memory_order_relaxed);
+}
+
+void modbus_device_set_capture(ModbusDevice* device, ModbusCapture* capture) {
+    device->capture = capture;
+}
+
+int modbus_capture_map(const char* path, ModbusCaptureFile* file) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return MODBUS_ERR_IO;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < MODBUS_CAPTURE_HEADER_SIZE) {
+        close(fd);
+        return MODBUS_ERR_IO;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return MODBUS_ERR_IO;
+    const uint8_t* header = (const uint8_t*)data;
+    if (memcmp(header, MODBUS_CAPTURE_MAGIC, 4) != 0 || capture_get_u16(header + 4) != MODBUS_CAPTURE_VERSION ||
+        capture_get_u16(header + 6) != MODBUS_CAPTURE_RECORD_SIZE) {
+        munmap(data, (size_t)st.st_size);
+        return MODBUS_ERR_VALUE;
+    }
+    // Воспроизведение читает файл подряд
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    file->data = header;
+    file->size = (size_t)st.st_size;
+    file->start_us = capture_get_u64(header + 8);
+    return MODBUS_OK;
+}
+
+void modbus_capture_unmap(ModbusCaptureFile* file) {
+    if (file->data != NULL) munmap((void*)file->data, file->size);
+    file->data = NULL;
+    file->size = 0;
+}
+
+bool modbus_capture_next(const ModbusCaptureFile* file, size_t* offset, ModbusCaptureRecord* record) {
+    size_t pos = *offset < MODBUS_CAPTURE_HEADER_SIZE ? MODBUS_CAPTURE_HEADER_SIZE : *offset;
+    if (file->size - pos < MODBUS_CAPTURE_RECORD_SIZE) return false;
+    const uint8_t* header = file->data + pos;
+    uint16_t length = capture_get_u16(header + 8);
+    if (file->size - pos - MODBUS_CAPTURE_RECORD_SIZE < length) return false;
+    record->timestamp_us = capture_get_u64(header);
+    record->length = length;
+    record->kind = header[10];
+    record->unit = header[11];
+    record->frame = header + MODBUS_CAPTURE_RECORD_SIZE;
+    *offset = pos + MODBUS_CAPTURE_RECORD_SIZE + length;
+    return true;
+}
@@ -0,0 +1,85 @@
+#ifndef MODBUS_CAPTURE_H
+#define MODBUS_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "modbus.h"
+
+// Запись обмена в файл для разбора и повторного воспроизведения (modbus_replay).
+//
+// Формат файла (все числа little-endian, без выравнивания):
+//   заголовок, 16 байт: "MBCP", версия (u16), размер заголовка записи (u16),
+//                       время начала записи (u64, мкс от эпохи)
+//   записи подряд:      время (u64, мкс от эпохи), длина кадра (u16), kind (u8), unit id (u8),
+//                       кадр
+// kind = направление | кадрирование. Кадр хранится как был передан: PDU с адресом slave,
+// RTU ADU с CRC или MBAP ADU.
+//
+// Запись из рабочих потоков - копирование кадра в кольцевой буфер без блокировок
+// (несколько писателей); в файл буфер сбрасывает отдельный поток. Если поток не успевает,
+// кадры отбрасываются и учитываются в dropped, рабочие потоки не ждут.
+
+#define MODBUS_CAPTURE_MAGIC        "MBCP"
+#define MODBUS_CAPTURE_VERSION      1
+#define MODBUS_CAPTURE_HEADER_SIZE  16
+#define MODBUS_CAPTURE_RECORD_SIZE  12      // заголовок записи
+
+// Направление
+#define MODBUS_CAPTURE_REQUEST      0x00    // master -> slave
+#define MODBUS_CAPTURE_RESPONSE     0x01    // slave -> master
+#define MODBUS_CAPTURE_DIRECTION    0x01
+// Кадрирование
+#define MODBUS_CAPTURE_PDU          0x00    // адрес slave + PDU
+#define MODBUS_CAPTURE_RTU          0x02
+#define MODBUS_CAPTURE_TCP          0x04
+#define MODBUS_CAPTURE_FRAMING      0x06
+
+typedef struct {
+    uint64_t records;           // записано в файл
+    uint64_t bytes;
+    uint64_t dropped;           // не поместились в кольцевой буфер
+    uint64_t io_errors;         // ошибки записи в файл
+} ModbusCaptureStats;
+
+typedef struct ModbusCapture ModbusCapture;
+
+// ring_size - размер кольцевого буфера, округляется вверх до степени двойки (0 - 1 МиБ)
+ModbusCapture* modbus_capture_open(const char* path, size_t ring_size);
+// Сбрасывает остаток буфера и закрывает файл
+void modbus_capture_close(ModbusCapture* capture);
+
+// kind - направление | кадрирование; unit id берётся из кадра.
+// MODBUS_ERR_BUSY, если кадр не поместился в буфер
+int modbus_capture_record(ModbusCapture* capture, uint8_t kind, const uint8_t* frame, uint16_t length);
+void modbus_capture_stats(const ModbusCapture* capture, ModbusCaptureStats* stats);
+
+// Запись запросов и ответов, обработанных устройством (modbus_process_request и всё,
+// что через него проходит: RTU, TCP, пакетная обработка). Один capture может быть у
+// нескольких устройств; NULL - запись выключена. Устройство не владеет capture.
+void modbus_device_set_capture(ModbusDevice* device, ModbusCapture* capture);
+
+// ----- Чтение -----
+
+typedef struct {
+    uint64_t timestamp_us;
+    uint8_t kind;
+    uint8_t unit;
+    uint16_t length;
+    const uint8_t* frame;       // внутри отображения файла
+} ModbusCaptureRecord;
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    uint64_t start_us;
+} ModbusCaptureFile;
+
+// Отображение файла в память только для чтения
+int modbus_capture_map(const char* path, ModbusCaptureFile* file);
+void modbus_capture_unmap(ModbusCaptureFile* file);
+// Очередная запись с позиции *offset (начинать с 0); false - конец файла или
+// обрезанная запись (файл, который ещё пишется или был прерван)
+bool modbus_capture_next(const ModbusCaptureFile* file, size_t* offset, ModbusCaptureRecord* record);
+
+#endif // MODBUS_CAPTURE_H
@@ -0,0 +1,254 @@
+#include <stdatomic.h>
+#include <pthread.h>
+#include "modbus.h"
+#include "modbus_crc.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MODBUS_CRC_HAVE_PCLMUL 1
+#include <immintrin.h>
+#endif
+
+typedef uint16_t (*ModbusCrcFn)(uint16_t crc, const uint8_t* data, uint16_t length);
+
+// Таблицы для slice-by-N: crc_tables[k][b] - вклад байта b, за которым следуют k нулевых байт
+static uint16_t crc_tables[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+static atomic_int crc_active = MODBUS_CRC_IMPL_BITWISE;
+
+// Побитовый расчёт (исходный алгоритм, эталон для самопроверки)
+static uint16_t crc16_bitwise(uint16_t crc, const uint8_t* data, uint16_t length) {
+    for (uint16_t pos = 0; pos < length; pos++) {
+        crc ^= (uint16_t)data[pos];
+        for (int i = 8; i != 0; i--) {
+            if ((crc & 0x0001) != 0) {
+                crc >>= 1;
+                crc ^= 0xA001;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+static uint16_t crc16_table(uint16_t crc, const uint8_t* data, uint16_t length) {
+    for (uint16_t pos = 0; pos < length; pos++) {
+        crc = (crc >> 8) ^ crc_tables[0][(crc ^ data[pos]) & 0xFF];
+    }
+    return crc;
+}
+
+static uint16_t crc16_slice4(uint16_t crc, const uint8_t* data, uint16_t length) {
+    while (length >= 4) {
+        uint32_t w = ((uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                      ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24)) ^ crc;
+        crc = crc_tables[3][w & 0xFF] ^ crc_tables[2][(w >> 8) & 0xFF] ^
+              crc_tables[1][(w >> 16) & 0xFF] ^ crc_tables[0][w >> 24];
+        data += 4;
+        length -= 4;
+    }
+    return crc16_table(crc, data, length);
+}
+
+static uint16_t crc16_slice8(uint16_t crc, const uint8_t* data, uint16_t length) {
+    while (length >= 8) {
+        uint32_t lo = ((uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                       ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24)) ^ crc;
+        uint32_t hi = (uint32_t)data[4] | ((uint32_t)data[5] << 8) |
+                      ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+        crc = crc_tables[7][lo & 0xFF] ^ crc_tables[6][(lo >> 8) & 0xFF] ^
+              crc_tables[5][(lo >> 16) & 0xFF] ^ crc_tables[4][lo >> 24] ^
+              crc_tables[3][hi & 0xFF] ^ crc_tables[2][(hi >> 8) & 0xFF] ^
+              crc_tables[1][(hi >> 16) & 0xFF] ^ crc_tables[0][hi >> 24];
+        data += 8;
+        length -= 8;
+    }
+    return crc16_table(crc, data, length);
+}
+
+#ifdef MODBUS_CRC_HAVE_PCLMUL
+// Константы свёртки в отражённом виде: младшее слово - x^(D+63) mod P, старшее - x^(D-1) mod P
+static uint64_t crc_fold128[2];
+static uint64_t crc_fold512[2];
+
+// x^n mod P (P = x^16 + x^15 + x^2 + 1), результат в отражённом виде, сдвинутый в старшие биты qword
+static uint64_t crc16_xpow_reflected(unsigned n) {
+    uint32_t r = 1;
+    for (unsigned i = 0; i < n; i++) {
+        r <<= 1;
+        if (r & 0x10000) r ^= 0x18005;
+    }
+    uint16_t reflected = 0;
+    for (int b = 0; b < 16; b++) {
+        if (r & (1u << b)) reflected |= (uint16_t)(1u << (15 - b));
+    }
+    return (uint64_t)reflected << 48;
+}
+
+__attribute__((target("pclmul,sse2")))
+static inline __m128i crc16_fold(__m128i x, __m128i k) {
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11));
+}
+
+// Свёртка 16-байтных блоков по модулю P; остаток и хвост досчитываются таблицей.
+// Начальное значение CRC складывается с первыми двумя байтами сообщения.
+__attribute__((target("pclmul,sse2")))
+static uint16_t crc16_pclmul(uint16_t crc, const uint8_t* data, uint16_t length) {
+    if (length < 32) return crc16_slice8(crc, data, length);
+
+    const __m128i k128 = _mm_set_epi64x((long long)crc_fold128[1], (long long)crc_fold128[0]);
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)data), _mm_cvtsi32_si128(crc));
+    data += 16;
+    length -= 16;
+
+    if (length >= 112) {
+        const __m128i k512 = _mm_set_epi64x((long long)crc_fold512[1], (long long)crc_fold512[0]);
+        __m128i x1 = _mm_loadu_si128((const __m128i*)(data));
+        __m128i x2 = _mm_loadu_si128((const __m128i*)(data + 16));
+        __m128i x3 = _mm_loadu_si128((const __m128i*)(data + 32));
+        data += 48;
+        length -= 48;
+        while (length >= 64) {
+            x  = _mm_xor_si128(crc16_fold(x,  k512), _mm_loadu_si128((const __m128i*)(data)));
+            x1 = _mm_xor_si128(crc16_fold(x1, k512), _mm_loadu_si128((const __m128i*)(data + 16)));
+            x2 = _mm_xor_si128(crc16_fold(x2, k512), _mm_loadu_si128((const __m128i*)(data + 32)));
+            x3 = _mm_xor_si128(crc16_fold(x3, k512), _mm_loadu_si128((const __m128i*)(data + 48)));
+            data += 64;
+            length -= 64;
+        }
+        x = _mm_xor_si128(crc16_fold(x, k128), x1);
+        x = _mm_xor_si128(crc16_fold(x, k128), x2);
+        x = _mm_xor_si128(crc16_fold(x, k128), x3);
+    }
+
+    while (length >= 16) {
+        x = _mm_xor_si128(crc16_fold(x, k128), _mm_loadu_si128((const __m128i*)data));
+        data += 16;
+        length -= 16;
+    }
+
+    uint8_t rest[16];
+    _mm_storeu_si128((__m128i*)rest, x);
+    crc = crc16_slice8(0, rest, sizeof(rest));
+    return crc16_slice8(crc, data, length);
+}
+#endif
+
+static const ModbusCrcFn crc_impls[MODBUS_CRC_IMPL_COUNT] = {
+    [MODBUS_CRC_IMPL_BITWISE] = crc16_bitwise,
+    [MODBUS_CRC_IMPL_TABLE]   = crc16_table,
+    [MODBUS_CRC_IMPL_SLICE4]  = crc16_slice4,
+    [MODBUS_CRC_IMPL_SLICE8]  = crc16_slice8,
+#ifdef MODBUS_CRC_HAVE_PCLMUL
+    [MODBUS_CRC_IMPL_PCLMUL]  = crc16_pclmul,
+#endif
+};
+
+static void crc16_init_once(void) {
+    for (int b = 0; b < 256; b++) {
+        crc_tables[0][b] = crc16_bitwise(0, &(uint8_t){(uint8_t)b}, 1);
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int b = 0; b < 256; b++) {
+            uint16_t prev = crc_tables[k - 1][b];
+            crc_tables[k][b] = (prev >> 8) ^ crc_tables[0][prev & 0xFF];
+        }
+    }
+#ifdef MODBUS_CRC_HAVE_PCLMUL
+    crc_fold128[0] = crc16_xpow_reflected(128 + 63);
+    crc_fold128[1] = crc16_xpow_reflected(128 - 1);
+    crc_fold512[0] = crc16_xpow_reflected(512 + 63);
+    crc_fold512[1] = crc16_xpow_reflected(512 - 1);
+#endif
+    // На кадрах Modbus (до 256 байт) свёртка выигрывает только при наличии PCLMULQDQ
+    atomic_store_explicit(&crc_active,
+                          modbus_crc16_impl_supported(MODBUS_CRC_IMPL_PCLMUL) ? MODBUS_CRC_IMPL_PCLMUL
+                                                                             : MODBUS_CRC_IMPL_SLICE8,
+                          memory_order_relaxed);
+}
+
+int modbus_crc16_impl_supported(ModbusCrcImpl impl) {
+    if (impl <= MODBUS_CRC_IMPL_AUTO || impl >= MODBUS_CRC_IMPL_COUNT) return 0;
+    if (crc_impls[impl] == NULL) return 0;
+#ifdef MODBUS_CRC_HAVE_PCLMUL
+    if (impl == MODBUS_CRC_IMPL_PCLMUL) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2");
+    }
+#endif
+    return 1;
+}
+
+const char* modbus_crc16_impl_name(ModbusCrcImpl impl) {
+    switch (impl) {
+    case MODBUS_CRC_IMPL_AUTO:    return "auto";
+    case MODBUS_CRC_IMPL_BITWISE: return "bitwise";
+    case MODBUS_CRC_IMPL_TABLE:   return "table";
+    case MODBUS_CRC_IMPL_SLICE4:  return "slice4";
+    case MODBUS_CRC_IMPL_SLICE8:  return "slice8";
+    case MODBUS_CRC_IMPL_PCLMUL:  return "pclmul";
+    default:                      return "unknown";
+    }
+}
+
+int modbus_crc16_select(ModbusCrcImpl impl) {
+    pthread_once(&crc_once, crc16_init_once);
+    if (impl == MODBUS_CRC_IMPL_AUTO) {
+        impl = modbus_crc16_impl_supported(MODBUS_CRC_IMPL_PCLMUL) ? MODBUS_CRC_IMPL_PCLMUL
+                                                                  : MODBUS_CRC_IMPL_SLICE8;
+    }
+    if (!modbus_crc16_impl_supported(impl)) return MODBUS_ERR_VALUE;
+    atomic_store_explicit(&crc_active, impl, memory_order_relaxed);
+    return MODBUS_OK;
+}
+
+ModbusCrcImpl modbus_crc16_active_impl(void) {
+    pthread_once(&crc_once, crc16_init_once);
+    return (ModbusCrcImpl)atomic_load_explicit(&crc_active, memory_order_relaxed);
+}
+
+uint16_t modbus_crc16_update_impl(ModbusCrcImpl impl, uint16_t crc, const uint8_t* data, uint16_t length) {
+    pthread_once(&crc_once, crc16_init_once);
+    if (impl == MODBUS_CRC_IMPL_AUTO) impl = modbus_crc16_active_impl();
+    if (!modbus_crc16_impl_supported(impl)) impl = MODBUS_CRC_IMPL_BITWISE;
+    return crc_impls[impl](crc, data, length);
+}
+
+uint16_t modbus_crc16_update(uint16_t crc, const uint8_t* data, uint16_t length) {
+    pthread_once(&crc_once, crc16_init_once);
+    return crc_impls[atomic_load_explicit(&crc_active, memory_order_relaxed)](crc, data, length);
+}
+
+uint16_t modbus_crc16(const uint8_t* buffer, uint16_t length) {
+    return modbus_crc16_update(MODBUS_CRC16_INIT, buffer, length);
+}
+
+int modbus_crc16_selftest(void) {
+    uint8_t data[MODBUS_MAX_ADU_SIZE * 2];
+    uint32_t seed = 0x12345678;
+    for (uint16_t i = 0; i < sizeof(data); i++) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+
+    for (int impl = MODBUS_CRC_IMPL_BITWISE + 1; impl < MODBUS_CRC_IMPL_COUNT; impl++) {
+        if (!modbus_crc16_impl_supported((ModbusCrcImpl)impl)) continue;
+        for (uint16_t length = 0; length <= sizeof(data); length++) {
+            uint16_t offset = length % 7;
+            if (offset + length > sizeof(data)) offset = 0;
+            uint16_t expected = crc16_bitwise(MODBUS_CRC16_INIT, data + offset, length);
+            if (modbus_crc16_update_impl((ModbusCrcImpl)impl, MODBUS_CRC16_INIT,
+                                         data + offset, length) != expected) {
+                return MODBUS_ERR_CRC;
+            }
+            // Инкрементальный расчёт по частям должен давать тот же результат
+            uint16_t split = length / 3;
+            uint16_t crc = modbus_crc16_update_impl((ModbusCrcImpl)impl, MODBUS_CRC16_INIT,
+                                                    data + offset, split);
+            crc = modbus_crc16_update_impl((ModbusCrcImpl)impl, crc,
+                                           data + offset + split, length - split);
+            if (crc != expected) return MODBUS_ERR_CRC;
+        }
+    }
+    return MODBUS_OK;
+}
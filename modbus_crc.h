@@ -0,0 +1,38 @@
+#ifndef MODBUS_CRC_H
+#define MODBUS_CRC_H
+
+#include <stdint.h>
+
+// Начальное значение CRC16 Modbus (полином 0xA001, отражённый 0x8005)
+#define MODBUS_CRC16_INIT       0xFFFF
+
+// Реализации CRC16
+typedef enum {
+    MODBUS_CRC_IMPL_AUTO = 0,   // Выбор лучшей доступной при запуске
+    MODBUS_CRC_IMPL_BITWISE,    // Побитовый цикл (эталон)
+    MODBUS_CRC_IMPL_TABLE,      // Таблица на 256 элементов
+    MODBUS_CRC_IMPL_SLICE4,     // Slice-by-4
+    MODBUS_CRC_IMPL_SLICE8,     // Slice-by-8
+    MODBUS_CRC_IMPL_PCLMUL,     // Свёртка через PCLMULQDQ (x86)
+    MODBUS_CRC_IMPL_COUNT
+} ModbusCrcImpl;
+
+// CRC16 всего буфера
+uint16_t modbus_crc16(const uint8_t* buffer, uint16_t length);
+
+// Инкрементальный расчёт: crc = modbus_crc16_update(MODBUS_CRC16_INIT, ...) и далее по частям
+uint16_t modbus_crc16_update(uint16_t crc, const uint8_t* data, uint16_t length);
+
+// Расчёт конкретной реализацией (для самопроверки и бенчмарков)
+uint16_t modbus_crc16_update_impl(ModbusCrcImpl impl, uint16_t crc, const uint8_t* data, uint16_t length);
+
+// Выбор реализации; MODBUS_ERR_VALUE, если она не поддерживается процессором
+int modbus_crc16_select(ModbusCrcImpl impl);
+ModbusCrcImpl modbus_crc16_active_impl(void);
+int modbus_crc16_impl_supported(ModbusCrcImpl impl);
+const char* modbus_crc16_impl_name(ModbusCrcImpl impl);
+
+// Сверка всех поддерживаемых реализаций с побитовой; MODBUS_OK или MODBUS_ERR_CRC
+int modbus_crc16_selftest(void);
+
+#endif // MODBUS_CRC_H
@@ -0,0 +1,465 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "modbus_history.h"
+
+// Запись в буфере: varint длины тела, тело = varint(разница меток с предыдущим снимком;
+// у опорного 0, метка - в индексе) и операции до конца блока: varint числа
+// неизменившихся регистров, varint числа изменившихся и их разности
+// (zigzag varint от (int16_t)(новое - старое)). Опорный снимок кодируется
+// относительно нулей. Позиции в буфере абсолютные, индекс - позиция % capacity.
+#define HISTORY_DEFAULT_INTERVAL    64
+#define HISTORY_MIN_RECORD          4       // длина + метка + серия + 0 изменившихся
+#define HISTORY_MAX_ZIGZAG          3       // байт varint на регистр
+
+typedef struct {
+    uint64_t timestamp_us;
+    uint64_t position;
+    uint32_t records;           // снимков в группе, включая опорный
+} HistoryKeyframe;
+
+typedef struct {
+    uint16_t address;
+    uint16_t count;
+    uint32_t keyframe_interval;
+    size_t record_max;          // худший размер записи
+
+    uint8_t* ring;
+    uint64_t capacity;
+    uint64_t head;
+    uint64_t tail;
+
+    HistoryKeyframe* keyframes; // кольцо групп от старой к новой
+    uint32_t keyframe_capacity;
+    uint32_t keyframe_first;
+    uint32_t keyframe_count;
+
+    uint16_t* last;             // последний записанный снимок
+    uint64_t last_us;
+    uint8_t* scratch;           // кодирование записи и склейка записей через конец буфера
+
+    uint64_t records;
+    uint64_t stored_records;
+    uint64_t evicted_records;
+    uint64_t raw_bytes;
+    uint64_t encoded_bytes;
+    uint64_t queries;
+    uint64_t query_ns_total;
+    uint64_t query_ns_max;
+} HistoryBlock;
+
+struct ModbusHistorian {
+    pthread_mutex_t lock;
+    HistoryBlock** blocks;
+    int block_count;
+};
+
+static uint64_t history_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint8_t* history_put_varint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static inline const uint8_t* history_get_varint(const uint8_t* in, uint64_t* value) {
+    uint64_t result = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+        byte = *in++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    *value = result;
+    return in;
+}
+
+static inline HistoryKeyframe* history_keyframe(HistoryBlock* block, uint32_t index) {
+    return &block->keyframes[(block->keyframe_first + index) % block->keyframe_capacity];
+}
+
+// Тело записи: prev == NULL - опорный снимок (относительно нулей)
+static size_t history_encode(const uint16_t* prev, const uint16_t* regs, uint16_t count, uint64_t dt,
+                             uint8_t* out) {
+    uint8_t* p = history_put_varint(out, dt);
+    uint16_t i = 0;
+    while (i < count) {
+        uint16_t start = i;
+        if (prev != NULL) {
+            // Неизменившиеся регистры пропускаются по четыре за сравнение
+            while (i + 4 <= count) {
+                uint64_t a, b;
+                memcpy(&a, regs + i, sizeof(a));
+                memcpy(&b, prev + i, sizeof(b));
+                if (a != b) break;
+                i += 4;
+            }
+            while (i < count && regs[i] == prev[i]) i++;
+        } else {
+            while (i < count && regs[i] == 0) i++;
+        }
+        uint16_t changed = i;
+        if (prev != NULL) {
+            while (changed < count && regs[changed] != prev[changed]) changed++;
+        } else {
+            while (changed < count && regs[changed] != 0) changed++;
+        }
+        p = history_put_varint(p, i - start);
+        p = history_put_varint(p, changed - i);
+        for (; i < changed; i++) {
+            int16_t delta = (int16_t)(uint16_t)(regs[i] - (prev != NULL ? prev[i] : 0));
+            uint16_t zigzag = (uint16_t)(((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15));
+            p = history_put_varint(p, zigzag);
+        }
+    }
+    return (size_t)(p - out);
+}
+
+// Применяет операции тела к окну [from, from + window) снимка
+static void history_apply(const uint8_t* p, uint16_t count, uint16_t from, uint16_t window, uint16_t* values) {
+    uint32_t end = (uint32_t)from + window;
+    uint32_t i = 0;
+    while (i < count) {
+        uint64_t skip, changed;
+        p = history_get_varint(p, &skip);
+        p = history_get_varint(p, &changed);
+        i += (uint32_t)skip;
+        for (uint64_t k = 0; k < changed; k++, i++) {
+            uint64_t zigzag;
+            p = history_get_varint(p, &zigzag);
+            if (i >= from && i < end) {
+                uint16_t delta = (uint16_t)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+                values[i - from] = (uint16_t)(values[i - from] + delta);
+            }
+        }
+    }
+}
+
+static void history_ring_write(HistoryBlock* block, const uint8_t* data, size_t length) {
+    size_t at = (size_t)(block->head % block->capacity);
+    size_t first = length < block->capacity - at ? length : (size_t)(block->capacity - at);
+    memcpy(block->ring + at, data, first);
+    memcpy(block->ring, data + first, length - first);
+    block->head += length;
+}
+
+// Тело записи с position; запись, разрезанная концом буфера, склеивается в scratch
+static const uint8_t* history_ring_read(HistoryBlock* block, uint64_t position, uint64_t* next) {
+    uint64_t length = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+        byte = block->ring[position++ % block->capacity];
+        length |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    *next = position + length;
+    size_t at = (size_t)(position % block->capacity);
+    if (at + length <= block->capacity) return block->ring + at;
+    size_t first = (size_t)(block->capacity - at);
+    memcpy(block->scratch, block->ring + at, first);
+    memcpy(block->scratch + first, block->ring, (size_t)length - first);
+    return block->scratch;
+}
+
+static void history_evict_group(HistoryBlock* block) {
+    HistoryKeyframe* oldest = history_keyframe(block, 0);
+    block->evicted_records += oldest->records;
+    block->stored_records -= oldest->records;
+    block->keyframe_first = (block->keyframe_first + 1) % block->keyframe_capacity;
+    block->keyframe_count--;
+    block->tail = block->keyframe_count > 0 ? history_keyframe(block, 0)->position : block->head;
+}
+
+ModbusHistorian* modbus_history_create(void) {
+    ModbusHistorian* history = (ModbusHistorian*)calloc(1, sizeof(ModbusHistorian));
+    if (history == NULL) return NULL;
+    pthread_mutex_init(&history->lock, NULL);
+    return history;
+}
+
+static void history_block_free(HistoryBlock* block) {
+    free(block->ring);
+    free(block->keyframes);
+    free(block->last);
+    free(block->scratch);
+    free(block);
+}
+
+void modbus_history_free(ModbusHistorian* history) {
+    if (history == NULL) return;
+    for (int i = 0; i < history->block_count; i++) history_block_free(history->blocks[i]);
+    free(history->blocks);
+    pthread_mutex_destroy(&history->lock);
+    free(history);
+}
+
+int modbus_history_add_block(ModbusHistorian* history, const ModbusHistoryBlockConfig* config, int* block) {
+    if (history == NULL || config == NULL || block == NULL) return MODBUS_ERR_VALUE;
+    if (config->count == 0 || (uint32_t)config->address + config->count > 0x10000) return MODBUS_ERR_ADDRESS;
+
+    uint32_t interval = config->keyframe_interval ? config->keyframe_interval : HISTORY_DEFAULT_INTERVAL;
+    // Худший случай: через регистр, на каждый изменившийся - две серии и разность
+    size_t record_max = (size_t)config->count * (HISTORY_MAX_ZIGZAG + 3) + 32;
+    size_t keyframe_max = (size_t)config->count * HISTORY_MAX_ZIGZAG + 32;
+    size_t fixed = sizeof(HistoryBlock) + config->count * sizeof(uint16_t) + record_max +
+                   2 * sizeof(HistoryKeyframe);
+    if (config->memory_bytes <= fixed) return MODBUS_ERR_VALUE;
+    // Все группы, кроме текущей, - interval записей не короче HISTORY_MIN_RECORD,
+    // поэтому индекс групп делит бюджет с буфером в пропорции
+    double group_bytes = (double)interval * HISTORY_MIN_RECORD;
+    uint64_t capacity = (uint64_t)((double)(config->memory_bytes - fixed) * group_bytes /
+                                   (group_bytes + sizeof(HistoryKeyframe)));
+    if (capacity < 2 * keyframe_max) return MODBUS_ERR_VALUE;
+
+    HistoryBlock* entry = (HistoryBlock*)calloc(1, sizeof(HistoryBlock));
+    if (entry == NULL) return MODBUS_ERR_VALUE;
+    entry->address = config->address;
+    entry->count = config->count;
+    entry->keyframe_interval = interval;
+    entry->record_max = record_max;
+    entry->capacity = capacity;
+    entry->keyframe_capacity = (uint32_t)(capacity / ((uint64_t)interval * HISTORY_MIN_RECORD)) + 2;
+    entry->ring = (uint8_t*)malloc((size_t)capacity);
+    entry->keyframes = (HistoryKeyframe*)malloc(entry->keyframe_capacity * sizeof(HistoryKeyframe));
+    entry->last = (uint16_t*)calloc(config->count, sizeof(uint16_t));
+    entry->scratch = (uint8_t*)malloc(record_max);
+    if (entry->ring == NULL || entry->keyframes == NULL || entry->last == NULL || entry->scratch == NULL) {
+        history_block_free(entry);
+        return MODBUS_ERR_VALUE;
+    }
+
+    pthread_mutex_lock(&history->lock);
+    HistoryBlock** blocks = (HistoryBlock**)realloc(history->blocks,
+                                                    (history->block_count + 1) * sizeof(HistoryBlock*));
+    if (blocks == NULL) {
+        pthread_mutex_unlock(&history->lock);
+        history_block_free(entry);
+        return MODBUS_ERR_VALUE;
+    }
+    history->blocks = blocks;
+    blocks[history->block_count] = entry;
+    *block = history->block_count++;
+    pthread_mutex_unlock(&history->lock);
+    return MODBUS_OK;
+}
+
+int modbus_history_record(ModbusHistorian* history, int block, uint64_t timestamp_us, const uint16_t* regs) {
+    if (history == NULL || regs == NULL) return MODBUS_ERR_VALUE;
+    pthread_mutex_lock(&history->lock);
+    if (block < 0 || block >= history->block_count) {
+        pthread_mutex_unlock(&history->lock);
+        return MODBUS_ERR_VALUE;
+    }
+    HistoryBlock* b = history->blocks[block];
+    if (b->keyframe_count > 0 && timestamp_us < b->last_us) {
+        pthread_mutex_unlock(&history->lock);
+        return MODBUS_ERR_VALUE;
+    }
+
+    bool keyframe = b->keyframe_count == 0 ||
+                    history_keyframe(b, b->keyframe_count - 1)->records >= b->keyframe_interval;
+    uint8_t* body = b->scratch + 8;
+    size_t length = history_encode(keyframe ? NULL : b->last, regs, b->count,
+                                   keyframe ? 0 : timestamp_us - b->last_us, body);
+    uint8_t prefix[8];
+    size_t prefix_length = (size_t)(history_put_varint(prefix, length) - prefix);
+
+    // Место освобождается целыми группами; текущую группу вытеснить нельзя - тогда
+    // запись становится опорной и буфер начинается заново
+    while (b->head - b->tail + prefix_length + length > b->capacity ||
+           (keyframe && b->keyframe_count == b->keyframe_capacity)) {
+        if (b->keyframe_count > 1 || keyframe) {
+            history_evict_group(b);
+            continue;
+        }
+        keyframe = true;
+        length = history_encode(NULL, regs, b->count, 0, body);
+        prefix_length = (size_t)(history_put_varint(prefix, length) - prefix);
+    }
+
+    if (keyframe) {
+        HistoryKeyframe* entry = history_keyframe(b, b->keyframe_count++);
+        entry->timestamp_us = timestamp_us;
+        entry->position = b->head;
+        entry->records = 0;
+        if (b->keyframe_count == 1) b->tail = b->head;
+    }
+    history_ring_write(b, prefix, prefix_length);
+    history_ring_write(b, body, length);
+    history_keyframe(b, b->keyframe_count - 1)->records++;
+    memcpy(b->last, regs, b->count * sizeof(uint16_t));
+    b->last_us = timestamp_us;
+
+    b->records++;
+    b->stored_records++;
+    b->raw_bytes += sizeof(uint64_t) + b->count * sizeof(uint16_t);
+    b->encoded_bytes += prefix_length + length;
+    pthread_mutex_unlock(&history->lock);
+    return MODBUS_OK;
+}
+
+// Группа, с которой начинается разбор: последняя с меткой <= t (inclusive) или < t;
+// -1, если таких нет
+static int64_t history_find_group(HistoryBlock* block, uint64_t t, bool inclusive) {
+    int64_t low = 0, high = (int64_t)block->keyframe_count - 1, found = -1;
+    while (low <= high) {
+        int64_t mid = (low + high) / 2;
+        uint64_t ts = history_keyframe(block, (uint32_t)mid)->timestamp_us;
+        if (ts < t || (inclusive && ts == t)) {
+            found = mid;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return found;
+}
+
+static void history_finish_query(HistoryBlock* block, uint64_t start_ns) {
+    uint64_t elapsed = history_now_ns() - start_ns;
+    block->queries++;
+    block->query_ns_total += elapsed;
+    if (elapsed > block->query_ns_max) block->query_ns_max = elapsed;
+}
+
+static int history_check(ModbusHistorian* history, int block, uint16_t address, uint16_t count) {
+    if (block < 0 || block >= history->block_count) return MODBUS_ERR_VALUE;
+    HistoryBlock* b = history->blocks[block];
+    if (count == 0 || address < b->address || (uint32_t)address + count > (uint32_t)b->address + b->count) {
+        return MODBUS_ERR_ADDRESS;
+    }
+    return MODBUS_OK;
+}
+
+int modbus_history_value_at(ModbusHistorian* history, int block, uint64_t timestamp_us, uint16_t address,
+                            uint16_t count, uint16_t* values, uint64_t* snapshot_us) {
+    if (history == NULL || values == NULL) return MODBUS_ERR_VALUE;
+    uint64_t start_ns = history_now_ns();
+    pthread_mutex_lock(&history->lock);
+    int status = history_check(history, block, address, count);
+    if (status != MODBUS_OK) {
+        pthread_mutex_unlock(&history->lock);
+        return status;
+    }
+    HistoryBlock* b = history->blocks[block];
+    int64_t group = history_find_group(b, timestamp_us, true);
+    if (group < 0) {
+        history_finish_query(b, start_ns);
+        pthread_mutex_unlock(&history->lock);
+        return MODBUS_ERR_VALUE;
+    }
+
+    // Снимки до следующей группы: её опорный снимок уже позже timestamp_us
+    HistoryKeyframe* keyframe = history_keyframe(b, (uint32_t)group);
+    uint16_t from = address - b->address;
+    uint64_t position = keyframe->position;
+    uint64_t ts = keyframe->timestamp_us;
+    memset(values, 0, count * sizeof(uint16_t));
+    for (uint32_t r = 0; r < keyframe->records; r++) {
+        uint64_t next;
+        const uint8_t* body = history_ring_read(b, position, &next);
+        uint64_t dt;
+        const uint8_t* ops = history_get_varint(body, &dt);
+        if (ts + dt > timestamp_us) break;
+        ts += dt;
+        history_apply(ops, b->count, from, count, values);
+        position = next;
+    }
+    if (snapshot_us != NULL) *snapshot_us = ts;
+    history_finish_query(b, start_ns);
+    pthread_mutex_unlock(&history->lock);
+    return MODBUS_OK;
+}
+
+int modbus_history_query(ModbusHistorian* history, int block, uint64_t from_us, uint64_t to_us, uint16_t address,
+                         uint16_t count, ModbusHistoryCallback callback, void* user, uint64_t* matched) {
+    if (history == NULL || callback == NULL || from_us > to_us) return MODBUS_ERR_VALUE;
+    uint64_t start_ns = history_now_ns();
+    pthread_mutex_lock(&history->lock);
+    int status = history_check(history, block, address, count);
+    if (status != MODBUS_OK) {
+        pthread_mutex_unlock(&history->lock);
+        return status;
+    }
+    HistoryBlock* b = history->blocks[block];
+    uint16_t* values = (uint16_t*)malloc(count * sizeof(uint16_t));
+    if (values == NULL) {
+        pthread_mutex_unlock(&history->lock);
+        return MODBUS_ERR_VALUE;
+    }
+
+    // Снимки с равными метками могут стоять по обе стороны границы групп
+    int64_t group = history_find_group(b, from_us, false);
+    if (group < 0) group = 0;
+    uint16_t from = address - b->address;
+    uint64_t found = 0;
+    bool done = false;
+    for (uint32_t g = (uint32_t)group; g < b->keyframe_count && !done; g++) {
+        HistoryKeyframe* keyframe = history_keyframe(b, g);
+        uint64_t position = keyframe->position;
+        uint64_t ts = keyframe->timestamp_us;
+        memset(values, 0, count * sizeof(uint16_t));
+        for (uint32_t r = 0; r < keyframe->records; r++) {
+            uint64_t next;
+            const uint8_t* body = history_ring_read(b, position, &next);
+            uint64_t dt;
+            const uint8_t* ops = history_get_varint(body, &dt);
+            ts += dt;
+            if (ts > to_us) {
+                done = true;
+                break;
+            }
+            history_apply(ops, b->count, from, count, values);
+            if (ts >= from_us) {
+                callback(user, ts, values, count);
+                found++;
+            }
+            position = next;
+        }
+    }
+    free(values);
+    if (matched != NULL) *matched = found;
+    history_finish_query(b, start_ns);
+    pthread_mutex_unlock(&history->lock);
+    return MODBUS_OK;
+}
+
+int modbus_history_stats(ModbusHistorian* history, int block, ModbusHistoryStats* stats) {
+    if (history == NULL || stats == NULL) return MODBUS_ERR_VALUE;
+    pthread_mutex_lock(&history->lock);
+    if (block < 0 || block >= history->block_count) {
+        pthread_mutex_unlock(&history->lock);
+        return MODBUS_ERR_VALUE;
+    }
+    HistoryBlock* b = history->blocks[block];
+    memset(stats, 0, sizeof(*stats));
+    stats->records = b->records;
+    stats->stored_records = b->stored_records;
+    stats->evicted_records = b->evicted_records;
+    stats->keyframes = b->keyframe_count;
+    stats->raw_bytes = b->raw_bytes;
+    stats->encoded_bytes = b->encoded_bytes;
+    stats->stored_bytes = b->head - b->tail;
+    stats->capacity_bytes = b->capacity;
+    if (b->keyframe_count > 0) {
+        stats->oldest_us = history_keyframe(b, 0)->timestamp_us;
+        stats->newest_us = b->last_us;
+    }
+    stats->queries = b->queries;
+    stats->query_ns_total = b->query_ns_total;
+    stats->query_ns_max = b->query_ns_max;
+    pthread_mutex_unlock(&history->lock);
+    return MODBUS_OK;
+}
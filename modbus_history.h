@@ -0,0 +1,64 @@
+#ifndef MODBUS_HISTORY_H
+#define MODBUS_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "modbus.h"
+
+// История опрашиваемых блоков регистров в памяти: у каждого блока кольцевой буфер
+// фиксированного размера со снимками блока и метками времени.
+// Снимок хранится как отличие от предыдущего: неизменившиеся регистры (XOR = 0) - длиной
+// серии, изменившиеся - разностью со старым значением в zigzag varint. Каждый
+// keyframe_interval-й снимок - опорный (полный), с него начинается разбор при запросах.
+// При нехватке места вытесняется самая старая группа (опорный снимок и его разности).
+// Запись и запросы из разных потоков сериализуются мьютексом историка.
+
+typedef struct {
+    uint16_t address;           // первый регистр блока
+    uint16_t count;
+    size_t memory_bytes;        // всё, что занимает блок, включая служебные массивы
+    uint32_t keyframe_interval; // 0 - 64
+} ModbusHistoryBlockConfig;
+
+typedef struct {
+    uint64_t records;           // записано снимков за всё время
+    uint64_t stored_records;    // сейчас в буфере
+    uint64_t evicted_records;
+    uint64_t keyframes;         // опорных снимков в буфере
+    uint64_t raw_bytes;         // снимки без сжатия: 8 байт метки + 2 байта на регистр
+    uint64_t encoded_bytes;     // они же после сжатия
+    uint64_t stored_bytes;      // занято в буфере
+    uint64_t capacity_bytes;
+    uint64_t oldest_us;         // метки времени в буфере (0, если пусто)
+    uint64_t newest_us;
+    uint64_t queries;
+    uint64_t query_ns_total;    // время запросов, включая ожидание мьютекса
+    uint64_t query_ns_max;
+} ModbusHistoryStats;
+
+// Вызывается для каждого снимка диапазона; values - count регистров с address запроса.
+// Вызывается под мьютексом: из обработчика нельзя обращаться к историку.
+typedef void (*ModbusHistoryCallback)(void* user, uint64_t timestamp_us, const uint16_t* values, uint16_t count);
+
+typedef struct ModbusHistorian ModbusHistorian;
+
+ModbusHistorian* modbus_history_create(void);
+void modbus_history_free(ModbusHistorian* history);
+
+// MODBUS_ERR_VALUE, если memory_bytes не хватает хотя бы на два опорных снимка
+int modbus_history_add_block(ModbusHistorian* history, const ModbusHistoryBlockConfig* config, int* block);
+
+// regs - count регистров блока (например, ModbusResponse.values); метки времени не убывают
+int modbus_history_record(ModbusHistorian* history, int block, uint64_t timestamp_us, const uint16_t* regs);
+
+// Значения [address, address + count) в последнем снимке не позже timestamp_us.
+// MODBUS_ERR_ADDRESS - диапазон вне блока, MODBUS_ERR_VALUE - таких снимков нет
+int modbus_history_value_at(ModbusHistorian* history, int block, uint64_t timestamp_us, uint16_t address,
+                            uint16_t count, uint16_t* values, uint64_t* snapshot_us);
+// Все снимки с метками в [from_us, to_us]; в *matched - их число
+int modbus_history_query(ModbusHistorian* history, int block, uint64_t from_us, uint64_t to_us, uint16_t address,
+                         uint16_t count, ModbusHistoryCallback callback, void* user, uint64_t* matched);
+
+int modbus_history_stats(ModbusHistorian* history, int block, ModbusHistoryStats* stats);
+
+#endif // MODBUS_HISTORY_H
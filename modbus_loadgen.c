@@ -0,0 +1,648 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "modbus.h"
+#include "modbus_rtu.h"
+#include "modbus_stats.h"
+#include "modbus_sync.h"
+#include "modbus_tcp.h"
+#include "modbus_units.h"
+
+// Сквозная нагрузка: ферма имитируемых slave (ModbusDevice в таблице unit id) и
+// генератор запросов в несколько потоков, по loopback TCP или по pty (RTU).
+//   tcp - у каждого потока генератора свой конвейерный master: --connections соединений,
+//         по --window запросов в полёте на каждом; ферма - --farm-threads серверов-шлюзов
+//         на одном порту (SO_REUSEPORT)
+//   rtu - --connections линий pty, на линии один запрос в полёте; линии делятся между
+//         потоками генератора и потоками фермы
+// Смесь кодов функций - веса --mix 3:60,16:20,...; адреса случайные в пределах таблиц.
+// Первые --warmup-ms не учитываются. Результат - JSON в stdout: пропускная способность,
+// задержки p50/p99/p999 (сквозные и обработки в slave), ошибки по кодам функций.
+
+#define LOAD_FC_COUNT       8
+#define LOAD_MAX_THREADS    64
+#define LOAD_DRAIN_MS       100     // сверх тайм-аута на ответы, оставшиеся в полёте
+
+static const uint8_t load_functions[LOAD_FC_COUNT] = {
+    FC_READ_COILS, FC_READ_DISCRETE_INPUTS, FC_READ_HOLDING_REG, FC_READ_INPUT_REG,
+    FC_WRITE_SINGLE_COIL, FC_WRITE_SINGLE_REG, FC_WRITE_MULT_COILS, FC_WRITE_MULT_REG
+};
+
+typedef enum { LOAD_TCP, LOAD_RTU } LoadTransport;
+
+typedef struct {
+    LoadTransport transport;
+    int threads;
+    int connections;            // tcp: на поток; rtu: линий всего
+    int window;
+    int units;
+    int farm_threads;
+    uint16_t size;              // регистров или бит в групповых запросах
+    uint16_t table_size;
+    uint32_t duration_ms;
+    uint32_t warmup_ms;
+    uint32_t timeout_ms;
+    uint32_t baud;
+    uint32_t weights[LOAD_FC_COUNT];
+    uint32_t weight_total;
+} LoadConfig;
+
+typedef struct {
+    ModbusFcStats fc[LOAD_FC_COUNT];    // requests - завершённые, exceptions - ответы-исключения
+    uint64_t timeouts;
+    uint64_t io_errors;
+    uint64_t bad_responses;             // ошибка разбора или ответ не соответствует запросу
+} LoadResults;
+
+// Окно замера: запросы, отправленные после measure_ns и завершённые до end_ns
+static uint64_t load_measure_ns;
+static uint64_t load_end_ns;
+
+typedef struct LoadWorker LoadWorker;
+
+// Запрос в полёте: у TCP - одно место окна соединения, у RTU - линия
+typedef struct {
+    LoadWorker* worker;
+    int connection;
+    uint64_t submit_ns;
+    ModbusFrame request;
+    uint8_t data[MODBUS_MAX_WRITE_REGS * 2];
+    // rtu
+    int fd;
+    bool busy;
+    uint64_t deadline_ns;
+    ModbusRtuFramer framer;
+} LoadSlot;
+
+struct LoadWorker {
+    const LoadConfig* config;
+    uint32_t seed;
+    LoadResults results;
+    ModbusTcpMaster* master;
+    LoadSlot* slots;
+    int slot_count;
+    pthread_t thread;
+};
+
+typedef struct {
+    ModbusUnitRegistry* registry;
+    int fd;                     // сторона slave pty
+    ModbusRtuFramer framer;
+} LoadFarmLine;
+
+typedef struct {
+    ModbusTcpServer* server;    // tcp
+    LoadFarmLine* lines;        // rtu: линии этого потока
+    int line_count;
+    atomic_bool* stop;
+    pthread_t thread;
+} LoadFarmThread;
+
+static uint64_t load_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint32_t load_random(uint32_t* seed) {
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
+
+static int load_fc_index(uint8_t function_code) {
+    for (int i = 0; i < LOAD_FC_COUNT; i++) {
+        if (load_functions[i] == function_code) return i;
+    }
+    return -1;
+}
+
+// Следующий запрос смеси; данные групповой записи - в slot->data
+static void load_next_request(LoadWorker* worker, LoadSlot* slot) {
+    const LoadConfig* config = worker->config;
+    uint32_t pick = load_random(&worker->seed) % config->weight_total;
+    int fc = 0;
+    while (pick >= config->weights[fc]) pick -= config->weights[fc++];
+
+    ModbusFrame* frame = &slot->request;
+    memset(frame, 0, sizeof(*frame));
+    frame->slave_id = (uint8_t)(1 + load_random(&worker->seed) % config->units);
+    frame->function_code = load_functions[fc];
+    uint16_t limit;
+    switch (frame->function_code) {
+    case FC_READ_COILS:
+    case FC_READ_DISCRETE_INPUTS: limit = MODBUS_MAX_READ_BITS; break;
+    case FC_READ_HOLDING_REG:
+    case FC_READ_INPUT_REG: limit = MODBUS_MAX_READ_REGS; break;
+    case FC_WRITE_MULT_COILS: limit = MODBUS_MAX_WRITE_BITS; break;
+    case FC_WRITE_MULT_REG: limit = MODBUS_MAX_WRITE_REGS; break;
+    default: limit = 1; break;
+    }
+    uint16_t count = config->size < limit ? config->size : limit;
+    if (count > config->table_size) count = config->table_size;
+    frame->address = (uint16_t)(load_random(&worker->seed) % (config->table_size - count + 1u));
+    frame->quantity = count;
+
+    uint32_t value = load_random(&worker->seed);
+    switch (frame->function_code) {
+    case FC_WRITE_SINGLE_COIL:
+        frame->quantity = value & 1;
+        break;
+    case FC_WRITE_SINGLE_REG:
+        frame->quantity = (uint16_t)value;
+        break;
+    case FC_WRITE_MULT_COILS:
+        frame->data_length = (uint16_t)((count + 7) / 8);
+        memset(slot->data, (uint8_t)value, frame->data_length);
+        frame->data = slot->data;
+        break;
+    case FC_WRITE_MULT_REG:
+        frame->data_length = (uint16_t)(count * 2);
+        memset(slot->data, (uint8_t)value, frame->data_length);
+        frame->data = slot->data;
+        break;
+    default:
+        break;
+    }
+}
+
+static void load_record(LoadWorker* worker, const ModbusFrame* request, int status, const ModbusResponse* response,
+                        uint64_t submit_ns, uint64_t now_ns) {
+    if (submit_ns < load_measure_ns || now_ns > load_end_ns) return;
+    LoadResults* results = &worker->results;
+    ModbusFcStats* stats = &results->fc[load_fc_index(request->function_code)];
+    switch (status) {
+    case MODBUS_OK: {
+        // Чтение - столько значений, сколько запрошено; запись - эхо адреса
+        bool read = request->function_code <= FC_READ_INPUT_REG;
+        if (read ? response->value_count != request->quantity : response->address != request->address) {
+            results->bad_responses++;
+            return;
+        }
+        break;
+    }
+    case MODBUS_ERR_EXCEPTION:
+        stats->exceptions++;
+        break;
+    case MODBUS_ERR_TIMEOUT:
+        results->timeouts++;
+        return;
+    case MODBUS_ERR_IO:
+        results->io_errors++;
+        return;
+    default:
+        results->bad_responses++;
+        return;
+    }
+    stats->requests++;
+    stats->latency[modbus_stats_bucket(now_ns - submit_ns)]++;
+}
+
+static void load_tcp_submit(LoadSlot* slot);
+
+static void load_tcp_completion(void* user, int connection, const ModbusFrame* request,
+                                int status, const ModbusResponse* response) {
+    (void)connection;
+    LoadSlot* slot = (LoadSlot*)user;
+    uint64_t now = load_now_ns();
+    load_record(slot->worker, request, status, response, slot->submit_ns, now);
+    if (now < load_end_ns) load_tcp_submit(slot);
+}
+
+static void load_tcp_submit(LoadSlot* slot) {
+    LoadWorker* worker = slot->worker;
+    load_next_request(worker, slot);
+    slot->submit_ns = load_now_ns();
+    // Отказ - соединение разорвано: место окна выбывает до конца прогона
+    if (modbus_tcp_master_submit(worker->master, slot->connection, &slot->request, load_tcp_completion,
+                                 slot) != MODBUS_OK) {
+        if (slot->submit_ns >= load_measure_ns) worker->results.io_errors++;
+    }
+}
+
+static void* load_tcp_worker(void* arg) {
+    LoadWorker* worker = (LoadWorker*)arg;
+    for (int i = 0; i < worker->slot_count; i++) load_tcp_submit(&worker->slots[i]);
+    while (load_now_ns() < load_end_ns) modbus_tcp_master_poll(worker->master, 10);
+
+    uint64_t drain_end = load_end_ns + (worker->config->timeout_ms + LOAD_DRAIN_MS) * 1000000ull;
+    for (;;) {
+        int pending = 0;
+        for (int c = 0; c < worker->config->connections; c++) {
+            pending += modbus_tcp_master_pending(worker->master, c);
+        }
+        if (pending == 0 || load_now_ns() > drain_end) break;
+        modbus_tcp_master_poll(worker->master, 10);
+    }
+    return NULL;
+}
+
+static void load_rtu_response(void* user, const uint8_t* adu, uint16_t length, uint64_t timestamp_us) {
+    (void)timestamp_us;
+    LoadSlot* slot = (LoadSlot*)user;
+    if (!slot->busy) return;
+    uint16_t values[MODBUS_MAX_READ_BITS];
+    ModbusResponse response = { .values = values, .values_capacity = MODBUS_MAX_READ_BITS };
+    int status = modbus_decode_response(&slot->request, adu, length, &response);
+    slot->busy = false;
+    load_record(slot->worker, &slot->request, status, &response, slot->submit_ns, load_now_ns());
+}
+
+static void load_rtu_send(LoadSlot* slot) {
+    uint8_t adu[MODBUS_MAX_ADU_SIZE];
+    uint16_t length = 0;
+    load_next_request(slot->worker, slot);
+    modbus_create_request(&slot->request, adu, &length);
+    slot->submit_ns = load_now_ns();
+    slot->deadline_ns = slot->submit_ns + slot->worker->config->timeout_ms * 1000000ull;
+    slot->busy = true;
+    for (uint16_t sent = 0; sent < length;) {
+        ssize_t n = write(slot->fd, adu + sent, length - sent);
+        if (n > 0) {
+            sent += (uint16_t)n;
+        } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            slot->busy = false;
+            load_record(slot->worker, &slot->request, MODBUS_ERR_IO, NULL, slot->submit_ns, load_now_ns());
+            return;
+        }
+    }
+}
+
+static void* load_rtu_worker(void* arg) {
+    LoadWorker* worker = (LoadWorker*)arg;
+    struct pollfd* fds = (struct pollfd*)calloc(worker->slot_count, sizeof(struct pollfd));
+    uint64_t drain_end = load_end_ns + (worker->config->timeout_ms + LOAD_DRAIN_MS) * 1000000ull;
+    for (;;) {
+        uint64_t now = load_now_ns();
+        int busy = 0;
+        for (int i = 0; i < worker->slot_count; i++) {
+            LoadSlot* slot = &worker->slots[i];
+            if (slot->busy && now > slot->deadline_ns) {
+                slot->busy = false;
+                modbus_rtu_framer_reset(&slot->framer);
+                load_record(worker, &slot->request, MODBUS_ERR_TIMEOUT, NULL, slot->submit_ns, now);
+            }
+            if (!slot->busy && now < load_end_ns) load_rtu_send(slot);
+            busy += slot->busy;
+            fds[i].fd = slot->fd;
+            fds[i].events = POLLIN;
+        }
+        if (busy == 0 && now >= load_end_ns) break;
+        if (now > drain_end) break;
+        // Паузу t3.5 после ответа сборщик отмечает по опросу: ждём не дольше миллисекунды
+        if (poll(fds, (nfds_t)worker->slot_count, 1) > 0) {
+            for (int i = 0; i < worker->slot_count; i++) {
+                if (fds[i].revents & POLLIN) modbus_rtu_read(&worker->slots[i].framer, fds[i].fd);
+            }
+        }
+        uint64_t now_us = modbus_rtu_now_us();
+        for (int i = 0; i < worker->slot_count; i++) modbus_rtu_framer_poll(&worker->slots[i].framer, now_us);
+    }
+    free(fds);
+    return NULL;
+}
+
+static void* load_tcp_farm_thread(void* arg) {
+    modbus_tcp_server_run(((LoadFarmThread*)arg)->server);
+    return NULL;
+}
+
+static void load_farm_request(void* user, const uint8_t* adu, uint16_t length, uint64_t timestamp_us) {
+    (void)timestamp_us;
+    LoadFarmLine* line = (LoadFarmLine*)user;
+    uint8_t tx[MODBUS_MAX_ADU_SIZE];
+    uint16_t tx_length = 0;
+    modbus_registry_process_rtu(line->registry, adu, length, tx, &tx_length);
+    for (uint16_t sent = 0; sent < tx_length;) {
+        ssize_t n = write(line->fd, tx + sent, tx_length - sent);
+        if (n > 0) sent += (uint16_t)n;
+        else if (n < 0 && errno != EAGAIN && errno != EINTR) return;
+    }
+}
+
+static void* load_rtu_farm_thread(void* arg) {
+    LoadFarmThread* farm = (LoadFarmThread*)arg;
+    struct pollfd* fds = (struct pollfd*)calloc(farm->line_count, sizeof(struct pollfd));
+    for (int i = 0; i < farm->line_count; i++) {
+        fds[i].fd = farm->lines[i].fd;
+        fds[i].events = POLLIN;
+    }
+    while (!atomic_load(farm->stop)) {
+        if (poll(fds, (nfds_t)farm->line_count, 1) > 0) {
+            for (int i = 0; i < farm->line_count; i++) {
+                if (fds[i].revents & POLLIN) modbus_rtu_read(&farm->lines[i].framer, fds[i].fd);
+            }
+        }
+        uint64_t now_us = modbus_rtu_now_us();
+        for (int i = 0; i < farm->line_count; i++) modbus_rtu_framer_poll(&farm->lines[i].framer, now_us);
+    }
+    free(fds);
+    return NULL;
+}
+
+// "3:60,16:20,0x0F:5" -> веса кодов функций
+static bool load_parse_mix(const char* text, LoadConfig* config) {
+    memset(config->weights, 0, sizeof(config->weights));
+    config->weight_total = 0;
+    char* copy = strdup(text);
+    bool ok = copy != NULL;
+    for (char* item = strtok(copy, ","); ok && item != NULL; item = strtok(NULL, ",")) {
+        char* end;
+        unsigned long function_code = strtoul(item, &end, 0);
+        int index = function_code <= 0xFF ? load_fc_index((uint8_t)function_code) : -1;
+        unsigned long weight = *end == ':' ? strtoul(end + 1, &end, 10) : 0;
+        if (index < 0 || *end != '\0' || weight > 1000000) {
+            ok = false;
+            break;
+        }
+        config->weights[index] += (uint32_t)weight;
+        config->weight_total += (uint32_t)weight;
+    }
+    free(copy);
+    return ok && config->weight_total > 0;
+}
+
+static void load_print_latency(const ModbusFcStats* stats) {
+    printf("\"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f",
+           modbus_stats_percentile_ns(stats, 0.5) / 1e3, modbus_stats_percentile_ns(stats, 0.99) / 1e3,
+           modbus_stats_percentile_ns(stats, 0.999) / 1e3);
+}
+
+static void load_usage(const char* name) {
+    fprintf(stderr, "usage: %s [--transport tcp|rtu] [--threads <n>] [--connections <n>] [--window <n>] "
+                    "[--units <n>] [--farm-threads <n>] [--size <n>] [--table-size <n>] [--mix <fc:weight,...>] "
+                    "[--duration-ms <ms>] [--warmup-ms <ms>] [--timeout-ms <ms>] [--baud <n>]\n", name);
+}
+
+int main(int argc, char** argv) {
+    LoadConfig config = {
+        .transport = LOAD_TCP, .threads = 1, .connections = 4, .window = 8, .units = 10, .farm_threads = 1,
+        .size = 10, .table_size = 1000, .duration_ms = 5000, .warmup_ms = 500, .timeout_ms = 1000,
+        .baud = 115200
+    };
+    const char* mix = "1:10,2:5,3:50,4:10,5:5,6:10,15:5,16:5";
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL) {
+            load_usage(argv[0]);
+            return 2;
+        }
+        i++;
+        long number = strtol(value, NULL, 10);
+        if (strcmp(option, "--transport") == 0) {
+            if (strcmp(value, "tcp") == 0) config.transport = LOAD_TCP;
+            else if (strcmp(value, "rtu") == 0) config.transport = LOAD_RTU;
+            else number = -1;
+        } else if (strcmp(option, "--threads") == 0) {
+            config.threads = (int)number;
+        } else if (strcmp(option, "--connections") == 0) {
+            config.connections = (int)number;
+        } else if (strcmp(option, "--window") == 0) {
+            config.window = (int)number;
+        } else if (strcmp(option, "--units") == 0) {
+            config.units = (int)number;
+        } else if (strcmp(option, "--farm-threads") == 0) {
+            config.farm_threads = (int)number;
+        } else if (strcmp(option, "--size") == 0) {
+            config.size = number > 0 && number <= 0xFFFF ? (uint16_t)number : 0;
+        } else if (strcmp(option, "--table-size") == 0) {
+            config.table_size = number > 0 && number <= 0xFFFF ? (uint16_t)number : 0;
+        } else if (strcmp(option, "--mix") == 0) {
+            mix = value;
+        } else if (strcmp(option, "--duration-ms") == 0) {
+            config.duration_ms = (uint32_t)number;
+        } else if (strcmp(option, "--warmup-ms") == 0) {
+            config.warmup_ms = number >= 0 ? (uint32_t)number : 0;
+        } else if (strcmp(option, "--timeout-ms") == 0) {
+            config.timeout_ms = (uint32_t)number;
+        } else if (strcmp(option, "--baud") == 0) {
+            config.baud = (uint32_t)number;
+        } else {
+            number = -1;
+        }
+        if (number < 0) {
+            load_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!load_parse_mix(mix, &config) || config.threads < 1 || config.threads > LOAD_MAX_THREADS ||
+        config.connections < 1 || config.window < 1 || config.window > 256 || config.units < 1 ||
+        config.units > MODBUS_MAX_UNIT || config.farm_threads < 1 || config.farm_threads > LOAD_MAX_THREADS ||
+        config.size == 0 || config.table_size == 0 || config.duration_ms == 0 || config.timeout_ms == 0 ||
+        config.baud == 0) {
+        load_usage(argv[0]);
+        return 2;
+    }
+    if (config.transport == LOAD_RTU) {
+        // Линий меньше, чем потоков, быть не может: лишние потоки не нужны
+        if (config.threads > config.connections) config.threads = config.connections;
+        if (config.farm_threads > config.connections) config.farm_threads = config.connections;
+    }
+
+    // Ферма: все unit id доступны через каждый сервер и каждую линию
+    ModbusUnitRegistry registry;
+    modbus_registry_init(&registry);
+    ModbusDevice** devices = (ModbusDevice**)calloc(config.units, sizeof(ModbusDevice*));
+    for (int u = 0; u < config.units; u++) {
+        devices[u] = modbus_init_device(config.table_size, config.table_size, config.table_size, config.table_size);
+        if (devices[u] == NULL) {
+            fprintf(stderr, "loadgen: device allocation failed\n");
+            return 1;
+        }
+        // Несколько потоков фермы обращаются к одним устройствам
+        if (config.farm_threads > 1) modbus_device_enable_sync(devices[u]);
+        modbus_device_enable_stats(devices[u], (unsigned)config.farm_threads, 0);
+        modbus_registry_add(&registry, (uint8_t)(u + 1), devices[u]);
+    }
+
+    atomic_bool farm_stop;
+    atomic_init(&farm_stop, false);
+    LoadFarmThread* farm = (LoadFarmThread*)calloc(config.farm_threads, sizeof(LoadFarmThread));
+    LoadWorker* workers = (LoadWorker*)calloc(config.threads, sizeof(LoadWorker));
+    LoadFarmLine* lines = NULL;
+    int* line_fds = NULL;
+    uint16_t port = 0;
+    bool ok = farm != NULL && workers != NULL;
+
+    if (ok && config.transport == LOAD_TCP) {
+        for (int f = 0; f < config.farm_threads && ok; f++) {
+            farm[f].server = modbus_tcp_server_create_gateway(&registry, "127.0.0.1", port);
+            ok = farm[f].server != NULL;
+            if (ok) port = modbus_tcp_server_port(farm[f].server);
+        }
+        for (int w = 0; w < config.threads && ok; w++) {
+            LoadWorker* worker = &workers[w];
+            worker->master = modbus_tcp_master_create((uint16_t)config.window, config.timeout_ms);
+            worker->slot_count = config.connections * config.window;
+            worker->slots = (LoadSlot*)calloc(worker->slot_count, sizeof(LoadSlot));
+            ok = worker->master != NULL && worker->slots != NULL;
+            for (int c = 0; c < config.connections && ok; c++) {
+                int connection;
+                ok = modbus_tcp_master_connect(worker->master, "127.0.0.1", port, &connection) == MODBUS_OK;
+                for (int k = 0; k < config.window && ok; k++) {
+                    LoadSlot* slot = &worker->slots[c * config.window + k];
+                    slot->worker = worker;
+                    slot->connection = connection;
+                }
+            }
+        }
+    } else if (ok) {
+        // Линия RTU - пара pty: сторона master у фермы, сторона slave у генератора
+        lines = (LoadFarmLine*)calloc(config.connections, sizeof(LoadFarmLine));
+        line_fds = (int*)malloc(config.connections * sizeof(int));
+        ok = lines != NULL && line_fds != NULL;
+        for (int l = 0; l < config.connections && ok; l++) {
+            lines[l].registry = &registry;
+            lines[l].fd = posix_openpt(O_RDWR | O_NOCTTY);
+            line_fds[l] = -1;
+            ok = lines[l].fd >= 0 && grantpt(lines[l].fd) == 0 && unlockpt(lines[l].fd) == 0 &&
+                 modbus_rtu_open(ptsname(lines[l].fd), config.baud, &line_fds[l]) == MODBUS_OK;
+            if (lines[l].fd >= 0) fcntl(lines[l].fd, F_SETFL, fcntl(lines[l].fd, F_GETFL) | O_NONBLOCK);
+            modbus_rtu_framer_init(&lines[l].framer, config.baud, MODBUS_RTU_REQUESTS, load_farm_request, &lines[l]);
+        }
+        for (int f = 0; f < config.farm_threads && ok; f++) {
+            int first = config.connections * f / config.farm_threads;
+            farm[f].lines = &lines[first];
+            farm[f].line_count = config.connections * (f + 1) / config.farm_threads - first;
+        }
+        for (int w = 0; w < config.threads && ok; w++) {
+            LoadWorker* worker = &workers[w];
+            int first = config.connections * w / config.threads;
+            worker->slot_count = config.connections * (w + 1) / config.threads - first;
+            worker->slots = (LoadSlot*)calloc(worker->slot_count, sizeof(LoadSlot));
+            ok = worker->slots != NULL;
+            for (int k = 0; k < worker->slot_count && ok; k++) {
+                LoadSlot* slot = &worker->slots[k];
+                slot->worker = worker;
+                slot->fd = line_fds[first + k];
+                modbus_rtu_framer_init(&slot->framer, config.baud, MODBUS_RTU_RESPONSES, load_rtu_response, slot);
+            }
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "loadgen: %s setup failed\n", config.transport == LOAD_TCP ? "tcp" : "pty");
+        return 1;
+    }
+
+    for (int f = 0; f < config.farm_threads; f++) {
+        farm[f].stop = &farm_stop;
+        pthread_create(&farm[f].thread, NULL,
+                       config.transport == LOAD_TCP ? load_tcp_farm_thread : load_rtu_farm_thread, &farm[f]);
+    }
+    uint64_t start = load_now_ns();
+    load_measure_ns = start + config.warmup_ms * 1000000ull;
+    load_end_ns = load_measure_ns + config.duration_ms * 1000000ull;
+    for (int w = 0; w < config.threads; w++) {
+        workers[w].config = &config;
+        workers[w].seed = 0x9E3779B9u ^ (uint32_t)(w + 1) * 0x85EBCA6Bu;
+        pthread_create(&workers[w].thread, NULL,
+                       config.transport == LOAD_TCP ? load_tcp_worker : load_rtu_worker, &workers[w]);
+    }
+    struct timespec pause = { .tv_sec = (time_t)(config.warmup_ms / 1000),
+                              .tv_nsec = (long)(config.warmup_ms % 1000) * 1000000L };
+    // Статистика slave - тоже только за окно замера
+    nanosleep(&pause, NULL);
+    for (int u = 0; u < config.units; u++) modbus_stats_reset(devices[u]);
+    for (int w = 0; w < config.threads; w++) pthread_join(workers[w].thread, NULL);
+
+    if (config.transport == LOAD_TCP) {
+        for (int f = 0; f < config.farm_threads; f++) modbus_tcp_server_stop(farm[f].server);
+    }
+    atomic_store(&farm_stop, true);
+    for (int f = 0; f < config.farm_threads; f++) pthread_join(farm[f].thread, NULL);
+
+    // Итоги: по кодам функций и общий
+    LoadResults total;
+    memset(&total, 0, sizeof(total));
+    ModbusFcStats all;
+    memset(&all, 0, sizeof(all));
+    for (int w = 0; w < config.threads; w++) {
+        const LoadResults* results = &workers[w].results;
+        total.timeouts += results->timeouts;
+        total.io_errors += results->io_errors;
+        total.bad_responses += results->bad_responses;
+        for (int i = 0; i < LOAD_FC_COUNT; i++) {
+            total.fc[i].requests += results->fc[i].requests;
+            total.fc[i].exceptions += results->fc[i].exceptions;
+            for (int b = 0; b < MODBUS_STATS_BUCKETS; b++) total.fc[i].latency[b] += results->fc[i].latency[b];
+        }
+    }
+    for (int i = 0; i < LOAD_FC_COUNT; i++) {
+        all.requests += total.fc[i].requests;
+        all.exceptions += total.fc[i].exceptions;
+        for (int b = 0; b < MODBUS_STATS_BUCKETS; b++) all.latency[b] += total.fc[i].latency[b];
+    }
+    ModbusFcStats slave;
+    memset(&slave, 0, sizeof(slave));
+    for (int u = 0; u < config.units; u++) {
+        ModbusStatsSnapshot snapshot;
+        modbus_stats_snapshot(devices[u], &snapshot);
+        for (int s = 0; s < MODBUS_STATS_FC_SLOTS; s++) {
+            slave.requests += snapshot.fc[s].requests;
+            for (int b = 0; b < MODBUS_STATS_BUCKETS; b++) slave.latency[b] += snapshot.fc[s].latency[b];
+        }
+    }
+    uint64_t failed = total.timeouts + total.io_errors + total.bad_responses;
+    double seconds = config.duration_ms / 1e3;
+
+    printf("{\n");
+    printf("  \"transport\": \"%s\",\n", config.transport == LOAD_TCP ? "tcp" : "rtu");
+    printf("  \"threads\": %d, \"connections\": %d, \"window\": %d, \"concurrency\": %d,\n", config.threads,
+           config.connections, config.transport == LOAD_TCP ? config.window : 1,
+           config.transport == LOAD_TCP ? config.threads * config.connections * config.window : config.connections);
+    printf("  \"units\": %d, \"farm_threads\": %d, \"size\": %u, \"table_size\": %u, \"mix\": \"%s\",\n",
+           config.units, config.farm_threads, config.size, config.table_size, mix);
+    printf("  \"duration_s\": %.3f,\n", seconds);
+    printf("  \"throughput_rps\": %.0f,\n", all.requests / seconds);
+    printf("  \"completed\": %llu, \"exceptions\": %llu, \"timeouts\": %llu, \"io_errors\": %llu, "
+           "\"bad_responses\": %llu,\n",
+           (unsigned long long)all.requests, (unsigned long long)all.exceptions,
+           (unsigned long long)total.timeouts, (unsigned long long)total.io_errors,
+           (unsigned long long)total.bad_responses);
+    printf("  \"error_rate\": %.6f,\n",
+           all.requests + failed ? (double)(all.exceptions + failed) / (double)(all.requests + failed) : 0.0);
+    printf("  \"latency\": {");
+    load_print_latency(&all);
+    printf("},\n  \"slave_latency\": {");
+    load_print_latency(&slave);
+    printf("},\n  \"functions\": [");
+    int printed = 0;
+    for (int i = 0; i < LOAD_FC_COUNT; i++) {
+        if (config.weights[i] == 0) continue;
+        const ModbusFcStats* stats = &total.fc[i];
+        printf("%s\n    {\"function_code\": %u, \"weight\": %u, \"completed\": %llu, \"exceptions\": %llu, ",
+               printed++ ? "," : "", load_functions[i], config.weights[i], (unsigned long long)stats->requests,
+               (unsigned long long)stats->exceptions);
+        load_print_latency(stats);
+        printf("}");
+    }
+    printf("\n  ]\n}\n");
+
+    for (int w = 0; w < config.threads; w++) {
+        modbus_tcp_master_free(workers[w].master);
+        free(workers[w].slots);
+    }
+    for (int f = 0; f < config.farm_threads; f++) modbus_tcp_server_free(farm[f].server);
+    for (int l = 0; lines != NULL && l < config.connections; l++) {
+        if (lines[l].fd >= 0) close(lines[l].fd);
+        if (line_fds[l] >= 0) close(line_fds[l]);
+    }
+    free(lines);
+    free(line_fds);
+    free(farm);
+    free(workers);
+    for (int u = 0; u < config.units; u++) modbus_free_device(devices[u]);
+    free(devices);
+    return failed == 0 ? 0 : 1;
+}
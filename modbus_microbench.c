@@ -0,0 +1,467 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "modbus.h"
+#include "modbus_capture.h"
+#include "modbus_crc.h"
+#include "modbus_stats.h"
+#include "modbus_template.h"
+#include "modbus_values.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MICRO_HAVE_TSC 1
+#else
+#define MICRO_HAVE_TSC 0
+#endif
+
+// Микробенчмарки кодирования, разбора, CRC и обработки запросов.
+// Результат - JSON в stdout: ns/op, кадров/с и тактов (TSC) на байт для каждого случая.
+// Аргументы: [--filter <подстрока имени>] [--min-time-ms <мс на случай>]
+
+#define MICRO_MAX_CASES     128
+// Указатель очереди FC24: дальше адресов, которые затрагивают случаи записи
+#define MICRO_FIFO_ADDRESS  0x8000
+
+typedef void (*MicroFn)(void* ctx, uint64_t iterations);
+
+typedef struct {
+    char name[48];
+    char variant[24];       // реализация CRC или пусто
+    uint8_t function_code;
+    uint16_t quantity;
+    uint32_t bytes;         // байт кадра на операцию
+    MicroFn fn;
+    void* ctx;
+} MicroCase;
+
+typedef struct {
+    double ns_per_op;
+    double cycles_per_op;
+} MicroResult;
+
+static volatile uint32_t micro_sink;
+static MicroCase micro_cases[MICRO_MAX_CASES];
+static int micro_case_count;
+
+static uint64_t micro_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t micro_cycles(void) {
+#if MICRO_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Подбор числа итераций под min_time_ns, затем замер
+static MicroResult micro_run(const MicroCase* c, uint64_t min_time_ns) {
+    uint64_t iterations = 64;
+    for (;;) {
+        uint64_t start = micro_now_ns();
+        c->fn(c->ctx, iterations);
+        uint64_t elapsed = micro_now_ns() - start;
+        if (elapsed >= min_time_ns / 4 || iterations >= (UINT64_C(1) << 32)) break;
+        iterations *= (elapsed > 0 && min_time_ns / 4 / elapsed < 16) ? 4 : 16;
+    }
+
+    iterations *= 4;
+    uint64_t start = micro_now_ns();
+    uint64_t start_cycles = micro_cycles();
+    c->fn(c->ctx, iterations);
+    uint64_t cycles = micro_cycles() - start_cycles;
+    uint64_t elapsed = micro_now_ns() - start;
+
+    MicroResult result = {
+        .ns_per_op = (double)elapsed / (double)iterations,
+        .cycles_per_op = (double)cycles / (double)iterations
+    };
+    return result;
+}
+
+static MicroCase* micro_add(const char* name, MicroFn fn, void* ctx) {
+    if (micro_case_count == MICRO_MAX_CASES) return NULL;
+    MicroCase* c = &micro_cases[micro_case_count++];
+    memset(c, 0, sizeof(*c));
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->fn = fn;
+    c->ctx = ctx;
+    return c;
+}
+
+// ----- CRC16 -----
+
+typedef struct {
+    ModbusCrcImpl impl;
+    uint16_t length;
+    uint8_t data[MODBUS_MAX_ADU_SIZE];
+} CrcCtx;
+
+static void micro_crc16(void* ctx, uint64_t iterations) {
+    CrcCtx* c = (CrcCtx*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        micro_sink += modbus_crc16_update_impl(c->impl, MODBUS_CRC16_INIT, c->data, c->length);
+    }
+}
+
+static void micro_add_crc_cases(void) {
+    static const uint16_t sizes[] = { 8, 16, 32, 64, 128, 256 };
+    static CrcCtx contexts[MODBUS_CRC_IMPL_COUNT][sizeof(sizes) / sizeof(sizes[0])];
+    for (int impl = MODBUS_CRC_IMPL_BITWISE; impl < MODBUS_CRC_IMPL_COUNT; impl++) {
+        if (!modbus_crc16_impl_supported((ModbusCrcImpl)impl)) continue;
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            CrcCtx* ctx = &contexts[impl][s];
+            ctx->impl = (ModbusCrcImpl)impl;
+            ctx->length = sizes[s];
+            for (uint16_t i = 0; i < sizes[s]; i++) ctx->data[i] = (uint8_t)(i * 31 + 7);
+            MicroCase* c = micro_add("crc16", micro_crc16, ctx);
+            if (c == NULL) return;
+            snprintf(c->variant, sizeof(c->variant), "%s", modbus_crc16_impl_name((ModbusCrcImpl)impl));
+            c->bytes = sizes[s];
+        }
+    }
+}
+
+// ----- Запросы master и их обработка slave -----
+
+typedef struct {
+    ModbusFrame frame;
+    uint8_t data[MODBUS_MAX_ADU_SIZE];
+    uint8_t request[MODBUS_MAX_ADU_SIZE];
+    uint16_t request_length;
+    uint8_t response[MODBUS_MAX_ADU_SIZE];
+    uint16_t response_length;
+    ModbusDevice* device;
+    uint16_t values[MODBUS_MAX_READ_BITS];
+} FrameCtx;
+
+static void micro_create_request(void* ctx, uint64_t iterations) {
+    FrameCtx* c = (FrameCtx*)ctx;
+    uint16_t length = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        modbus_create_request(&c->frame, c->request, &length);
+        micro_sink += length;
+    }
+}
+
+// Замер ветки ошибки вместо рабочей не должен попасть в результаты: прогон прерывается
+static void micro_fail(const FrameCtx* c, const char* stage, int status) {
+    fprintf(stderr, "microbench: %s fc %02X quantity %u failed: status %d\n", stage, c->frame.function_code,
+            c->frame.quantity, status);
+    exit(1);
+}
+
+static void micro_process(void* ctx, uint64_t iterations) {
+    FrameCtx* c = (FrameCtx*)ctx;
+    uint16_t length = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        int status = modbus_process_response_from_master(c->device, c->request, c->request_length,
+                                                         c->response, &length);
+        if (status != MODBUS_OK || (c->response[1] & 0x80) != 0) micro_fail(c, "process_request", status);
+        micro_sink += length;
+    }
+}
+
+static void micro_decode(void* ctx, uint64_t iterations) {
+    FrameCtx* c = (FrameCtx*)ctx;
+    ModbusResponse response = { .values = c->values, .values_capacity = MODBUS_MAX_READ_BITS };
+    for (uint64_t i = 0; i < iterations; i++) {
+        int status = modbus_decode_response(&c->frame, c->response, c->response_length, &response);
+        if (status != MODBUS_OK) micro_fail(c, "decode_response", status);
+        micro_sink += response.value_count;
+    }
+}
+
+// Запрос с данными для записи; для FC23 quantity - число читаемых регистров.
+// Запрос, на который устройство отвечает ошибкой, прерывает прогон
+static FrameCtx* micro_frame(ModbusDevice* device, uint8_t function, uint16_t quantity) {
+    FrameCtx* ctx = (FrameCtx*)calloc(1, sizeof(FrameCtx));
+    if (ctx == NULL) return NULL;
+    ctx->device = device;
+    for (size_t i = 0; i < sizeof(ctx->data); i++) ctx->data[i] = (uint8_t)(i * 13 + 1);
+    ctx->frame = (ModbusFrame){
+        .slave_id = 1,
+        .function_code = function,
+        .address = 0,
+        .quantity = quantity,
+        .data = ctx->data,
+        .data_length = 0
+    };
+    switch(function) {
+    case FC_WRITE_MULT_COILS:
+        ctx->frame.data_length = (quantity + 7) / 8;
+        break;
+    case FC_WRITE_MULT_REG:
+        ctx->frame.data_length = quantity * 2;
+        break;
+    case FC_MASK_WRITE_REG:
+        ctx->frame.data_length = 4;
+        break;
+    case FC_READ_WRITE_MULT_REG:
+        ctx->frame.write_address = 0;
+        ctx->frame.write_quantity = MODBUS_MAX_RW_WRITE_REGS;
+        ctx->frame.data_length = MODBUS_MAX_RW_WRITE_REGS * 2;
+        break;
+    case FC_READ_FIFO_QUEUE:
+        // Указатель FIFO вне регистров, которые меняют случаи записи
+        ctx->frame.address = MICRO_FIFO_ADDRESS;
+        device->holding_registers[MICRO_FIFO_ADDRESS] = quantity;
+        break;
+    default:
+        break;
+    }
+    int status = modbus_create_request(&ctx->frame, ctx->request, &ctx->request_length);
+    if (status != MODBUS_OK) micro_fail(ctx, "create_request", status);
+    status = modbus_process_response_from_master(device, ctx->request, ctx->request_length,
+                                                 ctx->response, &ctx->response_length);
+    if (status != MODBUS_OK || (ctx->response[1] & 0x80) != 0) micro_fail(ctx, "process_request", status);
+    return ctx;
+}
+
+static void micro_add_frame_cases(ModbusDevice* device) {
+    static const struct {
+        uint8_t function;
+        uint16_t quantity;
+    } cases[] = {
+        { FC_READ_COILS, 1 }, { FC_READ_COILS, 16 }, { FC_READ_COILS, MODBUS_MAX_READ_BITS },
+        { FC_READ_DISCRETE_INPUTS, 1 }, { FC_READ_DISCRETE_INPUTS, MODBUS_MAX_READ_BITS },
+        { FC_READ_HOLDING_REG, 1 }, { FC_READ_HOLDING_REG, 10 }, { FC_READ_HOLDING_REG, MODBUS_MAX_READ_REGS },
+        { FC_READ_INPUT_REG, 1 }, { FC_READ_INPUT_REG, MODBUS_MAX_READ_REGS },
+        { FC_WRITE_SINGLE_COIL, 1 }, { FC_WRITE_SINGLE_REG, 1 },
+        { FC_WRITE_MULT_COILS, 16 }, { FC_WRITE_MULT_COILS, MODBUS_MAX_WRITE_BITS },
+        { FC_WRITE_MULT_REG, 1 }, { FC_WRITE_MULT_REG, MODBUS_MAX_WRITE_REGS },
+        { FC_MASK_WRITE_REG, 1 },
+        { FC_READ_WRITE_MULT_REG, MODBUS_MAX_READ_REGS },
+        { FC_READ_FIFO_QUEUE, MODBUS_MAX_FIFO_COUNT },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        FrameCtx* ctx = micro_frame(device, cases[i].function, cases[i].quantity);
+        if (ctx == NULL) return;
+        // Один запрос на код функции достаточно для кодирования
+        if (i == 0 || cases[i - 1].function != cases[i].function) {
+            MicroCase* c = micro_add("create_request", micro_create_request, ctx);
+            if (c == NULL) return;
+            c->function_code = cases[i].function;
+            c->quantity = cases[i].quantity;
+            c->bytes = ctx->request_length;
+        }
+        MicroCase* c = micro_add("process_request", micro_process, ctx);
+        if (c == NULL) return;
+        c->function_code = cases[i].function;
+        c->quantity = cases[i].quantity;
+        c->bytes = ctx->request_length + ctx->response_length;
+
+        c = micro_add("decode_response", micro_decode, ctx);
+        if (c == NULL) return;
+        c->function_code = cases[i].function;
+        c->quantity = cases[i].quantity;
+        c->bytes = ctx->response_length;
+    }
+}
+
+// Цена статистики: тот же FC03 на 10 регистров с замером задержки каждого и каждого 64-го запроса
+static void micro_add_stats_cases(void) {
+    static const unsigned shifts[] = { 0, 6 };
+    for (size_t i = 0; i < sizeof(shifts) / sizeof(shifts[0]); i++) {
+        ModbusDevice* device = modbus_init_device(125, 0, 0, 0);
+        modbus_device_enable_stats(device, 1, shifts[i]);
+        FrameCtx* ctx = micro_frame(device, FC_READ_HOLDING_REG, 10);
+        if (ctx == NULL) return;
+        MicroCase* c = micro_add("process_request", micro_process, ctx);
+        if (c == NULL) return;
+        snprintf(c->variant, sizeof(c->variant), "stats/%u", 1u << shifts[i]);
+        c->function_code = FC_READ_HOLDING_REG;
+        c->quantity = 10;
+        c->bytes = ctx->request_length + ctx->response_length;
+    }
+}
+
+// Цена записи обмена: FC03 на 10 регистров, запрос и ответ копируются в кольцевой буфер.
+// Файл - /dev/null; если поток записи не успевает, кадры отбрасываются, не замедляя обработку.
+static void micro_add_capture_cases(void) {
+    ModbusCapture* capture = modbus_capture_open("/dev/null", 0);
+    if (capture == NULL) return;
+    ModbusDevice* device = modbus_init_device(125, 0, 0, 0);
+    modbus_device_set_capture(device, capture);
+    FrameCtx* ctx = micro_frame(device, FC_READ_HOLDING_REG, 10);
+    if (ctx == NULL) return;
+    MicroCase* c = micro_add("process_request", micro_process, ctx);
+    if (c == NULL) return;
+    snprintf(c->variant, sizeof(c->variant), "capture");
+    c->function_code = FC_READ_HOLDING_REG;
+    c->quantity = 10;
+    c->bytes = ctx->request_length + ctx->response_length;
+}
+
+// Скомпилированный запрос: смена unit id и одного регистра данных против полной сборки (rebuild)
+typedef struct {
+    ModbusRequestTemplate tpl;
+} TemplateCtx;
+
+static void micro_template(void* ctx, uint64_t iterations) {
+    TemplateCtx* c = (TemplateCtx*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        uint16_t value = (uint16_t)i;
+        modbus_template_set_unit(&c->tpl, (uint8_t)(1 + (i & 1)));
+        modbus_template_set_registers(&c->tpl, 0, &value, 1);
+        micro_sink += c->tpl.adu[c->tpl.length - 1];
+    }
+}
+
+static void micro_add_template_cases(ModbusDevice* device) {
+    static const uint16_t quantities[] = { 1, 10, MODBUS_MAX_WRITE_REGS };
+    for (size_t i = 0; i < sizeof(quantities) / sizeof(quantities[0]); i++) {
+        FrameCtx* frame = micro_frame(device, FC_WRITE_MULT_REG, quantities[i]);
+        TemplateCtx* ctx = (TemplateCtx*)calloc(1, sizeof(TemplateCtx));
+        if (frame == NULL || ctx == NULL ||
+            modbus_template_compile(&ctx->tpl, MODBUS_TEMPLATE_RTU, &frame->frame) != MODBUS_OK) {
+            free(frame);
+            free(ctx);
+            return;
+        }
+        MicroCase* c = micro_add("template_patch", micro_template, ctx);
+        if (c == NULL) return;
+        c->function_code = FC_WRITE_MULT_REG;
+        c->quantity = quantities[i];
+        c->bytes = ctx->tpl.length;
+
+        c = micro_add("template_patch", micro_create_request, frame);
+        if (c == NULL) return;
+        snprintf(c->variant, sizeof(c->variant), "rebuild");
+        c->function_code = FC_WRITE_MULT_REG;
+        c->quantity = quantities[i];
+        c->bytes = frame->request_length;
+    }
+}
+
+// Скан аналоговых точек: блок регистров -> инженерные значения по описаниям тегов.
+// quantity - число тегов, variant - тип и порядок байт; bytes - байт регистров блока
+typedef struct {
+    ModbusValueMap* map;
+    uint16_t* regs;
+    uint32_t reg_count;
+    double* values;
+} ValuesCtx;
+
+static void micro_values_decode(void* ctx, uint64_t iterations) {
+    ValuesCtx* c = (ValuesCtx*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        modbus_value_map_decode(c->map, c->regs, c->reg_count, c->values);
+        micro_sink += (uint32_t)c->values[0];
+    }
+}
+
+static void micro_values_encode(void* ctx, uint64_t iterations) {
+    ValuesCtx* c = (ValuesCtx*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        modbus_value_map_encode(c->map, c->values, c->regs, c->reg_count);
+        micro_sink += c->regs[0];
+    }
+}
+
+static void micro_add_values_cases(void) {
+    static const struct {
+        ModbusValueType type;
+        ModbusWordOrder order;
+        const char* variant;
+    } cases[] = {
+        { MODBUS_VALUE_INT16,   MODBUS_ORDER_ABCD, "int16" },
+        { MODBUS_VALUE_FLOAT32, MODBUS_ORDER_ABCD, "float32/abcd" },
+        { MODBUS_VALUE_FLOAT32, MODBUS_ORDER_CDAB, "float32/cdab" },
+        { MODBUS_VALUE_INT32,   MODBUS_ORDER_BADC, "int32/badc" },
+        { MODBUS_VALUE_FLOAT64, MODBUS_ORDER_DCBA, "float64/dcba" },
+    };
+    const uint32_t tags = 4000;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        ModbusValueLayout* layouts = (ModbusValueLayout*)calloc(tags, sizeof(ModbusValueLayout));
+        ValuesCtx* ctx = (ValuesCtx*)calloc(1, sizeof(ValuesCtx));
+        if (layouts == NULL || ctx == NULL) return;
+        uint16_t width = modbus_value_width(cases[i].type);
+        for (uint32_t t = 0; t < tags; t++) {
+            layouts[t] = (ModbusValueLayout){ .type = (uint8_t)cases[i].type, .order = (uint8_t)cases[i].order,
+                                              .position = (uint16_t)(t * width), .scale = 0.1, .offset = -40.0 };
+        }
+        ctx->map = modbus_value_map_create(layouts, tags);
+        free(layouts);
+        ctx->reg_count = tags * width;
+        ctx->regs = (uint16_t*)calloc(ctx->reg_count, sizeof(uint16_t));
+        ctx->values = (double*)calloc(tags, sizeof(double));
+        if (ctx->map == NULL || ctx->regs == NULL || ctx->values == NULL) return;
+        for (uint32_t r = 0; r < ctx->reg_count; r++) ctx->regs[r] = (uint16_t)(r * 7919 + 1);
+
+        const char* names[2] = { "values_decode", "values_encode" };
+        MicroFn fns[2] = { micro_values_decode, micro_values_encode };
+        for (int k = 0; k < 2; k++) {
+            MicroCase* c = micro_add(names[k], fns[k], ctx);
+            if (c == NULL) return;
+            snprintf(c->variant, sizeof(c->variant), "%s", cases[i].variant);
+            c->quantity = (uint16_t)tags;
+            c->bytes = ctx->reg_count * 2;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* filter = NULL;
+    uint64_t min_time_ms = 200;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time-ms") == 0 && i + 1 < argc) {
+            min_time_ms = strtoull(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--filter <name>] [--min-time-ms <ms>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    ModbusDevice* device = modbus_init_device(0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF);
+    micro_add_crc_cases();
+    micro_add_frame_cases(device);
+    micro_add_stats_cases();
+    micro_add_capture_cases();
+    micro_add_template_cases(device);
+    micro_add_values_cases();
+
+    // Частота TSC для пересчёта тактов: по короткому эталонному интервалу
+    double tsc_ghz = 0.0;
+    if (MICRO_HAVE_TSC) {
+        uint64_t start = micro_now_ns();
+        uint64_t start_cycles = micro_cycles();
+        while (micro_now_ns() - start < 20000000ull) {}
+        tsc_ghz = (double)(micro_cycles() - start_cycles) / (double)(micro_now_ns() - start);
+    }
+
+    printf("{\n");
+    printf("  \"crc_impl\": \"%s\",\n", modbus_crc16_impl_name(modbus_crc16_active_impl()));
+    printf("  \"regs_impl\": \"%s\",\n", modbus_regs_impl_name(modbus_regs_active_impl()));
+    printf("  \"tsc_ghz\": %.3f,\n", tsc_ghz);
+    printf("  \"results\": [");
+    int printed = 0;
+    for (int i = 0; i < micro_case_count; i++) {
+        const MicroCase* c = &micro_cases[i];
+        if (filter != NULL && strstr(c->name, filter) == NULL) continue;
+        MicroResult r = micro_run(c, min_time_ms * 1000000ull);
+        printf("%s\n    {\"name\": \"%s\", \"variant\": \"%s\", \"function_code\": %u, \"quantity\": %u, "
+               "\"bytes\": %u, \"ns_per_op\": %.2f, \"frames_per_s\": %.0f, ",
+               printed++ ? "," : "", c->name, c->variant, c->function_code, c->quantity,
+               c->bytes, r.ns_per_op, 1e9 / r.ns_per_op);
+        if (MICRO_HAVE_TSC && c->bytes > 0) {
+            printf("\"cycles_per_byte\": %.3f}", r.cycles_per_op / c->bytes);
+        } else {
+            printf("\"cycles_per_byte\": null}");
+        }
+        fflush(stdout);
+    }
+    printf("\n  ]\n}\n");
+
+    modbus_free_device(device);
+    return 0;
+}
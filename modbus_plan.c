@@ -0,0 +1,300 @@
+#include <stdlib.h>
+#include <string.h>
+#include "modbus_plan.h"
+
+#define PLANNER_GROUPS  (256 * MODBUS_TABLE_COUNT)
+
+typedef struct {
+    ModbusTag tag;
+    bool used;
+    uint32_t next_free;         // следующий свободный слот (для удалённых тегов)
+    uint16_t* values;           // последние полученные значения
+} PlannerTag;
+
+// Группа тегов одного (unit, table); планируется независимо от остальных
+typedef struct {
+    uint32_t* members;
+    uint32_t member_count;
+    uint32_t member_capacity;
+    bool dirty;
+    ModbusFrame* requests;
+    uint32_t* request_route_start;
+    uint32_t request_count;
+    ModbusPlanRoute* routes;
+    uint32_t route_count;
+} PlannerGroup;
+
+// Элемент сортировки тегов группы по адресу
+typedef struct {
+    uint16_t address;
+    uint16_t width;
+    uint32_t tag_id;
+} PlannerSortItem;
+
+struct ModbusPlanner {
+    uint16_t register_gap;
+    uint16_t bit_gap;
+    PlannerTag* tags;
+    uint32_t tag_count;
+    uint32_t tag_capacity;
+    uint32_t free_head;         // UINT32_MAX - свободных слотов нет
+    PlannerGroup groups[PLANNER_GROUPS];
+    bool changed;
+    ModbusPlanRequest* flat;    // запросы всех групп подряд
+    uint32_t flat_count;
+    uint32_t flat_capacity;
+};
+
+static const uint8_t planner_function[MODBUS_TABLE_COUNT] = {
+    FC_READ_COILS, FC_READ_DISCRETE_INPUTS, FC_READ_HOLDING_REG, FC_READ_INPUT_REG
+};
+
+static bool planner_is_bits(uint8_t table) {
+    return table == MODBUS_TABLE_COILS || table == MODBUS_TABLE_DISCRETE_INPUTS;
+}
+
+static uint16_t planner_limit(uint8_t table) {
+    return planner_is_bits(table) ? MODBUS_MAX_READ_BITS : MODBUS_MAX_READ_REGS;
+}
+
+ModbusPlanner* modbus_planner_create(uint16_t register_gap, uint16_t bit_gap) {
+    ModbusPlanner* planner = (ModbusPlanner*)calloc(1, sizeof(ModbusPlanner));
+    if (planner == NULL) return NULL;
+    planner->register_gap = register_gap;
+    planner->bit_gap = bit_gap;
+    planner->free_head = UINT32_MAX;
+    return planner;
+}
+
+void modbus_planner_free(ModbusPlanner* planner) {
+    if (planner == NULL) return;
+    for (uint32_t i = 0; i < planner->tag_count; i++) free(planner->tags[i].values);
+    for (int g = 0; g < PLANNER_GROUPS; g++) {
+        free(planner->groups[g].members);
+        free(planner->groups[g].requests);
+        free(planner->groups[g].request_route_start);
+        free(planner->groups[g].routes);
+    }
+    free(planner->tags);
+    free(planner->flat);
+    free(planner);
+}
+
+static PlannerGroup* planner_group(ModbusPlanner* planner, const ModbusTag* tag) {
+    return &planner->groups[tag->unit * MODBUS_TABLE_COUNT + tag->table];
+}
+
+int modbus_planner_add_tag(ModbusPlanner* planner, const ModbusTag* tag, uint32_t* tag_id) {
+    if (tag->table >= MODBUS_TABLE_COUNT || tag->width == 0) return MODBUS_ERR_VALUE;
+    if (tag->width > planner_limit(tag->table)) return MODBUS_ERR_VALUE;
+    if ((uint32_t)tag->address + tag->width > 0x10000) return MODBUS_ERR_ADDRESS;
+
+    PlannerGroup* group = planner_group(planner, tag);
+    if (group->member_count == group->member_capacity) {
+        uint32_t capacity = group->member_capacity ? group->member_capacity * 2 : 8;
+        uint32_t* members = (uint32_t*)realloc(group->members, capacity * sizeof(uint32_t));
+        if (members == NULL) return MODBUS_ERR_VALUE;
+        group->members = members;
+        group->member_capacity = capacity;
+    }
+
+    uint16_t* values = (uint16_t*)calloc(tag->width, sizeof(uint16_t));
+    if (values == NULL) return MODBUS_ERR_VALUE;
+
+    uint32_t id;
+    if (planner->free_head != UINT32_MAX) {
+        id = planner->free_head;
+        planner->free_head = planner->tags[id].next_free;
+    } else {
+        if (planner->tag_count == planner->tag_capacity) {
+            uint32_t capacity = planner->tag_capacity ? planner->tag_capacity * 2 : 64;
+            PlannerTag* tags = (PlannerTag*)realloc(planner->tags, capacity * sizeof(PlannerTag));
+            if (tags == NULL) {
+                free(values);
+                return MODBUS_ERR_VALUE;
+            }
+            planner->tags = tags;
+            planner->tag_capacity = capacity;
+        }
+        id = planner->tag_count++;
+    }
+
+    planner->tags[id].tag = *tag;
+    planner->tags[id].used = true;
+    planner->tags[id].values = values;
+    group->members[group->member_count++] = id;
+    group->dirty = true;
+    planner->changed = true;
+    *tag_id = id;
+    return MODBUS_OK;
+}
+
+int modbus_planner_remove_tag(ModbusPlanner* planner, uint32_t tag_id) {
+    if (tag_id >= planner->tag_count || !planner->tags[tag_id].used) return MODBUS_ERR_VALUE;
+    PlannerTag* entry = &planner->tags[tag_id];
+    PlannerGroup* group = planner_group(planner, &entry->tag);
+
+    for (uint32_t i = 0; i < group->member_count; i++) {
+        if (group->members[i] == tag_id) {
+            group->members[i] = group->members[--group->member_count];
+            break;
+        }
+    }
+    free(entry->values);
+    entry->values = NULL;
+    entry->used = false;
+    entry->next_free = planner->free_head;
+    planner->free_head = tag_id;
+    group->dirty = true;
+    planner->changed = true;
+    return MODBUS_OK;
+}
+
+static int planner_compare(const void* a, const void* b) {
+    const PlannerSortItem* x = (const PlannerSortItem*)a;
+    const PlannerSortItem* y = (const PlannerSortItem*)b;
+    if (x->address != y->address) return x->address < y->address ? -1 : 1;
+    if (x->width != y->width) return x->width < y->width ? -1 : 1;
+    return 0;
+}
+
+static void planner_emit(PlannerGroup* group, uint8_t unit, uint8_t table,
+                         uint32_t block_start, uint32_t block_end, uint32_t first_route) {
+    group->requests[group->request_count] = (ModbusFrame){
+        .slave_id = unit,
+        .function_code = planner_function[table],
+        .address = (uint16_t)block_start,
+        .quantity = (uint16_t)(block_end - block_start),
+        .data = NULL,
+        .data_length = 0
+    };
+    group->request_route_start[group->request_count] = first_route;
+    group->request_count++;
+}
+
+// Жадное объединение тегов, отсортированных по адресу: блок расширяется, пока разрыв
+// не превышает допуск, а длина - ограничение протокола. Для отсортированных интервалов
+// это даёт минимальное число запросов.
+static int planner_plan_group(ModbusPlanner* planner, int index) {
+    PlannerGroup* group = &planner->groups[index];
+    uint8_t unit = (uint8_t)(index / MODBUS_TABLE_COUNT);
+    uint8_t table = (uint8_t)(index % MODBUS_TABLE_COUNT);
+    uint16_t limit = planner_limit(table);
+    uint32_t gap = planner_is_bits(table) ? planner->bit_gap : planner->register_gap;
+    uint32_t count = group->member_count;
+
+    group->dirty = false;
+    group->request_count = 0;
+    group->route_count = 0;
+    if (count == 0) return MODBUS_OK;
+
+    PlannerSortItem* items = (PlannerSortItem*)malloc(count * sizeof(PlannerSortItem));
+    ModbusFrame* requests = (ModbusFrame*)realloc(group->requests, count * sizeof(ModbusFrame));
+    if (requests != NULL) group->requests = requests;
+    uint32_t* starts = (uint32_t*)realloc(group->request_route_start, count * sizeof(uint32_t));
+    if (starts != NULL) group->request_route_start = starts;
+    ModbusPlanRoute* routes = (ModbusPlanRoute*)realloc(group->routes, count * sizeof(ModbusPlanRoute));
+    if (routes != NULL) group->routes = routes;
+    if (items == NULL || requests == NULL || starts == NULL || routes == NULL) {
+        free(items);
+        group->dirty = true;
+        return MODBUS_ERR_VALUE;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const ModbusTag* tag = &planner->tags[group->members[i]].tag;
+        items[i].address = tag->address;
+        items[i].width = tag->width;
+        items[i].tag_id = group->members[i];
+    }
+    qsort(items, count, sizeof(PlannerSortItem), planner_compare);
+
+    uint32_t block_start = items[0].address;
+    uint32_t block_end = block_start + items[0].width;
+    uint32_t first_route = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t start = items[i].address;
+        uint32_t end = start + items[i].width;
+        if (i > 0) {
+            uint32_t new_end = end > block_end ? end : block_end;
+            if (start <= block_end + gap && new_end - block_start <= limit) {
+                block_end = new_end;
+            } else {
+                planner_emit(group, unit, table, block_start, block_end, first_route);
+                first_route = i;
+                block_start = start;
+                block_end = end;
+            }
+        }
+        routes[i].tag_id = items[i].tag_id;
+        routes[i].offset = (uint16_t)(start - block_start);
+        routes[i].width = items[i].width;
+    }
+    planner_emit(group, unit, table, block_start, block_end, first_route);
+    group->route_count = count;
+    free(items);
+    return MODBUS_OK;
+}
+
+int modbus_planner_update(ModbusPlanner* planner) {
+    if (!planner->changed) return MODBUS_OK;
+
+    uint32_t total = 0;
+    for (int g = 0; g < PLANNER_GROUPS; g++) {
+        PlannerGroup* group = &planner->groups[g];
+        if (group->dirty) {
+            int status = planner_plan_group(planner, g);
+            if (status != MODBUS_OK) return status;
+        }
+        total += group->request_count;
+    }
+
+    if (total > planner->flat_capacity) {
+        ModbusPlanRequest* flat = (ModbusPlanRequest*)realloc(planner->flat, total * sizeof(ModbusPlanRequest));
+        if (flat == NULL) return MODBUS_ERR_VALUE;
+        planner->flat = flat;
+        planner->flat_capacity = total;
+    }
+
+    uint32_t n = 0;
+    for (int g = 0; g < PLANNER_GROUPS; g++) {
+        PlannerGroup* group = &planner->groups[g];
+        for (uint32_t r = 0; r < group->request_count; r++) {
+            uint32_t start = group->request_route_start[r];
+            uint32_t end = (r + 1 < group->request_count) ? group->request_route_start[r + 1] : group->route_count;
+            planner->flat[n].request = group->requests[r];
+            planner->flat[n].routes = &group->routes[start];
+            planner->flat[n].route_count = end - start;
+            n++;
+        }
+    }
+    planner->flat_count = n;
+    planner->changed = false;
+    return MODBUS_OK;
+}
+
+const ModbusPlanRequest* modbus_planner_requests(const ModbusPlanner* planner, uint32_t* count) {
+    *count = planner->flat_count;
+    return planner->flat;
+}
+
+int modbus_planner_scatter(ModbusPlanner* planner, uint32_t request_index, const ModbusResponse* response) {
+    if (request_index >= planner->flat_count) return MODBUS_ERR_VALUE;
+    // Маршруты ссылаются на теги на момент последнего update: удалённый тег или слот,
+    // выданный новому тегу другой ширины, в них не учтены
+    if (planner->changed) return MODBUS_ERR_MISMATCH;
+    const ModbusPlanRequest* plan = &planner->flat[request_index];
+    if (response->values == NULL || response->value_count < plan->request.quantity) return MODBUS_ERR_MISMATCH;
+
+    for (uint32_t i = 0; i < plan->route_count; i++) {
+        const ModbusPlanRoute* route = &plan->routes[i];
+        memcpy(planner->tags[route->tag_id].values, response->values + route->offset,
+               route->width * sizeof(uint16_t));
+    }
+    return MODBUS_OK;
+}
+
+const uint16_t* modbus_planner_tag_values(const ModbusPlanner* planner, uint32_t tag_id) {
+    if (tag_id >= planner->tag_count || !planner->tags[tag_id].used) return NULL;
+    return planner->tags[tag_id].values;
+}
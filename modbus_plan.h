@@ -0,0 +1,49 @@
+#ifndef MODBUS_PLAN_H
+#define MODBUS_PLAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "modbus.h"
+
+// Опрашиваемый тег: width регистров или бит начиная с address
+typedef struct {
+    uint8_t unit;
+    uint8_t table;                  // ModbusTable
+    uint16_t address;
+    uint16_t width;
+} ModbusTag;
+
+// Куда направить часть ответа: значения [offset, offset + width) -> тег tag_id
+typedef struct {
+    uint32_t tag_id;
+    uint16_t offset;
+    uint16_t width;
+} ModbusPlanRoute;
+
+// Объединённый запрос чтения и его карта разбора
+typedef struct {
+    ModbusFrame request;
+    const ModbusPlanRoute* routes;
+    uint32_t route_count;
+} ModbusPlanRequest;
+
+typedef struct ModbusPlanner ModbusPlanner;
+
+// register_gap / bit_gap - сколько лишних регистров/бит можно прочитать ради объединения
+ModbusPlanner* modbus_planner_create(uint16_t register_gap, uint16_t bit_gap);
+void modbus_planner_free(ModbusPlanner* planner);
+
+int modbus_planner_add_tag(ModbusPlanner* planner, const ModbusTag* tag, uint32_t* tag_id);
+int modbus_planner_remove_tag(ModbusPlanner* planner, uint32_t tag_id);
+
+// Перестраивает только группы (unit, table), в которых менялись теги.
+// Указатели из modbus_planner_requests действительны до следующего вызова.
+int modbus_planner_update(ModbusPlanner* planner);
+const ModbusPlanRequest* modbus_planner_requests(const ModbusPlanner* planner, uint32_t* count);
+
+// Раскладка разобранного ответа (response->values) по значениям тегов.
+// MODBUS_ERR_MISMATCH, если теги менялись после modbus_planner_update
+int modbus_planner_scatter(ModbusPlanner* planner, uint32_t request_index, const ModbusResponse* response);
+const uint16_t* modbus_planner_tag_values(const ModbusPlanner* planner, uint32_t tag_id);
+
+#endif // MODBUS_PLAN_H
@@ -0,0 +1,879 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "modbus_poller.h"
+
+#define POLLER_MAX_EVENTS       256
+#define POLLER_DEFAULT_DEPTH    256
+#define POLLER_WAKE             UINT32_MAX  // номер "устройства" eventfd остановки
+
+enum { POLLER_DOWN, POLLER_CONNECTING, POLLER_UP };
+
+// Операции io_uring; user_data = (устройство << 32) | (поколение << 8) | операция
+enum { POLLER_OP_CONNECT = 1, POLLER_OP_SEND, POLLER_OP_RECV, POLLER_OP_WAKE };
+
+typedef struct {
+    ModbusRequestTemplate tpl;
+    int device;
+    uint64_t period_us;
+    uint64_t due_us;
+    bool queued;                // ждёт в очереди устройства или в полёте
+    int next;                   // следующий в очереди устройства, -1 - конец
+    ModbusTcpCompletion callback;
+    void* user;
+} PollerSchedule;
+
+typedef struct {
+    int fd;
+    struct sockaddr_in addr;
+    uint8_t state;
+    bool ready;                 // в списке устройств, которым можно отправлять
+    bool want_write;            // epoll: ждём EPOLLOUT
+    uint16_t generation;        // io_uring: завершения операций прежних сокетов отбрасываются
+    uint16_t ops;               // io_uring: операции устройства в ядре
+    uint16_t transaction_id;
+    int current;                // расписание в полёте, -1 - нет
+    int queue_head;
+    int queue_tail;
+    uint64_t deadline_us;       // ответа или установки соединения
+    uint64_t reconnect_us;
+    uint8_t* tx;                // в зарегистрированной области buffers
+    uint16_t tx_length;
+    uint16_t tx_sent;
+    uint8_t* rx;
+    uint16_t rx_length;
+} PollerDevice;
+
+// Кольца io_uring, отображённые в память процесса
+typedef struct {
+    int fd;
+    bool fixed;                 // буферы зарегистрированы: приём через READ_FIXED
+    unsigned sq_entries;
+    unsigned sq_mask;
+    unsigned sq_local_tail;     // заполненные, но ещё не опубликованные SQE
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned cq_mask;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    struct io_uring_cqe* cqes;
+    struct io_uring_sqe* sqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} PollerRing;
+
+struct ModbusPoller {
+    ModbusPollerBackend backend;
+    uint32_t max_devices;
+    uint64_t timeout_us;
+    uint64_t reconnect_delay_us;
+    int epoll_fd;
+    int wake_fd;
+    uint64_t wake_value;        // приёмник чтения eventfd через io_uring
+    atomic_bool stop;
+    PollerRing ring;
+    uint8_t* buffers;           // tx и rx всех устройств подряд
+    size_t buffers_size;
+    PollerDevice* devices;
+    int device_count;
+    PollerSchedule* schedules;
+    int schedule_count;
+    int schedule_capacity;
+    int* heap;                  // расписания, упорядоченные по due_us
+    int* ready;
+    int ready_count;
+    uint64_t next_timer_us;     // не позже ближайшего тайм-аута или переподключения
+    ModbusPollerStats stats;
+    uint16_t values[MODBUS_MAX_READ_BITS];  // значения ответа на время обработчика
+};
+
+static uint64_t poller_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+// ----- io_uring без liburing -----
+
+static void ring_teardown(PollerRing* ring) {
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static int ring_setup(PollerRing* ring, unsigned entries, unsigned cq_entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = cq_entries;
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return MODBUS_ERR_IO;
+    // Ожидание с тайм-аутом без отдельной SQE таймера
+    if (!(params.features & IORING_FEAT_EXT_ARG)) goto fail;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) goto fail;
+    if (single) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) goto fail;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) goto fail;
+
+    uint8_t* sq = (uint8_t*)ring->sq_ring;
+    uint8_t* cq = (uint8_t*)ring->cq_ring;
+    ring->sq_entries = params.sq_entries;
+    ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return MODBUS_OK;
+
+fail:
+    ring_teardown(ring);
+    return MODBUS_ERR_IO;
+}
+
+// Публикация SQE и вход в ядро; min_complete > 0 - ждать завершений не дольше timeout_us (< 0 - без срока)
+static int ring_enter(PollerRing* ring, unsigned min_complete, int64_t timeout_us) {
+    atomic_store_explicit((_Atomic unsigned*)ring->sq_tail, ring->sq_local_tail, memory_order_release);
+    unsigned to_submit = ring->sq_local_tail -
+                         atomic_load_explicit((_Atomic unsigned*)ring->sq_head, memory_order_acquire);
+    unsigned flags = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    void* argp = NULL;
+    size_t arg_size = 0;
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout_us >= 0) {
+            ts.tv_sec = timeout_us / 1000000;
+            ts.tv_nsec = (timeout_us % 1000000) * 1000;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            arg_size = sizeof(arg);
+        }
+    }
+    if (to_submit == 0 && min_complete == 0) return MODBUS_OK;
+    long ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, flags, argp, arg_size);
+    if (ret >= 0 || errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY) return MODBUS_OK;
+    return MODBUS_ERR_IO;
+}
+
+// Свободная SQE; при заполненной очереди накопленное отправляется в ядро
+static struct io_uring_sqe* ring_sqe(PollerRing* ring) {
+    unsigned head = atomic_load_explicit((_Atomic unsigned*)ring->sq_head, memory_order_acquire);
+    if (ring->sq_local_tail - head == ring->sq_entries) {
+        if (ring_enter(ring, 0, 0) != MODBUS_OK) return NULL;
+        head = atomic_load_explicit((_Atomic unsigned*)ring->sq_head, memory_order_acquire);
+        if (ring->sq_local_tail - head == ring->sq_entries) return NULL;
+    }
+    unsigned index = ring->sq_local_tail & ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+    return sqe;
+}
+
+static uint64_t ring_user_data(uint32_t device, uint16_t generation, uint8_t op) {
+    return ((uint64_t)device << 32) | ((uint64_t)generation << 8) | op;
+}
+
+// ----- Расписания -----
+
+static bool heap_less(const ModbusPoller* poller, int a, int b) {
+    return poller->schedules[poller->heap[a]].due_us < poller->schedules[poller->heap[b]].due_us;
+}
+
+static void heap_swap(ModbusPoller* poller, int a, int b) {
+    int tmp = poller->heap[a];
+    poller->heap[a] = poller->heap[b];
+    poller->heap[b] = tmp;
+}
+
+static void heap_push(ModbusPoller* poller, int count, int schedule) {
+    int i = count;
+    poller->heap[i] = schedule;
+    while (i > 0 && heap_less(poller, i, (i - 1) / 2)) {
+        heap_swap(poller, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+// Вершина изменила срок: просеивание вниз
+static void heap_sift_down(ModbusPoller* poller, int count) {
+    int i = 0;
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < count && heap_less(poller, left, smallest)) smallest = left;
+        if (right < count && heap_less(poller, right, smallest)) smallest = right;
+        if (smallest == i) return;
+        heap_swap(poller, i, smallest);
+        i = smallest;
+    }
+}
+
+static void poller_mark_ready(ModbusPoller* poller, int index) {
+    PollerDevice* dev = &poller->devices[index];
+    if (dev->ready) return;
+    dev->ready = true;
+    poller->ready[poller->ready_count++] = index;
+}
+
+static void poller_timer(ModbusPoller* poller, uint64_t at_us) {
+    if (at_us < poller->next_timer_us) poller->next_timer_us = at_us;
+}
+
+static void poller_notify(ModbusPoller* poller, int index, PollerSchedule* schedule, int status,
+                          const ModbusResponse* response) {
+    switch(status) {
+    case MODBUS_OK:          poller->stats.responses++; break;
+    case MODBUS_ERR_TIMEOUT: poller->stats.timeouts++; break;
+    case MODBUS_ERR_IO:      poller->stats.io_errors++; break;
+    default:                 poller->stats.failures++; break;
+    }
+    if (schedule->callback != NULL) {
+        ModbusResponse empty = {0};
+        schedule->callback(schedule->user, index, &schedule->tpl.frame, status,
+                           response != NULL ? response : &empty);
+    }
+}
+
+// Завершение запроса в полёте; устройство может сразу отправить следующий
+static void poller_complete(ModbusPoller* poller, int index, int status, const ModbusResponse* response) {
+    PollerDevice* dev = &poller->devices[index];
+    PollerSchedule* schedule = &poller->schedules[dev->current];
+    dev->current = -1;
+    schedule->queued = false;
+    poller_mark_ready(poller, index);
+    poller_notify(poller, index, schedule, status, response);
+}
+
+// ----- Соединения -----
+
+static void poller_fail(ModbusPoller* poller, int index) {
+    PollerDevice* dev = &poller->devices[index];
+    if (dev->state == POLLER_DOWN) return;
+    if (dev->state == POLLER_UP) poller->stats.disconnects++;
+    dev->state = POLLER_DOWN;
+    dev->generation++;
+    if (dev->fd >= 0) {
+        // shutdown завершает операции io_uring, ещё ждущие на сокете
+        if (poller->backend == MODBUS_POLLER_IO_URING) shutdown(dev->fd, SHUT_RDWR);
+        close(dev->fd);
+        dev->fd = -1;
+    }
+    dev->want_write = false;
+    dev->rx_length = 0;
+    dev->tx_length = 0;
+    dev->tx_sent = 0;
+    dev->reconnect_us = poller_now_us() + poller->reconnect_delay_us;
+    poller_timer(poller, dev->reconnect_us);
+
+    if (dev->current >= 0) poller_complete(poller, index, MODBUS_ERR_IO, NULL);
+    while (dev->queue_head >= 0) {
+        PollerSchedule* schedule = &poller->schedules[dev->queue_head];
+        dev->queue_head = schedule->next;
+        schedule->queued = false;
+        poller_notify(poller, index, schedule, MODBUS_ERR_IO, NULL);
+    }
+    dev->queue_tail = -1;
+}
+
+static void uring_recv(ModbusPoller* poller, int index) {
+    PollerDevice* dev = &poller->devices[index];
+    struct io_uring_sqe* sqe = ring_sqe(&poller->ring);
+    if (sqe == NULL) {
+        poller_fail(poller, index);
+        return;
+    }
+    sqe->fd = dev->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(dev->rx + dev->rx_length);
+    sqe->len = MODBUS_POLLER_BUFFER - dev->rx_length;
+    if (poller->ring.fixed) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = 0;
+    } else {
+        sqe->opcode = IORING_OP_RECV;
+    }
+    sqe->user_data = ring_user_data((uint32_t)index, dev->generation, POLLER_OP_RECV);
+    dev->ops++;
+}
+
+// Запись в сокет через io_uring шла бы без MSG_NOSIGNAL (SIGPIPE при разрыве),
+// поэтому отправка - IORING_OP_SEND из той же области буферов
+static void uring_send(ModbusPoller* poller, int index) {
+    PollerDevice* dev = &poller->devices[index];
+    struct io_uring_sqe* sqe = ring_sqe(&poller->ring);
+    if (sqe == NULL) {
+        poller_fail(poller, index);
+        return;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = dev->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(dev->tx + dev->tx_sent);
+    sqe->len = dev->tx_length - dev->tx_sent;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = ring_user_data((uint32_t)index, dev->generation, POLLER_OP_SEND);
+    dev->ops++;
+}
+
+static void uring_wake(ModbusPoller* poller) {
+    struct io_uring_sqe* sqe = ring_sqe(&poller->ring);
+    if (sqe == NULL) return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = poller->wake_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&poller->wake_value;
+    sqe->len = sizeof(poller->wake_value);
+    sqe->user_data = ring_user_data(POLLER_WAKE, 0, POLLER_OP_WAKE);
+}
+
+static void epoll_want_write(ModbusPoller* poller, int index, bool want_write) {
+    PollerDevice* dev = &poller->devices[index];
+    if (dev->want_write == want_write) return;
+    struct epoll_event ev = { .events = want_write ? EPOLLIN | EPOLLOUT : EPOLLIN, .data.u32 = (uint32_t)index };
+    if (epoll_ctl(poller->epoll_fd, EPOLL_CTL_MOD, dev->fd, &ev) != 0) {
+        poller_fail(poller, index);
+        return;
+    }
+    dev->want_write = want_write;
+}
+
+static void epoll_flush(ModbusPoller* poller, int index) {
+    PollerDevice* dev = &poller->devices[index];
+    while (dev->tx_sent < dev->tx_length) {
+        ssize_t n = send(dev->fd, dev->tx + dev->tx_sent, dev->tx_length - dev->tx_sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            dev->tx_sent += (uint16_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            epoll_want_write(poller, index, true);
+            return;
+        }
+        poller_fail(poller, index);
+        return;
+    }
+    epoll_want_write(poller, index, false);
+}
+
+static void poller_on_connected(ModbusPoller* poller, int index) {
+    PollerDevice* dev = &poller->devices[index];
+    dev->state = POLLER_UP;
+    poller->stats.connects++;
+    if (poller->backend == MODBUS_POLLER_IO_URING) uring_recv(poller, index);
+    poller_mark_ready(poller, index);
+}
+
+static void poller_connect(ModbusPoller* poller, int index, uint64_t now) {
+    PollerDevice* dev = &poller->devices[index];
+    bool uring = poller->backend == MODBUS_POLLER_IO_URING;
+    // io_uring сам ждёт готовности блокирующего сокета
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | (uring ? 0 : SOCK_NONBLOCK), 0);
+    if (fd < 0) {
+        dev->reconnect_us = now + poller->reconnect_delay_us;
+        poller_timer(poller, dev->reconnect_us);
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    dev->fd = fd;
+    dev->state = POLLER_CONNECTING;
+    dev->deadline_us = now + poller->timeout_us;
+    poller_timer(poller, dev->deadline_us);
+
+    if (uring) {
+        struct io_uring_sqe* sqe = ring_sqe(&poller->ring);
+        if (sqe == NULL) {
+            poller_fail(poller, index);
+            return;
+        }
+        sqe->opcode = IORING_OP_CONNECT;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)&dev->addr;
+        sqe->off = sizeof(dev->addr);
+        sqe->user_data = ring_user_data((uint32_t)index, dev->generation, POLLER_OP_CONNECT);
+        dev->ops++;
+        return;
+    }
+
+    bool connecting = false;
+    if (connect(fd, (struct sockaddr*)&dev->addr, sizeof(dev->addr)) != 0) {
+        if (errno != EINPROGRESS) {
+            poller_fail(poller, index);
+            return;
+        }
+        connecting = true;
+    }
+    dev->want_write = connecting;
+    struct epoll_event ev = { .events = connecting ? EPOLLOUT : EPOLLIN, .data.u32 = (uint32_t)index };
+    if (epoll_ctl(poller->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        poller_fail(poller, index);
+        return;
+    }
+    if (!connecting) poller_on_connected(poller, index);
+}
+
+// Отправка следующего запроса из очереди устройства
+static void poller_start(ModbusPoller* poller, int index, uint64_t now) {
+    PollerDevice* dev = &poller->devices[index];
+    if (dev->state != POLLER_UP || dev->current >= 0 || dev->queue_head < 0) return;
+
+    int schedule_index = dev->queue_head;
+    PollerSchedule* schedule = &poller->schedules[schedule_index];
+    dev->queue_head = schedule->next;
+    if (dev->queue_head < 0) dev->queue_tail = -1;
+    dev->current = schedule_index;
+    dev->transaction_id++;
+
+    memcpy(dev->tx, schedule->tpl.adu, schedule->tpl.length);
+    dev->tx[0] = (dev->transaction_id >> 8) & 0xFF;
+    dev->tx[1] = dev->transaction_id & 0xFF;
+    dev->tx_length = schedule->tpl.length;
+    dev->tx_sent = 0;
+    dev->deadline_us = now + poller->timeout_us;
+    poller_timer(poller, dev->deadline_us);
+    poller->stats.requests++;
+
+    if (poller->backend == MODBUS_POLLER_IO_URING) {
+        uring_send(poller, index);
+    } else {
+        epoll_flush(poller, index);
+    }
+}
+
+// Разбор принятых ADU; ответы на запросы, завершённые по тайм-ауту, отбрасываются по transaction id
+static void poller_on_received(ModbusPoller* poller, int index) {
+    PollerDevice* dev = &poller->devices[index];
+    uint16_t offset = 0;
+    for (;;) {
+        uint16_t transaction_id, adu_length;
+        if (modbus_tcp_parse_mbap(dev->rx + offset, dev->rx_length - offset,
+                                  &transaction_id, &adu_length) != MODBUS_OK) {
+            poller_fail(poller, index);
+            return;
+        }
+        if (adu_length == 0) break;
+        if (dev->current >= 0 && transaction_id == dev->transaction_id) {
+            ModbusResponse response = {
+                .values = poller->values,
+                .values_capacity = MODBUS_MAX_READ_BITS
+            };
+            int status = modbus_decode_pdu(&poller->schedules[dev->current].tpl.frame, dev->rx + offset + 6,
+                                           adu_length - 6, &response);
+            poller_complete(poller, index, status, &response);
+        }
+        offset += adu_length;
+    }
+    if (offset > 0) {
+        memmove(dev->rx, dev->rx + offset, dev->rx_length - offset);
+        dev->rx_length -= offset;
+    }
+}
+
+static void poller_on_cqe(ModbusPoller* poller, uint64_t user_data, int32_t result) {
+    uint32_t index = (uint32_t)(user_data >> 32);
+    uint16_t generation = (uint16_t)(user_data >> 8);
+    uint8_t op = (uint8_t)user_data;
+    if (op == POLLER_OP_WAKE) {
+        uring_wake(poller);
+        return;
+    }
+
+    PollerDevice* dev = &poller->devices[index];
+    dev->ops--;
+    if (generation != dev->generation) return;
+
+    switch(op) {
+    case POLLER_OP_CONNECT:
+        if (result < 0) {
+            poller_fail(poller, (int)index);
+        } else {
+            poller_on_connected(poller, (int)index);
+        }
+        break;
+    case POLLER_OP_SEND:
+        if (result <= 0) {
+            poller_fail(poller, (int)index);
+            break;
+        }
+        dev->tx_sent += (uint16_t)result;
+        if (dev->tx_sent < dev->tx_length) uring_send(poller, (int)index);
+        break;
+    case POLLER_OP_RECV:
+        if (result <= 0) {
+            poller_fail(poller, (int)index);
+            break;
+        }
+        dev->rx_length += (uint16_t)result;
+        poller_on_received(poller, (int)index);
+        if (dev->state == POLLER_UP && dev->generation == generation) uring_recv(poller, (int)index);
+        break;
+    default:
+        break;
+    }
+}
+
+static void epoll_on_event(ModbusPoller* poller, int index, uint32_t events) {
+    PollerDevice* dev = &poller->devices[index];
+    if (dev->state == POLLER_DOWN) return;
+    if (events & EPOLLOUT) {
+        if (dev->state == POLLER_CONNECTING) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(dev->fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+                poller_fail(poller, index);
+                return;
+            }
+            epoll_want_write(poller, index, false);
+            if (dev->state == POLLER_DOWN) return;
+            poller_on_connected(poller, index);
+        } else {
+            epoll_flush(poller, index);
+        }
+        if (dev->state == POLLER_DOWN) return;
+    }
+    // Данные, пришедшие перед закрытием соединения, разбираются до обработки HUP
+    if (events & EPOLLIN) {
+        ssize_t n = recv(dev->fd, dev->rx + dev->rx_length, MODBUS_POLLER_BUFFER - dev->rx_length, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            poller_fail(poller, index);
+            return;
+        }
+        if (n > 0) {
+            dev->rx_length += (uint16_t)n;
+            poller_on_received(poller, index);
+        }
+    }
+    if ((events & (EPOLLERR | EPOLLHUP)) && dev->state != POLLER_DOWN) poller_fail(poller, index);
+}
+
+// ----- Создание -----
+
+ModbusPoller* modbus_poller_create(const ModbusPollerConfig* config) {
+    if (config->max_devices == 0 || config->max_devices >= POLLER_WAKE) return NULL;
+    ModbusPoller* poller = (ModbusPoller*)calloc(1, sizeof(ModbusPoller));
+    if (poller == NULL) return NULL;
+    poller->epoll_fd = -1;
+    poller->wake_fd = -1;
+    poller->ring.fd = -1;
+    poller->max_devices = config->max_devices;
+    poller->timeout_us = (uint64_t)config->timeout_ms * 1000u;
+    poller->reconnect_delay_us = (uint64_t)config->reconnect_ms * 1000u;
+    poller->next_timer_us = UINT64_MAX;
+    atomic_init(&poller->stop, false);
+
+    poller->devices = (PollerDevice*)calloc(config->max_devices, sizeof(PollerDevice));
+    poller->ready = (int*)malloc(config->max_devices * sizeof(int));
+    poller->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    poller->buffers_size = (size_t)config->max_devices * 2 * MODBUS_POLLER_BUFFER;
+    poller->buffers = (uint8_t*)mmap(NULL, poller->buffers_size, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (poller->buffers == MAP_FAILED) poller->buffers = NULL;
+    if (poller->devices == NULL || poller->ready == NULL || poller->wake_fd < 0 || poller->buffers == NULL) {
+        goto fail;
+    }
+
+    if (config->backend != MODBUS_POLLER_EPOLL) {
+        unsigned depth = config->queue_depth ? config->queue_depth : POLLER_DEFAULT_DEPTH;
+        // В ядре одновременно до двух операций на устройство и чтение eventfd
+        unsigned cq = 2 * depth;
+        while (cq < 2 * config->max_devices + 2) cq *= 2;
+        if (ring_setup(&poller->ring, depth, cq) == MODBUS_OK) {
+            struct iovec iov = { .iov_base = poller->buffers, .iov_len = poller->buffers_size };
+            // Без регистрации (например, мал RLIMIT_MEMLOCK) приём идёт обычным IORING_OP_RECV
+            poller->ring.fixed = syscall(__NR_io_uring_register, poller->ring.fd, IORING_REGISTER_BUFFERS,
+                                         &iov, 1) == 0;
+            poller->backend = MODBUS_POLLER_IO_URING;
+            uring_wake(poller);
+        } else if (config->backend == MODBUS_POLLER_IO_URING) {
+            goto fail;
+        }
+    }
+    if (poller->ring.fd < 0) {
+        poller->backend = MODBUS_POLLER_EPOLL;
+        poller->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (poller->epoll_fd < 0) goto fail;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = POLLER_WAKE };
+        if (epoll_ctl(poller->epoll_fd, EPOLL_CTL_ADD, poller->wake_fd, &ev) != 0) goto fail;
+    }
+    return poller;
+
+fail:
+    modbus_poller_free(poller);
+    return NULL;
+}
+
+void modbus_poller_free(ModbusPoller* poller) {
+    if (poller == NULL) return;
+    for (int i = 0; i < poller->device_count; i++) {
+        if (poller->devices[i].fd >= 0) close(poller->devices[i].fd);
+    }
+    // Кольцо закрывается раньше области буферов: ядро отменяет операции, ссылающиеся на неё
+    if (poller->ring.fd >= 0) ring_teardown(&poller->ring);
+    if (poller->epoll_fd >= 0) close(poller->epoll_fd);
+    if (poller->wake_fd >= 0) close(poller->wake_fd);
+    if (poller->buffers != NULL) munmap(poller->buffers, poller->buffers_size);
+    free(poller->devices);
+    free(poller->ready);
+    free(poller->schedules);
+    free(poller->heap);
+    free(poller);
+}
+
+ModbusPollerBackend modbus_poller_backend(const ModbusPoller* poller) {
+    return poller->backend;
+}
+
+int modbus_poller_add_device(ModbusPoller* poller, const char* address, uint16_t port, int* device) {
+    if ((uint32_t)poller->device_count == poller->max_devices) return MODBUS_ERR_VALUE;
+    PollerDevice* dev = &poller->devices[poller->device_count];
+    memset(dev, 0, sizeof(*dev));
+    dev->addr.sin_family = AF_INET;
+    dev->addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &dev->addr.sin_addr) != 1) return MODBUS_ERR_VALUE;
+
+    int index = poller->device_count++;
+    dev->fd = -1;
+    dev->state = POLLER_DOWN;
+    dev->current = -1;
+    dev->queue_head = -1;
+    dev->queue_tail = -1;
+    dev->tx = poller->buffers + (size_t)index * 2 * MODBUS_POLLER_BUFFER;
+    dev->rx = dev->tx + MODBUS_POLLER_BUFFER;
+    dev->reconnect_us = 0;
+    poller_timer(poller, 0);
+    *device = index;
+    return MODBUS_OK;
+}
+
+bool modbus_poller_connected(const ModbusPoller* poller, int device) {
+    if (device < 0 || device >= poller->device_count) return false;
+    return poller->devices[device].state == POLLER_UP;
+}
+
+int modbus_poller_add_schedule(ModbusPoller* poller, int device, const ModbusFrame* request,
+                               uint32_t period_ms, ModbusTcpCompletion callback, void* user) {
+    if (device < 0 || device >= poller->device_count || period_ms == 0) return MODBUS_ERR_VALUE;
+    if (poller->schedule_count == poller->schedule_capacity) {
+        int capacity = poller->schedule_capacity ? poller->schedule_capacity * 2 : 64;
+        PollerSchedule* schedules = (PollerSchedule*)realloc(poller->schedules, capacity * sizeof(PollerSchedule));
+        if (schedules == NULL) return MODBUS_ERR_VALUE;
+        poller->schedules = schedules;
+        int* heap = (int*)realloc(poller->heap, capacity * sizeof(int));
+        if (heap == NULL) return MODBUS_ERR_VALUE;
+        poller->heap = heap;
+        poller->schedule_capacity = capacity;
+    }
+
+    PollerSchedule* schedule = &poller->schedules[poller->schedule_count];
+    int status = modbus_template_compile(&schedule->tpl, MODBUS_TEMPLATE_TCP, request);
+    if (status != MODBUS_OK) return status;
+    schedule->device = device;
+    schedule->period_us = (uint64_t)period_ms * 1000u;
+    schedule->due_us = poller_now_us();
+    schedule->queued = false;
+    schedule->next = -1;
+    schedule->callback = callback;
+    schedule->user = user;
+    heap_push(poller, poller->schedule_count, poller->schedule_count);
+    poller->schedule_count++;
+    return MODBUS_OK;
+}
+
+// ----- Цикл -----
+
+// Наступившие сроки расписаний: запрос в очередь устройства, следующий срок - через период
+static void poller_dispatch_due(ModbusPoller* poller, uint64_t now) {
+    while (poller->schedule_count > 0) {
+        int schedule_index = poller->heap[0];
+        PollerSchedule* schedule = &poller->schedules[schedule_index];
+        if (schedule->due_us > now) break;
+
+        schedule->due_us += schedule->period_us;
+        if (schedule->due_us <= now) schedule->due_us = now + schedule->period_us;  // пропущенные циклы
+        heap_sift_down(poller, poller->schedule_count);
+
+        PollerDevice* dev = &poller->devices[schedule->device];
+        if (schedule->queued) {
+            poller->stats.overruns++;
+        } else if (dev->state == POLLER_DOWN) {
+            poller_notify(poller, schedule->device, schedule, MODBUS_ERR_IO, NULL);
+        } else {
+            schedule->queued = true;
+            schedule->next = -1;
+            if (dev->queue_tail >= 0) {
+                poller->schedules[dev->queue_tail].next = schedule_index;
+            } else {
+                dev->queue_head = schedule_index;
+            }
+            dev->queue_tail = schedule_index;
+            poller_mark_ready(poller, schedule->device);
+        }
+    }
+}
+
+// Тайм-ауты ответов и соединений, переподключения
+static void poller_check_timers(ModbusPoller* poller, uint64_t now) {
+    if (now < poller->next_timer_us) return;
+    poller->next_timer_us = UINT64_MAX;
+    for (int index = 0; index < poller->device_count; index++) {
+        PollerDevice* dev = &poller->devices[index];
+        switch(dev->state) {
+        case POLLER_DOWN:
+            if (dev->reconnect_us > now) {
+                poller_timer(poller, dev->reconnect_us);
+            } else if (dev->ops > 0) {
+                // Операции прежнего сокета ещё в ядре: буферы устройства заняты
+                poller_timer(poller, now + 1000);
+            } else {
+                poller_connect(poller, index, now);
+            }
+            break;
+        case POLLER_CONNECTING:
+            if (dev->deadline_us <= now) {
+                poller_fail(poller, index);
+            } else {
+                poller_timer(poller, dev->deadline_us);
+            }
+            break;
+        case POLLER_UP:
+            if (dev->current < 0) break;
+            if (dev->deadline_us <= now) {
+                poller_complete(poller, index, MODBUS_ERR_TIMEOUT, NULL);
+                // Запрос не ушёл целиком: буфер tx ещё у SEND в ядре (io_uring) или ждёт EPOLLOUT,
+                // и следующий запрос испортил бы его. Разрыв отменяет SEND, а переподключение
+                // ждёт завершения всех операций прежнего сокета
+                if (dev->tx_sent < dev->tx_length) poller_fail(poller, index);
+            } else {
+                poller_timer(poller, dev->deadline_us);
+            }
+            break;
+        }
+    }
+}
+
+static void poller_flush_ready(ModbusPoller* poller, uint64_t now) {
+    // Обработчики завершений могут добавлять устройства в список во время обхода
+    for (int i = 0; i < poller->ready_count; i++) {
+        int index = poller->ready[i];
+        poller->devices[index].ready = false;
+        poller_start(poller, index, now);
+    }
+    poller->ready_count = 0;
+}
+
+int modbus_poller_run_once(ModbusPoller* poller, int timeout_ms) {
+    // Сначала подключения: запросы устройств, которые начали подключаться, ждут в очереди
+    uint64_t now = poller_now_us();
+    poller_check_timers(poller, now);
+    poller_dispatch_due(poller, now);
+    poller_flush_ready(poller, now);
+
+    int64_t wait_us = timeout_ms < 0 ? -1 : (int64_t)timeout_ms * 1000;
+    uint64_t next = poller->next_timer_us;
+    if (poller->schedule_count > 0 && poller->schedules[poller->heap[0]].due_us < next) {
+        next = poller->schedules[poller->heap[0]].due_us;
+    }
+    if (next != UINT64_MAX) {
+        int64_t left = next > now ? (int64_t)(next - now) : 0;
+        if (wait_us < 0 || left < wait_us) wait_us = left;
+    }
+    if (atomic_load(&poller->stop)) wait_us = 0;
+
+    if (poller->backend == MODBUS_POLLER_IO_URING) {
+        PollerRing* ring = &poller->ring;
+        if (ring_enter(ring, wait_us == 0 ? 0 : 1, wait_us) != MODBUS_OK) return MODBUS_ERR_IO;
+        unsigned head = *ring->cq_head;
+        unsigned tail = atomic_load_explicit((_Atomic unsigned*)ring->cq_tail, memory_order_acquire);
+        while (head != tail) {
+            struct io_uring_cqe cqe = ring->cqes[head & ring->cq_mask];
+            head++;
+            atomic_store_explicit((_Atomic unsigned*)ring->cq_head, head, memory_order_release);
+            poller_on_cqe(poller, cqe.user_data, cqe.res);
+        }
+    } else {
+        struct epoll_event events[POLLER_MAX_EVENTS];
+        int wait_ms = wait_us < 0 ? -1 : (int)((wait_us + 999) / 1000);
+        int count = epoll_wait(poller->epoll_fd, events, POLLER_MAX_EVENTS, wait_ms);
+        if (count < 0 && errno != EINTR) return MODBUS_ERR_IO;
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.u32 == POLLER_WAKE) {
+                uint64_t value;
+                while (read(poller->wake_fd, &value, sizeof(value)) > 0) {}
+                continue;
+            }
+            epoll_on_event(poller, (int)events[i].data.u32, events[i].events);
+        }
+    }
+
+    // epoll: следующие запросы уходят сразу; io_uring: SQE уйдут со следующим входом в ядро
+    now = poller_now_us();
+    poller_check_timers(poller, now);
+    poller_flush_ready(poller, now);
+    return MODBUS_OK;
+}
+
+int modbus_poller_run(ModbusPoller* poller) {
+    while (!atomic_load(&poller->stop)) {
+        int status = modbus_poller_run_once(poller, -1);
+        if (status != MODBUS_OK) return status;
+    }
+    atomic_store(&poller->stop, false);
+    return MODBUS_OK;
+}
+
+void modbus_poller_stop(ModbusPoller* poller) {
+    atomic_store(&poller->stop, true);
+    uint64_t one = 1;
+    ssize_t written = write(poller->wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+void modbus_poller_stats(const ModbusPoller* poller, ModbusPollerStats* stats) {
+    *stats = poller->stats;
+}
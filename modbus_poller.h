@@ -0,0 +1,68 @@
+#ifndef MODBUS_POLLER_H
+#define MODBUS_POLLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "modbus.h"
+#include "modbus_tcp.h"
+
+// Циклический опрос множества Modbus TCP slave из одного потока.
+// У каждого устройства одно соединение и один запрос в полёте; запросы расписаний
+// заранее скомпилированы (modbus_template.h). Отправки и приёмы всех соединений
+// уходят в ядро пачкой за один io_uring_enter (или обрабатываются пачкой событий epoll).
+// Разорванные соединения переустанавливаются автоматически.
+// Опрос не потокобезопасен: для двух потоков - два опросчика с разными устройствами.
+
+// Буферы приёма и передачи соединения: один ADU Modbus TCP
+#define MODBUS_POLLER_BUFFER    MODBUS_TCP_MAX_ADU_SIZE
+
+typedef enum {
+    MODBUS_POLLER_AUTO = 0,     // io_uring, если ядро его поддерживает, иначе epoll
+    MODBUS_POLLER_IO_URING,
+    MODBUS_POLLER_EPOLL
+} ModbusPollerBackend;
+
+typedef struct {
+    ModbusPollerBackend backend;
+    uint32_t max_devices;       // размер зарегистрированных буферов, задаётся при создании
+    uint32_t timeout_ms;        // тайм-аут ответа и установки соединения
+    uint32_t reconnect_ms;      // пауза перед повторным подключением
+    uint32_t queue_depth;       // размер очереди отправки io_uring; 0 - 256
+} ModbusPollerConfig;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t responses;         // завершены с MODBUS_OK
+    uint64_t failures;          // ошибки разбора и исключения slave
+    uint64_t timeouts;
+    uint64_t io_errors;         // запросы, не выполненные из-за разрыва соединения
+    uint64_t overruns;          // срок опроса наступил, а прошлый запрос ещё не завершён
+    uint64_t connects;
+    uint64_t disconnects;
+} ModbusPollerStats;
+
+typedef struct ModbusPoller ModbusPoller;
+
+ModbusPoller* modbus_poller_create(const ModbusPollerConfig* config);
+void modbus_poller_free(ModbusPoller* poller);
+ModbusPollerBackend modbus_poller_backend(const ModbusPoller* poller);
+
+// Подключение начинается при следующем modbus_poller_run_once
+int modbus_poller_add_device(ModbusPoller* poller, const char* address, uint16_t port, int* device);
+bool modbus_poller_connected(const ModbusPoller* poller, int device);
+
+// Запрос request каждые period_ms; результат - в callback (connection = номер устройства).
+// Пока устройство недоступно, запросы завершаются с MODBUS_ERR_IO.
+int modbus_poller_add_schedule(ModbusPoller* poller, int device, const ModbusFrame* request,
+                               uint32_t period_ms, ModbusTcpCompletion callback, void* user);
+
+// Один проход: сроки расписаний, отправка, ожидание не дольше timeout_ms (< 0 - до события),
+// обработка завершений
+int modbus_poller_run_once(ModbusPoller* poller, int timeout_ms);
+// Цикл до вызова modbus_poller_stop (можно из другого потока)
+int modbus_poller_run(ModbusPoller* poller);
+void modbus_poller_stop(ModbusPoller* poller);
+
+void modbus_poller_stats(const ModbusPoller* poller, ModbusPollerStats* stats);
+
+#endif // MODBUS_POLLER_H
@@ -0,0 +1,160 @@
+#include <string.h>
+#include "modbus.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MODBUS_REGS_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+// Перестановка байт в каждом 16-битном слове: одна операция и для чтения, и для записи,
+// т.к. big-endian <-> native на little-endian машине симметричны
+typedef void (*ModbusRegsSwapFn)(const uint8_t* src, uint8_t* dst, uint16_t count);
+
+// Короче - без косвенного вызова: векторный путь не успевает окупиться
+#define REGS_SHORT_COUNT    8
+
+// Слова через memcpy: кадр не выровнен, а uint16_t-загрузка не пересекается по типу с буфером байт
+static inline void regs_swap_words(const uint8_t* restrict src, uint8_t* restrict dst, uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t word;
+        memcpy(&word, src + i * 2, sizeof(word));
+        word = __builtin_bswap16(word);
+        memcpy(dst + i * 2, &word, sizeof(word));
+    }
+}
+
+static void regs_swap_scalar(const uint8_t* src, uint8_t* dst, uint16_t count) {
+    regs_swap_words(src, dst, count);
+}
+
+#ifdef MODBUS_REGS_HAVE_X86
+// Хвост короче вектора - последним вектором, перекрывающим уже переставленные слова
+// (src и dst не перекрываются, поэтому повторная перестановка даёт тот же результат)
+__attribute__((target("ssse3")))
+static void regs_swap_ssse3(const uint8_t* src, uint8_t* dst, uint16_t count) {
+    if (count < 8) {
+        regs_swap_words(src, dst, count);
+        return;
+    }
+    const __m128i shuffle = _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    uint16_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i * 2 + 16));
+        _mm_storeu_si128((__m128i*)(dst + i * 2), _mm_shuffle_epi8(a, shuffle));
+        _mm_storeu_si128((__m128i*)(dst + i * 2 + 16), _mm_shuffle_epi8(b, shuffle));
+    }
+    if (i + 8 <= count) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        _mm_storeu_si128((__m128i*)(dst + i * 2), _mm_shuffle_epi8(v, shuffle));
+        i += 8;
+    }
+    if (i < count) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + (count - 8) * 2));
+        _mm_storeu_si128((__m128i*)(dst + (count - 8) * 2), _mm_shuffle_epi8(v, shuffle));
+    }
+}
+
+__attribute__((target("avx2")))
+static void regs_swap_avx2(const uint8_t* src, uint8_t* dst, uint16_t count) {
+    if (count < 8) {
+        regs_swap_words(src, dst, count);
+        return;
+    }
+    const __m256i shuffle = _mm256_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+                                            14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    const __m128i half = _mm256_castsi256_si128(shuffle);
+    uint16_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 2));
+        _mm256_storeu_si256((__m256i*)(dst + i * 2), _mm256_shuffle_epi8(v, shuffle));
+    }
+    if (i + 8 <= count) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        _mm_storeu_si128((__m128i*)(dst + i * 2), _mm_shuffle_epi8(v, half));
+        i += 8;
+    }
+    if (i < count) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + (count - 8) * 2));
+        _mm_storeu_si128((__m128i*)(dst + (count - 8) * 2), _mm_shuffle_epi8(v, half));
+    }
+}
+#endif
+
+static const ModbusRegsSwapFn regs_impls[MODBUS_REGS_IMPL_COUNT] = {
+    [MODBUS_REGS_IMPL_SCALAR] = regs_swap_scalar,
+#ifdef MODBUS_REGS_HAVE_X86
+    [MODBUS_REGS_IMPL_SSSE3]  = regs_swap_ssse3,
+    [MODBUS_REGS_IMPL_AVX2]   = regs_swap_avx2,
+#endif
+};
+
+static ModbusRegsImpl regs_best_impl(void) {
+    if (modbus_regs_impl_supported(MODBUS_REGS_IMPL_AVX2)) return MODBUS_REGS_IMPL_AVX2;
+    if (modbus_regs_impl_supported(MODBUS_REGS_IMPL_SSSE3)) return MODBUS_REGS_IMPL_SSSE3;
+    return MODBUS_REGS_IMPL_SCALAR;
+}
+
+// Реализация выбирается один раз при загрузке; modbus_regs_select меняет её до запуска потоков
+static ModbusRegsImpl regs_active = MODBUS_REGS_IMPL_SCALAR;
+static ModbusRegsSwapFn regs_swap = regs_swap_scalar;
+
+__attribute__((constructor))
+static void regs_init(void) {
+    regs_active = regs_best_impl();
+    regs_swap = regs_impls[regs_active];
+}
+
+int modbus_regs_impl_supported(ModbusRegsImpl impl) {
+    if (impl <= MODBUS_REGS_IMPL_AUTO || impl >= MODBUS_REGS_IMPL_COUNT) return 0;
+    if (regs_impls[impl] == NULL) return 0;
+#ifdef MODBUS_REGS_HAVE_X86
+    __builtin_cpu_init();
+    if (impl == MODBUS_REGS_IMPL_SSSE3) return __builtin_cpu_supports("ssse3");
+    if (impl == MODBUS_REGS_IMPL_AVX2) return __builtin_cpu_supports("avx2");
+#endif
+    return 1;
+}
+
+const char* modbus_regs_impl_name(ModbusRegsImpl impl) {
+    switch (impl) {
+    case MODBUS_REGS_IMPL_AUTO:   return "auto";
+    case MODBUS_REGS_IMPL_SCALAR: return "scalar";
+    case MODBUS_REGS_IMPL_SSSE3:  return "ssse3";
+    case MODBUS_REGS_IMPL_AVX2:   return "avx2";
+    default:                      return "unknown";
+    }
+}
+
+int modbus_regs_select(ModbusRegsImpl impl) {
+    if (impl == MODBUS_REGS_IMPL_AUTO) impl = regs_best_impl();
+    if (!modbus_regs_impl_supported(impl)) return MODBUS_ERR_VALUE;
+    regs_active = impl;
+    regs_swap = regs_impls[impl];
+    return MODBUS_OK;
+}
+
+ModbusRegsImpl modbus_regs_active_impl(void) {
+    return regs_active;
+}
+
+static inline void regs_transfer(const uint8_t* src, uint8_t* dst, uint16_t count) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    // Порядок байт уже совпадает с сетевым
+    memmove(dst, src, (size_t)count * 2);
+#else
+    if (count < REGS_SHORT_COUNT) {
+        regs_swap_words(src, dst, count);
+        return;
+    }
+    regs_swap(src, dst, count);
+#endif
+}
+
+void modbus_regs_to_be(const uint16_t* regs, uint16_t count, uint8_t* dst) {
+    regs_transfer((const uint8_t*)regs, dst, count);
+}
+
+void modbus_regs_from_be(const uint8_t* src, uint16_t count, uint16_t* regs) {
+    regs_transfer(src, (uint8_t*)regs, count);
+}
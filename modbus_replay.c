@@ -0,0 +1,259 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "modbus.h"
+#include "modbus_capture.h"
+#include "modbus_crc.h"
+#include "modbus_tcp.h"
+
+// Воспроизведение записи обмена (modbus_capture.h):
+//   slave  - запросы прогоняются через обработку slave, ответы сверяются с записанными
+//            по адресу, коду функции (исключению) и длине
+//   master - записанные ответы разбираются декодером master относительно предшествующих
+//            запросов того же unit id
+// Темп - исходный (с коэффициентом --speed) или максимальный; --loops повторяет запись.
+// --size - размер каждой таблицы slave: при размерах как у исходного устройства
+// исключения адресации совпадают с записанными.
+
+typedef enum { REPLAY_SLAVE, REPLAY_MASTER } ReplayEngine;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t responses;
+    uint64_t errors;            // slave: ошибки обработки; master: ответ не разобран
+    uint64_t exceptions;
+    uint64_t mismatches;        // slave: ответ не совпал с записанным
+    uint64_t skipped;           // обрезанные кадры, ошибки CRC, ответы без запроса
+} ReplayStats;
+
+typedef struct {
+    bool valid;
+    ModbusFrame frame;
+    uint8_t response[MODBUS_TCP_MAX_ADU_SIZE];  // slave: наш ответ (адрес + PDU)
+    uint16_t response_length;
+} ReplayUnit;
+
+static uint64_t replay_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void replay_sleep_until(uint64_t deadline_ns) {
+    struct timespec ts = { .tv_sec = (time_t)(deadline_ns / 1000000000ull),
+                           .tv_nsec = (long)(deadline_ns % 1000000000ull) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {}
+}
+
+// Кадр записи -> адрес slave + PDU; false для обрезанных кадров и ошибок CRC
+static bool replay_pdu(const ModbusCaptureRecord* record, const uint8_t** pdu, uint16_t* length) {
+    switch (record->kind & MODBUS_CAPTURE_FRAMING) {
+    case MODBUS_CAPTURE_RTU:
+        if (record->length < MODBUS_MIN_ADU_SIZE) return false;
+        *length = record->length - MODBUS_CRC_SIZE;
+        if (modbus_crc16(record->frame, *length) !=
+            ((record->frame[*length + 1] << 8) | record->frame[*length])) {
+            return false;
+        }
+        *pdu = record->frame;
+        return true;
+    case MODBUS_CAPTURE_TCP:
+        if (record->length < MODBUS_TCP_MBAP_SIZE + 1) return false;
+        *pdu = record->frame + 6;
+        *length = record->length - 6;
+        return true;
+    default:
+        if (record->length < 2) return false;
+        *pdu = record->frame;
+        *length = record->length;
+        return true;
+    }
+}
+
+// Запрос (адрес + PDU) -> ModbusFrame для сверки ответа декодером master
+static bool replay_parse_request(const uint8_t* pdu, uint16_t length, ModbusFrame* frame) {
+    memset(frame, 0, sizeof(*frame));
+    frame->slave_id = pdu[0];
+    frame->function_code = pdu[1];
+    if (frame->function_code == FC_READ_FIFO_QUEUE) {
+        if (length < 4) return false;
+        frame->address = (pdu[2] << 8) | pdu[3];
+        return true;
+    }
+    if (length < 6) return false;
+    frame->address = (pdu[2] << 8) | pdu[3];
+    frame->quantity = (pdu[4] << 8) | pdu[5];
+    switch (frame->function_code) {
+    case FC_WRITE_SINGLE_COIL:
+        frame->quantity = frame->quantity ? 1 : 0;
+        break;
+    case FC_READ_WRITE_MULT_REG:
+        if (length < 10) return false;
+        frame->write_address = (pdu[6] << 8) | pdu[7];
+        frame->write_quantity = (pdu[8] << 8) | pdu[9];
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+static void replay_request(ReplayEngine engine, ModbusDevice* device, ReplayUnit* units,
+                           const ModbusCaptureRecord* record, ReplayStats* stats) {
+    const uint8_t* pdu;
+    uint16_t length;
+    if (!replay_pdu(record, &pdu, &length)) {
+        stats->skipped++;
+        return;
+    }
+    stats->requests++;
+    ReplayUnit* unit = &units[pdu[0]];
+    if (engine == REPLAY_MASTER) {
+        unit->valid = replay_parse_request(pdu, length, &unit->frame);
+        return;
+    }
+
+    // Кадры RTU идут в обработку целиком, с проверкой CRC; остальные - без CRC
+    int status;
+    if ((record->kind & MODBUS_CAPTURE_FRAMING) == MODBUS_CAPTURE_RTU) {
+        uint8_t tx[MODBUS_MAX_ADU_SIZE];
+        uint16_t tx_length = 0;
+        status = modbus_process_response_from_master(device, (uint8_t*)record->frame, record->length,
+                                                     tx, &tx_length);
+        if (status == MODBUS_OK) {
+            tx_length -= MODBUS_CRC_SIZE;
+            memcpy(unit->response, tx, tx_length);
+            unit->response_length = tx_length;
+        }
+    } else {
+        status = modbus_process_request(device, pdu, length, unit->response, &unit->response_length);
+    }
+    if (status != MODBUS_OK) {
+        stats->errors++;
+        unit->response[0] = pdu[0];
+        unit->response[1] = pdu[1] | 0x80;
+        unit->response[2] = modbus_exception_code(status);
+        unit->response_length = 3;
+    }
+    unit->valid = true;
+}
+
+static void replay_response(ReplayEngine engine, ReplayUnit* units, const ModbusCaptureRecord* record,
+                            uint16_t* values, ReplayStats* stats) {
+    const uint8_t* pdu;
+    uint16_t length;
+    if (!replay_pdu(record, &pdu, &length)) {
+        stats->skipped++;
+        return;
+    }
+    ReplayUnit* unit = &units[pdu[0]];
+    if (!unit->valid) {
+        stats->skipped++;
+        return;
+    }
+    unit->valid = false;
+    stats->responses++;
+    if (pdu[1] & 0x80) stats->exceptions++;
+
+    if (engine == REPLAY_SLAVE) {
+        if (unit->response_length != length || memcmp(unit->response, pdu, 2) != 0) stats->mismatches++;
+        return;
+    }
+    ModbusResponse response = { .values = values, .values_capacity = MODBUS_MAX_READ_BITS };
+    int status = modbus_decode_pdu(&unit->frame, pdu, length, &response);
+    if (status != MODBUS_OK && status != MODBUS_ERR_EXCEPTION) stats->errors++;
+}
+
+static void replay_usage(const char* name) {
+    fprintf(stderr, "usage: %s [--engine slave|master] [--rate original|max] [--speed <x>] "
+                    "[--loops <n>] [--size <n>] <capture>\n", name);
+}
+
+int main(int argc, char** argv) {
+    ReplayEngine engine = REPLAY_SLAVE;
+    bool original_rate = false;
+    double speed = 1.0;
+    unsigned long loops = 1;
+    unsigned long size = 0xFFFF;
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            const char* value = argv[++i];
+            engine = strcmp(value, "master") == 0 ? REPLAY_MASTER : REPLAY_SLAVE;
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            original_rate = strcmp(argv[++i], "original") == 0;
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+            loops = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            size = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            replay_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path == NULL || speed <= 0 || loops == 0 || size > 0xFFFF) {
+        replay_usage(argv[0]);
+        return 2;
+    }
+
+    ModbusCaptureFile file;
+    int status = modbus_capture_map(path, &file);
+    if (status != MODBUS_OK) {
+        fprintf(stderr, "%s: %s\n", path, status == MODBUS_ERR_VALUE ? "not a capture file" : "cannot open");
+        return 1;
+    }
+
+    ModbusDevice* device = NULL;
+    if (engine == REPLAY_SLAVE) {
+        device = modbus_init_device((uint16_t)size, (uint16_t)size, (uint16_t)size, (uint16_t)size);
+    }
+    ReplayUnit* units = (ReplayUnit*)calloc(256, sizeof(ReplayUnit));
+    uint16_t* values = (uint16_t*)malloc(MODBUS_MAX_READ_BITS * sizeof(uint16_t));
+    ReplayStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    uint64_t records = 0;
+    uint64_t start_ns = replay_now_ns();
+    for (unsigned long loop = 0; loop < loops; loop++) {
+        uint64_t loop_start_ns = replay_now_ns();
+        uint64_t first_us = 0;
+        size_t offset = 0;
+        ModbusCaptureRecord record;
+        while (modbus_capture_next(&file, &offset, &record)) {
+            records++;
+            if (first_us == 0) first_us = record.timestamp_us;
+            if (original_rate && record.timestamp_us > first_us) {
+                replay_sleep_until(loop_start_ns + (uint64_t)((record.timestamp_us - first_us) * 1000.0 / speed));
+            }
+            if ((record.kind & MODBUS_CAPTURE_DIRECTION) == MODBUS_CAPTURE_REQUEST) {
+                replay_request(engine, device, units, &record, &stats);
+            } else {
+                replay_response(engine, units, &record, values, &stats);
+            }
+        }
+    }
+    double seconds = (double)(replay_now_ns() - start_ns) / 1e9;
+
+    printf("replay %s %s: records %llu  requests %llu responses %llu  errors %llu exceptions %llu "
+           "mismatches %llu skipped %llu\n",
+           engine == REPLAY_SLAVE ? "slave" : "master", original_rate ? "original" : "max",
+           (unsigned long long)records, (unsigned long long)stats.requests,
+           (unsigned long long)stats.responses, (unsigned long long)stats.errors,
+           (unsigned long long)stats.exceptions, (unsigned long long)stats.mismatches,
+           (unsigned long long)stats.skipped);
+    printf("replay %.3f s  %10.0f records/s  %8.1f ns/record\n", seconds,
+           records / seconds, records ? seconds * 1e9 / records : 0.0);
+
+    free(values);
+    free(units);
+    if (device != NULL) modbus_free_device(device);
+    modbus_capture_unmap(&file);
+    // Исключения slave могли быть и в исходном обмене; ошибкой считается только расхождение
+    return stats.mismatches == 0 && (engine == REPLAY_SLAVE || stats.errors == 0) ? 0 : 1;
+}
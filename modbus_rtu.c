@@ -0,0 +1,304 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "modbus_crc.h"
+#include "modbus_rtu.h"
+
+// Символ RTU: старт + 8 бит данных + чётность/стоп + стоп
+#define MODBUS_RTU_CHAR_BITS    11
+
+void modbus_rtu_framer_init(ModbusRtuFramer* framer, uint32_t baud_rate, ModbusRtuDirection direction,
+                            ModbusRtuFrameCallback on_frame, void* user) {
+    memset(framer, 0, sizeof(*framer));
+    framer->direction = direction;
+    framer->on_frame = on_frame;
+    framer->user = user;
+
+    if (baud_rate == 0) baud_rate = 19200;
+    framer->char_time_us = (MODBUS_RTU_CHAR_BITS * 1000000u + baud_rate - 1) / baud_rate;
+    // Выше 19200 бод спецификация фиксирует t1.5 = 750 мкс и t3.5 = 1750 мкс
+    if (baud_rate > 19200) {
+        framer->t15_us = 750;
+        framer->t35_us = 1750;
+    } else {
+        framer->t15_us = framer->char_time_us * 3 / 2;
+        framer->t35_us = framer->char_time_us * 7 / 2;
+    }
+}
+
+void modbus_rtu_framer_reset(ModbusRtuFramer* framer) {
+    framer->start = 0;
+    framer->length = 0;
+    framer->t15_violation = false;
+    framer->resync = false;
+}
+
+int modbus_rtu_expected_length(const uint8_t* adu, uint16_t available, ModbusRtuDirection direction) {
+    if (available < 2) return 0;
+    uint8_t function = adu[1];
+
+    if (direction == MODBUS_RTU_REQUESTS) {
+        switch(function) {
+        case FC_READ_COILS:
+        case FC_READ_DISCRETE_INPUTS:
+        case FC_READ_HOLDING_REG:
+        case FC_READ_INPUT_REG:
+        case FC_WRITE_SINGLE_COIL:
+        case FC_WRITE_SINGLE_REG:
+            return 8;
+        case FC_WRITE_MULT_COILS:
+        case FC_WRITE_MULT_REG:
+            if (available < 7) return 0;
+            return 7 + adu[6] + MODBUS_CRC_SIZE;
+        case FC_MASK_WRITE_REG:
+            return 10;
+        case FC_READ_WRITE_MULT_REG:
+            if (available < 11) return 0;
+            return 11 + adu[10] + MODBUS_CRC_SIZE;
+        case FC_READ_FIFO_QUEUE:
+            return 6;
+        default:
+            return -1;
+        }
+    }
+
+    if (function & 0x80) return 5;
+    switch(function) {
+    case FC_READ_COILS:
+    case FC_READ_DISCRETE_INPUTS:
+    case FC_READ_HOLDING_REG:
+    case FC_READ_INPUT_REG:
+    case FC_READ_WRITE_MULT_REG:
+        if (available < 3) return 0;
+        return 3 + adu[2] + MODBUS_CRC_SIZE;
+    case FC_WRITE_SINGLE_COIL:
+    case FC_WRITE_SINGLE_REG:
+    case FC_WRITE_MULT_COILS:
+    case FC_WRITE_MULT_REG:
+        return 8;
+    case FC_MASK_WRITE_REG:
+        return 10;
+    case FC_READ_FIFO_QUEUE:
+        if (available < 4) return 0;
+        return 4 + ((adu[2] << 8) | adu[3]) + MODBUS_CRC_SIZE;
+    default:
+        return -1;
+    }
+}
+
+static bool rtu_crc_ok(const uint8_t* adu, uint16_t length) {
+    uint16_t received_crc = (adu[length-1] << 8) | adu[length-2];
+    return modbus_crc16(adu, length - 2) == received_crc;
+}
+
+// Выделение кадров из непрерывных данных; возвращает число использованных байт.
+// При несовпадении CRC сдвигаемся на байт и ищем следующий кадр (ресинхронизация).
+static uint16_t rtu_scan(ModbusRtuFramer* framer, const uint8_t* data, uint16_t length,
+                         uint64_t timestamp_us, bool at_silence) {
+    uint16_t offset = 0;
+
+    while (length - offset >= MODBUS_MIN_ADU_SIZE) {
+        const uint8_t* adu = data + offset;
+        uint16_t available = length - offset;
+        int expected = modbus_rtu_expected_length(adu, available, framer->direction);
+
+        if (expected < 0) {
+            // Неизвестный код функции: при поиске начала кадра это мусор,
+            // иначе длину знает только тишина на линии
+            if (framer->resync || adu[1] == 0) {
+                framer->dropped_bytes++;
+                offset++;
+                continue;
+            }
+            if (!at_silence) break;
+            if (available <= MODBUS_MAX_ADU_SIZE && rtu_crc_ok(adu, available)) {
+                framer->frames++;
+                framer->on_frame(framer->user, adu, available, timestamp_us);
+                offset = length;
+            } else {
+                framer->crc_errors++;
+                framer->dropped_bytes++;
+                framer->resync = true;
+                offset++;
+            }
+            continue;
+        }
+        if (expected > MODBUS_MAX_ADU_SIZE) {
+            framer->dropped_bytes++;
+            framer->resync = true;
+            offset++;
+            continue;
+        }
+        if (expected == 0 || available < expected) {
+            if (!at_silence) break;
+            // После тишины кадр уже не дополнится: заголовок был мусором, и кадр
+            // ищется со следующего байта
+            framer->dropped_bytes++;
+            framer->resync = true;
+            offset++;
+            continue;
+        }
+
+        if (rtu_crc_ok(adu, (uint16_t)expected)) {
+            framer->frames++;
+            framer->resync = false;
+            framer->on_frame(framer->user, adu, (uint16_t)expected, timestamp_us);
+            offset += expected;
+        } else {
+            framer->crc_errors++;
+            framer->dropped_bytes++;
+            framer->resync = true;
+            offset++;
+        }
+    }
+
+    // Остаток короче минимального кадра
+    if (at_silence) {
+        framer->dropped_bytes += length - offset;
+        framer->resync = false;
+        offset = length;
+    }
+    return offset;
+}
+
+static void rtu_scan_buffer(ModbusRtuFramer* framer, uint64_t timestamp_us, bool at_silence) {
+    uint16_t used = rtu_scan(framer, framer->buffer + framer->start, framer->length,
+                             timestamp_us, at_silence);
+    framer->start += used;
+    framer->length -= used;
+    if (framer->length == 0) {
+        framer->start = 0;
+        framer->t15_violation = false;
+    }
+}
+
+static void rtu_append(ModbusRtuFramer* framer, const uint8_t* data, size_t length) {
+    if (length > sizeof(framer->buffer)) {
+        // Сохраняем только хвост: старые байты заведомо не войдут в кадр
+        framer->dropped_bytes += (uint32_t)(length - sizeof(framer->buffer)) + framer->length;
+        data += length - sizeof(framer->buffer);
+        length = sizeof(framer->buffer);
+        framer->start = 0;
+        framer->length = 0;
+    }
+    if (framer->start + framer->length + length > sizeof(framer->buffer)) {
+        memmove(framer->buffer, framer->buffer + framer->start, framer->length);
+        framer->start = 0;
+    }
+    if (framer->length + length > sizeof(framer->buffer)) {
+        uint16_t excess = (uint16_t)(framer->length + length - sizeof(framer->buffer));
+        framer->dropped_bytes += excess;
+        memmove(framer->buffer, framer->buffer + excess, framer->length - excess);
+        framer->length -= excess;
+    }
+    memcpy(framer->buffer + framer->start + framer->length, data, length);
+    framer->length += (uint16_t)length;
+}
+
+void modbus_rtu_framer_feed(ModbusRtuFramer* framer, const uint8_t* data, size_t length,
+                            uint64_t timestamp_us) {
+    if (length == 0) return;
+
+    if (framer->length > 0) {
+        // Пауза между последним принятым байтом и началом этого куска
+        uint64_t chunk_time = (uint64_t)length * framer->char_time_us;
+        uint64_t chunk_start = timestamp_us > chunk_time ? timestamp_us - chunk_time : 0;
+        uint64_t silence = chunk_start > framer->last_byte_us ? chunk_start - framer->last_byte_us : 0;
+
+        if (silence >= framer->t35_us) {
+            rtu_scan_buffer(framer, framer->last_byte_us, true);
+        } else if (silence > framer->t15_us) {
+            framer->t15_errors++;
+            framer->t15_violation = true;
+            if (framer->strict_t15) {
+                framer->dropped_bytes += framer->length;
+                modbus_rtu_framer_reset(framer);
+            }
+        }
+    }
+    framer->last_byte_us = timestamp_us;
+
+    if (framer->length == 0) {
+        // Быстрый путь: кадры разбираются прямо во входном куске, без копирования
+        uint16_t chunk = length > UINT16_MAX ? UINT16_MAX : (uint16_t)length;
+        uint16_t used = rtu_scan(framer, data, chunk, timestamp_us, false);
+        data += used;
+        length -= used;
+        if (length == 0) return;
+    }
+
+    rtu_append(framer, data, length);
+    rtu_scan_buffer(framer, timestamp_us, false);
+}
+
+void modbus_rtu_framer_poll(ModbusRtuFramer* framer, uint64_t now_us) {
+    if (framer->length == 0) return;
+    if (now_us < framer->last_byte_us || now_us - framer->last_byte_us < framer->t35_us) return;
+    rtu_scan_buffer(framer, framer->last_byte_us, true);
+}
+
+uint64_t modbus_rtu_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static speed_t rtu_baud_constant(uint32_t baud_rate) {
+    switch(baud_rate) {
+    case 1200:   return B1200;
+    case 2400:   return B2400;
+    case 4800:   return B4800;
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    default:     return B0;
+    }
+}
+
+int modbus_rtu_open(const char* path, uint32_t baud_rate, int* fd) {
+    speed_t speed = rtu_baud_constant(baud_rate);
+    if (speed == B0) return MODBUS_ERR_VALUE;
+
+    int handle = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (handle < 0) return MODBUS_ERR_IO;
+
+    struct termios tio;
+    if (tcgetattr(handle, &tio) != 0) {
+        close(handle);
+        return MODBUS_ERR_IO;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(handle, TCSANOW, &tio) != 0) {
+        close(handle);
+        return MODBUS_ERR_IO;
+    }
+
+    *fd = handle;
+    return MODBUS_OK;
+}
+
+int modbus_rtu_read(ModbusRtuFramer* framer, int fd) {
+    uint8_t chunk[MODBUS_MAX_ADU_SIZE];
+    for (;;) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n > 0) {
+            modbus_rtu_framer_feed(framer, chunk, (size_t)n, modbus_rtu_now_us());
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return MODBUS_OK;
+        return MODBUS_ERR_IO;
+    }
+}
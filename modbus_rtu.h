@@ -0,0 +1,66 @@
+#ifndef MODBUS_RTU_H
+#define MODBUS_RTU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "modbus.h"
+
+// Какие кадры ожидаются в потоке: запросы (сторона slave) или ответы (сторона master)
+typedef enum {
+    MODBUS_RTU_REQUESTS = 0,
+    MODBUS_RTU_RESPONSES
+} ModbusRtuDirection;
+
+// Вызывается для каждого полного ADU с верным CRC; adu указывает во входной
+// кусок или во внутренний буфер сборщика и действителен только до возврата
+typedef void (*ModbusRtuFrameCallback)(void* user, const uint8_t* adu, uint16_t length,
+                                       uint64_t timestamp_us);
+
+// Потоковый сборщик RTU кадров
+typedef struct {
+    ModbusRtuDirection direction;
+    uint32_t char_time_us;      // время одного символа (11 бит)
+    uint32_t t15_us;            // допустимая пауза внутри кадра
+    uint32_t t35_us;            // пауза между кадрами
+    bool strict_t15;            // отбрасывать кадр при паузе между t1.5 и t3.5
+
+    ModbusRtuFrameCallback on_frame;
+    void* user;
+
+    uint8_t buffer[MODBUS_MAX_ADU_SIZE * 2];
+    uint16_t start;             // начало необработанных данных в buffer
+    uint16_t length;            // число необработанных байт
+    uint64_t last_byte_us;      // время приёма последнего байта
+    bool t15_violation;         // в текущем кадре была пауза больше t1.5
+    bool resync;                // идёт поиск начала кадра после ошибки CRC
+
+    // Статистика
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint32_t dropped_bytes;
+    uint32_t t15_errors;
+} ModbusRtuFramer;
+
+void modbus_rtu_framer_init(ModbusRtuFramer* framer, uint32_t baud_rate, ModbusRtuDirection direction,
+                            ModbusRtuFrameCallback on_frame, void* user);
+void modbus_rtu_framer_reset(ModbusRtuFramer* framer);
+
+// Подача куска байт; timestamp_us - время приёма последнего байта куска
+void modbus_rtu_framer_feed(ModbusRtuFramer* framer, const uint8_t* data, size_t length,
+                            uint64_t timestamp_us);
+
+// Проверка тишины на линии: по истечении t3.5 незавершённые данные разбираются или отбрасываются
+void modbus_rtu_framer_poll(ModbusRtuFramer* framer, uint64_t now_us);
+
+// Ожидаемая длина ADU по заголовку; 0 - заголовок ещё неполный,
+// -1 - длину нельзя определить по заголовку (неизвестный код функции)
+int modbus_rtu_expected_length(const uint8_t* adu, uint16_t available, ModbusRtuDirection direction);
+
+// Работа с последовательным портом или pty
+uint64_t modbus_rtu_now_us(void);
+int modbus_rtu_open(const char* path, uint32_t baud_rate, int* fd);
+// Чтение всех доступных байт из неблокирующего fd в сборщик; MODBUS_OK или MODBUS_ERR_IO
+int modbus_rtu_read(ModbusRtuFramer* framer, int fd);
+
+#endif // MODBUS_RTU_H
@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "modbus_shm.h"
+
+static uint32_t shm_align(uint64_t value) {
+    return (uint32_t)((value + MODBUS_SHM_ALIGN - 1) & ~(uint64_t)(MODBUS_SHM_ALIGN - 1));
+}
+
+static void shm_layout(ModbusShmHeader* header, uint16_t num_holding, uint16_t num_input,
+                       uint16_t num_coils, uint16_t num_discrete) {
+    memset(header, 0, sizeof(*header));
+    header->magic = MODBUS_SHM_MAGIC;
+    header->version = MODBUS_SHM_VERSION;
+    header->byte_order = MODBUS_SHM_BYTE_ORDER;
+    header->header_size = sizeof(ModbusShmHeader);
+    header->num_holding_regs = num_holding;
+    header->num_input_regs = num_input;
+    header->num_coils = num_coils;
+    header->num_discrete_inputs = num_discrete;
+
+    uint32_t offset = shm_align(sizeof(ModbusShmHeader));
+    header->coils_offset = offset;
+    offset = shm_align(offset + ((uint32_t)num_coils + 63) / 64 * sizeof(uint64_t));
+    header->discrete_inputs_offset = offset;
+    offset = shm_align(offset + ((uint32_t)num_discrete + 63) / 64 * sizeof(uint64_t));
+    header->holding_registers_offset = offset;
+    offset = shm_align(offset + (uint32_t)num_holding * sizeof(uint16_t));
+    header->input_registers_offset = offset;
+    offset = shm_align(offset + (uint32_t)num_input * sizeof(uint16_t));
+    header->total_size = offset;
+}
+
+static int shm_check_header(const ModbusShmHeader* header, uint64_t file_size) {
+    if (header->magic != MODBUS_SHM_MAGIC || header->version != MODBUS_SHM_VERSION ||
+        header->byte_order != MODBUS_SHM_BYTE_ORDER || header->header_size != sizeof(ModbusShmHeader)) {
+        return MODBUS_ERR_MISMATCH;
+    }
+    // Смещения должны соответствовать разметке этой версии
+    ModbusShmHeader expected;
+    shm_layout(&expected, header->num_holding_regs, header->num_input_regs,
+               header->num_coils, header->num_discrete_inputs);
+    if (memcmp(&expected, header, sizeof(expected)) != 0 || expected.total_size != file_size) {
+        return MODBUS_ERR_MISMATCH;
+    }
+    return MODBUS_OK;
+}
+
+// Разметка берётся из проверенной копии заголовка, а не из общей памяти
+static ModbusDevice* shm_map(int fd, const ModbusShmHeader* header, int* status) {
+    uint8_t* base = (uint8_t*)mmap(NULL, header->total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        *status = MODBUS_ERR_IO;
+        return NULL;
+    }
+    ModbusDevice* device = (ModbusDevice*)calloc(1, sizeof(ModbusDevice));
+    if (device == NULL) {
+        munmap(base, header->total_size);
+        *status = MODBUS_ERR_VALUE;
+        return NULL;
+    }
+    device->coils = (uint64_t*)(base + header->coils_offset);
+    device->discrete_inputs = (uint64_t*)(base + header->discrete_inputs_offset);
+    device->holding_registers = (uint16_t*)(base + header->holding_registers_offset);
+    device->input_registers = (uint16_t*)(base + header->input_registers_offset);
+    device->num_holding_regs = header->num_holding_regs;
+    device->num_input_regs = header->num_input_regs;
+    device->num_coils = header->num_coils;
+    device->num_discrete_inputs = header->num_discrete_inputs;
+    device->image = base;
+    device->image_size = header->total_size;
+    *status = MODBUS_OK;
+    return device;
+}
+
+ModbusDevice* modbus_shm_open(const char* path, uint16_t num_holding, uint16_t num_input,
+                              uint16_t num_coils, uint16_t num_discrete, int* status) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+    if (fd < 0) {
+        *status = MODBUS_ERR_IO;
+        return NULL;
+    }
+    // Разметку нового файла и проверку существующего делает один процесс за раз
+    flock(fd, LOCK_EX);
+
+    ModbusShmHeader layout;
+    shm_layout(&layout, num_holding, num_input, num_coils, num_discrete);
+
+    ModbusDevice* device = NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        *status = MODBUS_ERR_IO;
+    } else if (st.st_size == 0) {
+        // Новый образ: заголовок пишется последним, после обнуления таблиц
+        if (ftruncate(fd, (off_t)layout.total_size) != 0) {
+            *status = MODBUS_ERR_IO;
+        } else {
+            device = shm_map(fd, &layout, status);
+            if (device != NULL) memcpy(device->image, &layout, sizeof(layout));
+        }
+    } else {
+        ModbusShmHeader header;
+        if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+            *status = MODBUS_ERR_MISMATCH;
+        } else if ((*status = shm_check_header(&header, (uint64_t)st.st_size)) == MODBUS_OK) {
+            if (memcmp(&header, &layout, sizeof(layout)) != 0) {
+                *status = MODBUS_ERR_MISMATCH;
+            } else {
+                device = shm_map(fd, &header, status);
+            }
+        }
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return device;
+}
+
+ModbusDevice* modbus_shm_attach(const char* path, int* status) {
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        *status = MODBUS_ERR_IO;
+        return NULL;
+    }
+    flock(fd, LOCK_SH);
+
+    ModbusDevice* device = NULL;
+    ModbusShmHeader header;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        *status = MODBUS_ERR_IO;
+    } else if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        *status = MODBUS_ERR_MISMATCH;
+    } else if ((*status = shm_check_header(&header, (uint64_t)st.st_size)) == MODBUS_OK) {
+        device = shm_map(fd, &header, status);
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return device;
+}
+
+// Длина - из проверенного при отображении заголовка: заголовок в общей памяти может
+// испортить любой процесс, подключённый к образу
+int modbus_shm_flush(ModbusDevice* device) {
+    if (device->image == NULL) return MODBUS_ERR_VALUE;
+    return msync(device->image, device->image_size, MS_SYNC) == 0 ? MODBUS_OK : MODBUS_ERR_IO;
+}
+
+void modbus_shm_unmap(ModbusDevice* device) {
+    if (device->image == NULL) return;
+    munmap(device->image, device->image_size);
+    device->image = NULL;
+    device->image_size = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef MODBUS_SHM_H
+#define MODBUS_SHM_H
+
+#include <stdint.h>
+#include "modbus.h"
+
+#define MODBUS_SHM_MAGIC        0x4D425348u     // "MBSH"
+#define MODBUS_SHM_VERSION      1
+#define MODBUS_SHM_BYTE_ORDER   0x0102          // значения хранятся в порядке байт хоста
+#define MODBUS_SHM_ALIGN        64
+
+// Заголовок образа; таблицы лежат следом по смещениям, выровненным на MODBUS_SHM_ALIGN:
+// coils, discrete inputs (биты по 64 в слове), holding, input (uint16_t)
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t byte_order;
+    uint32_t header_size;
+    uint16_t num_holding_regs;
+    uint16_t num_input_regs;
+    uint16_t num_coils;
+    uint16_t num_discrete_inputs;
+    uint32_t coils_offset;
+    uint32_t discrete_inputs_offset;
+    uint32_t holding_registers_offset;
+    uint32_t input_registers_offset;
+    uint32_t reserved;
+    uint64_t total_size;
+} ModbusShmHeader;
+
+// Устройство в отображённом файле: /dev/shm/<имя> - общий образ в памяти,
+// обычный файл - образ, переживающий перезапуск. Пустой или новый файл размечается
+// под заданные размеры; существующий должен совпадать по версии и размерам
+// (иначе NULL и MODBUS_ERR_MISMATCH в status). Освобождение - modbus_free_device.
+ModbusDevice* modbus_shm_open(const char* path, uint16_t num_holding, uint16_t num_input,
+                              uint16_t num_coils, uint16_t num_discrete, int* status);
+// Подключение к существующему образу с размерами из его заголовка
+ModbusDevice* modbus_shm_attach(const char* path, int* status);
+// Сброс образа на диск
+int modbus_shm_flush(ModbusDevice* device);
+// Снятие отображения (вызывается из modbus_free_device)
+void modbus_shm_unmap(ModbusDevice* device);
+
+#endif // MODBUS_SHM_H
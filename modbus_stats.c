@@ -0,0 +1,287 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "modbus_stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define STATS_HAVE_TSC 1
+#else
+#define STATS_HAVE_TSC 0
+#endif
+
+#define STATS_MAX_SHARDS    64
+
+typedef struct {
+    atomic_uint_fast64_t requests;
+    atomic_uint_fast64_t exceptions;
+    atomic_uint_fast64_t crc_errors;
+    atomic_uint_fast64_t bytes_in;
+    atomic_uint_fast64_t bytes_out;
+    atomic_uint_fast64_t latency[MODBUS_STATS_BUCKETS];
+} StatsCounters;
+
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t sequence;     // запросы потока, для выборки замеров
+    StatsCounters fc[MODBUS_STATS_FC_SLOTS];
+} StatsShard;
+
+struct ModbusDeviceStats {
+    unsigned shard_count;       // копии потоков; за ними общая копия для остальных
+    uint64_t sample_mask;
+    StatsShard* shards;
+    pthread_mutex_t reset_lock;
+    ModbusStatsSnapshot baseline;
+};
+
+static const uint8_t stats_functions[MODBUS_STATS_FC_SLOTS] = {
+    FC_READ_COILS, FC_READ_DISCRETE_INPUTS, FC_READ_HOLDING_REG, FC_READ_INPUT_REG,
+    FC_WRITE_SINGLE_COIL, FC_WRITE_SINGLE_REG, FC_WRITE_MULT_COILS, FC_WRITE_MULT_REG,
+    FC_MASK_WRITE_REG, FC_READ_WRITE_MULT_REG, FC_READ_FIFO_QUEUE, 0
+};
+
+// Номера потоков 0..STATS_MAX_SHARDS-1 выдаются на время жизни потока и возвращаются при его
+// завершении; поток с номером меньше числа копий устройства пишет в свою копию один
+#define STATS_SLOT_NONE     UINT32_MAX
+#define STATS_SLOT_SHARED   (UINT32_MAX - 1)
+
+static pthread_once_t stats_slot_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_slot_key;
+static atomic_uint_fast64_t stats_slot_used;
+static _Thread_local unsigned stats_thread_slot = STATS_SLOT_NONE;
+
+// Перевод тактов TSC в наносекунды: ns = (ticks * stats_ns_mult) >> 32
+static pthread_once_t stats_clock_once = PTHREAD_ONCE_INIT;
+static uint64_t stats_ns_mult;
+
+static uint64_t stats_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void stats_clock_calibrate(void) {
+#if STATS_HAVE_TSC
+    uint64_t start_ns = stats_clock_ns();
+    uint64_t start_ticks = __rdtsc();
+    while (stats_clock_ns() - start_ns < 5000000ull) {}
+    uint64_t ticks = __rdtsc() - start_ticks;
+    uint64_t ns = stats_clock_ns() - start_ns;
+    stats_ns_mult = ticks > 0 ? (ns << 32) / ticks : (UINT64_C(1) << 32);
+#else
+    stats_ns_mult = UINT64_C(1) << 32;
+#endif
+}
+
+static inline uint64_t stats_now(void) {
+#if STATS_HAVE_TSC
+    return __rdtsc();
+#else
+    return stats_clock_ns();
+#endif
+}
+
+int modbus_stats_slot(uint8_t function_code) {
+    switch(function_code) {
+    case FC_READ_COILS:           return 0;
+    case FC_READ_DISCRETE_INPUTS: return 1;
+    case FC_READ_HOLDING_REG:     return 2;
+    case FC_READ_INPUT_REG:       return 3;
+    case FC_WRITE_SINGLE_COIL:    return 4;
+    case FC_WRITE_SINGLE_REG:     return 5;
+    case FC_WRITE_MULT_COILS:     return 6;
+    case FC_WRITE_MULT_REG:       return 7;
+    case FC_MASK_WRITE_REG:       return 8;
+    case FC_READ_WRITE_MULT_REG:  return 9;
+    case FC_READ_FIFO_QUEUE:      return 10;
+    default:                      return MODBUS_STATS_OTHER_SLOT;
+    }
+}
+
+uint8_t modbus_stats_slot_function(int slot) {
+    if (slot < 0 || slot >= MODBUS_STATS_FC_SLOTS) return 0;
+    return stats_functions[slot];
+}
+
+unsigned modbus_stats_bucket(uint64_t ns) {
+    const uint64_t sub = UINT64_C(1) << MODBUS_STATS_SUB_BITS;
+    if (ns < sub) return (unsigned)ns;
+    unsigned msb = 63 - (unsigned)__builtin_clzll(ns);
+    unsigned shift = msb - MODBUS_STATS_SUB_BITS;
+    unsigned bucket = (shift + 1) * (unsigned)sub + (unsigned)((ns >> shift) - sub);
+    return bucket < MODBUS_STATS_BUCKETS ? bucket : MODBUS_STATS_BUCKETS - 1;
+}
+
+uint64_t modbus_stats_bucket_upper_ns(unsigned bucket) {
+    const unsigned sub = 1u << MODBUS_STATS_SUB_BITS;
+    if (bucket < sub) return bucket;
+    unsigned shift = bucket / sub - 1;
+    uint64_t mantissa = sub + bucket % sub;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+uint64_t modbus_stats_percentile_ns(const ModbusFcStats* stats, double fraction) {
+    uint64_t total = 0;
+    for (unsigned b = 0; b < MODBUS_STATS_BUCKETS; b++) total += stats->latency[b];
+    if (total == 0) return 0;
+    uint64_t target = (uint64_t)(fraction * (double)total);
+    if (target >= total) target = total - 1;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < MODBUS_STATS_BUCKETS; b++) {
+        seen += stats->latency[b];
+        if (seen > target) return modbus_stats_bucket_upper_ns(b);
+    }
+    return modbus_stats_bucket_upper_ns(MODBUS_STATS_BUCKETS - 1);
+}
+
+int modbus_device_enable_stats(ModbusDevice* device, unsigned shards, unsigned latency_sample_shift) {
+    if (device->stats != NULL) return MODBUS_OK;
+    if (shards == 0 || shards > STATS_MAX_SHARDS || latency_sample_shift > 32) return MODBUS_ERR_VALUE;
+    pthread_once(&stats_clock_once, stats_clock_calibrate);
+
+    ModbusDeviceStats* stats = (ModbusDeviceStats*)calloc(1, sizeof(ModbusDeviceStats));
+    if (stats == NULL) return MODBUS_ERR_VALUE;
+    stats->shards = (StatsShard*)aligned_alloc(_Alignof(StatsShard), (shards + 1) * sizeof(StatsShard));
+    if (stats->shards == NULL) {
+        free(stats);
+        return MODBUS_ERR_VALUE;
+    }
+    memset(stats->shards, 0, (shards + 1) * sizeof(StatsShard));
+    stats->shard_count = shards;
+    stats->sample_mask = (UINT64_C(1) << latency_sample_shift) - 1;
+    pthread_mutex_init(&stats->reset_lock, NULL);
+    device->stats = stats;
+    return MODBUS_OK;
+}
+
+void modbus_device_disable_stats(ModbusDevice* device) {
+    ModbusDeviceStats* stats = device->stats;
+    if (stats == NULL) return;
+    pthread_mutex_destroy(&stats->reset_lock);
+    free(stats->shards);
+    free(stats);
+    device->stats = NULL;
+}
+
+static void stats_slot_release(void* value) {
+    unsigned slot = (unsigned)(uintptr_t)value - 1;
+    // release: следующий владелец номера видит все записи прежнего в его копии
+    atomic_fetch_and_explicit(&stats_slot_used, ~(UINT64_C(1) << slot), memory_order_release);
+}
+
+static void stats_slot_init(void) {
+    pthread_key_create(&stats_slot_key, stats_slot_release);
+}
+
+static unsigned stats_slot_claim(void) {
+    pthread_once(&stats_slot_once, stats_slot_init);
+    uint64_t used = atomic_load_explicit(&stats_slot_used, memory_order_relaxed);
+    while (~used != 0) {
+        unsigned slot = (unsigned)__builtin_ctzll(~used);
+        if (atomic_compare_exchange_weak_explicit(&stats_slot_used, &used, used | (UINT64_C(1) << slot),
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            pthread_setspecific(stats_slot_key, (void*)(uintptr_t)(slot + 1));
+            return slot;
+        }
+    }
+    return STATS_SLOT_SHARED;
+}
+
+// owned - копия принадлежит только текущему потоку
+static inline StatsShard* stats_shard(ModbusDeviceStats* stats, bool* owned) {
+    if (stats_thread_slot == STATS_SLOT_NONE) stats_thread_slot = stats_slot_claim();
+    *owned = stats_thread_slot < stats->shard_count;
+    return &stats->shards[*owned ? stats_thread_slot : stats->shard_count];
+}
+
+// В своей копии поток единственный писатель: обычная запись без блокировки шины.
+// Атомарные load/store лишь исключают гонку со снимком и компилируются в mov
+static inline void stats_add(atomic_uint_fast64_t* counter, uint64_t value, bool owned) {
+    if (owned) {
+        uint64_t current = atomic_load_explicit(counter, memory_order_relaxed);
+        atomic_store_explicit(counter, current + value, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+    }
+}
+
+uint64_t modbus_stats_begin(ModbusDevice* device) {
+    ModbusDeviceStats* stats = device->stats;
+    bool owned;
+    StatsShard* shard = stats_shard(stats, &owned);
+    uint64_t sequence = atomic_load_explicit(&shard->sequence, memory_order_relaxed);
+    // В общей копии номер лишь выбирает замеряемые запросы, точность не нужна
+    atomic_store_explicit(&shard->sequence, sequence + 1, memory_order_relaxed);
+    return (sequence & stats->sample_mask) == 0 ? stats_now() | 1 : 0;
+}
+
+void modbus_stats_record(ModbusDevice* device, uint8_t function_code, int status,
+                         uint16_t bytes_in, uint16_t bytes_out, uint64_t start) {
+    bool owned;
+    StatsCounters* counters = &stats_shard(device->stats, &owned)->fc[modbus_stats_slot(function_code)];
+    stats_add(&counters->requests, 1, owned);
+    if (status != MODBUS_OK) stats_add(&counters->exceptions, 1, owned);
+    stats_add(&counters->bytes_in, bytes_in, owned);
+    stats_add(&counters->bytes_out, bytes_out, owned);
+    if (start != 0) {
+        uint64_t elapsed = stats_now() - start;
+#if STATS_HAVE_TSC
+        elapsed = (uint64_t)(((unsigned __int128)elapsed * stats_ns_mult) >> 32);
+#endif
+        stats_add(&counters->latency[modbus_stats_bucket(elapsed)], 1, owned);
+    }
+}
+
+void modbus_stats_record_crc_error(ModbusDevice* device, uint8_t function_code, uint16_t bytes_in) {
+    bool owned;
+    StatsCounters* counters = &stats_shard(device->stats, &owned)->fc[modbus_stats_slot(function_code)];
+    stats_add(&counters->crc_errors, 1, owned);
+    stats_add(&counters->bytes_in, bytes_in, owned);
+}
+
+static void stats_collect(const ModbusDeviceStats* stats, ModbusStatsSnapshot* snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    for (unsigned s = 0; s <= stats->shard_count; s++) {
+        for (int f = 0; f < MODBUS_STATS_FC_SLOTS; f++) {
+            const StatsCounters* src = &stats->shards[s].fc[f];
+            ModbusFcStats* dst = &snapshot->fc[f];
+            dst->requests += atomic_load_explicit(&src->requests, memory_order_relaxed);
+            dst->exceptions += atomic_load_explicit(&src->exceptions, memory_order_relaxed);
+            dst->crc_errors += atomic_load_explicit(&src->crc_errors, memory_order_relaxed);
+            dst->bytes_in += atomic_load_explicit(&src->bytes_in, memory_order_relaxed);
+            dst->bytes_out += atomic_load_explicit(&src->bytes_out, memory_order_relaxed);
+            for (unsigned b = 0; b < MODBUS_STATS_BUCKETS; b++) {
+                dst->latency[b] += atomic_load_explicit(&src->latency[b], memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void modbus_stats_snapshot(const ModbusDevice* device, ModbusStatsSnapshot* snapshot) {
+    ModbusDeviceStats* stats = device->stats;
+    if (stats == NULL) {
+        memset(snapshot, 0, sizeof(*snapshot));
+        return;
+    }
+    stats_collect(stats, snapshot);
+    pthread_mutex_lock(&stats->reset_lock);
+    const uint64_t* base = (const uint64_t*)&stats->baseline;
+    uint64_t* values = (uint64_t*)snapshot;
+    for (size_t i = 0; i < sizeof(*snapshot) / sizeof(uint64_t); i++) {
+        // Снимок собран без остановки писателей: ячейка не может быть меньше базы
+        values[i] = values[i] > base[i] ? values[i] - base[i] : 0;
+    }
+    pthread_mutex_unlock(&stats->reset_lock);
+}
+
+void modbus_stats_reset(ModbusDevice* device) {
+    ModbusDeviceStats* stats = device->stats;
+    if (stats == NULL) return;
+    ModbusStatsSnapshot current;
+    stats_collect(stats, &current);
+    pthread_mutex_lock(&stats->reset_lock);
+    stats->baseline = current;
+    pthread_mutex_unlock(&stats->reset_lock);
+}
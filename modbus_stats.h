@@ -0,0 +1,58 @@
+#ifndef MODBUS_STATS_H
+#define MODBUS_STATS_H
+
+#include <stdint.h>
+#include "modbus.h"
+
+// Коды функций со своей статистикой; прочие учитываются в последнем слоте
+#define MODBUS_STATS_FC_SLOTS       12
+#define MODBUS_STATS_OTHER_SLOT     (MODBUS_STATS_FC_SLOTS - 1)
+
+// Гистограмма задержек в наносекундах: до 8 линейных ячеек, затем по 8 ячеек
+// на каждую степень двойки (погрешность не более 12.5%), до ~34 с
+#define MODBUS_STATS_SUB_BITS       3
+#define MODBUS_STATS_BUCKETS        272
+
+typedef struct {
+    uint64_t requests;
+    uint64_t exceptions;        // запросы, завершившиеся ошибкой обработки (ответ-исключение)
+    uint64_t crc_errors;
+    uint64_t bytes_in;          // адрес slave + PDU, без CRC и MBAP
+    uint64_t bytes_out;
+    uint64_t latency[MODBUS_STATS_BUCKETS];
+} ModbusFcStats;
+
+typedef struct {
+    ModbusFcStats fc[MODBUS_STATS_FC_SLOTS];
+} ModbusStatsSnapshot;
+
+// Счётчики хранятся в shards копиях по строкам кэша. Потоку при первом запросе выдаётся номер
+// (общий для всех устройств, до 64 живых потоков, освобождается при завершении потока); поток
+// с номером меньше shards единственный пишет в свою копию и обходится без атомарного сложения.
+// Остальные потоки делят ещё одну общую копию с атомарными счётчиками. Копии суммируются
+// только в снимке.
+// Задержка замеряется у каждого 2^latency_sample_shift-го запроса потока (0 - у всех):
+// чтение счётчика тактов на виртуальных машинах стоит десятки наносекунд.
+int modbus_device_enable_stats(ModbusDevice* device, unsigned shards, unsigned latency_sample_shift);
+void modbus_device_disable_stats(ModbusDevice* device);
+
+// Сумма по всем копиям за время с последнего сброса
+void modbus_stats_snapshot(const ModbusDevice* device, ModbusStatsSnapshot* snapshot);
+// Сброс: запоминается текущий срез, следующие снимки считаются от него
+void modbus_stats_reset(ModbusDevice* device);
+
+int modbus_stats_slot(uint8_t function_code);
+uint8_t modbus_stats_slot_function(int slot);       // 0 для слота прочих кодов
+unsigned modbus_stats_bucket(uint64_t ns);
+uint64_t modbus_stats_bucket_upper_ns(unsigned bucket);
+// Верхняя граница задержки для доли fraction (0.5, 0.99, 0.999) запросов
+uint64_t modbus_stats_percentile_ns(const ModbusFcStats* stats, double fraction);
+
+// Для кода библиотеки
+// begin возвращает 0, если задержка этого запроса не замеряется
+uint64_t modbus_stats_begin(ModbusDevice* device);
+void modbus_stats_record(ModbusDevice* device, uint8_t function_code, int status,
+                         uint16_t bytes_in, uint16_t bytes_out, uint64_t start);
+void modbus_stats_record_crc_error(ModbusDevice* device, uint8_t function_code, uint16_t bytes_in);
+
+#endif // MODBUS_STATS_H
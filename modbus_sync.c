@@ -0,0 +1,143 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modbus_sync.h"
+
+// Счётчик блока на отдельной строке кэша: записи в один блок не мешают читателям соседних
+typedef struct {
+    _Alignas(64) atomic_uint sequence;
+} SyncBlock;
+
+struct ModbusDeviceSync {
+    pthread_mutex_t write_lock;
+    SyncBlock* blocks[MODBUS_TABLE_COUNT];
+};
+
+static uint16_t sync_table_size(const ModbusDevice* device, ModbusTable table) {
+    switch(table) {
+    case MODBUS_TABLE_COILS:           return device->num_coils;
+    case MODBUS_TABLE_DISCRETE_INPUTS: return device->num_discrete_inputs;
+    case MODBUS_TABLE_HOLDING_REGS:    return device->num_holding_regs;
+    case MODBUS_TABLE_INPUT_REGS:      return device->num_input_regs;
+    default:                           return 0;
+    }
+}
+
+int modbus_device_enable_sync(ModbusDevice* device) {
+    if (device->sync != NULL) return MODBUS_OK;
+    ModbusDeviceSync* sync = (ModbusDeviceSync*)calloc(1, sizeof(ModbusDeviceSync));
+    if (sync == NULL) return MODBUS_ERR_VALUE;
+
+    for (int t = 0; t < MODBUS_TABLE_COUNT; t++) {
+        uint32_t count = ((uint32_t)sync_table_size(device, (ModbusTable)t) + MODBUS_SYNC_BLOCK - 1)
+                         / MODBUS_SYNC_BLOCK;
+        if (count == 0) count = 1;
+        sync->blocks[t] = (SyncBlock*)aligned_alloc(_Alignof(SyncBlock), count * sizeof(SyncBlock));
+        if (sync->blocks[t] == NULL) {
+            for (int i = 0; i < t; i++) free(sync->blocks[i]);
+            free(sync);
+            return MODBUS_ERR_VALUE;
+        }
+        for (uint32_t b = 0; b < count; b++) atomic_init(&sync->blocks[t][b].sequence, 0);
+    }
+    pthread_mutex_init(&sync->write_lock, NULL);
+    device->sync = sync;
+    return MODBUS_OK;
+}
+
+void modbus_device_disable_sync(ModbusDevice* device) {
+    ModbusDeviceSync* sync = device->sync;
+    if (sync == NULL) return;
+    for (int t = 0; t < MODBUS_TABLE_COUNT; t++) free(sync->blocks[t]);
+    pthread_mutex_destroy(&sync->write_lock);
+    free(sync);
+    device->sync = NULL;
+}
+
+// Писатель: нечётный счётчик - блок меняется
+void modbus_device_write_begin(ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count) {
+    ModbusDeviceSync* sync = device->sync;
+    if (sync == NULL || count == 0) return;
+    pthread_mutex_lock(&sync->write_lock);
+    SyncBlock* blocks = sync->blocks[table];
+    uint32_t last = ((uint32_t)address + count - 1) / MODBUS_SYNC_BLOCK;
+    for (uint32_t b = address / MODBUS_SYNC_BLOCK; b <= last; b++) {
+        unsigned s = atomic_load_explicit(&blocks[b].sequence, memory_order_relaxed);
+        atomic_store_explicit(&blocks[b].sequence, s + 1, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+}
+
+void modbus_device_write_end(ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count) {
+    ModbusDeviceSync* sync = device->sync;
+    if (sync == NULL || count == 0) return;
+    SyncBlock* blocks = sync->blocks[table];
+    uint32_t last = ((uint32_t)address + count - 1) / MODBUS_SYNC_BLOCK;
+    for (uint32_t b = address / MODBUS_SYNC_BLOCK; b <= last; b++) {
+        unsigned s = atomic_load_explicit(&blocks[b].sequence, memory_order_relaxed);
+        atomic_store_explicit(&blocks[b].sequence, s + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&sync->write_lock);
+}
+
+// Счётчики только растут, поэтому сумма по блокам меняется при любой записи в диапазон
+uint32_t modbus_sync_read_begin(const ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count) {
+    const ModbusDeviceSync* sync = device->sync;
+    if (sync == NULL || count == 0) return 0;
+    SyncBlock* blocks = sync->blocks[table];
+    uint32_t first = address / MODBUS_SYNC_BLOCK;
+    uint32_t last = ((uint32_t)address + count - 1) / MODBUS_SYNC_BLOCK;
+    for (;;) {
+        uint32_t sum = 0;
+        bool writing = false;
+        for (uint32_t b = first; b <= last; b++) {
+            unsigned s = atomic_load_explicit(&blocks[b].sequence, memory_order_acquire);
+            writing |= (s & 1) != 0;
+            sum += s;
+        }
+        if (!writing) return sum;
+        sched_yield();
+    }
+}
+
+bool modbus_sync_read_retry(const ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count,
+                            uint32_t start) {
+    const ModbusDeviceSync* sync = device->sync;
+    if (sync == NULL || count == 0) return false;
+    atomic_thread_fence(memory_order_acquire);
+    SyncBlock* blocks = sync->blocks[table];
+    uint32_t last = ((uint32_t)address + count - 1) / MODBUS_SYNC_BLOCK;
+    uint32_t sum = 0;
+    for (uint32_t b = address / MODBUS_SYNC_BLOCK; b <= last; b++) {
+        sum += atomic_load_explicit(&blocks[b].sequence, memory_order_relaxed);
+    }
+    return sum != start;
+}
+
+int modbus_device_read(const ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count,
+                       void* dst) {
+    if (table >= MODBUS_TABLE_COUNT) return MODBUS_ERR_VALUE;
+    if ((uint32_t)address + count > sync_table_size(device, table)) return MODBUS_ERR_ADDRESS;
+
+    uint32_t start;
+    do {
+        start = modbus_sync_read_begin(device, table, address, count);
+        switch(table) {
+        case MODBUS_TABLE_COILS:
+            modbus_bits_read(device->coils, address, count, (uint8_t*)dst);
+            break;
+        case MODBUS_TABLE_DISCRETE_INPUTS:
+            modbus_bits_read(device->discrete_inputs, address, count, (uint8_t*)dst);
+            break;
+        case MODBUS_TABLE_HOLDING_REGS:
+            memcpy(dst, &device->holding_registers[address], count * sizeof(uint16_t));
+            break;
+        default:
+            memcpy(dst, &device->input_registers[address], count * sizeof(uint16_t));
+            break;
+        }
+    } while (modbus_sync_read_retry(device, table, address, count, start));
+    return MODBUS_OK;
+}
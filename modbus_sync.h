@@ -0,0 +1,32 @@
+#ifndef MODBUS_SYNC_H
+#define MODBUS_SYNC_H
+
+#include <stdint.h>
+#include "modbus.h"
+
+// Регистров (бит) под одним seqlock
+#define MODBUS_SYNC_BLOCK   64
+
+// Режим конкурентного доступа: чтение FC01-FC04 без блокировок через seqlock на каждый
+// блок таблицы, записи (протокол и приложение) сериализуются мьютексом устройства.
+// Включается один раз до запуска потоков.
+int modbus_device_enable_sync(ModbusDevice* device);
+void modbus_device_disable_sync(ModbusDevice* device);
+
+// Запись приложением: между begin и end можно менять таблицу напрямую
+// в диапазоне [address, address + count). Без режима синхронизации ничего не делают.
+void modbus_device_write_begin(ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count);
+void modbus_device_write_end(ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count);
+
+// Согласованная копия диапазона: регистры в uint16_t* (порядок хоста),
+// биты упакованы по 8 в байт, как в кадре
+int modbus_device_read(const ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count,
+                       void* dst);
+
+// Протокол seqlock для кода библиотеки: read_begin ждёт завершения записей в диапазоне
+// и возвращает метку; read_retry - true, если за время чтения диапазон менялся
+uint32_t modbus_sync_read_begin(const ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count);
+bool modbus_sync_read_retry(const ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count,
+                            uint32_t start);
+
+#endif // MODBUS_SYNC_H
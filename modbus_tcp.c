@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "modbus_tcp.h"
+
+#define MODBUS_TCP_MAX_EVENTS   256
+
+typedef struct ModbusTcpConnection {
+    int fd;
+    bool want_write;            // ждём EPOLLOUT: ответы отправлены не полностью
+    uint16_t rx_length;
+    uint16_t tx_length;
+    uint16_t tx_sent;
+    struct ModbusTcpConnection* prev;
+    struct ModbusTcpConnection* next;
+    uint8_t rx[MODBUS_TCP_CONN_BUFFER];
+    uint8_t tx[MODBUS_TCP_CONN_BUFFER];
+} ModbusTcpConnection;
+
+struct ModbusTcpServer {
+    ModbusDevice* device;
+    ModbusUnitRegistry* registry;       // режим шлюза: выбор устройства по unit id
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;
+    uint16_t port;
+    int connections;
+    atomic_bool stop;
+    ModbusTcpConnection* active;        // открытые соединения
+    ModbusTcpConnection* free_list;     // закрытые, для повторного использования
+};
+
+int modbus_tcp_parse_mbap(const uint8_t* buffer, uint16_t length, uint16_t* transaction_id,
+                          uint16_t* adu_length) {
+    *adu_length = 0;
+    if (length < MODBUS_TCP_MBAP_SIZE) return MODBUS_OK;
+
+    uint16_t protocol_id = (buffer[2] << 8) | buffer[3];
+    uint16_t mbap_length = (buffer[4] << 8) | buffer[5];
+    // mbap_length = unit id + PDU (не больше 253 байт)
+    if (protocol_id != 0 || mbap_length < 2 || mbap_length > MODBUS_TCP_MAX_ADU_SIZE - 6) {
+        return MODBUS_ERR_VALUE;
+    }
+    if (length < 6 + mbap_length) return MODBUS_OK;
+
+    *transaction_id = (buffer[0] << 8) | buffer[1];
+    *adu_length = 6 + mbap_length;
+    return MODBUS_OK;
+}
+
+int modbus_tcp_process_request(ModbusDevice* device, const uint8_t* rx_adu, uint16_t rx_length,
+                               uint8_t* tx_adu, uint16_t* tx_length) {
+    uint16_t pdu_length = 0;
+
+    // unit id + PDU обрабатываются той же логикой, что и в RTU, но без CRC
+    int status = modbus_process_request(device, rx_adu + 6, rx_length - 6, tx_adu + 6, &pdu_length);
+    if (status != MODBUS_OK) {
+        tx_adu[6] = rx_adu[6];
+        tx_adu[7] = rx_adu[7] | 0x80;
+        tx_adu[8] = modbus_exception_code(status);
+        pdu_length = 3;
+    }
+
+    tx_adu[0] = rx_adu[0];      // эхо transaction id
+    tx_adu[1] = rx_adu[1];
+    tx_adu[2] = 0;
+    tx_adu[3] = 0;
+    tx_adu[4] = (pdu_length >> 8) & 0xFF;
+    tx_adu[5] = pdu_length & 0xFF;
+    *tx_length = 6 + pdu_length;
+    return status;
+}
+
+int modbus_tcp_create_request(const ModbusFrame* frame, uint16_t transaction_id,
+                              uint8_t* buffer, uint16_t* length) {
+    uint16_t pdu_length;
+    int status = modbus_create_pdu(frame, buffer + 6, &pdu_length);
+    if (status != MODBUS_OK) return status;
+
+    buffer[0] = (transaction_id >> 8) & 0xFF;
+    buffer[1] = transaction_id & 0xFF;
+    buffer[2] = 0;
+    buffer[3] = 0;
+    buffer[4] = (pdu_length >> 8) & 0xFF;
+    buffer[5] = pdu_length & 0xFF;
+    *length = 6 + pdu_length;
+    return MODBUS_OK;
+}
+
+static int tcp_update_events(ModbusTcpServer* server, ModbusTcpConnection* conn, bool want_write) {
+    if (conn->want_write == want_write) return MODBUS_OK;
+    struct epoll_event ev = {
+        .events = want_write ? EPOLLOUT : EPOLLIN,
+        .data.ptr = conn
+    };
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0) return MODBUS_ERR_IO;
+    conn->want_write = want_write;
+    return MODBUS_OK;
+}
+
+static void tcp_close(ModbusTcpServer* server, ModbusTcpConnection* conn) {
+    close(conn->fd);
+    if (conn->prev) conn->prev->next = conn->next;
+    else server->active = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    conn->next = server->free_list;
+    server->free_list = conn;
+    server->connections--;
+}
+
+// Обработка всех полных запросов в rx; ответы копятся в tx для одной записи
+static int tcp_process_buffered(ModbusTcpServer* server, ModbusTcpConnection* conn) {
+    uint16_t offset = 0;
+    for (;;) {
+        uint16_t transaction_id, adu_length;
+        if (modbus_tcp_parse_mbap(conn->rx + offset, conn->rx_length - offset,
+                                  &transaction_id, &adu_length) != MODBUS_OK) {
+            return MODBUS_ERR_VALUE;
+        }
+        if (adu_length == 0) break;
+        if (conn->tx_length + MODBUS_TCP_MAX_ADU_SIZE > MODBUS_TCP_CONN_BUFFER) break;
+
+        uint16_t tx_length;
+        if (server->registry != NULL) {
+            modbus_registry_process_tcp(server->registry, conn->rx + offset, adu_length,
+                                        conn->tx + conn->tx_length, &tx_length);
+        } else {
+            modbus_tcp_process_request(server->device, conn->rx + offset, adu_length,
+                                       conn->tx + conn->tx_length, &tx_length);
+        }
+        conn->tx_length += tx_length;
+        offset += adu_length;
+    }
+    if (offset > 0) {
+        memmove(conn->rx, conn->rx + offset, conn->rx_length - offset);
+        conn->rx_length -= offset;
+    }
+    return MODBUS_OK;
+}
+
+static int tcp_flush(ModbusTcpConnection* conn) {
+    while (conn->tx_sent < conn->tx_length) {
+        ssize_t n = send(conn->fd, conn->tx + conn->tx_sent, conn->tx_length - conn->tx_sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->tx_sent += (uint16_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return MODBUS_OK;
+        return MODBUS_ERR_IO;
+    }
+    conn->tx_length = 0;
+    conn->tx_sent = 0;
+    return MODBUS_OK;
+}
+
+// Обработка накопленного, отправка ответов и выбор событий для ожидания
+static void tcp_service(ModbusTcpServer* server, ModbusTcpConnection* conn) {
+    for (;;) {
+        if (tcp_process_buffered(server, conn) != MODBUS_OK || tcp_flush(conn) != MODBUS_OK) {
+            tcp_close(server, conn);
+            return;
+        }
+        if (conn->tx_length != 0) break;
+        // Ответы ушли полностью; в rx могли остаться запросы, отложенные из-за заполненного tx
+        uint16_t transaction_id, adu_length;
+        modbus_tcp_parse_mbap(conn->rx, conn->rx_length, &transaction_id, &adu_length);
+        if (adu_length == 0) break;
+    }
+    if (tcp_update_events(server, conn, conn->tx_length != 0) != MODBUS_OK) {
+        tcp_close(server, conn);
+    }
+}
+
+static void tcp_on_readable(ModbusTcpServer* server, ModbusTcpConnection* conn) {
+    ssize_t n = recv(conn->fd, conn->rx + conn->rx_length, MODBUS_TCP_CONN_BUFFER - conn->rx_length, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        tcp_close(server, conn);
+        return;
+    }
+    if (n > 0) conn->rx_length += (uint16_t)n;
+    tcp_service(server, conn);
+}
+
+static void tcp_accept(ModbusTcpServer* server) {
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        ModbusTcpConnection* conn = server->free_list;
+        if (conn != NULL) {
+            server->free_list = conn->next;
+        } else {
+            conn = (ModbusTcpConnection*)malloc(sizeof(ModbusTcpConnection));
+            if (conn == NULL) {
+                close(fd);
+                continue;
+            }
+        }
+        conn->fd = fd;
+        conn->want_write = false;
+        conn->rx_length = 0;
+        conn->tx_length = 0;
+        conn->tx_sent = 0;
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            conn->next = server->free_list;
+            server->free_list = conn;
+            continue;
+        }
+        conn->prev = NULL;
+        conn->next = server->active;
+        if (server->active) server->active->prev = conn;
+        server->active = conn;
+        server->connections++;
+    }
+}
+
+static ModbusTcpServer* tcp_server_create(ModbusDevice* device, ModbusUnitRegistry* registry,
+                                          const char* address, uint16_t port) {
+    ModbusTcpServer* server = (ModbusTcpServer*)calloc(1, sizeof(ModbusTcpServer));
+    if (server == NULL) return NULL;
+    server->device = device;
+    server->registry = registry;
+    server->listen_fd = -1;
+    server->wake_fd = -1;
+    atomic_init(&server->stop, false);
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->epoll_fd < 0 || server->wake_fd < 0 || server->listen_fd < 0) goto fail;
+
+    int one = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (address != NULL && inet_pton(AF_INET, address, &addr.sin_addr) != 1) goto fail;
+    if (bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) goto fail;
+    if (listen(server->listen_fd, SOMAXCONN) != 0) goto fail;
+
+    socklen_t addr_length = sizeof(addr);
+    getsockname(server->listen_fd, (struct sockaddr*)&addr, &addr_length);
+    server->port = ntohs(addr.sin_port);
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &server->listen_fd };
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &ev) != 0) goto fail;
+    ev.data.ptr = &server->wake_fd;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->wake_fd, &ev) != 0) goto fail;
+    return server;
+
+fail:
+    modbus_tcp_server_free(server);
+    return NULL;
+}
+
+ModbusTcpServer* modbus_tcp_server_create(ModbusDevice* device, const char* address, uint16_t port) {
+    return tcp_server_create(device, NULL, address, port);
+}
+
+ModbusTcpServer* modbus_tcp_server_create_gateway(ModbusUnitRegistry* registry, const char* address,
+                                                  uint16_t port) {
+    return tcp_server_create(NULL, registry, address, port);
+}
+
+void modbus_tcp_server_free(ModbusTcpServer* server) {
+    if (server == NULL) return;
+    while (server->active) tcp_close(server, server->active);
+    while (server->free_list) {
+        ModbusTcpConnection* next = server->free_list->next;
+        free(server->free_list);
+        server->free_list = next;
+    }
+    if (server->listen_fd >= 0) close(server->listen_fd);
+    if (server->wake_fd >= 0) close(server->wake_fd);
+    if (server->epoll_fd >= 0) close(server->epoll_fd);
+    free(server);
+}
+
+uint16_t modbus_tcp_server_port(const ModbusTcpServer* server) {
+    return server->port;
+}
+
+int modbus_tcp_server_fd(const ModbusTcpServer* server) {
+    return server->epoll_fd;
+}
+
+int modbus_tcp_server_connections(const ModbusTcpServer* server) {
+    return server->connections;
+}
+
+int modbus_tcp_server_run_once(ModbusTcpServer* server, int timeout_ms) {
+    struct epoll_event events[MODBUS_TCP_MAX_EVENTS];
+    int count = epoll_wait(server->epoll_fd, events, MODBUS_TCP_MAX_EVENTS, timeout_ms);
+    if (count < 0) return errno == EINTR ? MODBUS_OK : MODBUS_ERR_IO;
+
+    for (int i = 0; i < count; i++) {
+        void* ptr = events[i].data.ptr;
+        if (ptr == &server->listen_fd) {
+            tcp_accept(server);
+        } else if (ptr == &server->wake_fd) {
+            uint64_t value;
+            while (read(server->wake_fd, &value, sizeof(value)) > 0) {}
+        } else {
+            ModbusTcpConnection* conn = (ModbusTcpConnection*)ptr;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                tcp_close(server, conn);
+            } else if (events[i].events & EPOLLOUT) {
+                tcp_service(server, conn);
+            } else {
+                tcp_on_readable(server, conn);
+            }
+        }
+    }
+    return MODBUS_OK;
+}
+
+int modbus_tcp_server_run(ModbusTcpServer* server) {
+    while (!atomic_load(&server->stop)) {
+        int status = modbus_tcp_server_run_once(server, -1);
+        if (status != MODBUS_OK) return status;
+    }
+    return MODBUS_OK;
+}
+
+void modbus_tcp_server_stop(ModbusTcpServer* server) {
+    uint64_t one = 1;
+    atomic_store(&server->stop, true);
+    if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+        // eventfd переполнен - цикл и так будет разбужен
+    }
+}
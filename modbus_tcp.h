@@ -0,0 +1,78 @@
+#ifndef MODBUS_TCP_H
+#define MODBUS_TCP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "modbus.h"
+#include "modbus_units.h"
+#include "modbus_template.h"
+
+// MBAP заголовок: transaction id (2), protocol id (2), length (2), unit id (1)
+#define MODBUS_TCP_MBAP_SIZE        7
+#define MODBUS_TCP_MAX_ADU_SIZE     260
+#define MODBUS_TCP_DEFAULT_PORT     502
+
+// Буферы соединения: несколько конвейерных запросов/ответов за один read/write
+#define MODBUS_TCP_CONN_BUFFER      4096
+
+typedef struct ModbusTcpServer ModbusTcpServer;
+
+// Разбор MBAP; MODBUS_OK, если в буфере есть полный ADU (его длина в adu_length),
+// MODBUS_ERR_VALUE при нарушении протокола, 0 в adu_length - данных пока мало
+int modbus_tcp_parse_mbap(const uint8_t* buffer, uint16_t length, uint16_t* transaction_id,
+                          uint16_t* adu_length);
+
+// Запрос TCP (MBAP + PDU) -> ответ TCP с тем же transaction id; при ошибке обработки
+// формируется ответ-исключение. rx и tx не должны перекрываться.
+int modbus_tcp_process_request(ModbusDevice* device, const uint8_t* rx_adu, uint16_t rx_length,
+                               uint8_t* tx_adu, uint16_t* tx_length);
+
+// Неблокирующий сервер на epoll; порт 0 - выбрать свободный.
+// Несколько серверов на одном порту (по одному на поток) делят нагрузку через SO_REUSEPORT.
+ModbusTcpServer* modbus_tcp_server_create(ModbusDevice* device, const char* address, uint16_t port);
+// Шлюз: запросы направляются устройствам из таблицы по unit id (см. modbus_registry_process_tcp)
+ModbusTcpServer* modbus_tcp_server_create_gateway(ModbusUnitRegistry* registry, const char* address,
+                                                  uint16_t port);
+void modbus_tcp_server_free(ModbusTcpServer* server);
+uint16_t modbus_tcp_server_port(const ModbusTcpServer* server);
+// Дескриптор для встраивания во внешний цикл событий: готов к чтению, когда
+// modbus_tcp_server_run_once(server, 0) есть что обработать
+int modbus_tcp_server_fd(const ModbusTcpServer* server);
+int modbus_tcp_server_connections(const ModbusTcpServer* server);
+
+// Один проход цикла событий; timeout_ms < 0 - ждать бесконечно
+int modbus_tcp_server_run_once(ModbusTcpServer* server, int timeout_ms);
+// Цикл до вызова modbus_tcp_server_stop (можно из другого потока)
+int modbus_tcp_server_run(ModbusTcpServer* server);
+void modbus_tcp_server_stop(ModbusTcpServer* server);
+
+// Запрос TCP: MBAP с заданным transaction id + PDU
+int modbus_tcp_create_request(const ModbusFrame* frame, uint16_t transaction_id,
+                              uint8_t* buffer, uint16_t* length);
+
+// Конвейерный TCP master: много запросов в полёте на каждом соединении,
+// сопоставление ответов по transaction id, тайм-ауты на каждый запрос
+typedef struct ModbusTcpMaster ModbusTcpMaster;
+
+// Завершение запроса: status = MODBUS_OK, код ошибки разбора, MODBUS_ERR_EXCEPTION,
+// MODBUS_ERR_TIMEOUT или MODBUS_ERR_IO. response->values действительны только внутри вызова.
+typedef void (*ModbusTcpCompletion)(void* user, int connection, const ModbusFrame* request,
+                                    int status, const ModbusResponse* response);
+
+// window - максимум запросов в полёте на соединение (1..256)
+ModbusTcpMaster* modbus_tcp_master_create(uint16_t window, uint32_t timeout_ms);
+void modbus_tcp_master_free(ModbusTcpMaster* master);
+int modbus_tcp_master_connect(ModbusTcpMaster* master, const char* address, uint16_t port, int* connection);
+// Запрос ставится в буфер соединения и уходит при следующем modbus_tcp_master_poll;
+// MODBUS_ERR_BUSY, если окно заполнено
+int modbus_tcp_master_submit(ModbusTcpMaster* master, int connection, const ModbusFrame* request,
+                             ModbusTcpCompletion callback, void* user);
+// То же для заранее скомпилированного запроса (MODBUS_TEMPLATE_TCP): ADU копируется в буфер
+// соединения, подставляется только transaction id; шаблон не меняется
+int modbus_tcp_master_submit_template(ModbusTcpMaster* master, int connection, const ModbusRequestTemplate* tpl,
+                                      ModbusTcpCompletion callback, void* user);
+// Отправка накопленного, приём ответов, тайм-ауты; вызывает обработчики завершения
+int modbus_tcp_master_poll(ModbusTcpMaster* master, int timeout_ms);
+int modbus_tcp_master_pending(const ModbusTcpMaster* master, int connection);
+
+#endif // MODBUS_TCP_H
@@ -0,0 +1,420 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "modbus_tcp.h"
+
+#define MODBUS_TCP_MASTER_MAX_WINDOW    256
+#define MODBUS_TCP_MASTER_MAX_EVENTS    256
+
+// Запрос в полёте; transaction id = (generation << slot_bits) | индекс слота
+typedef struct {
+    bool busy;
+    uint16_t generation;
+    uint16_t transaction_id;
+    uint64_t deadline_us;
+    ModbusFrame request;        // data не сохраняется: запрос уже закодирован
+    ModbusTcpCompletion callback;
+    void* user;
+} ModbusTcpMasterSlot;
+
+typedef struct {
+    int fd;
+    bool connecting;            // неблокирующий connect ещё не завершён
+    bool failed;
+    bool dirty;                 // в tx есть неотправленные запросы
+    bool want_write;
+    uint16_t in_flight;
+    uint64_t next_deadline_us;  // не позже самого раннего тайм-аута среди запросов в полёте
+    ModbusTcpMasterSlot* slots;
+    uint16_t* free_slots;
+    uint16_t free_count;
+    uint8_t* tx;
+    uint32_t tx_length;
+    uint32_t tx_sent;
+    uint16_t rx_length;
+    uint8_t rx[MODBUS_TCP_CONN_BUFFER];
+} ModbusTcpMasterConn;
+
+struct ModbusTcpMaster {
+    int epoll_fd;
+    uint16_t window;
+    unsigned slot_bits;
+    uint32_t timeout_us;
+    ModbusTcpMasterConn** conns;   // по указателю: обработчики могут открывать соединения
+    int conn_count;
+    int conn_capacity;
+    int* dirty;                 // индексы соединений с неотправленными запросами
+    int dirty_count;
+    uint16_t values[MODBUS_MAX_READ_BITS];  // значения ответа на время обработчика
+};
+
+static uint64_t master_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+ModbusTcpMaster* modbus_tcp_master_create(uint16_t window, uint32_t timeout_ms) {
+    if (window == 0 || window > MODBUS_TCP_MASTER_MAX_WINDOW) return NULL;
+    ModbusTcpMaster* master = (ModbusTcpMaster*)calloc(1, sizeof(ModbusTcpMaster));
+    if (master == NULL) return NULL;
+
+    master->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (master->epoll_fd < 0) {
+        free(master);
+        return NULL;
+    }
+    master->window = window;
+    while ((1u << master->slot_bits) < window) master->slot_bits++;
+    master->timeout_us = timeout_ms * 1000u;
+    return master;
+}
+
+static void master_complete(ModbusTcpMaster* master, int index, uint16_t slot_index, int status,
+                            const ModbusResponse* response) {
+    ModbusTcpMasterConn* conn = master->conns[index];
+    ModbusTcpMasterSlot* slot = &conn->slots[slot_index];
+    ModbusFrame request = slot->request;
+    ModbusTcpCompletion callback = slot->callback;
+    void* user = slot->user;
+
+    // Слот освобождается до вызова, чтобы обработчик мог сразу отправить следующий запрос
+    slot->busy = false;
+    conn->free_slots[conn->free_count++] = slot_index;
+    conn->in_flight--;
+
+    if (callback != NULL) {
+        ModbusResponse empty = {0};
+        callback(user, index, &request, status, response != NULL ? response : &empty);
+    }
+}
+
+static void master_fail(ModbusTcpMaster* master, int index) {
+    ModbusTcpMasterConn* conn = master->conns[index];
+    if (conn->fd >= 0) {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+    conn->failed = true;
+    conn->tx_length = 0;
+    conn->tx_sent = 0;
+    for (uint16_t i = 0; i < master->window; i++) {
+        if (conn->slots[i].busy) master_complete(master, index, i, MODBUS_ERR_IO, NULL);
+    }
+}
+
+void modbus_tcp_master_free(ModbusTcpMaster* master) {
+    if (master == NULL) return;
+    for (int i = 0; i < master->conn_count; i++) {
+        ModbusTcpMasterConn* conn = master->conns[i];
+        if (conn->fd >= 0) close(conn->fd);
+        free(conn->slots);
+        free(conn->free_slots);
+        free(conn->tx);
+        free(conn);
+    }
+    free(master->conns);
+    free(master->dirty);
+    close(master->epoll_fd);
+    free(master);
+}
+
+int modbus_tcp_master_connect(ModbusTcpMaster* master, const char* address, uint16_t port, int* connection) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) return MODBUS_ERR_VALUE;
+
+    if (master->conn_count == master->conn_capacity) {
+        int capacity = master->conn_capacity ? master->conn_capacity * 2 : 16;
+        ModbusTcpMasterConn** conns = (ModbusTcpMasterConn**)realloc(master->conns, capacity * sizeof(*conns));
+        if (conns == NULL) return MODBUS_ERR_IO;
+        master->conns = conns;
+        int* dirty = (int*)realloc(master->dirty, capacity * sizeof(int));
+        if (dirty == NULL) return MODBUS_ERR_IO;
+        master->dirty = dirty;
+        master->conn_capacity = capacity;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return MODBUS_ERR_IO;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    bool connecting = false;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        if (errno != EINPROGRESS) {
+            close(fd);
+            return MODBUS_ERR_IO;
+        }
+        connecting = true;
+    }
+
+    int index = master->conn_count;
+    ModbusTcpMasterConn* conn = (ModbusTcpMasterConn*)calloc(1, sizeof(ModbusTcpMasterConn));
+    if (conn == NULL) {
+        close(fd);
+        return MODBUS_ERR_IO;
+    }
+    conn->fd = fd;
+    conn->connecting = connecting;
+    conn->slots = (ModbusTcpMasterSlot*)calloc(master->window, sizeof(ModbusTcpMasterSlot));
+    conn->free_slots = (uint16_t*)malloc(master->window * sizeof(uint16_t));
+    conn->tx = (uint8_t*)malloc((size_t)master->window * MODBUS_TCP_MAX_ADU_SIZE);
+    if (conn->slots == NULL || conn->free_slots == NULL || conn->tx == NULL) goto fail;
+    for (uint16_t i = 0; i < master->window; i++) {
+        conn->free_slots[i] = master->window - 1 - i;
+    }
+    conn->free_count = master->window;
+
+    conn->want_write = connecting;
+    struct epoll_event ev = { .events = connecting ? EPOLLOUT : EPOLLIN, .data.u32 = (uint32_t)index };
+    if (epoll_ctl(master->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) goto fail;
+
+    master->conns[index] = conn;
+    master->conn_count++;
+    *connection = index;
+    return MODBUS_OK;
+
+fail:
+    free(conn->slots);
+    free(conn->free_slots);
+    free(conn->tx);
+    free(conn);
+    close(fd);
+    return MODBUS_ERR_IO;
+}
+
+// Занимает слот и кодирует запрос в tx: из шаблона (копия ADU с новым transaction id)
+// или из request
+static int master_submit(ModbusTcpMaster* master, int connection, const ModbusFrame* request,
+                         const ModbusRequestTemplate* tpl, ModbusTcpCompletion callback, void* user) {
+    if (connection < 0 || connection >= master->conn_count) return MODBUS_ERR_VALUE;
+    ModbusTcpMasterConn* conn = master->conns[connection];
+    if (conn->failed) return MODBUS_ERR_IO;
+    if (conn->free_count == 0) return MODBUS_ERR_BUSY;
+    // Байты запросов, завершённых по тайм-ауту до отправки, ещё занимают tx
+    if (conn->tx_length + MODBUS_TCP_MAX_ADU_SIZE > (uint32_t)master->window * MODBUS_TCP_MAX_ADU_SIZE) {
+        return MODBUS_ERR_BUSY;
+    }
+
+    uint16_t slot_index = conn->free_slots[conn->free_count - 1];
+    ModbusTcpMasterSlot* slot = &conn->slots[slot_index];
+    uint16_t generation = (uint16_t)(slot->generation + 1);
+    uint16_t transaction_id = (uint16_t)((generation << master->slot_bits) | slot_index);
+
+    uint8_t* buffer = conn->tx + conn->tx_length;
+    uint16_t length;
+    if (tpl != NULL) {
+        memcpy(buffer, tpl->adu, tpl->length);
+        buffer[0] = (transaction_id >> 8) & 0xFF;
+        buffer[1] = transaction_id & 0xFF;
+        length = tpl->length;
+    } else {
+        int status = modbus_tcp_create_request(request, transaction_id, buffer, &length);
+        if (status != MODBUS_OK) return status;
+    }
+
+    conn->free_count--;
+    conn->tx_length += length;
+    conn->in_flight++;
+
+    slot->busy = true;
+    slot->generation = generation;
+    slot->transaction_id = transaction_id;
+    slot->deadline_us = master_now_us() + master->timeout_us;
+    slot->request = *request;
+    slot->request.data = NULL;
+    slot->callback = callback;
+    slot->user = user;
+    if (conn->in_flight == 1 || slot->deadline_us < conn->next_deadline_us) {
+        conn->next_deadline_us = slot->deadline_us;
+    }
+
+    if (!conn->dirty) {
+        conn->dirty = true;
+        master->dirty[master->dirty_count++] = connection;
+    }
+    return MODBUS_OK;
+}
+
+int modbus_tcp_master_submit(ModbusTcpMaster* master, int connection, const ModbusFrame* request,
+                             ModbusTcpCompletion callback, void* user) {
+    return master_submit(master, connection, request, NULL, callback, user);
+}
+
+int modbus_tcp_master_submit_template(ModbusTcpMaster* master, int connection, const ModbusRequestTemplate* tpl,
+                                      ModbusTcpCompletion callback, void* user) {
+    if (tpl->transport != MODBUS_TEMPLATE_TCP) return MODBUS_ERR_VALUE;
+    return master_submit(master, connection, &tpl->frame, tpl, callback, user);
+}
+
+int modbus_tcp_master_pending(const ModbusTcpMaster* master, int connection) {
+    if (connection < 0 || connection >= master->conn_count) return 0;
+    return master->conns[connection]->in_flight;
+}
+
+static void master_set_write(ModbusTcpMaster* master, int index, bool want_write) {
+    ModbusTcpMasterConn* conn = master->conns[index];
+    if (conn->want_write == want_write) return;
+    struct epoll_event ev = { .events = want_write ? EPOLLIN | EPOLLOUT : EPOLLIN, .data.u32 = (uint32_t)index };
+    if (epoll_ctl(master->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0) {
+        master_fail(master, index);
+        return;
+    }
+    conn->want_write = want_write;
+}
+
+// Отправка всех накопленных запросов соединения одним send
+static void master_flush(ModbusTcpMaster* master, int index) {
+    ModbusTcpMasterConn* conn = master->conns[index];
+    if (conn->failed || conn->connecting) return;
+
+    while (conn->tx_sent < conn->tx_length) {
+        ssize_t n = send(conn->fd, conn->tx + conn->tx_sent, conn->tx_length - conn->tx_sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->tx_sent += (uint32_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Сдвигаем неотправленный хвост, чтобы освободить место под новые запросы
+            memmove(conn->tx, conn->tx + conn->tx_sent, conn->tx_length - conn->tx_sent);
+            conn->tx_length -= conn->tx_sent;
+            conn->tx_sent = 0;
+            master_set_write(master, index, true);
+            return;
+        }
+        master_fail(master, index);
+        return;
+    }
+    conn->tx_length = 0;
+    conn->tx_sent = 0;
+    master_set_write(master, index, false);
+}
+
+static void master_on_readable(ModbusTcpMaster* master, int index) {
+    ModbusTcpMasterConn* conn = master->conns[index];
+    ssize_t n = recv(conn->fd, conn->rx + conn->rx_length, MODBUS_TCP_CONN_BUFFER - conn->rx_length, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        master_fail(master, index);
+        return;
+    }
+    if (n < 0) return;
+    conn->rx_length += (uint16_t)n;
+
+    uint16_t offset = 0;
+    for (;;) {
+        uint16_t transaction_id, adu_length;
+        if (modbus_tcp_parse_mbap(conn->rx + offset, conn->rx_length - offset,
+                                  &transaction_id, &adu_length) != MODBUS_OK) {
+            master_fail(master, index);
+            return;
+        }
+        if (adu_length == 0) break;
+
+        uint16_t slot_index = transaction_id & ((1u << master->slot_bits) - 1);
+        if (slot_index < master->window && conn->slots[slot_index].busy &&
+            conn->slots[slot_index].transaction_id == transaction_id) {
+            // Ответы на запросы, уже завершённые по тайм-ауту, сюда не попадают
+            ModbusResponse response = {
+                .values = master->values,
+                .values_capacity = MODBUS_MAX_READ_BITS
+            };
+            int status = modbus_decode_pdu(&conn->slots[slot_index].request, conn->rx + offset + 6,
+                                           adu_length - 6, &response);
+            master_complete(master, index, slot_index, status, &response);
+            if (conn->failed) return;
+        }
+        offset += adu_length;
+    }
+    if (offset > 0) {
+        memmove(conn->rx, conn->rx + offset, conn->rx_length - offset);
+        conn->rx_length -= offset;
+    }
+}
+
+static void master_on_writable(ModbusTcpMaster* master, int index) {
+    ModbusTcpMasterConn* conn = master->conns[index];
+    if (conn->connecting) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            master_fail(master, index);
+            return;
+        }
+        conn->connecting = false;
+    }
+    master_flush(master, index);
+}
+
+static void master_check_timeouts(ModbusTcpMaster* master, uint64_t now) {
+    uint16_t expired[MODBUS_TCP_MASTER_MAX_WINDOW];
+
+    for (int index = 0; index < master->conn_count; index++) {
+        ModbusTcpMasterConn* conn = master->conns[index];
+        if (conn->in_flight == 0 || now < conn->next_deadline_us) continue;
+
+        // Сначала пересчитываем срок, затем завершаем: обработчики могут добавить новые запросы
+        uint16_t expired_count = 0;
+        uint64_t next = UINT64_MAX;
+        for (uint16_t i = 0; i < master->window; i++) {
+            ModbusTcpMasterSlot* slot = &conn->slots[i];
+            if (!slot->busy) continue;
+            if (slot->deadline_us <= now) {
+                expired[expired_count++] = i;
+            } else if (slot->deadline_us < next) {
+                next = slot->deadline_us;
+            }
+        }
+        conn->next_deadline_us = next;
+        for (uint16_t k = 0; k < expired_count; k++) {
+            if (conn->slots[expired[k]].busy && conn->slots[expired[k]].deadline_us <= now) {
+                master_complete(master, index, expired[k], MODBUS_ERR_TIMEOUT, NULL);
+            }
+        }
+    }
+}
+
+int modbus_tcp_master_poll(ModbusTcpMaster* master, int timeout_ms) {
+    for (int i = 0; i < master->dirty_count; i++) {
+        int index = master->dirty[i];
+        master->conns[index]->dirty = false;
+        master_flush(master, index);
+    }
+    master->dirty_count = 0;
+
+    // Ожидание не дольше ближайшего тайм-аута
+    uint64_t now = master_now_us();
+    for (int i = 0; i < master->conn_count; i++) {
+        ModbusTcpMasterConn* conn = master->conns[i];
+        if (conn->in_flight == 0) continue;
+        int64_t left_ms = conn->next_deadline_us > now ? (int64_t)((conn->next_deadline_us - now + 999) / 1000) : 0;
+        if (timeout_ms < 0 || left_ms < timeout_ms) timeout_ms = (int)left_ms;
+    }
+
+    struct epoll_event events[MODBUS_TCP_MASTER_MAX_EVENTS];
+    int count = epoll_wait(master->epoll_fd, events, MODBUS_TCP_MASTER_MAX_EVENTS, timeout_ms);
+    if (count < 0 && errno != EINTR) return MODBUS_ERR_IO;
+
+    for (int i = 0; i < count; i++) {
+        int index = (int)events[i].data.u32;
+        ModbusTcpMasterConn* conn = master->conns[index];
+        if (conn->failed) continue;
+        if (events[i].events & EPOLLOUT) master_on_writable(master, index);
+        // Данные, пришедшие перед закрытием соединения, разбираются до обработки HUP
+        if ((events[i].events & EPOLLIN) && !conn->failed) master_on_readable(master, index);
+        if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !conn->failed) master_fail(master, index);
+    }
+
+    master_check_timeouts(master, master_now_us());
+    return MODBUS_OK;
+}
@@ -0,0 +1,185 @@
+#include <pthread.h>
+#include <string.h>
+#include "modbus_template.h"
+#include "modbus_crc.h"
+#include "modbus_tcp.h"
+
+// CRC линеен по данным: для сообщений одной длины crc(A) ^ crc(B) = crc0(A ^ B), где crc0 -
+// расчёт с нулевым начальным значением. Нулевые байты перед правкой не меняют состояние crc0,
+// а нулевые байты после неё - линейное преобразование 16-битного состояния. Поэтому правка
+// стоит crc0 по изменённым байтам плюс сдвиг на хвост за O(log хвоста) по таблицам ниже.
+
+#define TEMPLATE_SHIFT_LEVELS   8   // сдвиги на 1, 2, 4, ... 128 нулевых байт
+
+// template_shift[j][0][lo] ^ template_shift[j][1][hi] - состояние после 2^j нулевых байт
+static uint16_t template_shift[TEMPLATE_SHIFT_LEVELS][2][256];
+static pthread_once_t template_once = PTHREAD_ONCE_INIT;
+
+static uint16_t template_shift_apply(int level, uint16_t state) {
+    return template_shift[level][0][state & 0xFF] ^ template_shift[level][1][state >> 8];
+}
+
+static void template_init_once(void) {
+    static const uint8_t zero = 0;
+    for (int v = 0; v < 256; v++) {
+        template_shift[0][0][v] = modbus_crc16_update((uint16_t)v, &zero, 1);
+        template_shift[0][1][v] = modbus_crc16_update((uint16_t)(v << 8), &zero, 1);
+    }
+    for (int level = 1; level < TEMPLATE_SHIFT_LEVELS; level++) {
+        for (int v = 0; v < 256; v++) {
+            template_shift[level][0][v] = template_shift_apply(level - 1, template_shift[level - 1][0][v]);
+            template_shift[level][1][v] = template_shift_apply(level - 1, template_shift[level - 1][1][v]);
+        }
+    }
+}
+
+// crc0 по байтам; короткие правки (значение регистра) дешевле считать здесь, чем через
+// диспетчер реализаций modbus_crc16_update
+#define TEMPLATE_SHORT_PATCH    16
+
+static uint16_t template_crc0(const uint8_t* data, uint16_t length) {
+    if (length > TEMPLATE_SHORT_PATCH) return modbus_crc16_update(0, data, length);
+    uint16_t state = 0;
+    for (uint16_t i = 0; i < length; i++) state = template_shift_apply(0, state ^ data[i]);
+    return state;
+}
+
+// Состояние crc0 после count нулевых байт
+static uint16_t template_shift_zeros(uint16_t state, uint16_t count) {
+    for (int level = 0; count != 0 && state != 0; level++, count >>= 1) {
+        if (count & 1) state = template_shift_apply(level, state);
+    }
+    return state;
+}
+
+static void template_store_crc(ModbusRequestTemplate* tpl) {
+    tpl->adu[tpl->length - 2] = tpl->crc & 0xFF;
+    tpl->adu[tpl->length - 1] = (tpl->crc >> 8) & 0xFF;
+}
+
+int modbus_template_compile(ModbusRequestTemplate* tpl, ModbusTemplateTransport transport,
+                            const ModbusFrame* frame) {
+    uint16_t length;
+    int status;
+    if (transport == MODBUS_TEMPLATE_RTU) {
+        status = modbus_create_pdu(frame, tpl->adu, &length);
+        tpl->unit_offset = 0;
+    } else if (transport == MODBUS_TEMPLATE_TCP) {
+        status = modbus_tcp_create_request(frame, 0, tpl->adu, &length);
+        tpl->unit_offset = 6;
+    } else {
+        return MODBUS_ERR_VALUE;
+    }
+    if (status != MODBUS_OK) return status;
+
+    tpl->transport = (uint8_t)transport;
+    tpl->frame = *frame;
+    tpl->frame.data = NULL;
+    switch(frame->function_code) {
+    case FC_WRITE_SINGLE_COIL:
+    case FC_WRITE_SINGLE_REG:
+        tpl->payload_length = 2;
+        break;
+    case FC_WRITE_MULT_COILS:
+    case FC_WRITE_MULT_REG:
+    case FC_MASK_WRITE_REG:
+    case FC_READ_WRITE_MULT_REG:
+        tpl->payload_length = frame->data_length;
+        break;
+    default:
+        tpl->payload_length = 0;
+        break;
+    }
+    tpl->payload_offset = length - tpl->payload_length;
+
+    if (transport == MODBUS_TEMPLATE_RTU) {
+        pthread_once(&template_once, template_init_once);
+        tpl->crc = modbus_crc16(tpl->adu, length);
+        for (int bit = 0; bit < 8; bit++) {
+            uint8_t basis = (uint8_t)(1u << bit);
+            tpl->unit_crc[bit] = template_shift_zeros(modbus_crc16_update(0, &basis, 1), length - 1);
+        }
+        length += MODBUS_CRC_SIZE;
+        tpl->length = length;
+        template_store_crc(tpl);
+    } else {
+        tpl->crc = 0;
+        memset(tpl->unit_crc, 0, sizeof(tpl->unit_crc));
+        tpl->length = length;
+    }
+    return MODBUS_OK;
+}
+
+int modbus_template_set_unit(ModbusRequestTemplate* tpl, uint8_t unit) {
+    uint8_t delta = tpl->adu[tpl->unit_offset] ^ unit;
+    if (delta == 0) return MODBUS_OK;
+    tpl->adu[tpl->unit_offset] = unit;
+    tpl->frame.slave_id = unit;
+    if (tpl->transport == MODBUS_TEMPLATE_RTU) {
+        for (int bit = 0; bit < 8; bit++) {
+            if (delta & (1u << bit)) tpl->crc ^= tpl->unit_crc[bit];
+        }
+        template_store_crc(tpl);
+    }
+    return MODBUS_OK;
+}
+
+int modbus_template_set_transaction(ModbusRequestTemplate* tpl, uint16_t transaction_id) {
+    if (tpl->transport != MODBUS_TEMPLATE_TCP) return MODBUS_ERR_VALUE;
+    tpl->adu[0] = (transaction_id >> 8) & 0xFF;
+    tpl->adu[1] = transaction_id & 0xFF;
+    return MODBUS_OK;
+}
+
+int modbus_template_patch_payload(ModbusRequestTemplate* tpl, uint16_t offset, const uint8_t* data,
+                                  uint16_t length) {
+    if ((uint32_t)offset + length > tpl->payload_length) return MODBUS_ERR_VALUE;
+    uint8_t* payload = &tpl->adu[tpl->payload_offset];
+
+    if (tpl->frame.function_code == FC_WRITE_SINGLE_COIL) {
+        // Допустимы только 0xFF00 и 0x0000
+        uint8_t value[2] = { payload[0], payload[1] };
+        memcpy(&value[offset], data, length);
+        if (!((value[0] == 0xFF && value[1] == 0x00) || (value[0] == 0 && value[1] == 0))) {
+            return MODBUS_ERR_VALUE;
+        }
+    }
+
+    if (tpl->transport == MODBUS_TEMPLATE_RTU) {
+        uint8_t delta[MODBUS_TEMPLATE_MAX_ADU];
+        for (uint16_t i = 0; i < length; i++) delta[i] = payload[offset + i] ^ data[i];
+        uint16_t tail = tpl->payload_length - offset - length;
+        tpl->crc ^= template_shift_zeros(template_crc0(delta, length), tail);
+    }
+    memcpy(&payload[offset], data, length);
+    if (tpl->transport == MODBUS_TEMPLATE_RTU) template_store_crc(tpl);
+
+    // Ответ FC05/06 сверяется с запросом по значению
+    uint16_t value = (payload[0] << 8) | payload[1];
+    if (tpl->frame.function_code == FC_WRITE_SINGLE_REG) {
+        tpl->frame.quantity = value;
+    } else if (tpl->frame.function_code == FC_WRITE_SINGLE_COIL) {
+        tpl->frame.quantity = value ? 1 : 0;
+    }
+    return MODBUS_OK;
+}
+
+int modbus_template_set_registers(ModbusRequestTemplate* tpl, uint16_t index, const uint16_t* values,
+                                  uint16_t count) {
+    switch(tpl->frame.function_code) {
+    case FC_WRITE_SINGLE_REG:
+    case FC_WRITE_MULT_REG:
+    case FC_MASK_WRITE_REG:
+    case FC_READ_WRITE_MULT_REG:
+        break;
+    default:
+        return MODBUS_ERR_FUNCTION;
+    }
+    if ((uint32_t)index + count > tpl->payload_length / 2u) return MODBUS_ERR_VALUE;
+    uint8_t bytes[MODBUS_TEMPLATE_MAX_ADU];
+    for (uint16_t i = 0; i < count; i++) {
+        bytes[i * 2] = (values[i] >> 8) & 0xFF;
+        bytes[i * 2 + 1] = values[i] & 0xFF;
+    }
+    return modbus_template_patch_payload(tpl, index * 2, bytes, count * 2);
+}
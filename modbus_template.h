@@ -0,0 +1,53 @@
+#ifndef MODBUS_TEMPLATE_H
+#define MODBUS_TEMPLATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "modbus.h"
+
+#define MODBUS_TEMPLATE_MAX_ADU     260
+
+typedef enum {
+    MODBUS_TEMPLATE_RTU = 0,    // адрес slave + PDU + CRC
+    MODBUS_TEMPLATE_TCP         // MBAP + PDU
+} ModbusTemplateTransport;
+
+// Запрос, закодированный один раз. Меняются только unit id, transaction id (TCP)
+// и данные записи (FC05/06/0F/10/16/17); CRC при этом пересчитывается инкрементально.
+// Поля не изменять напрямую - только через modbus_template_*.
+typedef struct {
+    uint8_t adu[MODBUS_TEMPLATE_MAX_ADU];
+    uint16_t length;
+    uint8_t transport;          // ModbusTemplateTransport
+    uint8_t unit_offset;        // позиция unit id в adu
+    uint16_t payload_offset;    // данные записи в adu, всегда в конце PDU
+    uint16_t payload_length;    // 0 - запрос без данных (чтение)
+    uint16_t crc;               // текущий CRC (RTU)
+    uint16_t unit_crc[8];       // вклад каждого бита unit id в CRC (RTU)
+    ModbusFrame frame;          // запрос для разбора ответа (data = NULL)
+} ModbusRequestTemplate;
+
+int modbus_template_compile(ModbusRequestTemplate* tpl, ModbusTemplateTransport transport,
+                            const ModbusFrame* frame);
+
+static inline const uint8_t* modbus_template_adu(const ModbusRequestTemplate* tpl, uint16_t* length) {
+    *length = tpl->length;
+    return tpl->adu;
+}
+
+static inline const ModbusFrame* modbus_template_frame(const ModbusRequestTemplate* tpl) {
+    return &tpl->frame;
+}
+
+int modbus_template_set_unit(ModbusRequestTemplate* tpl, uint8_t unit);
+// Только для TCP
+int modbus_template_set_transaction(ModbusRequestTemplate* tpl, uint16_t transaction_id);
+
+// Замена байт данных записи [offset, offset + length) в порядке протокола
+int modbus_template_patch_payload(ModbusRequestTemplate* tpl, uint16_t offset, const uint8_t* data,
+                                  uint16_t length);
+// Регистры FC06/10/16/17 с индекса index (для FC22: 0 - AND-маска, 1 - OR-маска)
+int modbus_template_set_registers(ModbusRequestTemplate* tpl, uint16_t index, const uint16_t* values,
+                                  uint16_t count);
+
+#endif // MODBUS_TEMPLATE_H
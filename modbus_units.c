@@ -0,0 +1,114 @@
+#include <string.h>
+#include "modbus_crc.h"
+#include "modbus_stats.h"
+#include "modbus_tcp.h"
+#include "modbus_units.h"
+
+void modbus_registry_init(ModbusUnitRegistry* registry) {
+    memset(registry, 0, sizeof(*registry));
+}
+
+int modbus_registry_add(ModbusUnitRegistry* registry, uint8_t unit_id, ModbusDevice* device) {
+    if (unit_id == MODBUS_BROADCAST_UNIT || unit_id > MODBUS_MAX_UNIT || device == NULL) {
+        return MODBUS_ERR_VALUE;
+    }
+    if (registry->units[unit_id] == NULL) {
+        registry->ids[registry->count++] = unit_id;
+    }
+    registry->units[unit_id] = device;
+    return MODBUS_OK;
+}
+
+ModbusDevice* modbus_registry_remove(ModbusUnitRegistry* registry, uint8_t unit_id) {
+    ModbusDevice* device = registry->units[unit_id];
+    if (device == NULL) return NULL;
+    registry->units[unit_id] = NULL;
+    for (uint16_t i = 0; i < registry->count; i++) {
+        if (registry->ids[i] == unit_id) {
+            registry->ids[i] = registry->ids[--registry->count];
+            break;
+        }
+    }
+    return device;
+}
+
+static bool registry_is_write(uint8_t function) {
+    switch(function) {
+    case FC_WRITE_SINGLE_COIL:
+    case FC_WRITE_SINGLE_REG:
+    case FC_WRITE_MULT_COILS:
+    case FC_WRITE_MULT_REG:
+    case FC_MASK_WRITE_REG:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Широковещательная запись: применяется ко всем устройствам, ответ не отправляется
+static int registry_broadcast(ModbusUnitRegistry* registry, const uint8_t* request, uint16_t length) {
+    if (length < 2 || !registry_is_write(request[1])) return MODBUS_ERR_FUNCTION;
+    uint8_t scratch[MODBUS_MAX_ADU_SIZE];
+    uint16_t scratch_length;
+    int status = MODBUS_OK;
+    for (uint16_t i = 0; i < registry->count; i++) {
+        int unit_status = modbus_process_request(registry->units[registry->ids[i]], request, length,
+                                                 scratch, &scratch_length);
+        if (unit_status != MODBUS_OK) status = unit_status;
+    }
+    return status;
+}
+
+int modbus_registry_process_rtu(ModbusUnitRegistry* registry, const uint8_t* rx_buffer, uint16_t rx_length,
+                                uint8_t* tx_buffer, uint16_t* tx_length) {
+    *tx_length = 0;
+    if (rx_length < MODBUS_MIN_ADU_SIZE) return MODBUS_ERR_VALUE;
+
+    uint16_t received_crc = (rx_buffer[rx_length-1] << 8) | rx_buffer[rx_length-2];
+    if (received_crc != modbus_crc16(rx_buffer, rx_length - MODBUS_CRC_SIZE)) {
+        // Адрес в повреждённом кадре ненадёжен, но если такое устройство есть - учитываем у него
+        ModbusDevice* device = registry->units[rx_buffer[0]];
+        if (device != NULL && device->stats != NULL) {
+            modbus_stats_record_crc_error(device, rx_buffer[1], rx_length);
+        }
+        return MODBUS_ERR_CRC;
+    }
+
+    uint8_t unit_id = rx_buffer[0];
+    if (unit_id == MODBUS_BROADCAST_UNIT) {
+        registry_broadcast(registry, rx_buffer, rx_length - MODBUS_CRC_SIZE);
+        return MODBUS_OK;
+    }
+    ModbusDevice* device = registry->units[unit_id];
+    if (device == NULL) return MODBUS_ERR_UNIT;
+
+    uint16_t pos;
+    int status = modbus_process_request(device, rx_buffer, rx_length - MODBUS_CRC_SIZE, tx_buffer, &pos);
+    if (status != MODBUS_OK) {
+        tx_buffer[0] = unit_id;
+        tx_buffer[1] = rx_buffer[1] | 0x80;
+        tx_buffer[2] = modbus_exception_code(status);
+        pos = 3;
+    }
+
+    uint16_t crc = modbus_crc16(tx_buffer, pos);
+    tx_buffer[pos++] = crc & 0xFF;
+    tx_buffer[pos++] = (crc >> 8) & 0xFF;
+    *tx_length = pos;
+    return status;
+}
+
+int modbus_registry_process_tcp(ModbusUnitRegistry* registry, const uint8_t* rx_adu, uint16_t rx_length,
+                                uint8_t* tx_adu, uint16_t* tx_length) {
+    *tx_length = 0;
+    if (rx_length < MODBUS_TCP_MBAP_SIZE + 1) return MODBUS_ERR_VALUE;
+
+    uint8_t unit_id = rx_adu[6];
+    if (unit_id == MODBUS_BROADCAST_UNIT) {
+        registry_broadcast(registry, rx_adu + 6, rx_length - 6);
+        return MODBUS_OK;
+    }
+    ModbusDevice* device = registry->units[unit_id];
+    if (device == NULL) return MODBUS_ERR_UNIT;
+    return modbus_tcp_process_request(device, rx_adu, rx_length, tx_adu, tx_length);
+}
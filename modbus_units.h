@@ -0,0 +1,35 @@
+#ifndef MODBUS_UNITS_H
+#define MODBUS_UNITS_H
+
+#include <stdint.h>
+#include "modbus.h"
+
+#define MODBUS_BROADCAST_UNIT   0
+#define MODBUS_MAX_UNIT         247
+
+// Таблица устройств по адресу slave: выбор устройства за O(1).
+// Каждое устройство имеет собственную карту регистров.
+typedef struct ModbusUnitRegistry {
+    ModbusDevice* units[256];
+    uint8_t ids[MODBUS_MAX_UNIT];   // зарегистрированные адреса подряд, для широковещательной записи
+    uint16_t count;
+} ModbusUnitRegistry;
+
+void modbus_registry_init(ModbusUnitRegistry* registry);
+int modbus_registry_add(ModbusUnitRegistry* registry, uint8_t unit_id, ModbusDevice* device);
+ModbusDevice* modbus_registry_remove(ModbusUnitRegistry* registry, uint8_t unit_id);
+
+static inline ModbusDevice* modbus_registry_get(const ModbusUnitRegistry* registry, uint8_t unit_id) {
+    return registry->units[unit_id];
+}
+
+// Обработка RTU кадра (с CRC) для адресата из таблицы. Ответ не формируется (*tx_length = 0)
+// для широковещательных запросов (адрес 0 - запись во все устройства) и для неизвестных
+// адресов (MODBUS_ERR_UNIT). Ошибки обработки возвращаются вместе с ответом-исключением.
+int modbus_registry_process_rtu(ModbusUnitRegistry* registry, const uint8_t* rx_buffer, uint16_t rx_length,
+                                uint8_t* tx_buffer, uint16_t* tx_length);
+// То же для кадра Modbus TCP (MBAP + PDU)
+int modbus_registry_process_tcp(ModbusUnitRegistry* registry, const uint8_t* rx_adu, uint16_t rx_length,
+                                uint8_t* tx_adu, uint16_t* tx_length);
+
+#endif // MODBUS_UNITS_H
@@ -0,0 +1,425 @@
+#include <stdlib.h>
+#include <string.h>
+#include "modbus_values.h"
+#include "modbus_sync.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MODBUS_VALUES_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+// Значений в пачке: сырые значения пачки собираются во временный массив на стеке
+#define VALUES_CHUNK    256
+
+static const uint8_t values_widths[MODBUS_VALUE_TYPE_COUNT] = { 1, 1, 2, 2, 2, 4, 4, 4 };
+
+uint16_t modbus_value_width(ModbusValueType type) {
+    return type < MODBUS_VALUE_TYPE_COUNT ? values_widths[type] : 0;
+}
+
+static bool values_word_swap(ModbusWordOrder order) {
+    return order == MODBUS_ORDER_CDAB || order == MODBUS_ORDER_DCBA;
+}
+
+static bool values_byte_swap(ModbusWordOrder order) {
+    return order == MODBUS_ORDER_BADC || order == MODBUS_ORDER_DCBA;
+}
+
+static int values_is_big_endian(void) {
+    const uint16_t probe = 1;
+    return *(const uint8_t*)&probe == 0;
+}
+
+// ----- Перестановка байт -----
+
+// Переносимый вариант через сдвиги: для хвостов пачек и big-endian хостов
+static void values_unpack_scalar(const uint16_t* regs, uint32_t count, unsigned width, ModbusWordOrder order,
+                                 uint8_t* values) {
+    bool word_swap = values_word_swap(order);
+    bool byte_swap = values_byte_swap(order);
+    for (uint32_t i = 0; i < count; i++) {
+        const uint16_t* src = regs + (size_t)i * width;
+        uint64_t value = 0;
+        for (unsigned w = 0; w < width; w++) {
+            uint16_t word = src[word_swap ? width - 1 - w : w];
+            if (byte_swap) word = (uint16_t)((word << 8) | (word >> 8));
+            value = (value << 16) | word;
+        }
+        if (width == 1) {
+            uint16_t v = (uint16_t)value;
+            memcpy(values + (size_t)i * 2, &v, 2);
+        } else if (width == 2) {
+            uint32_t v = (uint32_t)value;
+            memcpy(values + (size_t)i * 4, &v, 4);
+        } else {
+            memcpy(values + (size_t)i * 8, &value, 8);
+        }
+    }
+}
+
+static void values_pack_scalar(const uint8_t* values, uint32_t count, unsigned width, ModbusWordOrder order,
+                               uint16_t* regs) {
+    bool word_swap = values_word_swap(order);
+    bool byte_swap = values_byte_swap(order);
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t value;
+        if (width == 1) {
+            uint16_t v;
+            memcpy(&v, values + (size_t)i * 2, 2);
+            value = v;
+        } else if (width == 2) {
+            uint32_t v;
+            memcpy(&v, values + (size_t)i * 4, 4);
+            value = v;
+        } else {
+            memcpy(&value, values + (size_t)i * 8, 8);
+        }
+        uint16_t* dst = regs + (size_t)i * width;
+        for (unsigned w = width; w-- > 0;) {
+            uint16_t word = (uint16_t)value;
+            value >>= 16;
+            if (byte_swap) word = (uint16_t)((word << 8) | (word >> 8));
+            dst[word_swap ? width - 1 - w : w] = word;
+        }
+    }
+}
+
+#ifdef MODBUS_VALUES_HAVE_X86
+// На little-endian хосте значение и его регистры занимают одинаковое число байт, и
+// сборка - перестановка байт внутри каждых 2*width байт. Маска pshufb на 16 байт
+// (несколько значений); inverse - обратная перестановка для упаковки.
+static void values_shuffle_mask(unsigned width, ModbusWordOrder order, bool inverse, uint8_t mask[16]) {
+    unsigned bytes = width * 2;
+    bool word_swap = values_word_swap(order);
+    bool byte_swap = values_byte_swap(order);
+    for (unsigned k = 0; k < bytes; k++) {
+        // Байт k значения (от младшего) - байт j от старшего, в слове j/2 значения
+        unsigned j = bytes - 1 - k;
+        unsigned word = j / 2;
+        unsigned reg = word_swap ? width - 1 - word : word;
+        bool high = (j % 2 == 0) != byte_swap;     // старший байт регистра лежит вторым
+        unsigned src = reg * 2 + (high ? 1 : 0);
+        for (unsigned base = 0; base < 16; base += bytes) {
+            if (inverse) mask[base + src] = (uint8_t)(base + k);
+            else mask[base + k] = (uint8_t)(base + src);
+        }
+    }
+}
+
+__attribute__((target("ssse3")))
+static uint32_t values_shuffle_ssse3(const uint8_t* src, uint8_t* dst, uint32_t bytes, const uint8_t mask[16]) {
+    const __m128i shuffle = _mm_loadu_si128((const __m128i*)mask);
+    uint32_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(v, shuffle));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static uint32_t values_shuffle_avx2(const uint8_t* src, uint8_t* dst, uint32_t bytes, const uint8_t mask[16]) {
+    const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)mask));
+    uint32_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(v, shuffle));
+    }
+    if (i + 16 <= bytes) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(v, _mm256_castsi256_si128(shuffle)));
+        i += 16;
+    }
+    return i;
+}
+
+// Сколько байт переставлено векторно; остаток - скалярно
+static uint32_t values_shuffle(const uint8_t* src, uint8_t* dst, uint32_t bytes, unsigned width,
+                               ModbusWordOrder order, bool inverse) {
+    if (values_is_big_endian()) return 0;
+    ModbusRegsImpl impl = modbus_regs_active_impl();
+    if (impl != MODBUS_REGS_IMPL_SSSE3 && impl != MODBUS_REGS_IMPL_AVX2) return 0;
+    uint8_t mask[16];
+    values_shuffle_mask(width, order, inverse, mask);
+    if (impl == MODBUS_REGS_IMPL_AVX2) return values_shuffle_avx2(src, dst, bytes, mask);
+    return values_shuffle_ssse3(src, dst, bytes, mask);
+}
+#else
+static uint32_t values_shuffle(const uint8_t* src, uint8_t* dst, uint32_t bytes, unsigned width,
+                               ModbusWordOrder order, bool inverse) {
+    (void)src; (void)dst; (void)bytes; (void)width; (void)order; (void)inverse;
+    return 0;
+}
+#endif
+
+int modbus_values_unpack(const uint16_t* regs, uint32_t count, ModbusValueType type, ModbusWordOrder order,
+                         void* values) {
+    if (type >= MODBUS_VALUE_TYPE_COUNT || order > MODBUS_ORDER_DCBA) return MODBUS_ERR_VALUE;
+    unsigned width = values_widths[type];
+    uint32_t bytes = count * width * 2;
+    uint32_t done = values_shuffle((const uint8_t*)regs, (uint8_t*)values, bytes, width, order, false);
+    uint32_t first = done / (width * 2);
+    values_unpack_scalar(regs + (size_t)first * width, count - first, width, order, (uint8_t*)values + done);
+    return MODBUS_OK;
+}
+
+int modbus_values_pack(const void* values, uint32_t count, ModbusValueType type, ModbusWordOrder order,
+                       uint16_t* regs) {
+    if (type >= MODBUS_VALUE_TYPE_COUNT || order > MODBUS_ORDER_DCBA) return MODBUS_ERR_VALUE;
+    unsigned width = values_widths[type];
+    uint32_t bytes = count * width * 2;
+    uint32_t done = values_shuffle((const uint8_t*)values, (uint8_t*)regs, bytes, width, order, true);
+    uint32_t first = done / (width * 2);
+    values_pack_scalar((const uint8_t*)values + done, count - first, width, order, regs + (size_t)first * width);
+    return MODBUS_OK;
+}
+
+// ----- Набор тегов -----
+
+// Теги first..first+count подряд в регистрах с position, одного типа и порядка
+typedef struct {
+    uint8_t type;
+    uint8_t order;
+    uint32_t position;
+    uint32_t first;
+    uint32_t count;
+} ValueRun;
+
+struct ModbusValueMap {
+    uint32_t count;
+    uint32_t span;
+    uint32_t run_count;
+    ValueRun* runs;
+    double* scale;
+    double* offset;
+    double* inverse;        // 1 / scale: целые всё равно округляются, умножение дешевле деления
+};
+
+ModbusValueMap* modbus_value_map_create(const ModbusValueLayout* layouts, uint32_t count) {
+    ModbusValueMap* map = (ModbusValueMap*)calloc(1, sizeof(ModbusValueMap));
+    if (map == NULL) return NULL;
+    map->count = count;
+    map->runs = (ValueRun*)malloc((count ? count : 1) * sizeof(ValueRun));
+    map->scale = (double*)malloc((count ? count : 1) * sizeof(double));
+    map->offset = (double*)malloc((count ? count : 1) * sizeof(double));
+    map->inverse = (double*)malloc((count ? count : 1) * sizeof(double));
+    if (map->runs == NULL || map->scale == NULL || map->offset == NULL || map->inverse == NULL) goto fail;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const ModbusValueLayout* layout = &layouts[i];
+        if (layout->type >= MODBUS_VALUE_TYPE_COUNT || layout->order > MODBUS_ORDER_DCBA) goto fail;
+        unsigned width = values_widths[layout->type];
+        uint32_t end = (uint32_t)layout->position + width;
+        if (end > map->span) map->span = end;
+        map->scale[i] = layout->scale != 0.0 ? layout->scale : 1.0;
+        map->offset[i] = layout->offset;
+        map->inverse[i] = 1.0 / map->scale[i];
+
+        ValueRun* run = map->run_count ? &map->runs[map->run_count - 1] : NULL;
+        // 16-битным значениям порядок слов безразличен
+        bool same_order = run != NULL && (run->order == layout->order ||
+                          (width == 1 && values_byte_swap(run->order) == values_byte_swap(layout->order)));
+        if (run != NULL && run->type == layout->type && same_order &&
+            layout->position == run->position + run->count * width) {
+            run->count++;
+            continue;
+        }
+        run = &map->runs[map->run_count++];
+        run->type = layout->type;
+        run->order = layout->order;
+        run->position = layout->position;
+        run->first = i;
+        run->count = 1;
+    }
+    return map;
+
+fail:
+    modbus_value_map_free(map);
+    return NULL;
+}
+
+void modbus_value_map_free(ModbusValueMap* map) {
+    if (map == NULL) return;
+    free(map->runs);
+    free(map->scale);
+    free(map->offset);
+    free(map->inverse);
+    free(map);
+}
+
+uint32_t modbus_value_map_count(const ModbusValueMap* map) {
+    return map->count;
+}
+
+uint32_t modbus_value_map_span(const ModbusValueMap* map) {
+    return map->span;
+}
+
+// Сырые значения пачки -> инженерные; простые циклы векторизуются компилятором
+static void values_to_double(ModbusValueType type, const void* raw, uint32_t n, const double* scale,
+                             const double* offset, double* out) {
+#define VALUES_SCALE(T) do { \
+        const T* v = (const T*)raw; \
+        for (uint32_t i = 0; i < n; i++) out[i] = (double)v[i] * scale[i] + offset[i]; \
+    } while (0)
+    switch (type) {
+    case MODBUS_VALUE_UINT16:  VALUES_SCALE(uint16_t); break;
+    case MODBUS_VALUE_INT16:   VALUES_SCALE(int16_t);  break;
+    case MODBUS_VALUE_UINT32:  VALUES_SCALE(uint32_t); break;
+    case MODBUS_VALUE_INT32:   VALUES_SCALE(int32_t);  break;
+    case MODBUS_VALUE_FLOAT32: VALUES_SCALE(float);    break;
+    case MODBUS_VALUE_UINT64:  VALUES_SCALE(uint64_t); break;
+    case MODBUS_VALUE_INT64:   VALUES_SCALE(int64_t);  break;
+    default:                   VALUES_SCALE(double);   break;
+    }
+#undef VALUES_SCALE
+}
+
+// Округление от нуля с ограничением диапазоном [lo, hi]; NaN -> lo
+static inline double values_round_clamp(double x, double lo, double hi) {
+    x = x > lo ? x : lo;
+    x = x < hi ? x : hi;
+    return x + __builtin_copysign(0.5, x);
+}
+
+// Плавающие типы делятся на scale точно; целые умножаются на inverse
+static void values_from_double(ModbusValueType type, const double* in, uint32_t n, const double* scale,
+                               const double* inverse, const double* offset, void* raw) {
+    switch (type) {
+    case MODBUS_VALUE_UINT16: {
+        uint16_t* v = (uint16_t*)raw;
+        for (uint32_t i = 0; i < n; i++) {
+            v[i] = (uint16_t)values_round_clamp((in[i] - offset[i]) * inverse[i], 0.0, 65535.0);
+        }
+        break;
+    }
+    case MODBUS_VALUE_INT16: {
+        int16_t* v = (int16_t*)raw;
+        for (uint32_t i = 0; i < n; i++) {
+            v[i] = (int16_t)values_round_clamp((in[i] - offset[i]) * inverse[i], -32768.0, 32767.0);
+        }
+        break;
+    }
+    case MODBUS_VALUE_UINT32: {
+        uint32_t* v = (uint32_t*)raw;
+        for (uint32_t i = 0; i < n; i++) {
+            v[i] = (uint32_t)values_round_clamp((in[i] - offset[i]) * inverse[i], 0.0, 4294967295.0);
+        }
+        break;
+    }
+    case MODBUS_VALUE_INT32: {
+        int32_t* v = (int32_t*)raw;
+        for (uint32_t i = 0; i < n; i++) {
+            v[i] = (int32_t)values_round_clamp((in[i] - offset[i]) * inverse[i], -2147483648.0, 2147483647.0);
+        }
+        break;
+    }
+    case MODBUS_VALUE_FLOAT32: {
+        float* v = (float*)raw;
+        for (uint32_t i = 0; i < n; i++) v[i] = (float)((in[i] - offset[i]) / scale[i]);
+        break;
+    }
+    case MODBUS_VALUE_UINT64: {
+        // 2^64 в double не представимо без округления вверх: граница проверяется отдельно
+        uint64_t* v = (uint64_t*)raw;
+        for (uint32_t i = 0; i < n; i++) {
+            double x = values_round_clamp((in[i] - offset[i]) * inverse[i], 0.0, 18446744073709551616.0);
+            v[i] = x >= 18446744073709551616.0 ? UINT64_MAX : (uint64_t)x;
+        }
+        break;
+    }
+    case MODBUS_VALUE_INT64: {
+        int64_t* v = (int64_t*)raw;
+        for (uint32_t i = 0; i < n; i++) {
+            double x = values_round_clamp((in[i] - offset[i]) * inverse[i], -9223372036854775808.0,
+                                          9223372036854775808.0);
+            v[i] = x >= 9223372036854775808.0 ? INT64_MAX : (int64_t)x;
+        }
+        break;
+    }
+    default: {
+        double* v = (double*)raw;
+        for (uint32_t i = 0; i < n; i++) v[i] = (in[i] - offset[i]) / scale[i];
+        break;
+    }
+    }
+}
+
+int modbus_value_map_decode(const ModbusValueMap* map, const uint16_t* regs, uint32_t reg_count, double* values) {
+    if (reg_count < map->span) return MODBUS_ERR_ADDRESS;
+    uint64_t raw[VALUES_CHUNK];
+    for (uint32_t r = 0; r < map->run_count; r++) {
+        const ValueRun* run = &map->runs[r];
+        unsigned width = values_widths[run->type];
+        for (uint32_t done = 0; done < run->count; done += VALUES_CHUNK) {
+            uint32_t n = run->count - done < VALUES_CHUNK ? run->count - done : VALUES_CHUNK;
+            uint32_t tag = run->first + done;
+            modbus_values_unpack(regs + run->position + (size_t)done * width, n, (ModbusValueType)run->type,
+                                 (ModbusWordOrder)run->order, raw);
+            values_to_double((ModbusValueType)run->type, raw, n, &map->scale[tag], &map->offset[tag],
+                             &values[tag]);
+        }
+    }
+    return MODBUS_OK;
+}
+
+int modbus_value_map_encode(const ModbusValueMap* map, const double* values, uint16_t* regs, uint32_t reg_count) {
+    if (reg_count < map->span) return MODBUS_ERR_ADDRESS;
+    uint64_t raw[VALUES_CHUNK];
+    for (uint32_t r = 0; r < map->run_count; r++) {
+        const ValueRun* run = &map->runs[r];
+        unsigned width = values_widths[run->type];
+        for (uint32_t done = 0; done < run->count; done += VALUES_CHUNK) {
+            uint32_t n = run->count - done < VALUES_CHUNK ? run->count - done : VALUES_CHUNK;
+            uint32_t tag = run->first + done;
+            values_from_double((ModbusValueType)run->type, &values[tag], n, &map->scale[tag], &map->inverse[tag],
+                               &map->offset[tag], raw);
+            modbus_values_pack(raw, n, (ModbusValueType)run->type, (ModbusWordOrder)run->order,
+                               regs + run->position + (size_t)done * width);
+        }
+    }
+    return MODBUS_OK;
+}
+
+static uint16_t* values_device_table(const ModbusDevice* device, ModbusTable table, uint32_t* size) {
+    if (table == MODBUS_TABLE_HOLDING_REGS) {
+        *size = device->num_holding_regs;
+        return device->holding_registers;
+    }
+    if (table == MODBUS_TABLE_INPUT_REGS) {
+        *size = device->num_input_regs;
+        return device->input_registers;
+    }
+    return NULL;
+}
+
+int modbus_value_map_read_device(const ModbusValueMap* map, const ModbusDevice* device, ModbusTable table,
+                                 uint16_t address, double* values) {
+    uint32_t size;
+    const uint16_t* regs = values_device_table(device, table, &size);
+    if (regs == NULL) return MODBUS_ERR_VALUE;
+    if (map->span == 0) return MODBUS_OK;
+    if ((uint32_t)address + map->span > size) return MODBUS_ERR_ADDRESS;
+
+    // Разбор прямо из таблицы под seqlock: при конкурентной записи - повтор
+    uint32_t start;
+    do {
+        start = modbus_sync_read_begin(device, table, address, (uint16_t)map->span);
+        modbus_value_map_decode(map, regs + address, map->span, values);
+    } while (modbus_sync_read_retry(device, table, address, (uint16_t)map->span, start));
+    return MODBUS_OK;
+}
+
+int modbus_value_map_write_device(const ModbusValueMap* map, ModbusDevice* device, ModbusTable table,
+                                  uint16_t address, const double* values) {
+    uint32_t size;
+    uint16_t* regs = values_device_table(device, table, &size);
+    if (regs == NULL) return MODBUS_ERR_VALUE;
+    if (map->span == 0) return MODBUS_OK;
+    if ((uint32_t)address + map->span > size) return MODBUS_ERR_ADDRESS;
+
+    modbus_device_write_begin(device, table, address, (uint16_t)map->span);
+    modbus_value_map_encode(map, values, regs + address, map->span);
+    modbus_device_write_end(device, table, address, (uint16_t)map->span);
+    return MODBUS_OK;
+}
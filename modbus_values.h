@@ -0,0 +1,76 @@
+#ifndef MODBUS_VALUES_H
+#define MODBUS_VALUES_H
+
+#include <stdint.h>
+#include "modbus.h"
+
+// Значения, занимающие несколько регистров: сборка из блока регистров (uint16_t в порядке
+// хоста, как в ModbusResponse.values и таблицах ModbusDevice) и разборка обратно.
+// Перестановка байт выполняется пачками той же реализацией, что выбрана для пересылки
+// блоков регистров (modbus_regs_select).
+
+typedef enum {
+    MODBUS_VALUE_UINT16 = 0,
+    MODBUS_VALUE_INT16,
+    MODBUS_VALUE_UINT32,
+    MODBUS_VALUE_INT32,
+    MODBUS_VALUE_FLOAT32,
+    MODBUS_VALUE_UINT64,
+    MODBUS_VALUE_INT64,
+    MODBUS_VALUE_FLOAT64,
+    MODBUS_VALUE_TYPE_COUNT
+} ModbusValueType;
+
+// Порядок байт значения A B C D (A - старший) в регистрах; для 64-битных значений
+// так же по словам: CDAB - младшее слово в первом регистре, BADC - байты в словах
+// переставлены, DCBA - и то, и другое
+typedef enum {
+    MODBUS_ORDER_ABCD = 0,      // big-endian, как в спецификации Modbus
+    MODBUS_ORDER_CDAB,
+    MODBUS_ORDER_BADC,
+    MODBUS_ORDER_DCBA
+} ModbusWordOrder;
+
+// Число регистров значения типа type
+uint16_t modbus_value_width(ModbusValueType type);
+
+// Однотипный массив: count значений подряд с regs. values - массив типа type
+// (uint16_t, int16_t, uint32_t, int32_t, float, uint64_t, int64_t, double)
+int modbus_values_unpack(const uint16_t* regs, uint32_t count, ModbusValueType type, ModbusWordOrder order,
+                         void* values);
+int modbus_values_pack(const void* values, uint32_t count, ModbusValueType type, ModbusWordOrder order,
+                       uint16_t* regs);
+
+// Описание тега в блоке регистров: инженерное значение = сырое * scale + offset
+typedef struct {
+    uint8_t type;               // ModbusValueType
+    uint8_t order;              // ModbusWordOrder
+    uint16_t position;          // первый регистр значения от начала блока
+    double scale;               // 0 - без масштаба (1.0)
+    double offset;
+} ModbusValueLayout;
+
+// Скомпилированный набор тегов: соседние теги одного типа и порядка, идущие подряд,
+// преобразуются одной пачкой. Неизменяем после создания, можно использовать из
+// нескольких потоков.
+typedef struct ModbusValueMap ModbusValueMap;
+
+ModbusValueMap* modbus_value_map_create(const ModbusValueLayout* layouts, uint32_t count);
+void modbus_value_map_free(ModbusValueMap* map);
+uint32_t modbus_value_map_count(const ModbusValueMap* map);
+// Сколько регистров от начала блока занимают теги
+uint32_t modbus_value_map_span(const ModbusValueMap* map);
+
+// values[i] - инженерное значение тега layouts[i]. MODBUS_ERR_ADDRESS, если блок короче span
+int modbus_value_map_decode(const ModbusValueMap* map, const uint16_t* regs, uint32_t reg_count, double* values);
+// Обратно: в regs меняются только регистры тегов. Целые округляются и ограничиваются диапазоном типа
+int modbus_value_map_encode(const ModbusValueMap* map, const double* values, uint16_t* regs, uint32_t reg_count);
+
+// Теги в регистрах устройства с address (MODBUS_TABLE_HOLDING_REGS или MODBUS_TABLE_INPUT_REGS):
+// согласованная копия через modbus_device_read, запись - между write_begin и write_end
+int modbus_value_map_read_device(const ModbusValueMap* map, const ModbusDevice* device, ModbusTable table,
+                                 uint16_t address, double* values);
+int modbus_value_map_write_device(const ModbusValueMap* map, ModbusDevice* device, ModbusTable table,
+                                  uint16_t address, const double* values);
+
+#endif // MODBUS_VALUES_H
@@ -0,0 +1,251 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modbus_watch.h"
+
+// Таблицы, которые может менять master
+#define WATCH_TABLES    2
+// Подписок, совпавших с одной записью, без выделения памяти
+#define WATCH_LOCAL_CALLS   16
+
+typedef struct {
+    uint32_t id;
+    uint16_t address;
+    uint32_t end;
+    ModbusWriteCallback callback;
+    void* user;
+} WatchSubscription;
+
+// Вызов подписчика, собранный под блокировкой
+typedef struct {
+    ModbusWriteCallback callback;
+    void* user;
+    uint16_t address;
+    uint16_t count;
+} WatchCall;
+
+// Бит на адрес и бит сводки на каждое 64-битное слово: сбор обходит только изменённые слова
+typedef struct {
+    atomic_uint_fast64_t* bits;
+    atomic_uint_fast64_t* summary;
+    uint32_t words;
+    uint32_t summary_words;
+    WatchSubscription* subscriptions;
+    uint32_t subscription_count;
+    uint32_t subscription_capacity;
+} WatchTable;
+
+struct ModbusDeviceWatch {
+    WatchTable tables[WATCH_TABLES];
+    pthread_rwlock_t subscriptions_lock;
+    atomic_uint subscription_total;
+    uint32_t next_id;
+};
+
+static int watch_index(ModbusTable table) {
+    switch(table) {
+    case MODBUS_TABLE_COILS:        return 0;
+    case MODBUS_TABLE_HOLDING_REGS: return 1;
+    default:                        return -1;
+    }
+}
+
+int modbus_device_enable_watch(ModbusDevice* device) {
+    if (device->watch != NULL) return MODBUS_OK;
+    ModbusDeviceWatch* watch = (ModbusDeviceWatch*)calloc(1, sizeof(ModbusDeviceWatch));
+    if (watch == NULL) return MODBUS_ERR_VALUE;
+
+    const uint16_t sizes[WATCH_TABLES] = { device->num_coils, device->num_holding_regs };
+    for (int t = 0; t < WATCH_TABLES; t++) {
+        WatchTable* table = &watch->tables[t];
+        table->words = ((uint32_t)sizes[t] + 63) / 64;
+        table->summary_words = (table->words + 63) / 64;
+        table->bits = (atomic_uint_fast64_t*)calloc(table->words + 1, sizeof(atomic_uint_fast64_t));
+        table->summary = (atomic_uint_fast64_t*)calloc(table->summary_words + 1, sizeof(atomic_uint_fast64_t));
+        if (table->bits == NULL || table->summary == NULL) {
+            // Блокировка ещё не создана и watch не опубликован: освобождаем напрямую
+            for (int i = 0; i <= t; i++) {
+                free(watch->tables[i].bits);
+                free(watch->tables[i].summary);
+            }
+            free(watch);
+            return MODBUS_ERR_VALUE;
+        }
+    }
+    pthread_rwlock_init(&watch->subscriptions_lock, NULL);
+    atomic_init(&watch->subscription_total, 0);
+    watch->next_id = 1;
+    device->watch = watch;
+    return MODBUS_OK;
+}
+
+void modbus_device_disable_watch(ModbusDevice* device) {
+    ModbusDeviceWatch* watch = device->watch;
+    if (watch == NULL) return;
+    for (int t = 0; t < WATCH_TABLES; t++) {
+        free(watch->tables[t].bits);
+        free(watch->tables[t].summary);
+        free(watch->tables[t].subscriptions);
+    }
+    pthread_rwlock_destroy(&watch->subscriptions_lock);
+    free(watch);
+    device->watch = NULL;
+}
+
+static void watch_mark(WatchTable* table, uint16_t address, uint16_t count) {
+    uint32_t bit = address;
+    uint32_t end = (uint32_t)address + count;
+    while (bit < end) {
+        uint32_t word = bit / 64;
+        unsigned shift = bit % 64;
+        unsigned n = end - bit < 64 - shift ? end - bit : 64 - shift;
+        uint64_t mask = (n == 64) ? ~UINT64_C(0) : (((UINT64_C(1) << n) - 1) << shift);
+        atomic_fetch_or_explicit(&table->bits[word], mask, memory_order_relaxed);
+        atomic_fetch_or_explicit(&table->summary[word / 64], UINT64_C(1) << (word % 64), memory_order_release);
+        bit += n;
+    }
+}
+
+void modbus_watch_notify(ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count) {
+    ModbusDeviceWatch* watch = device->watch;
+    int index = watch_index(table);
+    if (watch == NULL || index < 0 || count == 0) return;
+    watch_mark(&watch->tables[index], address, count);
+
+    if (atomic_load_explicit(&watch->subscription_total, memory_order_relaxed) == 0) return;
+    // Совпавшие подписки копируются, обработчики вызываются без блокировки:
+    // из них можно подписываться и отписываться
+    WatchCall local[WATCH_LOCAL_CALLS];
+    WatchCall* calls = local;
+    uint32_t call_count = 0;
+    uint32_t end = (uint32_t)address + count;
+    pthread_rwlock_rdlock(&watch->subscriptions_lock);
+    const WatchTable* t = &watch->tables[index];
+    if (t->subscription_count > WATCH_LOCAL_CALLS) {
+        calls = (WatchCall*)malloc(t->subscription_count * sizeof(WatchCall));
+        if (calls == NULL) {
+            pthread_rwlock_unlock(&watch->subscriptions_lock);
+            return;
+        }
+    }
+    for (uint32_t i = 0; i < t->subscription_count; i++) {
+        const WatchSubscription* s = &t->subscriptions[i];
+        uint32_t first = address > s->address ? address : s->address;
+        uint32_t last = end < s->end ? end : s->end;
+        if (first < last) {
+            calls[call_count++] = (WatchCall){ s->callback, s->user, (uint16_t)first, (uint16_t)(last - first) };
+        }
+    }
+    pthread_rwlock_unlock(&watch->subscriptions_lock);
+    for (uint32_t i = 0; i < call_count; i++) {
+        calls[i].callback(calls[i].user, device, table, calls[i].address, calls[i].count);
+    }
+    if (calls != local) free(calls);
+}
+
+bool modbus_dirty_any(const ModbusDevice* device, ModbusTable table) {
+    const ModbusDeviceWatch* watch = device->watch;
+    int index = watch_index(table);
+    if (watch == NULL || index < 0) return false;
+    const WatchTable* t = &watch->tables[index];
+    for (uint32_t i = 0; i < t->summary_words; i++) {
+        if (atomic_load_explicit(&t->summary[i], memory_order_relaxed) != 0) return true;
+    }
+    return false;
+}
+
+int modbus_dirty_collect(ModbusDevice* device, ModbusTable table, ModbusRange* ranges,
+                         uint32_t capacity, uint32_t* count) {
+    *count = 0;
+    ModbusDeviceWatch* watch = device->watch;
+    int index = watch_index(table);
+    if (watch == NULL || index < 0) return MODBUS_ERR_VALUE;
+    WatchTable* t = &watch->tables[index];
+
+    // Слова идут по возрастанию, поэтому соседние участки сливаются с последним диапазоном
+    uint32_t n = 0;
+    for (uint32_t s = 0; s < t->summary_words; s++) {
+        uint64_t summary = atomic_exchange_explicit(&t->summary[s], 0, memory_order_acquire);
+        while (summary != 0) {
+            uint32_t word = s * 64 + (uint32_t)__builtin_ctzll(summary);
+            uint64_t bits = atomic_exchange_explicit(&t->bits[word], 0, memory_order_relaxed);
+            while (bits != 0) {
+                unsigned start = (unsigned)__builtin_ctzll(bits);
+                uint64_t run = ~(bits >> start);
+                unsigned length = run == 0 ? 64 - start : (unsigned)__builtin_ctzll(run);
+                uint32_t address = word * 64 + start;
+                if (n > 0 && (uint32_t)ranges[n - 1].address + ranges[n - 1].count == address) {
+                    ranges[n - 1].count += length;
+                } else if (n < capacity) {
+                    ranges[n].address = (uint16_t)address;
+                    ranges[n].count = (uint16_t)length;
+                    n++;
+                } else {
+                    // Не поместилось: остаток слова и сводки возвращается для следующего вызова
+                    atomic_fetch_or_explicit(&t->bits[word], bits, memory_order_relaxed);
+                    atomic_fetch_or_explicit(&t->summary[s], summary, memory_order_release);
+                    *count = n;
+                    return MODBUS_OK;
+                }
+                bits = length + start == 64 ? 0 : bits & ~(((UINT64_C(1) << length) - 1) << start);
+            }
+            summary &= summary - 1;
+        }
+    }
+    *count = n;
+    return MODBUS_OK;
+}
+
+int modbus_watch_subscribe(ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count,
+                           ModbusWriteCallback callback, void* user, uint32_t* subscription_id) {
+    ModbusDeviceWatch* watch = device->watch;
+    int index = watch_index(table);
+    if (watch == NULL || index < 0 || callback == NULL || count == 0) return MODBUS_ERR_VALUE;
+
+    pthread_rwlock_wrlock(&watch->subscriptions_lock);
+    WatchTable* t = &watch->tables[index];
+    if (t->subscription_count == t->subscription_capacity) {
+        uint32_t capacity = t->subscription_capacity ? t->subscription_capacity * 2 : 8;
+        WatchSubscription* subscriptions = (WatchSubscription*)realloc(t->subscriptions,
+                                                                       capacity * sizeof(WatchSubscription));
+        if (subscriptions == NULL) {
+            pthread_rwlock_unlock(&watch->subscriptions_lock);
+            return MODBUS_ERR_VALUE;
+        }
+        t->subscriptions = subscriptions;
+        t->subscription_capacity = capacity;
+    }
+    WatchSubscription* s = &t->subscriptions[t->subscription_count++];
+    s->id = watch->next_id++;
+    s->address = address;
+    s->end = (uint32_t)address + count;
+    s->callback = callback;
+    s->user = user;
+    *subscription_id = s->id;
+    atomic_fetch_add_explicit(&watch->subscription_total, 1, memory_order_relaxed);
+    pthread_rwlock_unlock(&watch->subscriptions_lock);
+    return MODBUS_OK;
+}
+
+int modbus_watch_unsubscribe(ModbusDevice* device, uint32_t subscription_id) {
+    ModbusDeviceWatch* watch = device->watch;
+    if (watch == NULL) return MODBUS_ERR_VALUE;
+    int status = MODBUS_ERR_VALUE;
+    pthread_rwlock_wrlock(&watch->subscriptions_lock);
+    for (int index = 0; index < WATCH_TABLES && status != MODBUS_OK; index++) {
+        WatchTable* t = &watch->tables[index];
+        for (uint32_t i = 0; i < t->subscription_count; i++) {
+            if (t->subscriptions[i].id == subscription_id) {
+                memmove(&t->subscriptions[i], &t->subscriptions[i + 1],
+                        (t->subscription_count - i - 1) * sizeof(WatchSubscription));
+                t->subscription_count--;
+                atomic_fetch_sub_explicit(&watch->subscription_total, 1, memory_order_relaxed);
+                status = MODBUS_OK;
+                break;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&watch->subscriptions_lock);
+    return status;
+}
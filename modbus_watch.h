@@ -0,0 +1,38 @@
+#ifndef MODBUS_WATCH_H
+#define MODBUS_WATCH_H
+
+#include <stdint.h>
+#include "modbus.h"
+
+// Учёт записей master (FC05/06/0F/10/16/17) в coils и holding-регистры:
+// битовые карты изменённых адресов и подписки на диапазоны
+
+typedef struct {
+    uint16_t address;
+    uint16_t count;
+} ModbusRange;
+
+// Вызывается после применения записи, вне блокировок устройства и списка подписок: из обработчика
+// можно подписываться и отписываться. Отписка не ждёт уже начатых уведомлений - обработчик
+// может быть вызван ещё раз из записи, идущей в другом потоке.
+// address/count - пересечение записанного диапазона с диапазоном подписки
+typedef void (*ModbusWriteCallback)(void* user, ModbusDevice* device, ModbusTable table,
+                                    uint16_t address, uint16_t count);
+
+int modbus_device_enable_watch(ModbusDevice* device);
+void modbus_device_disable_watch(ModbusDevice* device);
+
+// Изменённые с прошлого вызова диапазоны (слитые, по возрастанию адреса); возвращённые
+// диапазоны сбрасываются. Если не хватило capacity, остаток вернёт следующий вызов.
+int modbus_dirty_collect(ModbusDevice* device, ModbusTable table, ModbusRange* ranges,
+                         uint32_t capacity, uint32_t* count);
+bool modbus_dirty_any(const ModbusDevice* device, ModbusTable table);
+
+int modbus_watch_subscribe(ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count,
+                           ModbusWriteCallback callback, void* user, uint32_t* subscription_id);
+int modbus_watch_unsubscribe(ModbusDevice* device, uint32_t subscription_id);
+
+// Для кода библиотеки: отметка записи и вызов подписчиков
+void modbus_watch_notify(ModbusDevice* device, ModbusTable table, uint16_t address, uint16_t count);
+
+#endif // MODBUS_WATCH_H